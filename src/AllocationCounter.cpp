@@ -0,0 +1,55 @@
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef GL2_COUNT_ALLOCATIONS
+
+namespace
+{
+	std::atomic<uint64_t> s_AllocationCount{ 0 };
+
+	void* CountedAllocate(size_t size)
+	{
+		s_AllocationCount.fetch_add(1, std::memory_order_relaxed);
+
+		void* pointer = std::malloc(size ? size : 1);
+		if (!pointer)
+		{
+			throw std::bad_alloc();
+		}
+		return pointer;
+	}
+}
+
+void* operator new(size_t size) { return CountedAllocate(size); }
+void* operator new[](size_t size) { return CountedAllocate(size); }
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { std::free(pointer); }
+
+bool AllocationCounter::IsEnabled()
+{
+	return true;
+}
+
+uint64_t AllocationCounter::GetCount()
+{
+	return s_AllocationCount.load(std::memory_order_relaxed);
+}
+
+#else
+
+bool AllocationCounter::IsEnabled()
+{
+	return false;
+}
+
+uint64_t AllocationCounter::GetCount()
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,387 @@
+#include "AssetLoader.h"
+
+namespace
+{
+	const char MESH_FILE_MAGIC[4] = { 'G', 'L', '2', 'M' };
+	const uint32_t MESH_FILE_VERSION = 1;
+
+	double SecondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+AssetLoader::AssetLoader(GeometryManager& geometryManager, const AssetLoaderSettings& settings)
+	: m_GeometryManager(geometryManager)
+	, m_Settings(settings)
+{
+	// AssetID 0 means no asset, keep its slot so IDs index the vector directly
+	m_Assets.emplace_back();
+
+	const uint32_t threadCount = std::max(m_Settings.threadCount, 1u);
+	for (uint32_t i = 0; i < threadCount; i++)
+	{
+		m_Threads.emplace_back(&AssetLoader::LoaderLoop, this);
+	}
+}
+
+AssetLoader::~AssetLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stop = true;
+	}
+	m_RequestCondition.notify_all();
+
+	for (std::thread& thread : m_Threads)
+	{
+		thread.join();
+	}
+}
+
+AssetID AssetLoader::LoadMeshFile(const std::string& name, const std::string& path)
+{
+	Request request;
+	request.name = name;
+	request.path = path;
+	return Queue(std::move(request));
+}
+
+AssetID AssetLoader::LoadGenerated(const MeshDesc& desc)
+{
+	Request request;
+	request.name = desc.GetName();
+	request.desc = desc;
+	return Queue(std::move(request));
+}
+
+AssetID AssetLoader::Queue(Request&& request)
+{
+	const StringID nameID(request.name);
+	auto it = m_NameToAsset.find(nameID);
+	if (it != m_NameToAsset.end())
+	{
+		return it->second;
+	}
+
+	const AssetID asset = (AssetID)m_Assets.size();
+	m_NameToAsset.emplace(nameID, asset);
+	m_Stats.requested++;
+
+	m_Assets.emplace_back();
+	Asset& entry = m_Assets.back();
+	entry.requestTime = std::chrono::steady_clock::now();
+	entry.requestFrame = m_Frame;
+
+	// Added some other way already, e.g. by a MeshCache
+	const GeoID geoID = m_GeometryManager.GetID(nameID);
+	if (geoID != 0)
+	{
+		entry.geoID = geoID;
+		entry.state = AssetState::Ready;
+		m_Stats.loaded++;
+		return asset;
+	}
+
+	request.asset = asset;
+	request.encode = m_GeometryManager.NeedsEncodedSource();
+	m_Pending++;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Requests.push_back(std::move(request));
+	}
+	m_RequestCondition.notify_one();
+
+	return asset;
+}
+
+void AssetLoader::Update()
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	size_t uploadedBytes = 0;
+	uint32_t uploads = 0;
+	while (uploadedBytes < m_Settings.uploadBytesPerFrame)
+	{
+		std::unique_ptr<LoadedMesh> loaded;
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			if (m_Loaded.empty())
+			{
+				break;
+			}
+
+			loaded = std::move(m_Loaded.front());
+			m_Loaded.pop_front();
+		}
+
+		uploadedBytes += Upload(*loaded);
+		uploads++;
+	}
+
+	if (uploads > 0)
+	{
+		const double seconds = SecondsSince(start);
+		m_Stats.uploadSecondsSum += seconds;
+		m_Stats.uploadSecondsMax = std::max(m_Stats.uploadSecondsMax, seconds);
+		m_Stats.uploadedBytesMax = std::max(m_Stats.uploadedBytesMax, uploadedBytes);
+		m_Stats.uploadFrames++;
+
+		LOG_TRACE("Assets: uploaded %u meshes, %zu bytes in %.3f ms, %u pending", uploads, uploadedBytes, seconds * 1000.0, m_Pending)
+	}
+
+	m_Frame++;
+}
+
+size_t AssetLoader::Upload(LoadedMesh& loaded)
+{
+	Asset& asset = m_Assets[loaded.asset];
+	m_Pending--;
+
+	GeoID geoID = 0;
+	if (loaded.succeeded)
+	{
+		// Someone else may have added the name while it was loading
+		geoID = m_GeometryManager.GetID(StringID(loaded.name));
+		if (geoID == 0)
+		{
+			geoID = m_GeometryManager.AddGeometry(loaded.name, loaded.vertices.data(), loaded.indices.data(), std::move(loaded.mesh));
+			if (geoID == 0)
+			{
+				LOG_ERROR("Geometry buffers are full, couldn't add [%s]", loaded.name.c_str())
+			}
+		}
+	}
+
+	if (geoID == 0)
+	{
+		asset.state = AssetState::Failed;
+		m_Stats.failed++;
+		return 0;
+	}
+
+	asset.geoID = geoID;
+	asset.state = AssetState::Ready;
+	m_Stats.loaded++;
+
+	const double latency = SecondsSince(asset.requestTime);
+	m_Stats.latencySum += latency;
+	m_Stats.latencyMax = std::max(m_Stats.latencyMax, latency);
+	m_Stats.latencyFramesMax = std::max(m_Stats.latencyFramesMax, m_Frame - asset.requestFrame);
+
+	const size_t bytes = loaded.vertices.size() * sizeof(float) + loaded.indices.size() * sizeof(uint32_t);
+	m_Stats.uploadedBytes += bytes;
+	return bytes;
+}
+
+void AssetLoader::LoaderLoop()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	while (true)
+	{
+		m_RequestCondition.wait(lock, [this]() { return m_Stop || !m_Requests.empty(); });
+		if (m_Stop)
+		{
+			break;
+		}
+
+		Request request = std::move(m_Requests.front());
+		m_Requests.pop_front();
+
+		lock.unlock();
+		const auto start = std::chrono::steady_clock::now();
+		std::unique_ptr<LoadedMesh> loaded = std::make_unique<LoadedMesh>();
+		Load(request, *loaded);
+		const double seconds = SecondsSince(start);
+		lock.lock();
+
+		m_LoadSeconds += seconds;
+		m_Loaded.push_back(std::move(loaded));
+	}
+}
+
+void AssetLoader::Load(const Request& request, LoadedMesh& loaded)
+{
+	loaded.asset = request.asset;
+	loaded.name = request.name;
+
+	if (request.path.empty())
+	{
+		MeshData data = MeshGenerator::Generate(request.desc);
+		const GLsizeiptr bytes = (GLsizeiptr)(data.vertices.size() * sizeof(float));
+		loaded.mesh = request.encode
+			? GeometryManager::Encode(data.vertices.data(), bytes, data.indices.data(), data.GetIndexCount())
+			: GeometryManager::Describe(data.vertices.data(), bytes, data.GetIndexCount());
+		loaded.vertices = std::move(data.vertices);
+		loaded.indices = std::move(data.indices);
+		loaded.succeeded = true;
+		return;
+	}
+
+	EncodedMesh mesh;
+	if (!ReadMeshFile(request.path, mesh))
+	{
+		return;
+	}
+
+	if (mesh.vertexSize != SIZE_OF_VERTEX)
+	{
+		LOG_ERROR("[%s] has %u byte vertices, expected %u", request.path.c_str(), mesh.vertexSize, SIZE_OF_VERTEX)
+		return;
+	}
+
+	// The counts come from the header, check them against the data before allocating for them
+	if (mesh.vertices.size() < MeshCodec::GetMinVertexBytes(mesh.vertexCount, mesh.vertexSize)
+		|| mesh.indices.size() < MeshCodec::GetMinIndexBytes(mesh.indexCount))
+	{
+		LOG_ERROR("[%s] has %u vertices and %u indices, which its data can't hold", request.path.c_str(), mesh.vertexCount, mesh.indexCount)
+		return;
+	}
+
+	loaded.vertices.resize((size_t)mesh.vertexCount * SIZE_OF_VERTEX / sizeof(float));
+	loaded.indices.resize(mesh.indexCount);
+	if (!MeshCodec::Decode(mesh, loaded.vertices.data(), loaded.indices.data()))
+	{
+		LOG_ERROR("Couldn't decode the mesh in [%s]", request.path.c_str())
+		return;
+	}
+
+	// The file is already encoded, only keep it if the GeometryManager wants it
+	if (!request.encode)
+	{
+		mesh.vertices = std::vector<uint8_t>();
+		mesh.indices = std::vector<uint8_t>();
+	}
+
+	loaded.mesh = std::move(mesh);
+	loaded.succeeded = true;
+}
+
+AssetLoaderStats AssetLoader::GetStats()
+{
+	AssetLoaderStats stats = m_Stats;
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	stats.loadSeconds = m_LoadSeconds;
+	return stats;
+}
+
+void AssetLoader::LogStats()
+{
+	const AssetLoaderStats stats = GetStats();
+	if (stats.requested == 0)
+	{
+		return;
+	}
+
+	const double mb = 1024.0 * 1024.0;
+	LOG_INFO("Assets: %llu requested, %llu loaded, %llu failed, %u pending, %.2f MB uploaded, %.3f s on loader threads",
+		(unsigned long long)stats.requested, (unsigned long long)stats.loaded, (unsigned long long)stats.failed,
+		m_Pending, stats.uploadedBytes / mb, stats.loadSeconds)
+
+	if (stats.uploadFrames > 0)
+	{
+		LOG_INFO("Assets: upload %.3f ms/frame mean, %.3f ms max, %.2f MB max over %llu frames, budget %.2f MB",
+			stats.uploadSecondsSum / stats.uploadFrames * 1000.0, stats.uploadSecondsMax * 1000.0, stats.uploadedBytesMax / mb,
+			(unsigned long long)stats.uploadFrames, m_Settings.uploadBytesPerFrame / mb)
+	}
+
+	if (stats.loaded > 0)
+	{
+		LOG_INFO("Assets: request to ready mean %.2f ms, max %.2f ms (%llu frames)",
+			stats.latencySum / stats.loaded * 1000.0, stats.latencyMax * 1000.0, (unsigned long long)stats.latencyFramesMax)
+	}
+}
+
+bool AssetLoader::ReadMeshFile(const std::string& path, EncodedMesh& mesh)
+{
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+	{
+		LOG_ERROR("Couldn't open mesh file [%s]", path.c_str())
+		return false;
+	}
+
+	std::vector<uint8_t> data((size_t)file.tellg());
+	file.seekg(0);
+	file.read((char*)data.data(), data.size());
+
+	size_t offset = 0;
+	bool failed = false;
+	auto read = [&](void* target, size_t bytes)
+	{
+		if (failed || offset + bytes > data.size())
+		{
+			failed = true;
+			return;
+		}
+
+		memcpy(target, data.data() + offset, bytes);
+		offset += bytes;
+	};
+
+	char magic[4] = {};
+	uint32_t version = 0;
+	read(magic, sizeof(magic));
+	read(&version, sizeof(version));
+	if (failed || memcmp(magic, MESH_FILE_MAGIC, sizeof(magic)) != 0 || version != MESH_FILE_VERSION)
+	{
+		LOG_ERROR("[%s] is not a mesh file of version %u", path.c_str(), MESH_FILE_VERSION)
+		return false;
+	}
+
+	uint32_t vertexBytes = 0;
+	uint32_t indexBytes = 0;
+	read(&mesh.vertexCount, sizeof(mesh.vertexCount));
+	read(&mesh.vertexSize, sizeof(mesh.vertexSize));
+	read(&mesh.indexCount, sizeof(mesh.indexCount));
+	read(&mesh.boundsCenter, sizeof(mesh.boundsCenter));
+	read(&mesh.boundsRadius, sizeof(mesh.boundsRadius));
+	read(&vertexBytes, sizeof(vertexBytes));
+	mesh.vertices.resize(failed ? 0 : std::min<size_t>(vertexBytes, data.size()));
+	read(mesh.vertices.data(), vertexBytes);
+	read(&indexBytes, sizeof(indexBytes));
+	mesh.indices.resize(failed ? 0 : std::min<size_t>(indexBytes, data.size()));
+	read(mesh.indices.data(), indexBytes);
+
+	if (failed || offset != data.size())
+	{
+		LOG_ERROR("Mesh file [%s] is truncated or has trailing data", path.c_str())
+		return false;
+	}
+
+	return true;
+}
+
+bool AssetLoader::WriteMeshFile(const std::string& path, const EncodedMesh& mesh)
+{
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file)
+	{
+		LOG_ERROR("Couldn't open mesh file [%s] for writing", path.c_str())
+		return false;
+	}
+
+	const uint32_t vertexBytes = (uint32_t)mesh.vertices.size();
+	const uint32_t indexBytes = (uint32_t)mesh.indices.size();
+
+	bool written = fwrite(MESH_FILE_MAGIC, sizeof(MESH_FILE_MAGIC), 1, file) == 1;
+	written &= fwrite(&MESH_FILE_VERSION, sizeof(MESH_FILE_VERSION), 1, file) == 1;
+	written &= fwrite(&mesh.vertexCount, sizeof(mesh.vertexCount), 1, file) == 1;
+	written &= fwrite(&mesh.vertexSize, sizeof(mesh.vertexSize), 1, file) == 1;
+	written &= fwrite(&mesh.indexCount, sizeof(mesh.indexCount), 1, file) == 1;
+	written &= fwrite(&mesh.boundsCenter, sizeof(mesh.boundsCenter), 1, file) == 1;
+	written &= fwrite(&mesh.boundsRadius, sizeof(mesh.boundsRadius), 1, file) == 1;
+	written &= fwrite(&vertexBytes, sizeof(vertexBytes), 1, file) == 1;
+	written &= fwrite(mesh.vertices.data(), 1, vertexBytes, file) == vertexBytes;
+	written &= fwrite(&indexBytes, sizeof(indexBytes), 1, file) == 1;
+	written &= fwrite(mesh.indices.data(), 1, indexBytes, file) == indexBytes;
+	written &= fclose(file) == 0;
+
+	if (!written)
+	{
+		LOG_ERROR("Couldn't write mesh file [%s]", path.c_str())
+	}
+	return written;
+}
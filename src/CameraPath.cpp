@@ -0,0 +1,116 @@
+#include "CameraPath.h"
+
+#define ORBIT_KEYFRAMES 16
+
+bool CameraPath::LoadFromFile(const std::string& path, CameraPath& cameraPath)
+{
+	std::ifstream file(path);
+	if (!file.is_open())
+	{
+		LOG_ERROR("Couldn't open camera path at location [%s]", path.c_str())
+		return false;
+	}
+
+	cameraPath.m_Keyframes.clear();
+
+	std::string line;
+	uint32_t lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		lineNumber++;
+		if (line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+
+		std::istringstream stream(line);
+		CameraKeyframe keyframe{};
+		stream >> keyframe.time
+			>> keyframe.position.x >> keyframe.position.y >> keyframe.position.z
+			>> keyframe.rotation.x >> keyframe.rotation.y;
+
+		if (stream.fail())
+		{
+			LOG_ERROR("Invalid keyframe in [%s] line %u", path.c_str(), lineNumber)
+			return false;
+		}
+
+		cameraPath.AddKeyframe(keyframe);
+	}
+
+	LOG_INFO("Loaded camera path [%s] with %u keyframes", path.c_str(), (uint32_t)cameraPath.m_Keyframes.size())
+	return !cameraPath.IsEmpty();
+}
+
+CameraPath CameraPath::Orbit(const glm::vec3& center, float radius, float height, float period)
+{
+	CameraPath cameraPath;
+
+	for (uint32_t i = 0; i <= ORBIT_KEYFRAMES; i++)
+	{
+		const float angle = glm::radians(360.f * i / ORBIT_KEYFRAMES);
+
+		CameraKeyframe keyframe{};
+		keyframe.time = period * i / ORBIT_KEYFRAMES;
+		keyframe.position = center + glm::vec3(cos(angle) * radius, height, sin(angle) * radius);
+
+		// Look back at the center. The yaw keeps counting up instead of wrapping so the linear
+		// interpolation never takes the long way around.
+		const glm::vec3 direction = glm::normalize(center - keyframe.position);
+		keyframe.rotation.x = glm::degrees(asin(direction.y));
+		keyframe.rotation.y = 180.f + 360.f * i / ORBIT_KEYFRAMES;
+
+		cameraPath.AddKeyframe(keyframe);
+	}
+
+	return cameraPath;
+}
+
+void CameraPath::AddKeyframe(const CameraKeyframe& keyframe)
+{
+	assert(m_Keyframes.empty() || keyframe.time > m_Keyframes.back().time);
+	m_Keyframes.push_back(keyframe);
+}
+
+void CameraPath::Sample(float time, glm::vec3& position, glm::vec3& rotation) const
+{
+	assert(!m_Keyframes.empty());
+
+	const float duration = GetDuration();
+	if (m_Looping && duration > 0.f)
+	{
+		time = fmod(time, duration);
+	}
+	time = std::clamp(time, m_Keyframes.front().time, duration);
+
+	// First keyframe after time
+	size_t next = 1;
+	while (next < m_Keyframes.size() && m_Keyframes[next].time < time)
+	{
+		next++;
+	}
+
+	if (next >= m_Keyframes.size())
+	{
+		position = m_Keyframes.back().position;
+		rotation = m_Keyframes.back().rotation;
+		return;
+	}
+
+	const CameraKeyframe& k1 = m_Keyframes[next - 1];
+	const CameraKeyframe& k2 = m_Keyframes[next];
+	const glm::vec3& p0 = m_Keyframes[next >= 2 ? next - 2 : next - 1].position;
+	const glm::vec3& p3 = m_Keyframes[next + 1 < m_Keyframes.size() ? next + 1 : next].position;
+
+	const float t = (time - k1.time) / (k2.time - k1.time);
+	const float t2 = t * t;
+	const float t3 = t2 * t;
+
+	position = 0.5f * (
+		(2.f * k1.position) +
+		(k2.position - p0) * t +
+		(2.f * p0 - 5.f * k1.position + 4.f * k2.position - p3) * t2 +
+		(3.f * k1.position - p0 - 3.f * k2.position + p3) * t3);
+
+	rotation = glm::mix(k1.rotation, k2.rotation, t);
+}
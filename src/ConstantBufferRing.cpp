@@ -0,0 +1,92 @@
+#include "ConstantBufferRing.h"
+
+ConstantBufferRing::ConstantBufferRing(GLsizeiptr regionSize, uint32_t regionCount)
+	: m_RegionSize(regionSize)
+	, m_RegionCount(regionCount)
+	, m_Alignment(0)
+	, m_Buffer(0)
+	, m_Data(nullptr)
+	, m_Fences(regionCount, nullptr)
+	, m_Region(regionCount - 1)
+	, m_RegionTop(0)
+	, m_PeakUsage(0)
+{
+	assert(m_RegionCount > 0);
+
+	// Any range bound as UBO or SSBO has to start on the stricter of the two alignments
+	GLint uniformAlignment = 0;
+	GLint storageAlignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+	m_Alignment = std::max({ uniformAlignment, storageAlignment, 16 });
+
+	// Regions start aligned too
+	m_RegionSize = (m_RegionSize + m_Alignment - 1) / m_Alignment * m_Alignment;
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glCreateBuffers(1, &m_Buffer);
+	glNamedBufferStorage(m_Buffer, m_RegionSize * m_RegionCount, nullptr, flags);
+	m_Data = (char*)glMapNamedBufferRange(m_Buffer, 0, m_RegionSize * m_RegionCount, flags);
+
+	LOG_INFO("Constant buffer ring with %u regions of %lld bytes, alignment %d", m_RegionCount, (long long)m_RegionSize, m_Alignment)
+}
+
+ConstantBufferRing::~ConstantBufferRing()
+{
+	for (GLsync fence : m_Fences)
+	{
+		if (fence)
+		{
+			glDeleteSync(fence);
+		}
+	}
+
+	glUnmapNamedBuffer(m_Buffer);
+	GLState::Get().DeleteBuffers(1, &m_Buffer);
+}
+
+void ConstantBufferRing::BeginFrame()
+{
+	m_Region = (m_Region + 1) % m_RegionCount;
+	m_RegionTop = 0;
+
+	GLsync& fence = m_Fences[m_Region];
+	if (!fence)
+	{
+		return;
+	}
+
+	GLenum waitReturn = GL_UNSIGNALED;
+	while (waitReturn != GL_ALREADY_SIGNALED && waitReturn != GL_CONDITION_SATISFIED)
+	{
+		waitReturn = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1);
+
+		// Lost context or similar, it would never signal
+		if (waitReturn == GL_WAIT_FAILED)
+		{
+			LOG_ERROR("Waiting for constant buffer region %u failed", m_Region)
+			break;
+		}
+	}
+
+	glDeleteSync(fence);
+	fence = nullptr;
+}
+
+void ConstantBufferRing::EndFrame()
+{
+	GLsync& fence = m_Fences[m_Region];
+	assert(!fence);
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+GLintptr ConstantBufferRing::Allocate(GLsizeiptr size)
+{
+	const GLintptr offset = m_RegionTop;
+	m_RegionTop += (size + m_Alignment - 1) / m_Alignment * m_Alignment;
+	m_PeakUsage = std::max(m_PeakUsage, (GLsizeiptr)m_RegionTop);
+
+	assert(m_RegionTop <= m_RegionSize && "Constant buffer region overflow, raise CONSTANT_BUFFER_REGION_SIZE");
+
+	return m_Region * m_RegionSize + offset;
+}
@@ -0,0 +1,127 @@
+#include "FrameArena.h"
+
+namespace
+{
+	// Arena of the current thread, the owner check keeps separate FrameArena instances apart
+	thread_local const FrameArena* t_Owner = nullptr;
+	thread_local LinearArena* t_Arena = nullptr;
+}
+
+LinearArena::LinearArena(size_t initialSize)
+	: m_Offset(0)
+	, m_Used(0)
+	, m_HighWater(0)
+	, m_BlockAllocations(0)
+{
+	AddBlock(initialSize);
+}
+
+void* LinearArena::Allocate(size_t size, size_t alignment)
+{
+	assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+	auto alignedOffset = [&]()
+	{
+		const uintptr_t base = (uintptr_t)m_Blocks.back().data.get();
+		return (size_t)(((base + m_Offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base);
+	};
+
+	size_t offset = alignedOffset();
+	if (offset + size > m_Blocks.back().size)
+	{
+		AddBlock(std::max(size + alignment, m_Blocks.back().size * 2));
+		offset = alignedOffset();
+	}
+
+	m_Used += offset + size - m_Offset;
+	m_HighWater = std::max(m_HighWater, m_Used);
+	m_Offset = offset + size;
+
+	return m_Blocks.back().data.get() + offset;
+}
+
+void LinearArena::Reset()
+{
+	// Whatever the last frame needed fits into one block from now on
+	if (m_Blocks.size() > 1)
+	{
+		const size_t capacity = GetCapacity();
+		m_Blocks.clear();
+		AddBlock(capacity);
+	}
+
+	m_Offset = 0;
+	m_Used = 0;
+}
+
+size_t LinearArena::GetCapacity() const
+{
+	size_t capacity = 0;
+	for (const Block& block : m_Blocks)
+	{
+		capacity += block.size;
+	}
+	return capacity;
+}
+
+void LinearArena::AddBlock(size_t minimumSize)
+{
+	Block block;
+	block.size = minimumSize;
+	block.data = std::make_unique<char[]>(block.size);
+
+	m_Blocks.push_back(std::move(block));
+	m_Offset = 0;
+	m_BlockAllocations++;
+}
+
+FrameArena& FrameArena::Get()
+{
+	static FrameArena frameArena;
+	return frameArena;
+}
+
+LinearArena& FrameArena::GetThreadArena()
+{
+	if (t_Owner != this)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Arenas.push_back(std::make_unique<LinearArena>());
+
+		t_Owner = this;
+		t_Arena = m_Arenas.back().get();
+	}
+
+	return *t_Arena;
+}
+
+void FrameArena::Reset()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	for (auto& arena : m_Arenas)
+	{
+		arena->Reset();
+	}
+}
+
+void FrameArena::LogStats() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	size_t highWater = 0;
+	size_t capacity = 0;
+	for (const auto& arena : m_Arenas)
+	{
+		highWater += arena->GetHighWater();
+		capacity += arena->GetCapacity();
+	}
+
+	LOG_INFO("Frame arenas: %u threads, %.2f KB peak of %.2f KB reserved", (uint32_t)m_Arenas.size(), highWater / 1024.0, capacity / 1024.0)
+
+	for (uint32_t i = 0; i < m_Arenas.size(); i++)
+	{
+		const LinearArena& arena = *m_Arenas[i];
+		LOG_INFO("  arena %u: %.2f KB peak, %.2f KB reserved, %u heap allocations", i,
+			arena.GetHighWater() / 1024.0, arena.GetCapacity() / 1024.0, arena.GetBlockAllocations())
+	}
+}
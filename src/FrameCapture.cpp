@@ -0,0 +1,454 @@
+#include "FrameCapture.h"
+#include "GLState.h"
+
+#define BYTES_PER_PIXEL 4
+
+namespace
+{
+	// Full range BT.601, matches the C420jpeg tag in the Y4M header
+	inline uint8_t RgbToY(int r, int g, int b) { return (uint8_t)((77 * r + 150 * g + 29 * b + 128) >> 8); }
+	inline uint8_t RgbToU(int r, int g, int b) { return (uint8_t)(((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128); }
+	inline uint8_t RgbToV(int r, int g, int b) { return (uint8_t)(((128 * r - 107 * g - 21 * b + 128) >> 8) + 128); }
+
+	// Splits a path like "frames/%05d.ppm" around its frame number pattern, false if it has none.
+	// %d, %i and %u with an optional zero flag and width count, any other % is part of the path.
+	bool SplitFramePattern(const std::string& path, std::string& prefix, std::string& suffix, int& width, bool& zeroPad)
+	{
+		for (size_t percent = path.find('%'); percent != std::string::npos; percent = path.find('%', percent + 1))
+		{
+			size_t end = percent + 1;
+			zeroPad = end < path.size() && path[end] == '0';
+			while (end < path.size() && path[end] >= '0' && path[end] <= '9')
+			{
+				end++;
+			}
+
+			if (end < path.size() && (path[end] == 'd' || path[end] == 'i' || path[end] == 'u'))
+			{
+				width = end > percent + 1 ? std::min(std::atoi(path.c_str() + percent + 1), 32) : 0;
+				prefix = path.substr(0, percent);
+				suffix = path.substr(end + 1);
+				return true;
+			}
+		}
+
+		return false;
+	}
+}
+
+FrameCapture::FrameCapture(int width, int height, const FrameCaptureSettings& settings)
+	: m_Width(width)
+	, m_Height(height)
+	, m_FrameBytes((size_t)width * height * BYTES_PER_PIXEL)
+	, m_Settings(settings)
+	, m_Start(std::chrono::steady_clock::now())
+{
+	assert(m_Width > 0 && m_Height > 0);
+	assert(m_Settings.ringSize > 0 && m_Settings.maxQueuedFrames > 0);
+
+	// Frames come back to the free list from the writer thread, it shouldn't grow mid run
+	m_FreeFrames.reserve(m_Settings.maxQueuedFrames);
+
+	if (!m_Settings.output.empty() && m_Settings.output[0] == '|')
+	{
+#ifdef _WIN32
+		m_Output = _popen(m_Settings.output.c_str() + 1, "wb");
+#else
+		m_Output = popen(m_Settings.output.c_str() + 1, "w");
+#endif
+		m_IsPipe = true;
+	}
+	else if (m_Settings.format == CaptureFormat::PPM
+		&& SplitFramePattern(m_Settings.output, m_FramePathPrefix, m_FramePathSuffix, m_FramePathWidth, m_FramePathZeroPad))
+	{
+		// Every frame opens its own file on the writer thread
+		m_FilePerFrame = true;
+	}
+	else
+	{
+		m_Output = fopen(m_Settings.output.c_str(), "wb");
+	}
+
+	if (!m_Output && !m_FilePerFrame)
+	{
+		LOG_ERROR("Couldn't open capture output [%s]", m_Settings.output.c_str())
+		return;
+	}
+
+	if (m_Output && m_Settings.format == CaptureFormat::Y4M)
+	{
+		fprintf(m_Output, "YUV4MPEG2 W%d H%d F%u:1 Ip A1:1 C420jpeg\n", m_Width, m_Height, m_Settings.frameRate);
+	}
+
+	// Persistently mapped and coherent, so a signaled fence is all it takes before reading
+	const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	m_Slots.resize(m_Settings.ringSize);
+	for (Slot& slot : m_Slots)
+	{
+		glCreateBuffers(1, &slot.buffer);
+		glNamedBufferStorage(slot.buffer, m_FrameBytes, nullptr, flags | GL_CLIENT_STORAGE_BIT);
+		slot.mapped = (const uint8_t*)glMapNamedBufferRange(slot.buffer, 0, m_FrameBytes, flags);
+	}
+
+	m_Writer = std::thread(&FrameCapture::WriterLoop, this);
+
+	LOG_INFO("Capturing %dx%d to [%s] through %u pixel pack buffers", m_Width, m_Height, m_Settings.output.c_str(), m_Settings.ringSize)
+}
+
+FrameCapture::~FrameCapture()
+{
+	if (m_Writer.joinable())
+	{
+		Flush();
+
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Stop = true;
+		}
+		m_QueueCondition.notify_one();
+		m_Writer.join();
+	}
+
+	for (Slot& slot : m_Slots)
+	{
+		if (slot.fence)
+		{
+			glDeleteSync(slot.fence);
+		}
+		glUnmapNamedBuffer(slot.buffer);
+		GLState::Get().DeleteBuffers(1, &slot.buffer);
+	}
+
+	if (m_Output)
+	{
+#ifdef _WIN32
+		m_IsPipe ? _pclose(m_Output) : fclose(m_Output);
+#else
+		m_IsPipe ? pclose(m_Output) : fclose(m_Output);
+#endif
+	}
+}
+
+void FrameCapture::Capture(GLuint framebuffer)
+{
+	if (!m_Writer.joinable())
+	{
+		return;
+	}
+
+	Poll(false);
+
+	// The oldest readback is still running on the GPU, waiting for it would stall the frame
+	Slot& slot = m_Slots[m_NextSlot];
+	if (slot.fence)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stats.droppedGpu++;
+		return;
+	}
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glReadBuffer(framebuffer == 0 ? GL_BACK : GL_COLOR_ATTACHMENT0);
+	GLState::Get().BindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+	// Returns right away, the copy lands in the buffer whenever the GPU gets to it
+	glReadPixels(0, 0, m_Width, m_Height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+	GLState::Get().BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.frameIndex = m_FrameCounter++;
+	slot.issueTime = Now();
+
+	m_NextSlot = (m_NextSlot + 1) % m_Settings.ringSize;
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Stats.issued++;
+	if (m_Stats.firstIssueTime < 0.0)
+	{
+		m_Stats.firstIssueTime = slot.issueTime;
+	}
+}
+
+void FrameCapture::Flush()
+{
+	if (!m_Writer.joinable())
+	{
+		return;
+	}
+
+	Poll(true);
+
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_IdleCondition.wait(lock, [this]() { return m_Queue.empty() && !m_WriterBusy; });
+}
+
+void FrameCapture::Poll(bool wait)
+{
+	// Slots are filled in order, so the next one to be reused is the oldest
+	for (uint32_t i = 0; i < m_Settings.ringSize; i++)
+	{
+		Slot& slot = m_Slots[(m_NextSlot + i) % m_Settings.ringSize];
+		if (!slot.fence)
+		{
+			continue;
+		}
+
+		const GLuint64 timeout = wait ? GL_TIMEOUT_IGNORED : 0;
+		const GLenum result = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+		if (result == GL_TIMEOUT_EXPIRED)
+		{
+			// Everything after this one was issued later and can't be done either
+			break;
+		}
+
+		glDeleteSync(slot.fence);
+		slot.fence = nullptr;
+
+		// Nothing says the copy landed, the buffer may hold anything
+		if (result == GL_WAIT_FAILED)
+		{
+			LOG_ERROR("Waiting for the readback of captured frame %llu failed, dropping it", (unsigned long long)slot.frameIndex)
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Stats.droppedGpu++;
+			continue;
+		}
+
+		Handoff(slot);
+	}
+}
+
+void FrameCapture::Handoff(Slot& slot)
+{
+	const double latency = Now() - slot.issueTime;
+	const uint64_t latencyFrames = m_FrameCounter - slot.frameIndex;
+
+	std::unique_ptr<Frame> frame;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		m_Stats.latencySum += latency;
+		m_Stats.latencyMax = std::max(m_Stats.latencyMax, latency);
+		m_Stats.latencyFramesSum += latencyFrames;
+
+		if (!m_FreeFrames.empty())
+		{
+			frame = std::move(m_FreeFrames.back());
+			m_FreeFrames.pop_back();
+		}
+		else if (m_AllocatedFrames < m_Settings.maxQueuedFrames)
+		{
+			m_AllocatedFrames++;
+		}
+		else
+		{
+			// The writer can't keep up, dropping is cheaper than blocking the render thread
+			m_Stats.droppedWriter++;
+			return;
+		}
+	}
+
+	if (!frame)
+	{
+		frame = std::make_unique<Frame>();
+		frame->pixels.resize(m_FrameBytes);
+	}
+
+	// The only copy on the render thread, the slot is free again right after
+	memcpy(frame->pixels.data(), slot.mapped, m_FrameBytes);
+	frame->frameIndex = slot.frameIndex;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Queue.push_back(std::move(frame));
+	}
+	m_QueueCondition.notify_one();
+}
+
+void FrameCapture::WriterLoop()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	while (true)
+	{
+		m_QueueCondition.wait(lock, [this]() { return m_Stop || !m_Queue.empty(); });
+		if (m_Queue.empty())
+		{
+			break;
+		}
+
+		std::unique_ptr<Frame> frame = std::move(m_Queue.front());
+		m_Queue.pop_front();
+		m_WriterBusy = true;
+
+		lock.unlock();
+		WriteFrame(*frame);
+		const double writeTime = Now();
+		lock.lock();
+
+		m_Stats.written++;
+		m_Stats.lastWriteTime = writeTime;
+		m_FreeFrames.push_back(std::move(frame));
+		m_WriterBusy = false;
+
+		if (m_Queue.empty())
+		{
+			m_IdleCondition.notify_all();
+		}
+	}
+}
+
+void FrameCapture::WriteFrame(const Frame& frame)
+{
+	// GL rows start at the bottom, every format here wants the top row first
+	const size_t rowBytes = (size_t)m_Width * BYTES_PER_PIXEL;
+	auto sourceRow = [&](int y) { return frame.pixels.data() + (size_t)(m_Height - 1 - y) * rowBytes; };
+
+	FILE* output = m_Output;
+	char path[512];
+	if (m_FilePerFrame)
+	{
+		snprintf(path, sizeof(path), m_FramePathZeroPad ? "%s%0*llu%s" : "%s%*llu%s", m_FramePathPrefix.c_str(), m_FramePathWidth,
+			(unsigned long long)frame.frameIndex, m_FramePathSuffix.c_str());
+		output = fopen(path, "wb");
+		if (!output)
+		{
+			LOG_ERROR("Couldn't open capture output [%s]", path)
+			return;
+		}
+	}
+
+	size_t bytes = 0;
+	switch (m_Settings.format)
+	{
+	case CaptureFormat::Raw:
+	{
+		for (int y = 0; y < m_Height; y++)
+		{
+			bytes += fwrite(sourceRow(y), 1, rowBytes, output);
+		}
+		break;
+	}
+
+	case CaptureFormat::PPM:
+	{
+		m_ConvertBuffer.resize((size_t)m_Width * m_Height * 3);
+		uint8_t* dst = m_ConvertBuffer.data();
+		for (int y = 0; y < m_Height; y++)
+		{
+			const uint8_t* src = sourceRow(y);
+			for (int x = 0; x < m_Width; x++, src += BYTES_PER_PIXEL)
+			{
+				*dst++ = src[0];
+				*dst++ = src[1];
+				*dst++ = src[2];
+			}
+		}
+
+		bytes += fprintf(output, "P6\n%d %d\n255\n", m_Width, m_Height);
+		bytes += fwrite(m_ConvertBuffer.data(), 1, m_ConvertBuffer.size(), output);
+		break;
+	}
+
+	case CaptureFormat::Y4M:
+	{
+		// Chroma planes are rounded up for odd sizes, each sample averages up to 2x2 pixels
+		const int chromaWidth = (m_Width + 1) / 2;
+		const int chromaHeight = (m_Height + 1) / 2;
+		const size_t lumaSize = (size_t)m_Width * m_Height;
+		const size_t chromaSize = (size_t)chromaWidth * chromaHeight;
+
+		m_ConvertBuffer.resize(lumaSize + 2 * chromaSize);
+		uint8_t* yPlane = m_ConvertBuffer.data();
+		uint8_t* uPlane = yPlane + lumaSize;
+		uint8_t* vPlane = uPlane + chromaSize;
+
+		for (int y = 0; y < m_Height; y++)
+		{
+			const uint8_t* src = sourceRow(y);
+			uint8_t* dst = yPlane + (size_t)y * m_Width;
+			for (int x = 0; x < m_Width; x++, src += BYTES_PER_PIXEL)
+			{
+				dst[x] = RgbToY(src[0], src[1], src[2]);
+			}
+		}
+
+		for (int cy = 0; cy < chromaHeight; cy++)
+		{
+			const uint8_t* row0 = sourceRow(cy * 2);
+			const uint8_t* row1 = sourceRow(std::min(cy * 2 + 1, m_Height - 1));
+			for (int cx = 0; cx < chromaWidth; cx++)
+			{
+				const int x0 = cx * 2 * BYTES_PER_PIXEL;
+				const int x1 = std::min(cx * 2 + 1, m_Width - 1) * BYTES_PER_PIXEL;
+
+				const int r = (row0[x0 + 0] + row0[x1 + 0] + row1[x0 + 0] + row1[x1 + 0] + 2) >> 2;
+				const int g = (row0[x0 + 1] + row0[x1 + 1] + row1[x0 + 1] + row1[x1 + 1] + 2) >> 2;
+				const int b = (row0[x0 + 2] + row0[x1 + 2] + row1[x0 + 2] + row1[x1 + 2] + 2) >> 2;
+
+				uPlane[(size_t)cy * chromaWidth + cx] = RgbToU(r, g, b);
+				vPlane[(size_t)cy * chromaWidth + cx] = RgbToV(r, g, b);
+			}
+		}
+
+		bytes += fwrite("FRAME\n", 1, 6, output);
+		bytes += fwrite(m_ConvertBuffer.data(), 1, m_ConvertBuffer.size(), output);
+		break;
+	}
+	}
+
+	if (m_FilePerFrame)
+	{
+		fclose(output);
+	}
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Stats.bytesWritten += bytes;
+}
+
+FrameCaptureStats FrameCapture::GetStats()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_Stats;
+}
+
+void FrameCapture::LogStats()
+{
+	const FrameCaptureStats stats = GetStats();
+	const uint64_t handedOff = stats.written + stats.droppedWriter;
+	const double duration = stats.lastWriteTime - stats.firstIssueTime;
+
+	LOG_INFO("Capture: %llu issued, %llu written, %llu dropped (gpu busy %llu, writer full %llu)",
+		(unsigned long long)stats.issued, (unsigned long long)stats.written,
+		(unsigned long long)(stats.droppedGpu + stats.droppedWriter),
+		(unsigned long long)stats.droppedGpu, (unsigned long long)stats.droppedWriter)
+
+	if (handedOff > 0)
+	{
+		LOG_INFO("Capture readback latency: mean %.2fms (%.2f frames), max %.2fms",
+			stats.latencySum / handedOff * 1000.0, (double)stats.latencyFramesSum / handedOff, stats.latencyMax * 1000.0)
+	}
+
+	if (stats.written > 0 && duration > 0.0)
+	{
+		LOG_INFO("Capture throughput: %.2f fps, %.2f MB/s",
+			stats.written / duration, stats.bytesWritten / duration / (1024.0 * 1024.0))
+	}
+}
+
+bool FrameCapture::ParseFormat(const std::string& name, CaptureFormat& format)
+{
+	if (name == "raw") { format = CaptureFormat::Raw; }
+	else if (name == "ppm") { format = CaptureFormat::PPM; }
+	else if (name == "y4m") { format = CaptureFormat::Y4M; }
+	else { return false; }
+
+	return true;
+}
+
+double FrameCapture::Now() const
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_Start).count();
+}
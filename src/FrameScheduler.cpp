@@ -0,0 +1,203 @@
+#include "FrameScheduler.h"
+
+void FrameTimeHistogram::Add(double seconds)
+{
+	const uint32_t bucket = std::min((uint32_t)(seconds / HISTOGRAM_BUCKET_WIDTH), (uint32_t)HISTOGRAM_BUCKET_COUNT - 1);
+	m_Buckets[bucket]++;
+	m_Count++;
+	m_Sum += seconds;
+	m_Max = std::max(m_Max, seconds);
+}
+
+void FrameTimeHistogram::Reset()
+{
+	*this = FrameTimeHistogram();
+}
+
+double FrameTimeHistogram::GetPercentile(double p) const
+{
+	if (m_Count == 0)
+	{
+		return 0.0;
+	}
+
+	const uint32_t target = std::max(1u, (uint32_t)std::ceil(p * m_Count));
+	uint32_t seen = 0;
+	for (uint32_t i = 0; i < HISTOGRAM_BUCKET_COUNT; i++)
+	{
+		seen += m_Buckets[i];
+		if (seen >= target)
+		{
+			// Upper edge of the bucket, so the estimate never undershoots
+			return std::min((i + 1) * HISTOGRAM_BUCKET_WIDTH, m_Max);
+		}
+	}
+	return m_Max;
+}
+
+FrameScheduler::FrameScheduler(Clock& clock, const FrameSchedulerSettings& settings)
+	: m_Clock(clock)
+	, m_Settings(settings)
+{
+	assert(m_Settings.fixedTimestep > 0.0);
+	assert(m_Settings.maxStepsPerFrame > 0);
+
+	m_LastReportTime = m_Clock.Now();
+}
+
+FrameScheduler::~FrameScheduler()
+{
+	for (GLsync fence : m_GpuFences)
+	{
+		glDeleteSync(fence);
+	}
+}
+
+void FrameScheduler::RunFrame(const Callbacks& callbacks)
+{
+	const double frameStart = m_Clock.Now();
+	if (m_LastFrameStart >= 0.0)
+	{
+		m_FrameTimes.Add(frameStart - m_LastFrameStart);
+	}
+	m_LastFrameStart = frameStart;
+
+	if (m_Settings.lowLatency)
+	{
+		WaitForFrameSlot();
+		WaitForGpu();
+	}
+
+	const double inputTime = m_Clock.Now();
+	if (callbacks.sampleInput)
+	{
+		callbacks.sampleInput();
+	}
+
+	// Fixed timestep update
+	if (m_LastUpdateTime < 0.0)
+	{
+		m_LastUpdateTime = inputTime;
+	}
+	m_Accumulator += inputTime - m_LastUpdateTime;
+	m_LastUpdateTime = inputTime;
+
+	uint32_t steps = 0;
+	while (m_Accumulator >= m_Settings.fixedTimestep && steps < m_Settings.maxStepsPerFrame)
+	{
+		if (callbacks.update)
+		{
+			callbacks.update(m_Settings.fixedTimestep);
+		}
+
+		m_Accumulator -= m_Settings.fixedTimestep;
+		m_SimulationTime += m_Settings.fixedTimestep;
+		m_StepCount++;
+		steps++;
+	}
+
+	// Drop whatever is left after a long hitch instead of spiraling
+	if (m_Accumulator >= m_Settings.fixedTimestep)
+	{
+		const uint64_t dropped = (uint64_t)(m_Accumulator / m_Settings.fixedTimestep);
+		m_DroppedSteps += dropped;
+		m_Accumulator -= dropped * m_Settings.fixedTimestep;
+		LOG_WARN("Frame %llu dropped %llu simulation steps", (unsigned long long)m_FrameIndex, (unsigned long long)dropped)
+	}
+
+	if (!m_Settings.lowLatency)
+	{
+		WaitForFrameSlot();
+		WaitForGpu();
+	}
+
+	if (callbacks.render)
+	{
+		callbacks.render(m_Accumulator / m_Settings.fixedTimestep);
+	}
+
+	if (callbacks.present)
+	{
+		callbacks.present();
+	}
+	SignalGpu();
+
+	const double frameEnd = m_Clock.Now();
+	m_CpuTimes.Add(frameEnd - frameStart);
+	m_InputLatencies.Add(frameEnd - inputTime);
+	m_FrameIndex++;
+
+	if (m_Settings.reportInterval > 0.0 && frameEnd - m_LastReportTime >= m_Settings.reportInterval)
+	{
+		LogStats();
+		m_FrameTimes.Reset();
+		m_CpuTimes.Reset();
+		m_InputLatencies.Reset();
+		m_LastReportTime = frameEnd;
+	}
+}
+
+void FrameScheduler::LogStats() const
+{
+	auto logHistogram = [](const char* name, const FrameTimeHistogram& histogram)
+	{
+		LOG_INFO("%-14s mean %6.2fms  p50 %6.2fms  p95 %6.2fms  p99 %6.2fms  max %6.2fms (%u frames)",
+			name,
+			histogram.GetMean() * 1000.0,
+			histogram.GetPercentile(0.5) * 1000.0,
+			histogram.GetPercentile(0.95) * 1000.0,
+			histogram.GetPercentile(0.99) * 1000.0,
+			histogram.GetMax() * 1000.0,
+			histogram.GetCount())
+	};
+
+	logHistogram("Frame time", m_FrameTimes);
+	logHistogram("CPU time", m_CpuTimes);
+	logHistogram("Input latency", m_InputLatencies);
+	LOG_INFO("%llu steps, %llu dropped, low latency %s", (unsigned long long)m_StepCount, (unsigned long long)m_DroppedSteps,
+		m_Settings.lowLatency ? "on" : "off")
+}
+
+void FrameScheduler::WaitForFrameSlot()
+{
+	if (m_Settings.targetFrameRate <= 0.0)
+	{
+		return;
+	}
+
+	const double frameDuration = 1.0 / m_Settings.targetFrameRate;
+	const double now = m_Clock.Now();
+
+	// Fell behind by more than a frame, start a new cadence instead of bursting to catch up
+	if (m_NextFrameTime < 0.0 || now - m_NextFrameTime > frameDuration)
+	{
+		m_NextFrameTime = now;
+	}
+
+	m_Clock.SleepUntil(m_NextFrameTime);
+	m_NextFrameTime += frameDuration;
+}
+
+void FrameScheduler::WaitForGpu()
+{
+	while (m_Settings.maxFramesInFlight > 0 && m_GpuFences.size() >= m_Settings.maxFramesInFlight)
+	{
+		GLsync fence = m_GpuFences.front();
+		m_GpuFences.pop_front();
+
+		GLenum waitReturn = GL_UNSIGNALED;
+		while (waitReturn != GL_ALREADY_SIGNALED && waitReturn != GL_CONDITION_SATISFIED && waitReturn != GL_WAIT_FAILED)
+		{
+			waitReturn = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		}
+		glDeleteSync(fence);
+	}
+}
+
+void FrameScheduler::SignalGpu()
+{
+	if (m_Settings.maxFramesInFlight > 0)
+	{
+		m_GpuFences.push_back(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+	}
+}
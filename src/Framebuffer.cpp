@@ -0,0 +1,70 @@
+#include "Framebuffer.h"
+
+Framebuffer::Framebuffer(int width, int height)
+	: m_Width(width)
+	, m_Height(height)
+{
+	glCreateFramebuffers(1, &m_Framebuffer);
+	CreateAttachments();
+}
+
+Framebuffer::~Framebuffer()
+{
+	DeleteAttachments();
+	glDeleteFramebuffers(1, &m_Framebuffer);
+}
+
+void Framebuffer::Bind()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffer);
+	glViewport(0, 0, m_Width, m_Height);
+}
+
+void Framebuffer::BindDefault(int width, int height)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, width, height);
+}
+
+void Framebuffer::Resize(int width, int height)
+{
+	if (width == m_Width && height == m_Height)
+	{
+		return;
+	}
+
+	m_Width = width;
+	m_Height = height;
+
+	DeleteAttachments();
+	CreateAttachments();
+}
+
+void Framebuffer::CreateAttachments()
+{
+	glCreateTextures(GL_TEXTURE_2D, 1, &m_ColorTexture);
+	glTextureStorage2D(m_ColorTexture, 1, GL_RGBA8, m_Width, m_Height);
+	glTextureParameteri(m_ColorTexture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTextureParameteri(m_ColorTexture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	glCreateRenderbuffers(1, &m_DepthRenderbuffer);
+	glNamedRenderbufferStorage(m_DepthRenderbuffer, GL_DEPTH_COMPONENT24, m_Width, m_Height);
+
+	glNamedFramebufferTexture(m_Framebuffer, GL_COLOR_ATTACHMENT0, m_ColorTexture, 0);
+	glNamedFramebufferRenderbuffer(m_Framebuffer, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_DepthRenderbuffer);
+
+	const GLenum status = glCheckNamedFramebufferStatus(m_Framebuffer, GL_FRAMEBUFFER);
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		LOG_ERROR("Framebuffer [%u] incomplete (0x%x)", m_Framebuffer, status)
+		assert(false);
+	}
+}
+
+void Framebuffer::DeleteAttachments()
+{
+	glDeleteTextures(1, &m_ColorTexture);
+	glDeleteRenderbuffers(1, &m_DepthRenderbuffer);
+	m_ColorTexture = 0;
+	m_DepthRenderbuffer = 0;
+}
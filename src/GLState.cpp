@@ -0,0 +1,311 @@
+#include "GLState.h"
+
+namespace
+{
+	const char* GetCallName(GLState::Call call)
+	{
+		switch (call)
+		{
+		case GLState::Call::UseProgram: return "glUseProgram";
+		case GLState::Call::BindVertexArray: return "glBindVertexArray";
+		case GLState::Call::BindBuffer: return "glBindBuffer";
+		case GLState::Call::BindBufferRange: return "glBindBufferRange/Base";
+		case GLState::Call::PolygonMode: return "glPolygonMode";
+		case GLState::Call::PointSize: return "glPointSize";
+		case GLState::Call::Capability: return "glEnable/glDisable";
+		case GLState::Call::DepthMask: return "glDepthMask";
+		case GLState::Call::BlendFunc: return "glBlendFunc";
+		default: return "?";
+		}
+	}
+}
+
+GLState& GLState::Get()
+{
+	static GLState state;
+	return state;
+}
+
+GLState::GLState()
+	: m_InBeforeChange(false)
+	, m_Issued{}
+	, m_Elided{}
+	, m_FrameIssued(0)
+	, m_FrameElided(0)
+	, m_MaxFrameIssued(0)
+	, m_Frames(0)
+{
+}
+
+template<typename T>
+bool GLState::Elide(Call call, const Cached<T>& cached, const T& value)
+{
+	if (!cached.known || !(cached.value == value))
+	{
+		return false;
+	}
+
+	m_Elided[(uint32_t)call]++;
+	m_FrameElided++;
+	return true;
+}
+
+template<typename T>
+bool GLState::Change(Call call, Cached<T>& cached, const T& value)
+{
+	if (Elide(call, cached, value))
+	{
+		return false;
+	}
+
+	// May set the same value on its own
+	if (m_BeforeChange && !m_InBeforeChange)
+	{
+		m_InBeforeChange = true;
+		m_BeforeChange();
+		m_InBeforeChange = false;
+
+		if (Elide(call, cached, value))
+		{
+			return false;
+		}
+	}
+
+	cached.value = value;
+	cached.known = true;
+	m_Issued[(uint32_t)call]++;
+	m_FrameIssued++;
+	return true;
+}
+
+void GLState::UseProgram(GLuint program)
+{
+	if (Change(Call::UseProgram, m_Program, program))
+	{
+		glUseProgram(program);
+	}
+}
+
+void GLState::BindVertexArray(GLuint vertexArray)
+{
+	if (Change(Call::BindVertexArray, m_VertexArray, vertexArray))
+	{
+		glBindVertexArray(vertexArray);
+	}
+}
+
+void GLState::BindBuffer(GLenum target, GLuint buffer)
+{
+	if (Change(Call::BindBuffer, m_Buffers[GetBufferTarget(target)], buffer))
+	{
+		glBindBuffer(target, buffer);
+	}
+}
+
+void GLState::BindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+	assert(index < GL_STATE_MAX_BUFFER_BINDINGS && "Raise GL_STATE_MAX_BUFFER_BINDINGS");
+
+	if (Change(Call::BindBufferRange, m_BufferRanges[GetIndexedTarget(target)][index], BufferRange{ buffer, 0, 0 }))
+	{
+		glBindBufferBase(target, index, buffer);
+	}
+}
+
+void GLState::BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	assert(index < GL_STATE_MAX_BUFFER_BINDINGS && "Raise GL_STATE_MAX_BUFFER_BINDINGS");
+	assert(size > 0);
+
+	if (Change(Call::BindBufferRange, m_BufferRanges[GetIndexedTarget(target)][index], BufferRange{ buffer, offset, size }))
+	{
+		glBindBufferRange(target, index, buffer, offset, size);
+	}
+}
+
+void GLState::PolygonMode(GLenum mode)
+{
+	if (Change(Call::PolygonMode, m_PolygonMode, mode))
+	{
+		glPolygonMode(GL_FRONT_AND_BACK, mode);
+	}
+}
+
+void GLState::PointSize(float size)
+{
+	if (Change(Call::PointSize, m_PointSize, size))
+	{
+		glPointSize(size);
+	}
+}
+
+void GLState::Enable(GLenum capability)
+{
+	SetCapability(capability, true);
+}
+
+void GLState::Disable(GLenum capability)
+{
+	SetCapability(capability, false);
+}
+
+void GLState::SetCapability(GLenum capability, bool enabled)
+{
+	if (!Change(Call::Capability, m_Capabilities[GetCapability(capability)], enabled))
+	{
+		return;
+	}
+
+	if (enabled)
+	{
+		glEnable(capability);
+	}
+	else
+	{
+		glDisable(capability);
+	}
+}
+
+void GLState::DepthMask(GLboolean mask)
+{
+	if (Change(Call::DepthMask, m_DepthMask, mask))
+	{
+		glDepthMask(mask);
+	}
+}
+
+void GLState::BlendFunc(GLenum sourceFactor, GLenum destinationFactor)
+{
+	if (Change(Call::BlendFunc, m_BlendFunc, std::make_pair(sourceFactor, destinationFactor)))
+	{
+		glBlendFunc(sourceFactor, destinationFactor);
+	}
+}
+
+bool GLState::IsEnabled(GLenum capability) const
+{
+	const Cached<bool>& cached = m_Capabilities[GetCapability(capability)];
+	return cached.known && cached.value;
+}
+
+void GLState::DeleteBuffers(GLsizei count, const GLuint* buffers)
+{
+	// GL unbinds a deleted buffer from the non-indexed targets, indexed bindings are left to
+	// whatever the implementation does, so neither is known afterwards
+	for (GLsizei i = 0; i < count; i++)
+	{
+		if (buffers[i] == 0)
+		{
+			continue;
+		}
+
+		for (Cached<GLuint>& binding : m_Buffers)
+		{
+			binding.known = binding.known && binding.value != buffers[i];
+		}
+
+		for (auto& target : m_BufferRanges)
+		{
+			for (Cached<BufferRange>& binding : target)
+			{
+				binding.known = binding.known && binding.value.buffer != buffers[i];
+			}
+		}
+	}
+
+	glDeleteBuffers(count, buffers);
+}
+
+void GLState::Invalidate()
+{
+	m_Program.known = false;
+	m_VertexArray.known = false;
+	for (Cached<GLuint>& binding : m_Buffers)
+	{
+		binding.known = false;
+	}
+	for (auto& target : m_BufferRanges)
+	{
+		for (Cached<BufferRange>& binding : target)
+		{
+			binding.known = false;
+		}
+	}
+	m_PolygonMode.known = false;
+	m_PointSize.known = false;
+	for (Cached<bool>& capability : m_Capabilities)
+	{
+		capability.known = false;
+	}
+	m_DepthMask.known = false;
+	m_BlendFunc.known = false;
+}
+
+void GLState::EndFrame()
+{
+	m_MaxFrameIssued = std::max(m_MaxFrameIssued, m_FrameIssued);
+	m_FrameIssued = 0;
+	m_FrameElided = 0;
+	m_Frames++;
+}
+
+void GLState::LogStats() const
+{
+	if (m_Frames == 0)
+	{
+		return;
+	}
+
+	uint64_t issued = 0;
+	uint64_t elided = 0;
+	for (uint32_t i = 0; i < (uint32_t)Call::Count; i++)
+	{
+		issued += m_Issued[i];
+		elided += m_Elided[i];
+	}
+
+	const double frames = (double)m_Frames;
+	LOG_INFO("GL state: %.1f calls per frame issued, %.1f elided (%.1f%%), %llu issued at most in %llu frames",
+		issued / frames, elided / frames, issued + elided > 0 ? 100.0 * elided / (issued + elided) : 0.0,
+		(unsigned long long)m_MaxFrameIssued, (unsigned long long)m_Frames)
+
+	for (uint32_t i = 0; i < (uint32_t)Call::Count; i++)
+	{
+		if (m_Issued[i] + m_Elided[i] > 0)
+		{
+			LOG_INFO("  %-24s %8.1f issued, %8.1f elided per frame", GetCallName((Call)i), m_Issued[i] / frames, m_Elided[i] / frames)
+		}
+	}
+}
+
+uint32_t GLState::GetBufferTarget(GLenum target)
+{
+	switch (target)
+	{
+	case GL_DRAW_INDIRECT_BUFFER: return 0;
+	case GL_PARAMETER_BUFFER: return 1;
+	case GL_PIXEL_PACK_BUFFER: return 2;
+	default:
+		assert(false && "Buffer target isn't tracked");
+		return 0;
+	}
+}
+
+uint32_t GLState::GetIndexedTarget(GLenum target)
+{
+	assert((target == GL_UNIFORM_BUFFER || target == GL_SHADER_STORAGE_BUFFER) && "Indexed target isn't tracked");
+	return target == GL_UNIFORM_BUFFER ? 0 : 1;
+}
+
+uint32_t GLState::GetCapability(GLenum capability)
+{
+	switch (capability)
+	{
+	case GL_DEPTH_TEST: return DepthTest;
+	case GL_BLEND: return Blend;
+	case GL_CULL_FACE: return CullFace;
+	default:
+		assert(false && "Capability isn't tracked");
+		return DepthTest;
+	}
+}
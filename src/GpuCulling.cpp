@@ -0,0 +1,472 @@
+#include "GpuCulling.h"
+#include "GLState.h"
+#include "ShaderLibrary.h"
+
+GpuCulling::GpuCulling(GeometryManager& geometryManager, ShaderLibrary& shaderLibrary)
+	: m_GeometryManager(geometryManager)
+	, m_CullPrograms{0,0,0}
+	, m_InstanceCount(0)
+	, m_GeometryCount(0)
+	, m_InstanceCapacity(0)
+	, m_GeometryCapacity(0)
+	, m_Constants{}
+	, m_ConstantBuffer(0)
+	, m_InstanceBuffer(0)
+	, m_GeometryBuffer(0)
+	, m_RankBuffer(0)
+	, m_BlockBuffer(0)
+	, m_VisibleBuffer(0)
+	, m_CommandBuffer(0)
+	, m_VertexArray(0)
+	, m_EmptyVertexArray(0)
+	, m_StorageBufferAlignment(256)
+	, m_UseIndirectCount(false)
+	, m_TimerQueries{}
+	, m_TimerQueriesIssued(0)
+	, m_TimerQueriesRead(0)
+{
+	// One program per pass, compiled right away since the first Cull needs all of them
+	shaderLibrary.Declare("gpuCull", { "assets/shaders/gpuCull.cs" });
+	for (uint32_t pass = 0; pass < 3; pass++)
+	{
+		const ShaderDefines defines = {
+			{ "CULL_PASS", std::to_string(pass + 1) },
+			{ "GROUP_SIZE", std::to_string(GPU_CULL_GROUP_SIZE) },
+		};
+		m_CullPrograms[pass] = shaderLibrary.GetVariant(ShaderVariant("gpuCull"_sid, defines));
+	}
+
+	glCreateBuffers(1, &m_ConstantBuffer);
+	glNamedBufferStorage(m_ConstantBuffer, sizeof(CullConstants), nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+	// Same attribute layout as the Renderer's, the matrices come from the compacted visible instances
+	glCreateVertexArrays(1, &m_VertexArray);
+	glEnableVertexArrayAttrib(m_VertexArray, 0);
+	glVertexArrayVertexBuffer(m_VertexArray, 0, m_GeometryManager.GetVertexBufferID(), 0, sizeof(float) * 3);
+	glVertexArrayAttribFormat(m_VertexArray, 0, 3, GL_FLOAT, GL_FALSE, 0);
+	glVertexArrayElementBuffer(m_VertexArray, m_GeometryManager.GetElementBufferID());
+
+	for (GLuint attribute = 1; attribute <= 4; attribute++)
+	{
+		glEnableVertexArrayAttrib(m_VertexArray, attribute);
+		glVertexArrayAttribBinding(m_VertexArray, attribute, 1);
+		glVertexArrayAttribFormat(m_VertexArray, attribute, 4, GL_FLOAT, GL_FALSE, (attribute - 1) * 16);
+	}
+	glVertexArrayBindingDivisor(m_VertexArray, 1, 1);
+
+	glCreateVertexArrays(1, &m_EmptyVertexArray);
+
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &m_StorageBufferAlignment);
+	m_UseIndirectCount = GLEW_VERSION_4_6 || GLEW_ARB_indirect_parameters;
+
+	glCreateQueries(GL_TIME_ELAPSED, TIMER_QUERY_COUNT, m_TimerQueries);
+}
+
+GpuCulling::~GpuCulling()
+{
+	const GLuint buffers[] = { m_ConstantBuffer, m_InstanceBuffer, m_GeometryBuffer, m_RankBuffer, m_BlockBuffer, m_VisibleBuffer, m_CommandBuffer };
+	GLState::Get().DeleteBuffers(sizeof(buffers) / sizeof(GLuint), buffers);
+
+	glDeleteVertexArrays(1, &m_VertexArray);
+	glDeleteVertexArrays(1, &m_EmptyVertexArray);
+	glDeleteQueries(TIMER_QUERY_COUNT, m_TimerQueries);
+}
+
+void GpuCulling::SetInstances(const std::vector<Renderable>& renderables)
+{
+	// Every geometry's instances next to each other, in submission order
+	std::vector<uint32_t> order(renderables.size());
+	for (uint32_t i = 0; i < (uint32_t)order.size(); i++)
+	{
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return renderables[a].geoID < renderables[b].geoID; });
+
+	m_Instances.resize(renderables.size());
+	m_Geometry.clear();
+
+	GeoID lastGeoID = 0;
+	for (uint32_t i = 0; i < (uint32_t)order.size(); i++)
+	{
+		const Renderable& renderable = renderables[order[i]];
+		if (renderable.geoID != lastGeoID)
+		{
+			const Geometry& geometry = m_GeometryManager.GetGeometry(renderable.geoID);
+			assert(geometry.resident && "GpuCulling doesn't go through the residency manager");
+
+			CullGeometryData geometryData{};
+			geometryData.bounds = glm::vec4(geometry.boundsCenter, geometry.boundsRadius);
+			geometryData.firstInstance = i;
+			geometryData.elementCount = geometry.elementCount;
+			geometryData.firstIndex = geometry.firstIndex;
+			geometryData.baseVertex = geometry.baseVertex;
+			m_Geometry.push_back(geometryData);
+
+			lastGeoID = renderable.geoID;
+		}
+
+		m_Geometry.back().instanceCount++;
+
+		CullInstanceData& instance = m_Instances[i];
+		instance = {};
+		instance.modelTransform = renderable.modelTransform;
+		instance.geometry = (uint32_t)m_Geometry.size() - 1;
+	}
+
+	m_InstanceCount = (uint32_t)m_Instances.size();
+	m_GeometryCount = (uint32_t)m_Geometry.size();
+	ReserveBuffers(m_InstanceCount, m_GeometryCount);
+
+	if (m_InstanceCount > 0)
+	{
+		glNamedBufferSubData(m_InstanceBuffer, 0, m_InstanceCount * sizeof(CullInstanceData), m_Instances.data());
+		glNamedBufferSubData(m_GeometryBuffer, 0, m_GeometryCount * sizeof(CullGeometryData), m_Geometry.data());
+	}
+
+	m_Stats.instanceCount = m_InstanceCount;
+	m_Stats.geometryCount = m_GeometryCount;
+
+	LOG_INFO("GPU culling holds %u instances of %u geometries, %.2f MB", m_InstanceCount, m_GeometryCount,
+		(m_InstanceCount * (sizeof(CullInstanceData) + sizeof(glm::mat4) + sizeof(GLuint)) + m_GeometryCount * sizeof(CullGeometryData)) / (1024.0 * 1024.0))
+}
+
+void GpuCulling::Cull(const glm::mat4& viewProjection)
+{
+	if (m_InstanceCount == 0)
+	{
+		return;
+	}
+
+	Renderer::ExtractFrustumPlanes(viewProjection, m_Constants.frustumPlanes);
+	m_Constants.instanceCount = m_InstanceCount;
+	m_Constants.geometryCount = m_GeometryCount;
+	m_Constants.blockCount = (m_InstanceCount + GPU_CULL_GROUP_SIZE - 1) / GPU_CULL_GROUP_SIZE;
+	glNamedBufferSubData(m_ConstantBuffer, 0, sizeof(CullConstants), &m_Constants);
+
+	ReadTimerQueries();
+	glBeginQuery(GL_TIME_ELAPSED, m_TimerQueries[m_TimerQueriesIssued % TIMER_QUERY_COUNT]);
+
+	BindCullBuffers();
+
+	GLState& state = GLState::Get();
+	state.UseProgram(m_CullPrograms[0]);
+	glDispatchCompute(m_Constants.blockCount, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	state.UseProgram(m_CullPrograms[1]);
+	glDispatchCompute(1, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	state.UseProgram(m_CullPrograms[2]);
+	glDispatchCompute(m_Constants.blockCount, 1, 1);
+
+	// The draws read the commands, the draw count and the matrices as attributes or storage buffers
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+	glEndQuery(GL_TIME_ELAPSED);
+	m_TimerQueriesIssued++;
+}
+
+void GpuCulling::Draw(DrawPath drawPath, GLenum mode)
+{
+	if (m_InstanceCount == 0)
+	{
+		return;
+	}
+
+	const CommandLayout layout = GetCommandLayout(m_GeometryCapacity);
+	const GLintptr drawCountOffset = offsetof(BlockHeader, drawCount);
+
+	if (drawPath == DrawPath::VertexPulling)
+	{
+		BindPullBuffers();
+
+		if (m_UseIndirectCount)
+		{
+			MultiDrawArraysIndirectCount(mode, (const void*)layout.pullCommands, drawCountOffset, m_GeometryCount);
+		}
+		else
+		{
+			glMultiDrawArraysIndirect(mode, (const void*)layout.pullCommands, m_GeometryCount, 0);
+		}
+	}
+	else
+	{
+		GLState& state = GLState::Get();
+		state.BindBuffer(GL_DRAW_INDIRECT_BUFFER, m_CommandBuffer);
+		if (m_UseIndirectCount)
+		{
+			state.BindBuffer(GL_PARAMETER_BUFFER, m_BlockBuffer);
+		}
+		state.BindVertexArray(m_VertexArray);
+
+		if (m_UseIndirectCount)
+		{
+			MultiDrawElementsIndirectCount(mode, GL_UNSIGNED_INT, (const void*)layout.drawCommands, drawCountOffset, m_GeometryCount);
+		}
+		else
+		{
+			glMultiDrawElementsIndirect(mode, GL_UNSIGNED_INT, (const void*)layout.drawCommands, m_GeometryCount, 0);
+		}
+	}
+}
+
+void GpuCulling::DrawPointQuads(DrawPath drawPath)
+{
+	if (drawPath == DrawPath::VertexAttributes)
+	{
+		Draw(drawPath, GL_POINTS);
+		return;
+	}
+
+	if (m_InstanceCount == 0)
+	{
+		return;
+	}
+
+	BindPullBuffers();
+
+	// The quad commands follow the line commands
+	const CommandLayout layout = GetCommandLayout(m_GeometryCapacity);
+	const GLintptr commandOffset = layout.pullCommands + m_GeometryCount * sizeof(DrawArraysCommand);
+	const GLintptr drawCountOffset = offsetof(BlockHeader, drawCount);
+
+	if (m_UseIndirectCount)
+	{
+		MultiDrawArraysIndirectCount(GL_TRIANGLE_STRIP, (const void*)commandOffset, drawCountOffset, m_GeometryCount);
+	}
+	else
+	{
+		glMultiDrawArraysIndirect(GL_TRIANGLE_STRIP, (const void*)commandOffset, m_GeometryCount, 0);
+	}
+}
+
+bool GpuCulling::CheckAgainstCpu()
+{
+	if (m_InstanceCount == 0)
+	{
+		return true;
+	}
+
+	// glGetNamedBufferSubData waits for the passes
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	BlockHeader header{};
+	glGetNamedBufferSubData(m_BlockBuffer, 0, sizeof(BlockHeader), &header);
+
+	const CommandLayout layout = GetCommandLayout(m_GeometryCapacity);
+	std::vector<DrawCommand> commands(m_GeometryCount);
+	glGetNamedBufferSubData(m_CommandBuffer, layout.drawCommands, m_GeometryCount * sizeof(DrawCommand), commands.data());
+
+	std::vector<glm::mat4> visible(std::min(header.visibleCount, m_InstanceCount));
+	if (!visible.empty())
+	{
+		glGetNamedBufferSubData(m_VisibleBuffer, 0, visible.size() * sizeof(glm::mat4), visible.data());
+	}
+
+	// Same test as gpuCull.cs, in the same order
+	std::vector<DrawCommand> expectedCommands;
+	std::vector<glm::mat4> expectedVisible;
+	uint32_t uncertain = 0;
+
+	for (const CullGeometryData& geometry : m_Geometry)
+	{
+		const uint32_t firstVisible = (uint32_t)expectedVisible.size();
+		for (uint32_t i = geometry.firstInstance; i < geometry.firstInstance + geometry.instanceCount; i++)
+		{
+			const glm::mat4& model = m_Instances[i].modelTransform;
+			const glm::vec3 center = glm::vec3(model * glm::vec4(glm::vec3(geometry.bounds), 1.f));
+			const float scale = std::max({
+				glm::length(glm::vec3(model[0])),
+				glm::length(glm::vec3(model[1])),
+				glm::length(glm::vec3(model[2]))
+			});
+			const float radius = geometry.bounds.w * scale;
+
+			bool isVisible = true;
+			for (const glm::vec4& plane : m_Constants.frustumPlanes)
+			{
+				const float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+				const float tolerance = 1e-4f * std::max(1.f, std::abs(distance) + radius);
+				uncertain += std::abs(distance + radius) < tolerance ? 1 : 0;
+				isVisible = isVisible && distance > -radius;
+			}
+
+			if (isVisible)
+			{
+				expectedVisible.push_back(model);
+			}
+		}
+
+		const uint32_t count = (uint32_t)expectedVisible.size() - firstVisible;
+		if (count > 0)
+		{
+			expectedCommands.push_back({ geometry.elementCount, count, geometry.firstIndex, geometry.baseVertex, firstVisible });
+		}
+	}
+
+	auto difference = [](uint32_t a, size_t b) { return a > b ? a - b : b - a; };
+
+	bool matches = difference(header.drawCount, expectedCommands.size()) <= uncertain
+		&& difference(header.visibleCount, expectedVisible.size()) <= uncertain;
+
+	if (matches && uncertain == 0)
+	{
+		for (uint32_t c = 0; c < m_GeometryCount && matches; c++)
+		{
+			const DrawCommand& command = commands[c];
+			if (c >= expectedCommands.size())
+			{
+				// Drawn without a draw count, so they have to draw nothing
+				matches = command.instanceCount == 0;
+				continue;
+			}
+
+			const DrawCommand& expected = expectedCommands[c];
+			matches = command.elementCount == expected.elementCount && command.instanceCount == expected.instanceCount
+				&& command.firstIndex == expected.firstIndex && command.baseVertex == expected.baseVertex
+				&& command.baseInstance == expected.baseInstance;
+		}
+
+		for (size_t i = 0; i < visible.size() && matches; i++)
+		{
+			matches = visible[i] == expectedVisible[i];
+		}
+	}
+
+	m_Stats.checkedFrames++;
+	m_Stats.visibleInstancesChecked += header.visibleCount;
+	if (!matches)
+	{
+		m_Stats.mismatchedFrames++;
+		LOG_ERROR("GPU culling doesn't match the CPU: %u draws, %u visible instances, expected %zu draws, %zu visible instances (%u uncertain)",
+			header.drawCount, header.visibleCount, expectedCommands.size(), expectedVisible.size(), uncertain)
+	}
+
+	return matches;
+}
+
+void GpuCulling::LogStats() const
+{
+	if (m_Stats.culledFrames == 0)
+	{
+		LOG_INFO("GPU culling: %u instances of %u geometries, no frames timed", m_Stats.instanceCount, m_Stats.geometryCount)
+	}
+	else
+	{
+		LOG_INFO("GPU culling: %u instances of %u geometries, %.3f ms mean, %.3f ms max on the GPU over %llu frames",
+			m_Stats.instanceCount, m_Stats.geometryCount, m_Stats.gpuSecondsSum / m_Stats.culledFrames * 1000.0,
+			m_Stats.gpuSecondsMax * 1000.0, (unsigned long long)m_Stats.culledFrames)
+	}
+
+	if (m_Stats.checkedFrames > 0)
+	{
+		LOG_INFO("GPU culling check: %llu frames against the CPU, %.1f visible instances/frame, %llu mismatched",
+			(unsigned long long)m_Stats.checkedFrames, (double)m_Stats.visibleInstancesChecked / m_Stats.checkedFrames,
+			(unsigned long long)m_Stats.mismatchedFrames)
+	}
+}
+
+GpuCulling::CommandLayout GpuCulling::GetCommandLayout(uint32_t geometryCount) const
+{
+	const GLintptr alignment = m_StorageBufferAlignment;
+	auto align = [alignment](GLintptr offset) { return (offset + alignment - 1) / alignment * alignment; };
+
+	CommandLayout layout;
+	layout.drawCommands = 0;
+	layout.pullCommands = align(layout.drawCommands + geometryCount * sizeof(DrawCommand));
+	layout.pullDrawParams = align(layout.pullCommands + 2 * geometryCount * sizeof(DrawArraysCommand));
+	layout.size = align(layout.pullDrawParams + geometryCount * sizeof(PullDrawParams));
+	return layout;
+}
+
+void GpuCulling::ReserveBuffers(uint32_t instanceCount, uint32_t geometryCount)
+{
+	if (instanceCount > m_InstanceCapacity)
+	{
+		m_InstanceCapacity = std::max(instanceCount, m_InstanceCapacity * 2);
+		const uint32_t blockCapacity = (m_InstanceCapacity + GPU_CULL_GROUP_SIZE - 1) / GPU_CULL_GROUP_SIZE;
+
+		const GLuint buffers[] = { m_InstanceBuffer, m_RankBuffer, m_BlockBuffer, m_VisibleBuffer };
+		GLState::Get().DeleteBuffers(sizeof(buffers) / sizeof(GLuint), buffers);
+
+		// Only the instances come from the CPU, everything else is written by the passes
+		glCreateBuffers(1, &m_InstanceBuffer);
+		glNamedBufferStorage(m_InstanceBuffer, m_InstanceCapacity * sizeof(CullInstanceData), nullptr, GL_DYNAMIC_STORAGE_BIT);
+		glCreateBuffers(1, &m_RankBuffer);
+		glNamedBufferStorage(m_RankBuffer, m_InstanceCapacity * sizeof(GLuint), nullptr, 0);
+		glCreateBuffers(1, &m_BlockBuffer);
+		glNamedBufferStorage(m_BlockBuffer, sizeof(BlockHeader) + blockCapacity * sizeof(GLuint), nullptr, 0);
+		glCreateBuffers(1, &m_VisibleBuffer);
+		glNamedBufferStorage(m_VisibleBuffer, m_InstanceCapacity * sizeof(glm::mat4), nullptr, 0);
+
+		glVertexArrayVertexBuffer(m_VertexArray, 1, m_VisibleBuffer, 0, sizeof(glm::mat4));
+	}
+
+	if (geometryCount > m_GeometryCapacity)
+	{
+		m_GeometryCapacity = std::max(geometryCount, m_GeometryCapacity * 2);
+
+		const GLuint buffers[] = { m_GeometryBuffer, m_CommandBuffer };
+		GLState::Get().DeleteBuffers(sizeof(buffers) / sizeof(GLuint), buffers);
+
+		glCreateBuffers(1, &m_GeometryBuffer);
+		glNamedBufferStorage(m_GeometryBuffer, m_GeometryCapacity * sizeof(CullGeometryData), nullptr, GL_DYNAMIC_STORAGE_BIT);
+		glCreateBuffers(1, &m_CommandBuffer);
+		glNamedBufferStorage(m_CommandBuffer, GetCommandLayout(m_GeometryCapacity).size, nullptr, 0);
+	}
+}
+
+void GpuCulling::BindCullBuffers()
+{
+	const CommandLayout layout = GetCommandLayout(m_GeometryCapacity);
+
+	GLState& state = GLState::Get();
+	state.BindBufferBase(GL_UNIFORM_BUFFER, CULL_CONSTANTS_BINDING, m_ConstantBuffer);
+	state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_INSTANCES_BINDING, m_InstanceBuffer);
+	state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_GEOMETRY_BINDING, m_GeometryBuffer);
+	state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_RANKS_BINDING, m_RankBuffer);
+	state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_BLOCKS_BINDING, m_BlockBuffer);
+	state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_VISIBLE_BINDING, m_VisibleBuffer);
+	state.BindBufferRange(GL_SHADER_STORAGE_BUFFER, CULL_COMMANDS_BINDING, m_CommandBuffer,
+		layout.drawCommands, m_GeometryCapacity * sizeof(DrawCommand));
+	state.BindBufferRange(GL_SHADER_STORAGE_BUFFER, CULL_PULL_COMMANDS_BINDING, m_CommandBuffer,
+		layout.pullCommands, 2 * m_GeometryCapacity * sizeof(DrawArraysCommand));
+	state.BindBufferRange(GL_SHADER_STORAGE_BUFFER, CULL_PULL_DRAW_PARAMS_BINDING, m_CommandBuffer,
+		layout.pullDrawParams, m_GeometryCapacity * sizeof(PullDrawParams));
+}
+
+void GpuCulling::BindPullBuffers()
+{
+	const CommandLayout layout = GetCommandLayout(m_GeometryCapacity);
+
+	GLState& state = GLState::Get();
+	state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, PULL_POSITIONS_BINDING, m_GeometryManager.GetVertexBufferID());
+	state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, PULL_INDICES_BINDING, m_GeometryManager.GetElementBufferID());
+	state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, PULL_INSTANCES_BINDING, m_VisibleBuffer);
+	state.BindBufferRange(GL_SHADER_STORAGE_BUFFER, PULL_DRAW_PARAMS_BINDING, m_CommandBuffer,
+		layout.pullDrawParams, m_GeometryCapacity * sizeof(PullDrawParams));
+
+	state.BindBuffer(GL_DRAW_INDIRECT_BUFFER, m_CommandBuffer);
+	if (m_UseIndirectCount)
+	{
+		state.BindBuffer(GL_PARAMETER_BUFFER, m_BlockBuffer);
+	}
+	state.BindVertexArray(m_EmptyVertexArray);
+}
+
+void GpuCulling::ReadTimerQueries()
+{
+	// The query Cull is about to reuse was issued TIMER_QUERY_COUNT frames ago
+	while (m_TimerQueriesRead + TIMER_QUERY_COUNT <= m_TimerQueriesIssued)
+	{
+		GLuint64 nanoseconds = 0;
+		glGetQueryObjectui64v(m_TimerQueries[m_TimerQueriesRead % TIMER_QUERY_COUNT], GL_QUERY_RESULT, &nanoseconds);
+		m_TimerQueriesRead++;
+
+		const double seconds = nanoseconds / 1e9;
+		m_Stats.culledFrames++;
+		m_Stats.gpuSecondsSum += seconds;
+		m_Stats.gpuSecondsMax = std::max(m_Stats.gpuSecondsMax, seconds);
+	}
+}
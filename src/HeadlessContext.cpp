@@ -0,0 +1,169 @@
+#include "HeadlessContext.h"
+
+#define MIN_HEADLESS_MINOR_VERSION 5 // Mesa llvmpipe only exposes 4.5 on older releases
+
+HeadlessContext::~HeadlessContext()
+{
+	Destroy();
+}
+
+#ifdef GL2_USE_OSMESA
+
+bool HeadlessContext::Create(int majorVersion, int minorVersion)
+{
+	for (int minor = minorVersion; minor >= MIN_HEADLESS_MINOR_VERSION && !m_Context; minor--)
+	{
+		const int attributes[] = {
+			OSMESA_FORMAT, OSMESA_RGBA,
+			OSMESA_DEPTH_BITS, 24,
+			OSMESA_PROFILE, OSMESA_CORE_PROFILE,
+			OSMESA_CONTEXT_MAJOR_VERSION, majorVersion,
+			OSMESA_CONTEXT_MINOR_VERSION, minor,
+			0
+		};
+
+		m_Context = OSMesaCreateContextAttribs(attributes, nullptr);
+		m_MajorVersion = majorVersion;
+		m_MinorVersion = minor;
+	}
+
+	if (!m_Context)
+	{
+		LOG_ERROR("Couldn't create OSMesa context")
+		return false;
+	}
+
+	m_DummyBuffer.resize(4);
+	if (!OSMesaMakeCurrent(m_Context, m_DummyBuffer.data(), GL_UNSIGNED_BYTE, 1, 1))
+	{
+		LOG_ERROR("Couldn't make OSMesa context current")
+		Destroy();
+		return false;
+	}
+
+	LOG_INFO("Created OSMesa context %d.%d", m_MajorVersion, m_MinorVersion)
+	return true;
+}
+
+void HeadlessContext::Destroy()
+{
+	if (m_Context)
+	{
+		OSMesaDestroyContext(m_Context);
+		m_Context = nullptr;
+	}
+}
+
+#else
+
+bool HeadlessContext::Create(int majorVersion, int minorVersion)
+{
+	// Surfaceless platform first, it needs neither X11 nor a DRM device
+	const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+	if (getPlatformDisplay && clientExtensions && strstr(clientExtensions, "EGL_MESA_platform_surfaceless"))
+	{
+		m_Display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	}
+
+	if (m_Display == EGL_NO_DISPLAY)
+	{
+		m_Display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+
+	EGLint eglMajor, eglMinor;
+	if (m_Display == EGL_NO_DISPLAY || !eglInitialize(m_Display, &eglMajor, &eglMinor))
+	{
+		LOG_ERROR("Couldn't initialize EGL display (0x%x)", eglGetError())
+		return false;
+	}
+
+	const char* displayExtensions = eglQueryString(m_Display, EGL_EXTENSIONS);
+	if (!displayExtensions || !strstr(displayExtensions, "EGL_KHR_surfaceless_context"))
+	{
+		LOG_ERROR("EGL display doesn't support EGL_KHR_surfaceless_context")
+		Destroy();
+		return false;
+	}
+
+	if (!eglBindAPI(EGL_OPENGL_API))
+	{
+		LOG_ERROR("EGL display doesn't support desktop OpenGL")
+		Destroy();
+		return false;
+	}
+
+	const EGLint configAttributes[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+
+	EGLConfig config = nullptr;
+	EGLint configCount = 0;
+	eglChooseConfig(m_Display, configAttributes, &config, 1, &configCount);
+
+	// Without a matching config fall back to EGL_KHR_no_config_context
+	if (configCount == 0)
+	{
+		config = EGL_NO_CONFIG_KHR;
+	}
+
+	for (int minor = minorVersion; minor >= MIN_HEADLESS_MINOR_VERSION && m_Context == EGL_NO_CONTEXT; minor--)
+	{
+		const EGLint contextAttributes[] = {
+			EGL_CONTEXT_MAJOR_VERSION, majorVersion,
+			EGL_CONTEXT_MINOR_VERSION, minor,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE
+		};
+
+		m_Context = eglCreateContext(m_Display, config, EGL_NO_CONTEXT, contextAttributes);
+		m_MajorVersion = majorVersion;
+		m_MinorVersion = minor;
+	}
+
+	if (m_Context == EGL_NO_CONTEXT)
+	{
+		LOG_ERROR("Couldn't create EGL context (0x%x)", eglGetError())
+		Destroy();
+		return false;
+	}
+
+	if (!eglMakeCurrent(m_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_Context))
+	{
+		LOG_ERROR("Couldn't make EGL context current (0x%x)", eglGetError())
+		Destroy();
+		return false;
+	}
+
+	if (m_MinorVersion != minorVersion)
+	{
+		LOG_WARN("Requested OpenGL %d.%d, got %d.%d", majorVersion, minorVersion, m_MajorVersion, m_MinorVersion)
+	}
+
+	LOG_INFO("Created surfaceless EGL %d.%d context with OpenGL %d.%d", eglMajor, eglMinor, m_MajorVersion, m_MinorVersion)
+	return true;
+}
+
+void HeadlessContext::Destroy()
+{
+	if (m_Display == EGL_NO_DISPLAY)
+	{
+		return;
+	}
+
+	eglMakeCurrent(m_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+	if (m_Context != EGL_NO_CONTEXT)
+	{
+		eglDestroyContext(m_Display, m_Context);
+		m_Context = EGL_NO_CONTEXT;
+	}
+
+	eglTerminate(m_Display);
+	m_Display = EGL_NO_DISPLAY;
+}
+
+#endif
@@ -0,0 +1,280 @@
+#include "JobSystem.h"
+
+namespace
+{
+	// Which queue the current thread owns, workers of other pools count as external threads
+	thread_local const JobSystem* t_Owner = nullptr;
+	thread_local uint32_t t_QueueIndex = 0;
+
+	// Jobs that Wait inside another job run nested, only the outermost one counts as busy time
+	thread_local uint32_t t_Depth = 0;
+}
+
+JobSystem::JobSystem(uint32_t workerCount)
+	: m_QueuedJobs(0)
+	, m_Quit(false)
+	, m_JobCount(0)
+	, m_StealCount(0)
+	, m_StatsStart(std::chrono::steady_clock::now())
+{
+	if (workerCount == 0)
+	{
+		workerCount = std::max(1u, std::thread::hardware_concurrency()) - 1;
+	}
+
+	m_BusyTime = std::make_unique<std::atomic<uint64_t>[]>(workerCount + 1);
+	for (uint32_t i = 0; i <= workerCount; i++)
+	{
+		m_Queues.push_back(std::make_unique<Queue>());
+		m_BusyTime[i] = 0;
+	}
+
+	m_Workers.reserve(workerCount);
+	for (uint32_t i = 0; i < workerCount; i++)
+	{
+		m_Workers.emplace_back(&JobSystem::WorkerLoop, this, i + 1);
+	}
+
+	LOG_INFO("Job system started with %u workers", workerCount)
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_WakeMutex);
+		m_Quit = true;
+	}
+	m_WakeCondition.notify_all();
+
+	for (auto& worker : m_Workers)
+	{
+		worker.join();
+	}
+}
+
+JobSystem& JobSystem::Get()
+{
+	static JobSystem jobSystem;
+	return jobSystem;
+}
+
+void JobSystem::Run(JobCounter& counter, std::function<void()> job)
+{
+	counter.m_Pending.fetch_add(1, std::memory_order_relaxed);
+
+	Queue& queue = *m_Queues[GetCallerQueue()];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.PushBack({ std::move(job), &counter });
+	}
+	m_QueuedJobs.fetch_add(1, std::memory_order_release);
+
+	// Taking the mutex orders this with a worker that just found nothing and is about to sleep
+	{
+		std::lock_guard<std::mutex> lock(m_WakeMutex);
+	}
+	m_WakeCondition.notify_one();
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+	while (!counter.IsDone())
+	{
+		if (!RunPendingJob())
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+void JobSystem::ParallelForChunks(uint32_t count, uint32_t grainSize, const std::function<void(uint32_t begin, uint32_t end)>& job)
+{
+	grainSize = std::max(1u, grainSize);
+
+	// A few chunks per thread so stealing can even out uneven ranges
+	const uint32_t chunkSize = std::max(grainSize, count / (GetThreadCount() * 4) + 1);
+	if (count <= chunkSize)
+	{
+		if (count > 0)
+		{
+			job(0, count);
+		}
+		return;
+	}
+
+	JobCounter counter;
+	for (uint32_t begin = chunkSize; begin < count; begin += chunkSize)
+	{
+		const uint32_t end = std::min(begin + chunkSize, count);
+		Run(counter, [&job, begin, end]() { job(begin, end); });
+	}
+
+	// The calling thread takes the first chunk instead of idling
+	job(0, chunkSize);
+	Wait(counter);
+}
+
+bool JobSystem::RunPendingJob()
+{
+	const uint32_t queueIndex = GetCallerQueue();
+
+	Job job;
+	if (!FindJob(queueIndex, job))
+	{
+		return false;
+	}
+
+	Execute(job, queueIndex);
+	return true;
+}
+
+JobSystemStats JobSystem::GetStats() const
+{
+	JobSystemStats stats;
+	stats.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_StatsStart).count();
+	stats.threadCount = GetThreadCount();
+	stats.jobs = m_JobCount;
+	stats.steals = m_StealCount;
+
+	for (uint32_t i = 0; i < m_Queues.size(); i++)
+	{
+		stats.busySeconds += m_BusyTime[i] * 1e-9;
+	}
+
+	return stats;
+}
+
+void JobSystem::ResetStats()
+{
+	for (uint32_t i = 0; i < m_Queues.size(); i++)
+	{
+		m_BusyTime[i] = 0;
+	}
+	m_JobCount = 0;
+	m_StealCount = 0;
+	m_StatsStart = std::chrono::steady_clock::now();
+}
+
+void JobSystem::LogStats() const
+{
+	const JobSystemStats stats = GetStats();
+	LOG_INFO("Jobs: %llu executed, %llu stolen, %u threads %.1f%% utilized (%.3f of %.3f thread seconds busy)",
+		(unsigned long long)stats.jobs, (unsigned long long)stats.steals, stats.threadCount, stats.GetUtilization() * 100.0,
+		stats.busySeconds, stats.wallSeconds * stats.threadCount)
+}
+
+void JobSystem::WorkerLoop(uint32_t queueIndex)
+{
+	t_Owner = this;
+	t_QueueIndex = queueIndex;
+
+	while (true)
+	{
+		Job job;
+		if (FindJob(queueIndex, job))
+		{
+			Execute(job, queueIndex);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_WakeMutex);
+		m_WakeCondition.wait(lock, [this]() { return m_Quit || m_QueuedJobs.load(std::memory_order_acquire) > 0; });
+		if (m_Quit)
+		{
+			return;
+		}
+	}
+}
+
+bool JobSystem::FindJob(uint32_t queueIndex, Job& job)
+{
+	if (m_QueuedJobs.load(std::memory_order_acquire) == 0)
+	{
+		return false;
+	}
+
+	// Newest first from the own queue, it is most likely still in cache
+	{
+		Queue& queue = *m_Queues[queueIndex];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.count > 0)
+		{
+			queue.PopBack(job);
+			m_QueuedJobs.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+
+	// Oldest first from everyone else
+	const uint32_t queueCount = (uint32_t)m_Queues.size();
+	for (uint32_t i = 1; i < queueCount; i++)
+	{
+		Queue& queue = *m_Queues[(queueIndex + i) % queueCount];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.count > 0)
+		{
+			queue.PopFront(job);
+			m_QueuedJobs.fetch_sub(1, std::memory_order_relaxed);
+			m_StealCount.fetch_add(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void JobSystem::Execute(Job& job, uint32_t queueIndex)
+{
+	const auto start = std::chrono::steady_clock::now();
+	t_Depth++;
+	job.function();
+	t_Depth--;
+
+	if (t_Depth == 0)
+	{
+		const auto end = std::chrono::steady_clock::now();
+		m_BusyTime[queueIndex].fetch_add((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(), std::memory_order_relaxed);
+	}
+	m_JobCount.fetch_add(1, std::memory_order_relaxed);
+
+	job.counter->m_Pending.fetch_sub(1, std::memory_order_release);
+}
+
+uint32_t JobSystem::GetCallerQueue() const
+{
+	return t_Owner == this ? t_QueueIndex : 0;
+}
+
+void JobSystem::Queue::PushBack(Job&& job)
+{
+	if (count == jobs.size())
+	{
+		// Unroll into a bigger ring, the oldest job lands at the front
+		std::vector<Job> grown(std::max<size_t>(64, jobs.size() * 2));
+		for (size_t i = 0; i < count; i++)
+		{
+			grown[i] = std::move(jobs[(head + i) % jobs.size()]);
+		}
+
+		jobs.swap(grown);
+		head = 0;
+	}
+
+	jobs[(head + count) % jobs.size()] = std::move(job);
+	count++;
+}
+
+void JobSystem::Queue::PopBack(Job& job)
+{
+	assert(count > 0);
+	count--;
+	job = std::move(jobs[(head + count) % jobs.size()]);
+}
+
+void JobSystem::Queue::PopFront(Job& job)
+{
+	assert(count > 0);
+	job = std::move(jobs[head]);
+	head = (head + 1) % jobs.size();
+	count--;
+}
@@ -0,0 +1,541 @@
+#include "MeshCodec.h"
+
+#if !defined(GL2_MESH_CODEC_SCALAR) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define MESH_CODEC_SSE2
+#include <emmintrin.h>
+#elif !defined(GL2_MESH_CODEC_SCALAR) && (defined(__ARM_NEON) || defined(_M_ARM64))
+#define MESH_CODEC_NEON
+#include <arm_neon.h>
+#endif
+
+#define MESH_CODEC_VERTEX_VERSION 0xa1
+#define MESH_CODEC_INDEX_VERSION 0xb1
+
+// Bytes per group and its 2 bit header code: all zero, 2, 4 or 8 bits per byte
+#define MESH_CODEC_GROUP_SIZE 16
+
+// Index codes: FIFO positions below MESH_CODEC_INDEX_FIFO_HITS, then the next unseen vertex and
+// an explicit delta
+#define MESH_CODEC_INDEX_FIFO_HITS 14
+#define MESH_CODEC_INDEX_NEXT 14
+#define MESH_CODEC_INDEX_EXPLICIT 15
+
+namespace
+{
+	const uint32_t GROUP_BYTES[4] = { 0, 4, 8, 16 };
+
+	// Every byte plane of a block starts with the 2 bit codes of its up to 16 groups
+	typedef uint32_t GroupHeader;
+
+	size_t GetPayloadBytes(GroupHeader header)
+	{
+		size_t bytes = 0;
+		for (; header != 0; header >>= 2)
+		{
+			bytes += GROUP_BYTES[header & 3];
+		}
+		return bytes;
+	}
+
+	uint32_t ZigZag(uint32_t value)
+	{
+		return (value << 1) ^ (uint32_t)((int32_t)value >> 31);
+	}
+
+	uint32_t UnZigZag(uint32_t value)
+	{
+		return (value >> 1) ^ (0u - (value & 1));
+	}
+
+	void WriteVarint(uint32_t value, std::vector<uint8_t>& encoded)
+	{
+		while (value >= 0x80)
+		{
+			encoded.push_back((uint8_t)(value | 0x80));
+			value >>= 7;
+		}
+		encoded.push_back((uint8_t)value);
+	}
+
+	bool ReadVarint(const uint8_t*& data, const uint8_t* end, uint32_t& value)
+	{
+		value = 0;
+		for (uint32_t shift = 0; shift < 35 && data < end; shift += 7)
+		{
+			const uint8_t byte = *data++;
+			value |= (uint32_t)(byte & 0x7f) << shift;
+			if ((byte & 0x80) == 0)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void EncodeGroup(const uint8_t* values, uint32_t& code, std::vector<uint8_t>& encoded)
+	{
+		const uint8_t largest = *std::max_element(values, values + MESH_CODEC_GROUP_SIZE);
+		code = largest == 0 ? 0 : largest < 4 ? 1 : largest < 16 ? 2 : 3;
+
+		switch (code)
+		{
+		case 1:
+			for (uint32_t i = 0; i < MESH_CODEC_GROUP_SIZE; i += 4)
+			{
+				encoded.push_back((uint8_t)(values[i] | values[i + 1] << 2 | values[i + 2] << 4 | values[i + 3] << 6));
+			}
+			break;
+
+		case 2:
+			for (uint32_t i = 0; i < MESH_CODEC_GROUP_SIZE; i += 2)
+			{
+				encoded.push_back((uint8_t)(values[i] | values[i + 1] << 4));
+			}
+			break;
+
+		case 3:
+			encoded.insert(encoded.end(), values, values + MESH_CODEC_GROUP_SIZE);
+			break;
+		}
+	}
+
+	// The two steps the decoder spends its time in, once per backend. UnpackGroup expands one
+	// bit packed group to 16 bytes, DecodeGroupWords combines the 4 byte planes of 16 vertices
+	// into words, undoes the zigzag and adds the deltas up starting from carry.
+#if defined(MESH_CODEC_SSE2)
+	const char* DECODER_NAME = "SSE2";
+
+	void UnpackGroup(uint32_t code, const uint8_t* data, uint8_t* out)
+	{
+		__m128i result;
+		switch (code)
+		{
+		case 0:
+			result = _mm_setzero_si128();
+			break;
+
+		case 1:
+		{
+			int32_t bits;
+			memcpy(&bits, data, sizeof(bits));
+			const __m128i packed = _mm_cvtsi32_si128(bits);
+			const __m128i mask = _mm_set1_epi8(3);
+			const __m128i a = _mm_and_si128(packed, mask);
+			const __m128i b = _mm_and_si128(_mm_srli_epi16(packed, 2), mask);
+			const __m128i c = _mm_and_si128(_mm_srli_epi16(packed, 4), mask);
+			const __m128i d = _mm_and_si128(_mm_srli_epi16(packed, 6), mask);
+			result = _mm_unpacklo_epi16(_mm_unpacklo_epi8(a, b), _mm_unpacklo_epi8(c, d));
+			break;
+		}
+
+		case 2:
+		{
+			const __m128i packed = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(data));
+			const __m128i mask = _mm_set1_epi8(0x0f);
+			result = _mm_unpacklo_epi8(_mm_and_si128(packed, mask), _mm_and_si128(_mm_srli_epi16(packed, 4), mask));
+			break;
+		}
+
+		default:
+			result = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+			break;
+		}
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out), result);
+	}
+
+	void DecodeGroupWords(const uint8_t* const* planes, uint32_t& carry, uint32_t* out)
+	{
+		const __m128i plane0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[0]));
+		const __m128i plane1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[1]));
+		const __m128i plane2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[2]));
+		const __m128i plane3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[3]));
+
+		const __m128i low01 = _mm_unpacklo_epi8(plane0, plane1);
+		const __m128i high01 = _mm_unpackhi_epi8(plane0, plane1);
+		const __m128i low23 = _mm_unpacklo_epi8(plane2, plane3);
+		const __m128i high23 = _mm_unpackhi_epi8(plane2, plane3);
+
+		const __m128i words[4] = {
+			_mm_unpacklo_epi16(low01, low23),
+			_mm_unpackhi_epi16(low01, low23),
+			_mm_unpacklo_epi16(high01, high23),
+			_mm_unpackhi_epi16(high01, high23),
+		};
+
+		const __m128i one = _mm_set1_epi32(1);
+		__m128i sum = _mm_set1_epi32((int32_t)carry);
+		for (uint32_t i = 0; i < 4; i++)
+		{
+			__m128i delta = _mm_xor_si128(_mm_srli_epi32(words[i], 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(words[i], one)));
+			delta = _mm_add_epi32(delta, _mm_slli_si128(delta, 4));
+			delta = _mm_add_epi32(delta, _mm_slli_si128(delta, 8));
+
+			sum = _mm_add_epi32(delta, sum);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 4), sum);
+			sum = _mm_shuffle_epi32(sum, _MM_SHUFFLE(3, 3, 3, 3));
+		}
+
+		carry = (uint32_t)_mm_cvtsi128_si32(sum);
+	}
+#elif defined(MESH_CODEC_NEON)
+	const char* DECODER_NAME = "NEON";
+
+	void UnpackGroup(uint32_t code, const uint8_t* data, uint8_t* out)
+	{
+		uint8x16_t result;
+		switch (code)
+		{
+		case 0:
+			result = vdupq_n_u8(0);
+			break;
+
+		case 1:
+		{
+			uint32_t bits;
+			memcpy(&bits, data, sizeof(bits));
+			const uint8x8_t packed = vreinterpret_u8_u32(vdup_n_u32(bits));
+			const uint8x8_t mask = vdup_n_u8(3);
+			const uint8x8_t a = vand_u8(packed, mask);
+			const uint8x8_t b = vand_u8(vshr_n_u8(packed, 2), mask);
+			const uint8x8_t c = vand_u8(vshr_n_u8(packed, 4), mask);
+			const uint8x8_t d = vshr_n_u8(packed, 6);
+			const uint8x8_t ab = vzip_u8(a, b).val[0];
+			const uint8x8_t cd = vzip_u8(c, d).val[0];
+			const uint16x4x2_t abcd = vzip_u16(vreinterpret_u16_u8(ab), vreinterpret_u16_u8(cd));
+			result = vcombine_u8(vreinterpret_u8_u16(abcd.val[0]), vreinterpret_u8_u16(abcd.val[1]));
+			break;
+		}
+
+		case 2:
+		{
+			const uint8x8_t packed = vld1_u8(data);
+			const uint8x8x2_t nibbles = vzip_u8(vand_u8(packed, vdup_n_u8(0x0f)), vshr_n_u8(packed, 4));
+			result = vcombine_u8(nibbles.val[0], nibbles.val[1]);
+			break;
+		}
+
+		default:
+			result = vld1q_u8(data);
+			break;
+		}
+
+		vst1q_u8(out, result);
+	}
+
+	void DecodeGroupWords(const uint8_t* const* planes, uint32_t& carry, uint32_t* out)
+	{
+		const uint8x16x2_t bytes01 = vzipq_u8(vld1q_u8(planes[0]), vld1q_u8(planes[1]));
+		const uint8x16x2_t bytes23 = vzipq_u8(vld1q_u8(planes[2]), vld1q_u8(planes[3]));
+		const uint16x8x2_t low = vzipq_u16(vreinterpretq_u16_u8(bytes01.val[0]), vreinterpretq_u16_u8(bytes23.val[0]));
+		const uint16x8x2_t high = vzipq_u16(vreinterpretq_u16_u8(bytes01.val[1]), vreinterpretq_u16_u8(bytes23.val[1]));
+
+		const uint32x4_t words[4] = {
+			vreinterpretq_u32_u16(low.val[0]),
+			vreinterpretq_u32_u16(low.val[1]),
+			vreinterpretq_u32_u16(high.val[0]),
+			vreinterpretq_u32_u16(high.val[1]),
+		};
+
+		const uint32x4_t zero = vdupq_n_u32(0);
+		uint32x4_t sum = vdupq_n_u32(carry);
+		for (uint32_t i = 0; i < 4; i++)
+		{
+			const int32x4_t sign = vnegq_s32(vreinterpretq_s32_u32(vandq_u32(words[i], vdupq_n_u32(1))));
+			uint32x4_t delta = veorq_u32(vshrq_n_u32(words[i], 1), vreinterpretq_u32_s32(sign));
+			delta = vaddq_u32(delta, vextq_u32(zero, delta, 3));
+			delta = vaddq_u32(delta, vextq_u32(zero, delta, 2));
+
+			sum = vaddq_u32(delta, sum);
+			vst1q_u32(out + i * 4, sum);
+			sum = vdupq_n_u32(vgetq_lane_u32(sum, 3));
+		}
+
+		carry = vgetq_lane_u32(sum, 0);
+	}
+#else
+	const char* DECODER_NAME = "scalar";
+
+	void UnpackGroup(uint32_t code, const uint8_t* data, uint8_t* out)
+	{
+		switch (code)
+		{
+		case 0:
+			memset(out, 0, MESH_CODEC_GROUP_SIZE);
+			break;
+
+		case 1:
+			for (uint32_t i = 0; i < MESH_CODEC_GROUP_SIZE; i++)
+			{
+				out[i] = (data[i / 4] >> (i % 4 * 2)) & 3;
+			}
+			break;
+
+		case 2:
+			for (uint32_t i = 0; i < MESH_CODEC_GROUP_SIZE; i++)
+			{
+				out[i] = (data[i / 2] >> (i % 2 * 4)) & 0x0f;
+			}
+			break;
+
+		default:
+			memcpy(out, data, MESH_CODEC_GROUP_SIZE);
+			break;
+		}
+	}
+
+	void DecodeGroupWords(const uint8_t* const* planes, uint32_t& carry, uint32_t* out)
+	{
+		for (uint32_t i = 0; i < MESH_CODEC_GROUP_SIZE; i++)
+		{
+			const uint32_t word = planes[0][i] | planes[1][i] << 8 | planes[2][i] << 16 | (uint32_t)planes[3][i] << 24;
+			carry += UnZigZag(word);
+			out[i] = carry;
+		}
+	}
+#endif
+}
+
+void MeshCodec::EncodeVertices(const void* vertices, uint32_t vertexCount, uint32_t vertexSize, std::vector<uint8_t>& encoded)
+{
+	assert(vertexSize > 0 && vertexSize % 4 == 0 && vertexSize <= MESH_CODEC_MAX_VERTEX_SIZE);
+
+	const uint8_t* source = static_cast<const uint8_t*>(vertices);
+	const uint32_t wordCount = vertexSize / 4;
+	uint32_t previous[MESH_CODEC_MAX_VERTEX_SIZE / 4] = {};
+
+	encoded.push_back(MESH_CODEC_VERTEX_VERSION);
+
+	for (uint32_t blockStart = 0; blockStart < vertexCount; blockStart += MESH_CODEC_VERTEX_BLOCK_SIZE)
+	{
+		const uint32_t blockCount = std::min(vertexCount - blockStart, (uint32_t)MESH_CODEC_VERTEX_BLOCK_SIZE);
+		const uint32_t groupCount = (blockCount + MESH_CODEC_GROUP_SIZE - 1) / MESH_CODEC_GROUP_SIZE;
+
+		for (uint32_t word = 0; word < wordCount; word++)
+		{
+			// The padding of the last group decodes to the last vertex again and is dropped
+			uint32_t deltas[MESH_CODEC_VERTEX_BLOCK_SIZE] = {};
+			for (uint32_t i = 0; i < blockCount; i++)
+			{
+				uint32_t value;
+				memcpy(&value, source + (size_t)(blockStart + i) * vertexSize + word * 4, sizeof(value));
+				deltas[i] = ZigZag(value - previous[word]);
+				previous[word] = value;
+			}
+
+			for (uint32_t plane = 0; plane < 4; plane++)
+			{
+				uint8_t bytes[MESH_CODEC_VERTEX_BLOCK_SIZE];
+				for (uint32_t i = 0; i < groupCount * MESH_CODEC_GROUP_SIZE; i++)
+				{
+					bytes[i] = (uint8_t)(deltas[i] >> (plane * 8));
+				}
+
+				const size_t headerOffset = encoded.size();
+				encoded.resize(headerOffset + sizeof(GroupHeader));
+
+				GroupHeader header = 0;
+				for (uint32_t group = 0; group < groupCount; group++)
+				{
+					uint32_t code = 0;
+					EncodeGroup(bytes + group * MESH_CODEC_GROUP_SIZE, code, encoded);
+					header |= code << (group * 2);
+				}
+				memcpy(encoded.data() + headerOffset, &header, sizeof(header));
+			}
+		}
+	}
+}
+
+bool MeshCodec::DecodeVertices(const uint8_t* encoded, size_t encodedBytes, void* vertices, uint32_t vertexCount, uint32_t vertexSize)
+{
+	if (vertexSize == 0 || vertexSize % 4 != 0 || vertexSize > MESH_CODEC_MAX_VERTEX_SIZE)
+	{
+		return false;
+	}
+
+	const uint8_t* data = encoded;
+	const uint8_t* end = encoded + encodedBytes;
+	if (data == end || *data++ != MESH_CODEC_VERTEX_VERSION)
+	{
+		return false;
+	}
+
+	uint8_t* out = static_cast<uint8_t*>(vertices);
+	const uint32_t wordCount = vertexSize / 4;
+	uint32_t previous[MESH_CODEC_MAX_VERTEX_SIZE / 4] = {};
+
+	// One block is assembled here and then written out front to back in one go
+	alignas(16) uint8_t planes[4][MESH_CODEC_VERTEX_BLOCK_SIZE];
+	alignas(16) uint32_t groupWords[MESH_CODEC_GROUP_SIZE];
+	alignas(16) uint32_t block[MESH_CODEC_VERTEX_BLOCK_SIZE * MESH_CODEC_MAX_VERTEX_SIZE / 4];
+
+	for (uint32_t blockStart = 0; blockStart < vertexCount; blockStart += MESH_CODEC_VERTEX_BLOCK_SIZE)
+	{
+		const uint32_t blockCount = std::min(vertexCount - blockStart, (uint32_t)MESH_CODEC_VERTEX_BLOCK_SIZE);
+		const uint32_t groupCount = (blockCount + MESH_CODEC_GROUP_SIZE - 1) / MESH_CODEC_GROUP_SIZE;
+
+		for (uint32_t word = 0; word < wordCount; word++)
+		{
+			for (uint32_t plane = 0; plane < 4; plane++)
+			{
+				GroupHeader header;
+				if ((size_t)(end - data) < sizeof(header))
+				{
+					return false;
+				}
+				memcpy(&header, data, sizeof(header));
+				data += sizeof(header);
+
+				// Checked once per plane, the groups are read without further tests
+				if ((groupCount < 16 && (header >> (groupCount * 2)) != 0) || (size_t)(end - data) < GetPayloadBytes(header))
+				{
+					return false;
+				}
+
+				uint8_t* target = planes[plane];
+				for (uint32_t group = 0; group < groupCount; group++, header >>= 2)
+				{
+					UnpackGroup(header & 3, data, target);
+					data += GROUP_BYTES[header & 3];
+					target += MESH_CODEC_GROUP_SIZE;
+				}
+			}
+
+			uint32_t carry = previous[word];
+			for (uint32_t group = 0; group < groupCount; group++)
+			{
+				const uint32_t first = group * MESH_CODEC_GROUP_SIZE;
+				const uint8_t* groupPlanes[4] = { planes[0] + first, planes[1] + first, planes[2] + first, planes[3] + first };
+				DecodeGroupWords(groupPlanes, carry, groupWords);
+
+				const uint32_t count = std::min(blockCount - first, (uint32_t)MESH_CODEC_GROUP_SIZE);
+				for (uint32_t i = 0; i < count; i++)
+				{
+					block[(first + i) * wordCount + word] = groupWords[i];
+				}
+			}
+			previous[word] = carry;
+		}
+
+		memcpy(out + (size_t)blockStart * vertexSize, block, (size_t)blockCount * vertexSize);
+	}
+
+	return data == end;
+}
+
+void MeshCodec::EncodeIndices(const uint32_t* indices, uint32_t indexCount, std::vector<uint8_t>& encoded)
+{
+	encoded.push_back(MESH_CODEC_INDEX_VERSION);
+
+	// Two codes per byte, low nibble first, followed by the explicit deltas
+	const size_t codes = encoded.size();
+	encoded.resize(codes + (indexCount + 1) / 2, 0);
+
+	uint32_t fifo[16] = {};
+	uint32_t fifoHead = 0;
+	uint32_t fifoSize = 0;
+	uint32_t next = 0;
+
+	for (uint32_t i = 0; i < indexCount; i++)
+	{
+		const uint32_t index = indices[i];
+
+		uint32_t code = MESH_CODEC_INDEX_EXPLICIT;
+		for (uint32_t position = 0; position < fifoSize; position++)
+		{
+			if (fifo[(fifoHead - 1 - position) & 15] == index)
+			{
+				code = position;
+				break;
+			}
+		}
+
+		if (code == MESH_CODEC_INDEX_EXPLICIT)
+		{
+			if (index == next)
+			{
+				code = MESH_CODEC_INDEX_NEXT;
+			}
+			else
+			{
+				WriteVarint(ZigZag(index - next), encoded);
+			}
+
+			next = std::max(next, index + 1);
+			fifo[fifoHead++ & 15] = index;
+			fifoSize = std::min(fifoSize + 1, (uint32_t)MESH_CODEC_INDEX_FIFO_HITS);
+		}
+
+		encoded[codes + i / 2] |= (uint8_t)(code << (i % 2 * 4));
+	}
+}
+
+bool MeshCodec::DecodeIndices(const uint8_t* encoded, size_t encodedBytes, uint32_t* indices, uint32_t indexCount)
+{
+	const uint8_t* end = encoded + encodedBytes;
+	const size_t codeBytes = ((size_t)indexCount + 1) / 2;
+	if (encodedBytes < 1 + codeBytes || encoded[0] != MESH_CODEC_INDEX_VERSION)
+	{
+		return false;
+	}
+
+	const uint8_t* codes = encoded + 1;
+	const uint8_t* data = codes + codeBytes;
+
+	uint32_t fifo[16] = {};
+	uint32_t fifoHead = 0;
+	uint32_t fifoSize = 0;
+	uint32_t next = 0;
+
+	for (uint32_t i = 0; i < indexCount; i++)
+	{
+		const uint32_t code = (codes[i / 2] >> (i % 2 * 4)) & 0x0f;
+		if (code < MESH_CODEC_INDEX_FIFO_HITS)
+		{
+			if (code >= fifoSize)
+			{
+				return false;
+			}
+
+			indices[i] = fifo[(fifoHead - 1 - code) & 15];
+			continue;
+		}
+
+		uint32_t index = next;
+		if (code == MESH_CODEC_INDEX_EXPLICIT)
+		{
+			uint32_t delta;
+			if (!ReadVarint(data, end, delta))
+			{
+				return false;
+			}
+			index = next + UnZigZag(delta);
+		}
+
+		indices[i] = index;
+		next = std::max(next, index + 1);
+		fifo[fifoHead++ & 15] = index;
+		fifoSize = std::min(fifoSize + 1, (uint32_t)MESH_CODEC_INDEX_FIFO_HITS);
+	}
+
+	return data == end;
+}
+
+size_t MeshCodec::GetMinVertexBytes(uint32_t vertexCount, uint32_t vertexSize)
+{
+	// Version, then a header for every byte plane of every word in each block
+	const size_t blocks = ((size_t)vertexCount + MESH_CODEC_VERTEX_BLOCK_SIZE - 1) / MESH_CODEC_VERTEX_BLOCK_SIZE;
+	return 1 + blocks * (vertexSize / 4) * 4 * sizeof(GroupHeader);
+}
+
+size_t MeshCodec::GetMinIndexBytes(uint32_t indexCount)
+{
+	// Version, then a nibble per index
+	return 1 + ((size_t)indexCount + 1) / 2;
+}
+
+const char* MeshCodec::GetDecoderName()
+{
+	return DECODER_NAME;
+}
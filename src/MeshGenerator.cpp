@@ -0,0 +1,485 @@
+#include "MeshGenerator.h"
+#include "JobSystem.h"
+
+#include <chrono>
+
+#define PI_D 3.14159265358979323846
+#define PARALLEL_VERTEX_THRESHOLD (1 << 16) // below this a single thread beats handing out jobs
+#define MAX_ICOSPHERE_SUBDIVISIONS 10
+
+namespace
+{
+	struct TrigTable
+	{
+		std::vector<float> sin;
+		std::vector<float> cos;
+	};
+
+	// segments + 1 entries so the seam vertex gets its own slot. The last entry is copied from the
+	// first one for full turns, otherwise rounding would open a gap along the seam.
+	TrigTable BuildTrigTable(uint32_t segments, double startAngle, double range)
+	{
+		TrigTable table;
+		table.sin.resize(segments + 1);
+		table.cos.resize(segments + 1);
+
+		for (uint32_t i = 0; i <= segments; i++)
+		{
+			const double angle = startAngle + range * i / segments;
+			table.sin[i] = (float)std::sin(angle);
+			table.cos[i] = (float)std::cos(angle);
+		}
+
+		if (range == 2.0 * PI_D)
+		{
+			table.sin[segments] = table.sin[0];
+			table.cos[segments] = table.cos[0];
+		}
+
+		return table;
+	}
+
+	// Splits [0, rowCount) into contiguous chunks on the job system. Every row writes to its
+	// own precomputed slice of the output, so no synchronisation is needed.
+	void ParallelRows(uint32_t rowCount, uint32_t verticesPerRow, const std::function<void(uint32_t, uint32_t)>& job)
+	{
+		JobSystem& jobSystem = JobSystem::Get();
+		if (jobSystem.GetThreadCount() == 1 || (size_t)rowCount * verticesPerRow < PARALLEL_VERTEX_THRESHOLD)
+		{
+			job(0, rowCount);
+			return;
+		}
+
+		jobSystem.ParallelFor(rowCount, 1, job);
+	}
+
+	// Two triangles per quad, (a, a+1, b) and (a+1, b+1, b) where a+1 steps along u and b along v.
+	// Counter clockwise when looking against cross(u, v).
+	inline void WriteGridRowIndices(uint32_t* out, uint32_t rowStart, uint32_t columns)
+	{
+		const uint32_t stride = columns + 1;
+		for (uint32_t j = 0; j < columns; j++)
+		{
+			const uint32_t a = rowStart + j;
+			const uint32_t b = a + stride;
+
+			out[0] = a;
+			out[1] = a + 1;
+			out[2] = b;
+			out[3] = a + 1;
+			out[4] = b + 1;
+			out[5] = b;
+			out += 6;
+		}
+	}
+
+	// Flat (segmentsU + 1) x (segmentsV + 1) grid spanning origin .. origin + u + v
+	void WriteGridFace(MeshData& mesh, uint32_t firstVertex, uint32_t firstIndex,
+		const glm::vec3& origin, const glm::vec3& u, const glm::vec3& v, uint32_t segmentsU, uint32_t segmentsV)
+	{
+		const uint32_t stride = segmentsU + 1;
+		float* vertices = mesh.vertices.data();
+		uint32_t* indices = mesh.indices.data();
+
+		ParallelRows(segmentsV + 1, stride, [&](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; i++)
+			{
+				const glm::vec3 rowOrigin = origin + v * ((float)i / segmentsV);
+				float* out = vertices + 3 * ((size_t)firstVertex + (size_t)i * stride);
+
+				for (uint32_t j = 0; j <= segmentsU; j++)
+				{
+					const glm::vec3 position = rowOrigin + u * ((float)j / segmentsU);
+					*out++ = position.x;
+					*out++ = position.y;
+					*out++ = position.z;
+				}
+
+				if (i < segmentsV)
+				{
+					WriteGridRowIndices(indices + firstIndex + (size_t)i * segmentsU * 6, firstVertex + i * stride, segmentsU);
+				}
+			}
+		});
+	}
+}
+
+std::string MeshDesc::GetName() const
+{
+	char name[64] = { 0 };
+	switch (shape)
+	{
+	case MeshShape::UVSphere:  snprintf(name, sizeof(name), "uvsphere_%ux%u", segmentsU, segmentsV); break;
+	case MeshShape::Icosphere: snprintf(name, sizeof(name), "icosphere_%u", segmentsU); break;
+	case MeshShape::Cube:      snprintf(name, sizeof(name), "cube_%u", segmentsU); break;
+	case MeshShape::PlaneGrid: snprintf(name, sizeof(name), "plane_%ux%u", segmentsU, segmentsV); break;
+	case MeshShape::Cylinder:  snprintf(name, sizeof(name), "cylinder_%ux%u", segmentsU, segmentsV); break;
+	case MeshShape::Torus:     snprintf(name, sizeof(name), "torus_%ux%u_%.3f", segmentsU, segmentsV, tubeRadius); break;
+	}
+	return name;
+}
+
+MeshDesc MeshDesc::GetKey() const
+{
+	MeshDesc key = *this;
+	switch (shape)
+	{
+	case MeshShape::Icosphere:
+	case MeshShape::Cube:
+		key.segmentsV = 0;
+		key.tubeRadius = 0.f;
+		break;
+	case MeshShape::Torus:
+		key.tubeRadius = std::round(tubeRadius * 1000.f) / 1000.f;
+		break;
+	default:
+		key.tubeRadius = 0.f;
+		break;
+	}
+	return key;
+}
+
+MeshData MeshGenerator::Generate(const MeshDesc& desc)
+{
+	switch (desc.shape)
+	{
+	case MeshShape::UVSphere:  return UVSphere(desc.segmentsU, desc.segmentsV);
+	case MeshShape::Icosphere: return Icosphere(desc.segmentsU);
+	case MeshShape::Cube:      return Cube(desc.segmentsU);
+	case MeshShape::PlaneGrid: return PlaneGrid(desc.segmentsU, desc.segmentsV);
+	case MeshShape::Cylinder:  return Cylinder(desc.segmentsU, desc.segmentsV);
+	case MeshShape::Torus:     return Torus(desc.segmentsU, desc.segmentsV, desc.tubeRadius);
+	}
+
+	LOG_ERROR("Unknown mesh shape [%u]", (uint32_t)desc.shape)
+	assert(false);
+	return {};
+}
+
+MeshData MeshGenerator::UVSphere(uint32_t slices, uint32_t stacks)
+{
+	assert(slices >= 3 && stacks >= 2);
+
+	const uint32_t stride = slices + 1;
+
+	MeshData mesh;
+	mesh.vertices.resize((size_t)(stacks + 1) * stride * 3);
+	mesh.indices.resize((size_t)stacks * slices * 6);
+
+	// Stack i sits at y = -cos(i * pi / stacks) with ring radius sin(i * pi / stacks),
+	// which is what cos(asin(y)) used to compute per vertex
+	const TrigTable stackTable = BuildTrigTable(stacks, 0.0, PI_D);
+	const TrigTable sliceTable = BuildTrigTable(slices, 0.0, 2.0 * PI_D);
+
+	float* vertices = mesh.vertices.data();
+	uint32_t* indices = mesh.indices.data();
+
+	ParallelRows(stacks + 1, stride, [&](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t i = begin; i < end; i++)
+		{
+			const float y = -stackTable.cos[i];
+			const float radius = stackTable.sin[i];
+			float* out = vertices + (size_t)i * stride * 3;
+
+			for (uint32_t j = 0; j <= slices; j++)
+			{
+				// The minus infront of x influences the winding
+				*out++ = -sliceTable.cos[j] * radius;
+				*out++ = y;
+				*out++ = sliceTable.sin[j] * radius;
+			}
+
+			if (i < stacks)
+			{
+				WriteGridRowIndices(indices + (size_t)i * slices * 6, i * stride, slices);
+			}
+		}
+	});
+
+	return mesh;
+}
+
+MeshData MeshGenerator::Icosphere(uint32_t subdivisions)
+{
+	assert(subdivisions <= MAX_ICOSPHERE_SUBDIVISIONS);
+
+	// Every level splits each triangle into four and adds one vertex per edge. Unlike the grid
+	// shapes this stays serial: a level subdivides the previous one and neighbouring triangles
+	// share their edge midpoints through the map.
+	const size_t finalTriangles = (size_t)20 << (2 * subdivisions);
+	const size_t finalVertices = finalTriangles / 2 + 2;
+
+	MeshData mesh;
+	mesh.vertices.reserve(finalVertices * 3);
+	mesh.indices.reserve(finalTriangles * 3);
+
+	const float t = (1.f + std::sqrt(5.f)) / 2.f;
+	const float base[12][3] = {
+		{ -1,  t,  0 }, {  1,  t,  0 }, { -1, -t,  0 }, {  1, -t,  0 },
+		{  0, -1,  t }, {  0,  1,  t }, {  0, -1, -t }, {  0,  1, -t },
+		{  t,  0, -1 }, {  t,  0,  1 }, { -t,  0, -1 }, { -t,  0,  1 },
+	};
+
+	for (auto& v : base)
+	{
+		const glm::vec3 p = glm::normalize(glm::vec3(v[0], v[1], v[2]));
+		mesh.vertices.push_back(p.x);
+		mesh.vertices.push_back(p.y);
+		mesh.vertices.push_back(p.z);
+	}
+
+	mesh.indices = {
+		0, 11, 5,  0, 5, 1,   0, 1, 7,   0, 7, 10,  0, 10, 11,
+		1, 5, 9,   5, 11, 4,  11, 10, 2, 10, 7, 6,  7, 1, 8,
+		3, 9, 4,   3, 4, 2,   3, 2, 6,   3, 6, 8,   3, 8, 9,
+		4, 9, 5,   2, 4, 11,  6, 2, 10,  8, 6, 7,   9, 8, 1,
+	};
+	mesh.indices.reserve(finalTriangles * 3);
+
+	std::vector<uint32_t> next;
+	next.reserve(finalTriangles * 3);
+
+	std::unordered_map<uint64_t, uint32_t> midpoints;
+	midpoints.reserve(finalTriangles * 3 / 2);
+
+	for (uint32_t level = 0; level < subdivisions; level++)
+	{
+		midpoints.clear();
+		next.clear();
+
+		auto midpoint = [&](uint32_t a, uint32_t b) -> uint32_t
+		{
+			const uint64_t key = ((uint64_t)std::min(a, b) << 32) | std::max(a, b);
+			auto it = midpoints.find(key);
+			if (it != midpoints.end())
+			{
+				return it->second;
+			}
+
+			const float* pa = &mesh.vertices[(size_t)a * 3];
+			const float* pb = &mesh.vertices[(size_t)b * 3];
+			const glm::vec3 p = glm::normalize(glm::vec3(pa[0] + pb[0], pa[1] + pb[1], pa[2] + pb[2]));
+
+			const uint32_t index = mesh.GetVertexCount();
+			mesh.vertices.push_back(p.x);
+			mesh.vertices.push_back(p.y);
+			mesh.vertices.push_back(p.z);
+
+			midpoints.emplace(key, index);
+			return index;
+		};
+
+		for (size_t i = 0; i < mesh.indices.size(); i += 3)
+		{
+			const uint32_t v0 = mesh.indices[i + 0];
+			const uint32_t v1 = mesh.indices[i + 1];
+			const uint32_t v2 = mesh.indices[i + 2];
+
+			const uint32_t m01 = midpoint(v0, v1);
+			const uint32_t m12 = midpoint(v1, v2);
+			const uint32_t m20 = midpoint(v2, v0);
+
+			next.insert(next.end(), {
+				v0, m01, m20,
+				v1, m12, m01,
+				v2, m20, m12,
+				m01, m12, m20
+			});
+		}
+
+		mesh.indices.swap(next);
+	}
+
+	assert(mesh.GetVertexCount() == finalVertices);
+	return mesh;
+}
+
+MeshData MeshGenerator::Cube(uint32_t segments)
+{
+	assert(segments >= 1);
+
+	const uint32_t faceVertices = (segments + 1) * (segments + 1);
+	const uint32_t faceIndices = segments * segments * 6;
+
+	MeshData mesh;
+	mesh.vertices.resize((size_t)faceVertices * 6 * 3);
+	mesh.indices.resize((size_t)faceIndices * 6);
+
+	// origin, u, v per face with cross(u, v) pointing outwards
+	const glm::vec3 faces[6][3] = {
+		{ {  0.5f, -0.5f,  0.5f }, {  0, 0, -1 }, { 0, 1, 0 } }, // rechts
+		{ { -0.5f, -0.5f, -0.5f }, {  0, 0,  1 }, { 0, 1, 0 } }, // links
+		{ { -0.5f,  0.5f,  0.5f }, {  1, 0,  0 }, { 0, 0, -1 } }, // oben
+		{ { -0.5f, -0.5f, -0.5f }, {  1, 0,  0 }, { 0, 0,  1 } }, // unten
+		{ { -0.5f, -0.5f,  0.5f }, {  1, 0,  0 }, { 0, 1, 0 } }, // vorne
+		{ {  0.5f, -0.5f, -0.5f }, { -1, 0,  0 }, { 0, 1, 0 } }, // hinten
+	};
+
+	for (uint32_t face = 0; face < 6; face++)
+	{
+		WriteGridFace(mesh, face * faceVertices, face * faceIndices, faces[face][0], faces[face][1], faces[face][2], segments, segments);
+	}
+
+	return mesh;
+}
+
+MeshData MeshGenerator::PlaneGrid(uint32_t segmentsX, uint32_t segmentsZ)
+{
+	assert(segmentsX >= 1 && segmentsZ >= 1);
+
+	MeshData mesh;
+	mesh.vertices.resize((size_t)(segmentsX + 1) * (segmentsZ + 1) * 3);
+	mesh.indices.resize((size_t)segmentsX * segmentsZ * 6);
+
+	// XZ plane facing +y
+	WriteGridFace(mesh, 0, 0, { -0.5f, 0.f, 0.5f }, { 1.f, 0.f, 0.f }, { 0.f, 0.f, -1.f }, segmentsX, segmentsZ);
+
+	return mesh;
+}
+
+MeshData MeshGenerator::Cylinder(uint32_t slices, uint32_t stacks)
+{
+	assert(slices >= 3 && stacks >= 1);
+
+	const uint32_t stride = slices + 1;
+	const uint32_t sideVertices = (stacks + 1) * stride;
+	const uint32_t sideIndices = stacks * slices * 6;
+
+	MeshData mesh;
+	mesh.vertices.resize(((size_t)sideVertices + 2) * 3);
+	mesh.indices.resize((size_t)sideIndices + (size_t)slices * 6);
+
+	const TrigTable sliceTable = BuildTrigTable(slices, 0.0, 2.0 * PI_D);
+
+	float* vertices = mesh.vertices.data();
+	uint32_t* indices = mesh.indices.data();
+
+	ParallelRows(stacks + 1, stride, [&](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t i = begin; i < end; i++)
+		{
+			const float y = -0.5f + (float)i / stacks;
+			float* out = vertices + (size_t)i * stride * 3;
+
+			for (uint32_t j = 0; j <= slices; j++)
+			{
+				*out++ = -sliceTable.cos[j] * 0.5f;
+				*out++ = y;
+				*out++ = sliceTable.sin[j] * 0.5f;
+			}
+
+			if (i < stacks)
+			{
+				WriteGridRowIndices(indices + (size_t)i * slices * 6, i * stride, slices);
+			}
+		}
+	});
+
+	// Caps are fans around a center vertex, reusing the first and last ring of the side
+	const uint32_t bottomCenter = sideVertices;
+	const uint32_t topCenter = sideVertices + 1;
+	const uint32_t topRing = stacks * stride;
+
+	float* centers = vertices + (size_t)sideVertices * 3;
+	centers[0] = 0.f; centers[1] = -0.5f; centers[2] = 0.f;
+	centers[3] = 0.f; centers[4] = 0.5f;  centers[5] = 0.f;
+
+	uint32_t* out = indices + sideIndices;
+	for (uint32_t j = 0; j < slices; j++)
+	{
+		*out++ = bottomCenter;
+		*out++ = j + 1;
+		*out++ = j;
+
+		*out++ = topCenter;
+		*out++ = topRing + j;
+		*out++ = topRing + j + 1;
+	}
+
+	return mesh;
+}
+
+MeshData MeshGenerator::Torus(uint32_t ringSegments, uint32_t tubeSegments, float tubeRadius)
+{
+	assert(ringSegments >= 3 && tubeSegments >= 3);
+
+	const float ringRadius = 0.5f;
+	const float tube = ringRadius * tubeRadius;
+	const uint32_t stride = tubeSegments + 1;
+
+	MeshData mesh;
+	mesh.vertices.resize((size_t)(ringSegments + 1) * stride * 3);
+	mesh.indices.resize((size_t)ringSegments * tubeSegments * 6);
+
+	const TrigTable ringTable = BuildTrigTable(ringSegments, 0.0, 2.0 * PI_D);
+	const TrigTable tubeTable = BuildTrigTable(tubeSegments, 0.0, 2.0 * PI_D);
+
+	float* vertices = mesh.vertices.data();
+	uint32_t* indices = mesh.indices.data();
+
+	ParallelRows(ringSegments + 1, stride, [&](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t i = begin; i < end; i++)
+		{
+			float* out = vertices + (size_t)i * stride * 3;
+
+			for (uint32_t j = 0; j <= tubeSegments; j++)
+			{
+				const float distance = ringRadius + tube * tubeTable.cos[j];
+				*out++ = distance * ringTable.cos[i];
+				*out++ = tube * tubeTable.sin[j];
+				*out++ = distance * ringTable.sin[i];
+			}
+
+			if (i < ringSegments)
+			{
+				WriteGridRowIndices(indices + (size_t)i * tubeSegments * 6, i * stride, tubeSegments);
+			}
+		}
+	});
+
+	return mesh;
+}
+
+GeoID MeshCache::Get(const MeshDesc& desc)
+{
+	const MeshDesc key = desc.GetKey();
+	auto it = m_Cache.find(key);
+	if (it != m_Cache.end())
+	{
+		m_Hits++;
+		return it->second;
+	}
+
+	// Registered by someone else, adding it again would take the name over
+	const std::string name = key.GetName();
+	const GeoID registered = m_GeometryManager.GetID(StringID(name));
+	if (registered != 0)
+	{
+		m_Hits++;
+		m_Cache.emplace(key, registered);
+		return registered;
+	}
+
+	m_Misses++;
+
+	const auto start = std::chrono::steady_clock::now();
+	const MeshData mesh = MeshGenerator::Generate(key);
+	const auto end = std::chrono::steady_clock::now();
+
+	LOG_DEBUG("Generated [%s] with %u vertices and %u indices in %.3f ms", name.c_str(), mesh.GetVertexCount(), mesh.GetIndexCount(),
+		std::chrono::duration<double, std::milli>(end - start).count())
+
+	const GeoID geoID = m_GeometryManager.AddGeometry(
+		name,
+		mesh.vertices.data(),
+		mesh.vertices.size() * sizeof(float),
+		mesh.indices.data(),
+		mesh.GetIndexCount()
+	);
+
+	m_Cache.emplace(key, geoID);
+	return geoID;
+}
@@ -0,0 +1,159 @@
+#include "RadixSort.h"
+
+#include "FrameArena.h"
+#include "JobSystem.h"
+
+void RadixSort::Sort(uint32_t* keys, uint32_t* values, uint32_t count, uint32_t* scratchKeys, uint32_t* scratchValues, JobSystem* jobSystem)
+{
+	if (jobSystem && jobSystem->GetThreadCount() > 1 && count >= 2 * RADIX_SORT_GRAIN_SIZE)
+	{
+		SortParallel(keys, values, count, scratchKeys, scratchValues, *jobSystem);
+	}
+	else
+	{
+		SortSerial(keys, values, count, scratchKeys, scratchValues);
+	}
+}
+
+void RadixSort::SortSerial(uint32_t* keys, uint32_t* values, uint32_t count, uint32_t* scratchKeys, uint32_t* scratchValues)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	// The digits don't change between passes, only their order, so one read fills all histograms
+	uint32_t histograms[4][256] = {};
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const uint32_t key = keys[i];
+		histograms[0][key & 0xff]++;
+		histograms[1][(key >> 8) & 0xff]++;
+		histograms[2][(key >> 16) & 0xff]++;
+		histograms[3][key >> 24]++;
+	}
+
+	uint32_t* sourceKeys = keys;
+	uint32_t* sourceValues = values;
+	uint32_t* targetKeys = scratchKeys;
+	uint32_t* targetValues = scratchValues;
+
+	for (uint32_t pass = 0; pass < 4; pass++)
+	{
+		const uint32_t shift = pass * 8;
+		uint32_t* histogram = histograms[pass];
+
+		// Every key has the same digit, the pass wouldn't move anything
+		if (histogram[(sourceKeys[0] >> shift) & 0xff] == count)
+		{
+			continue;
+		}
+
+		uint32_t offset = 0;
+		for (uint32_t digit = 0; digit < 256; digit++)
+		{
+			const uint32_t digitCount = histogram[digit];
+			histogram[digit] = offset;
+			offset += digitCount;
+		}
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const uint32_t position = histogram[(sourceKeys[i] >> shift) & 0xff]++;
+			targetKeys[position] = sourceKeys[i];
+			targetValues[position] = sourceValues[i];
+		}
+
+		std::swap(sourceKeys, targetKeys);
+		std::swap(sourceValues, targetValues);
+	}
+
+	if (sourceKeys != keys)
+	{
+		memcpy(keys, sourceKeys, count * sizeof(uint32_t));
+		memcpy(values, sourceValues, count * sizeof(uint32_t));
+	}
+}
+
+void RadixSort::SortParallel(uint32_t* keys, uint32_t* values, uint32_t count, uint32_t* scratchKeys, uint32_t* scratchValues, JobSystem& jobSystem)
+{
+	const uint32_t chunkCount = (count + RADIX_SORT_GRAIN_SIZE - 1) / RADIX_SORT_GRAIN_SIZE;
+
+	// One histogram per chunk, turned into that chunk's write offsets before the scatter
+	ArenaVector<uint32_t> offsets((size_t)chunkCount * 256, 0, FrameArena::Get().GetThreadArena());
+
+	uint32_t* sourceKeys = keys;
+	uint32_t* sourceValues = values;
+	uint32_t* targetKeys = scratchKeys;
+	uint32_t* targetValues = scratchValues;
+
+	for (uint32_t pass = 0; pass < 4; pass++)
+	{
+		const uint32_t shift = pass * 8;
+
+		jobSystem.ParallelFor(chunkCount, 1, [&](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t chunk = begin; chunk < end; chunk++)
+			{
+				uint32_t* histogram = &offsets[(size_t)chunk * 256];
+				std::fill(histogram, histogram + 256, 0u);
+
+				const uint32_t last = std::min(count, (chunk + 1) * RADIX_SORT_GRAIN_SIZE);
+				for (uint32_t i = chunk * RADIX_SORT_GRAIN_SIZE; i < last; i++)
+				{
+					histogram[(sourceKeys[i] >> shift) & 0xff]++;
+				}
+			}
+		});
+
+		// Every key has the same digit, the pass wouldn't move anything
+		const uint32_t firstDigit = (sourceKeys[0] >> shift) & 0xff;
+		uint32_t firstDigitCount = 0;
+		for (uint32_t chunk = 0; chunk < chunkCount; chunk++)
+		{
+			firstDigitCount += offsets[(size_t)chunk * 256 + firstDigit];
+		}
+		if (firstDigitCount == count)
+		{
+			continue;
+		}
+
+		// Digit major, chunk minor: equal digits keep the order of the chunks they came from
+		uint32_t offset = 0;
+		for (uint32_t digit = 0; digit < 256; digit++)
+		{
+			for (uint32_t chunk = 0; chunk < chunkCount; chunk++)
+			{
+				uint32_t& entry = offsets[(size_t)chunk * 256 + digit];
+				const uint32_t digitCount = entry;
+				entry = offset;
+				offset += digitCount;
+			}
+		}
+
+		jobSystem.ParallelFor(chunkCount, 1, [&](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t chunk = begin; chunk < end; chunk++)
+			{
+				uint32_t* chunkOffsets = &offsets[(size_t)chunk * 256];
+
+				const uint32_t last = std::min(count, (chunk + 1) * RADIX_SORT_GRAIN_SIZE);
+				for (uint32_t i = chunk * RADIX_SORT_GRAIN_SIZE; i < last; i++)
+				{
+					const uint32_t position = chunkOffsets[(sourceKeys[i] >> shift) & 0xff]++;
+					targetKeys[position] = sourceKeys[i];
+					targetValues[position] = sourceValues[i];
+				}
+			}
+		});
+
+		std::swap(sourceKeys, targetKeys);
+		std::swap(sourceValues, targetValues);
+	}
+
+	if (sourceKeys != keys)
+	{
+		memcpy(keys, sourceKeys, count * sizeof(uint32_t));
+		memcpy(values, sourceValues, count * sizeof(uint32_t));
+	}
+}
@@ -0,0 +1,1393 @@
+#include "Renderer.h"
+#include "GLState.h"
+#include "JobSystem.h"
+#include "RadixSort.h"
+#include "ResidencyManager.h"
+#include "Trace.h"
+
+Renderer::Renderer(GeometryManager* geometryManager)
+	: m_GeometryManager(geometryManager)
+	, m_TraceRecorder(nullptr)
+	, m_ResidencyManager(nullptr)
+	, m_DrawPath(DrawPath::VertexAttributes)
+	, m_BuildFrame(0)
+	, m_DrawFrame(0)
+	, m_DepthSort(false)
+	, m_SortTime(0)
+	, m_SortedInstances(0)
+	, m_SortedFrames(0)
+	, m_CullTime(0)
+	, m_PackTime(0)
+	, m_CulledViews(0)
+	, m_CulledFrames(0)
+	, m_VertexArray(0)
+	, m_RangeVertexArray(0)
+	, m_InstanceDataBuffer{0,0}
+	, m_PersistentInstanceDataBuffer(0)
+	, m_CommandRing(0)
+	, m_CommandRingData(nullptr)
+	, m_CommandRingCapacity(0)
+	, m_CommandSlotSize(0)
+	, m_RequiredCommandCapacity(COMMAND_RING_INITIAL_CAPACITY)
+	, m_StorageBufferAlignment(256)
+	, m_UseIndirectCount(false)
+	, m_VertexBufferID(0)
+	, m_ElementBufferID(0)
+	, m_EmptyVertexArray(0)
+	, m_FlushingDraws(false)
+	, m_ImmediateDrawCount(0)
+	, m_ImmediateMultiDrawCount(0)
+	, m_ImmediateCommandCount(0)
+	, m_GeoManagerGeoCount(0)
+{
+	// Read as mat4[] by the pulling shaders, std430 puts them back to back
+	static_assert(sizeof(InstanceData) == 64, "InstanceData has to match the std430 mat4 array stride");
+
+	glCreateVertexArrays(1, &m_VertexArray);
+
+	glCreateBuffers(2, m_InstanceDataBuffer);
+
+	glNamedBufferData(m_InstanceDataBuffer[0], INSTANCE_BUFFER_DATA_SIZE, nullptr, GL_STATIC_DRAW);
+	glNamedBufferData(m_InstanceDataBuffer[1], INSTANCE_BUFFER_DATA_SIZE, nullptr, GL_STATIC_DRAW);
+
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glCreateBuffers(1, &m_PersistentInstanceDataBuffer);
+	glNamedBufferStorage(m_PersistentInstanceDataBuffer, INSTANCE_BUFFER_DATA_SIZE, nullptr, flags);
+
+	m_InstanceDataPtr = (char*)glMapNamedBufferRange(m_PersistentInstanceDataBuffer, 0, INSTANCE_BUFFER_DATA_SIZE, flags);
+
+	// Bind buffer to binding point 1
+	//glVertexArrayVertexBuffer(m_VertexArray, 1, m_InstanceDataBuffer[0], 0, 64);
+	glVertexArrayVertexBuffer(m_VertexArray, 1, m_PersistentInstanceDataBuffer, 0, 64);
+
+	// Enable attribute indices
+	glEnableVertexArrayAttrib(m_VertexArray, 1);
+	glEnableVertexArrayAttrib(m_VertexArray, 2);
+	glEnableVertexArrayAttrib(m_VertexArray, 3);
+	glEnableVertexArrayAttrib(m_VertexArray, 4);
+
+	// Associate Binding Index with attribute indices
+	glVertexArrayAttribBinding(m_VertexArray, 1, 1);
+	glVertexArrayAttribBinding(m_VertexArray, 2, 1);
+	glVertexArrayAttribBinding(m_VertexArray, 3, 1);
+	glVertexArrayAttribBinding(m_VertexArray, 4, 1);
+
+	// Specify layout of data for attribute indices
+	glVertexArrayAttribFormat(m_VertexArray, 1, 4, GL_FLOAT, GL_FALSE, 0);
+	glVertexArrayAttribFormat(m_VertexArray, 2, 4, GL_FLOAT, GL_FALSE, 16);
+	glVertexArrayAttribFormat(m_VertexArray, 3, 4, GL_FLOAT, GL_FALSE, 32);
+	glVertexArrayAttribFormat(m_VertexArray, 4, 4, GL_FLOAT, GL_FALSE, 48);
+
+	// Specify Divisor for Binding Index
+	glVertexArrayBindingDivisor(m_VertexArray, 1, 1);
+
+	// Core profile still wants a VAO bound for attributeless draws
+	glCreateVertexArrays(1, &m_EmptyVertexArray);
+
+	// Instance ranges expand their model matrices in the shader, nothing per instance to fetch
+	glCreateVertexArrays(1, &m_RangeVertexArray);
+
+	for (uint32_t i = 0; i < RENDERER_FRAME_SLOTS; i++)
+	{
+		m_Frames[i].instanceRegionOffset = (GLintptr)i * INSTANCE_REGION_SIZE;
+	}
+
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &m_StorageBufferAlignment);
+	m_UseIndirectCount = GLEW_VERSION_4_6 || GLEW_ARB_indirect_parameters;
+	LOG_INFO("Draw counts come from %s", m_UseIndirectCount ? "the command ring" : "the CPU, no ARB_indirect_parameters")
+
+	// Recorded draws go out before whatever changes the state they were recorded under
+	GLState::Get().SetBeforeChange([this]() { FlushDraws(); });
+
+	LOG_INFO("Renderer initialized InstanceDataBuffer")
+}
+
+Renderer::~Renderer()
+{
+	GLState::Get().SetBeforeChange(nullptr);
+}
+
+void Renderer::SetVertexBuffer(GLuint vertexBufferID)
+{
+	LOG_INFO("Set vertex buffer for renderer")
+	m_VertexBufferID = vertexBufferID;
+	for (GLuint vertexArray : { m_VertexArray, m_RangeVertexArray })
+	{
+		glEnableVertexArrayAttrib(vertexArray, 0);
+		glVertexArrayVertexBuffer(vertexArray, 0, vertexBufferID, 0, sizeof(float) * 3);
+		glVertexArrayAttribFormat(vertexArray, 0, 3, GL_FLOAT, GL_FALSE, 0);
+	}
+}
+
+void Renderer::SetElementBuffer(GLuint elementBufferID)
+{
+	LOG_INFO("Set element buffer for renderer")
+	m_ElementBufferID = elementBufferID;
+	glVertexArrayElementBuffer(m_VertexArray, elementBufferID);
+	glVertexArrayElementBuffer(m_RangeVertexArray, elementBufferID);
+}
+
+void Renderer::SetGeoCount(size_t count)
+{
+	m_GeoManagerGeoCount = count;
+
+	// One command per geometry and view is the common case, the ring grows if a frame needs more
+	m_RequiredCommandCapacity = std::max(m_RequiredCommandCapacity, (uint32_t)count);
+}
+
+void Renderer::BeginScene()
+{
+	FlushDraws();
+
+	// Everything issued since the last BeginScene, including all DrawView calls, reads the
+	// instances of the drawn frame. The slot can't be rebuilt before this is signaled.
+	FrameState& drawFrame = m_Frames[m_DrawFrame];
+	if (drawFrame.fence)
+	{
+		glDeleteSync(drawFrame.fence);
+	}
+	drawFrame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	m_BuildFrame = (m_BuildFrame + 1) % RENDERER_FRAME_SLOTS;
+	FrameState& frame = m_Frames[m_BuildFrame];
+
+	// Wait buffer
+	GLenum waitReturn = GL_UNSIGNALED;
+	while (frame.fence && waitReturn != GL_ALREADY_SIGNALED && waitReturn != GL_CONDITION_SATISFIED)
+	{
+		waitReturn = glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1);
+	}
+	if (frame.fence)
+	{
+		glDeleteSync(frame.fence);
+		frame.fence = nullptr;
+	}
+
+	frame.views.clear();
+	frame.ranges.clear();
+	frame.rangeDataCount = 0;
+	frame.drawDataCount = 0;
+	frame.instanceBytes = 0;
+	frame.immediateBytes = 0;
+	frame.depthSort = m_DepthSort;
+
+	// No worker runs between frames, so this is the one place the ring can be swapped out
+	if (m_RequiredCommandCapacity > m_CommandRingCapacity)
+	{
+		GrowCommandRing(std::max(m_RequiredCommandCapacity, m_CommandRingCapacity * 2));
+	}
+
+	frame.commandBuffer = m_CommandRing;
+	frame.commandOffset = m_BuildFrame * m_CommandSlotSize;
+	frame.commandData = m_CommandRingData + frame.commandOffset;
+	frame.commandCapacity = m_CommandRingCapacity;
+	frame.commandCount = 0;
+	frame.drawCommands.clear();
+
+	ReleaseRetiredCommandBuffers();
+
+	if (m_TraceRecorder)
+	{
+		m_TraceRecorder->BeginFrame();
+	}
+}
+
+ViewID Renderer::AddView(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix)
+{
+	FrameState& frame = m_Frames[m_BuildFrame];
+	assert(frame.views.size() < MAX_VIEWS);
+
+	if (m_TraceRecorder)
+	{
+		m_TraceRecorder->RecordView(viewMatrix, projectionMatrix);
+	}
+
+	View view{};
+	ExtractFrustumPlanes(projectionMatrix * viewMatrix, view.frustumPlanes);
+
+	// The camera looks down -z, negate the z row so depth grows away from it
+	view.depthAxis = -glm::vec4(viewMatrix[0][2], viewMatrix[1][2], viewMatrix[2][2], viewMatrix[3][2]);
+	frame.views.push_back(view);
+
+	return (ViewID)frame.views.size() - 1;
+}
+
+void Renderer::Submit(const Renderable& renderable)
+{
+	if (m_TraceRecorder)
+	{
+		m_TraceRecorder->RecordSubmit(renderable.geoID, renderable.modelTransform);
+	}
+
+	FrameState& frame = m_Frames[m_BuildFrame];
+
+	// Find DrawData entry for current geoID and queue
+	const size_t slot = (size_t)renderable.geoID * RENDER_QUEUE_COUNT + (uint32_t)renderable.queue;
+	if (slot >= m_DrawDataSlots.size())
+	{
+		m_DrawDataSlots.resize(slot + 1, 0);
+		m_SlotInstanceCounts.resize(slot + 1, 0);
+	}
+	uint32_t drawDataPos = m_DrawDataSlots[slot] - 1;
+
+	// Create new entry if no DrawData entry exists for current geoID, the slot may still have
+	// one with allocated vectors from an earlier frame
+	if(m_DrawDataSlots[slot] == 0)
+	{
+		drawDataPos = frame.drawDataCount++;
+		m_DrawDataSlots[slot] = drawDataPos + 1;
+
+		if (drawDataPos == frame.drawData.size())
+		{
+			frame.drawData.push_back(DrawData{});
+		}
+
+		// What the geometry got in the last frame it was submitted is a good guess for how many
+		// instances are coming
+		DrawData& drawData = frame.drawData[drawDataPos];
+		const uint32_t expectedInstances = std::max(m_SlotInstanceCounts[slot], 64u);
+
+		drawData.geoID = renderable.geoID;
+		drawData.queue = renderable.queue;
+		drawData.instanceCount = 0;
+		drawData.instanceData = ArenaVector<InstanceData>(FrameArena::Get().GetThreadArena());
+		drawData.instanceData.reserve(expectedInstances);
+	}
+
+	// Update DrawData entry
+	DrawData& drawData = frame.drawData[drawDataPos];
+	drawData.instanceCount++;
+	InstanceData instanceData;
+	instanceData.modelTransform = renderable.modelTransform;
+	drawData.instanceData.push_back(instanceData);
+}
+
+void Renderer::SubmitRange(const InstanceRange& range)
+{
+	const uint32_t instanceCount = range.GetInstanceCount();
+	if (instanceCount == 0)
+	{
+		return;
+	}
+
+	RangeDrawData rangeDrawData{};
+	rangeDrawData.geoID = range.geoID;
+	rangeDrawData.queue = range.queue;
+	rangeDrawData.instanceCount = instanceCount;
+	rangeDrawData.data.transform = range.transform;
+	rangeDrawData.data.stride = glm::vec4(range.stride, range.positionJitter);
+	rangeDrawData.data.countSeed = glm::uvec4(range.count.x, range.count.y, range.count.z, range.seed);
+	rangeDrawData.data.jitter = glm::vec4(range.rotationJitter, range.scaleJitter, 0.f, 0.f);
+
+	// Traces only know renderables, the replay draws the same instances one by one
+	if (m_TraceRecorder)
+	{
+		for (uint32_t i = 0; i < instanceCount; i++)
+		{
+			m_TraceRecorder->RecordSubmit(range.geoID, InstanceRangeTransform(rangeDrawData.data, i));
+		}
+	}
+
+	m_Frames[m_BuildFrame].ranges.push_back(rangeDrawData);
+}
+
+void Renderer::EndScene(JobSystem* jobSystem)
+{
+	CullScene(jobSystem);
+	PackScene(jobSystem);
+	UploadScene();
+}
+
+void Renderer::CullScene(JobSystem* jobSystem)
+{
+	const auto cullStart = std::chrono::steady_clock::now();
+
+	if (m_TraceRecorder)
+	{
+		m_TraceRecorder->EndFrame();
+	}
+
+	FrameState& frame = m_Frames[m_BuildFrame];
+	LinearArena& arena = FrameArena::Get().GetThreadArena();
+
+	ArenaVector<CullChunk> chunks(arena);
+	for (uint32_t i = 0; i < frame.drawDataCount; i++)
+	{
+		DrawData& drawData = frame.drawData[i];
+		const uint32_t instanceCount = (uint32_t)drawData.instanceData.size();
+		drawData.visibilityMasks = ArenaVector<uint32_t>(arena);
+		drawData.visibilityMasks.resize(instanceCount);
+		drawData.depthKeys = ArenaVector<uint32_t>(arena);
+		if (frame.depthSort)
+		{
+			drawData.depthKeys.resize(instanceCount);
+		}
+
+		for (uint32_t begin = 0; begin < instanceCount; begin += CULL_GRAIN_SIZE)
+		{
+			chunks.push_back({ i, begin, std::min(begin + CULL_GRAIN_SIZE, instanceCount) });
+		}
+	}
+
+	// Pass 1: test every instance against all views. Sorting follows the first view, usually
+	// the main camera.
+	const glm::vec4 depthAxis = frame.views.empty() ? glm::vec4(0.f) : frame.views[0].depthAxis;
+
+	auto cull = [&](uint32_t chunkBegin, uint32_t chunkEnd)
+	{
+		for (uint32_t c = chunkBegin; c < chunkEnd; c++)
+		{
+			const CullChunk& chunk = chunks[c];
+			DrawData& drawData = frame.drawData[chunk.drawData];
+			const Geometry& geometry = m_GeometryManager->GetGeometry(drawData.geoID);
+
+			for (uint32_t i = chunk.begin; i < chunk.end; i++)
+			{
+				const glm::mat4& model = drawData.instanceData[i].modelTransform;
+				const glm::vec3 center = glm::vec3(model * glm::vec4(geometry.boundsCenter, 1.f));
+				const float scale = std::max({
+					glm::length(glm::vec3(model[0])),
+					glm::length(glm::vec3(model[1])),
+					glm::length(glm::vec3(model[2]))
+				});
+
+				drawData.visibilityMasks[i] = CalculateVisibilityMask(frame.views, center, geometry.boundsRadius * scale);
+
+				// Ascending keys draw opaque instances nearest first, inverted ones transparent
+				// instances farthest first
+				if (frame.depthSort)
+				{
+					const uint32_t key = RadixSort::FloatKey(glm::dot(depthAxis, glm::vec4(center, 1.f)));
+					drawData.depthKeys[i] = drawData.queue == RenderQueue::Transparent ? ~key : key;
+				}
+			}
+		}
+	};
+
+	if (jobSystem)
+	{
+		jobSystem->ParallelFor((uint32_t)chunks.size(), 1, cull);
+	}
+	else
+	{
+		cull(0, (uint32_t)chunks.size());
+	}
+
+	// Few and coarse, one sphere per range
+	for (RangeDrawData& range : frame.ranges)
+	{
+		glm::vec3 center;
+		float radius;
+		GetRangeBounds(range.data, m_GeometryManager->GetGeometry(range.geoID), center, radius);
+
+		range.visibilityMask = CalculateVisibilityMask(frame.views, center, radius);
+		range.sortKey = 0;
+		if (frame.depthSort)
+		{
+			const uint32_t key = RadixSort::FloatKey(glm::dot(depthAxis, glm::vec4(center, 1.f)));
+			range.sortKey = range.queue == RenderQueue::Transparent ? ~key : key;
+		}
+	}
+
+	m_CullTime += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - cullStart).count();
+	m_CulledViews += frame.views.size();
+	m_CulledFrames++;
+}
+
+void Renderer::PackScene(JobSystem* jobSystem)
+{
+	const auto packStart = std::chrono::steady_clock::now();
+	FrameState& frame = m_Frames[m_BuildFrame];
+	LinearArena& arena = FrameArena::Get().GetThreadArena();
+
+	uint32_t baseInstance = (uint32_t)(frame.instanceRegionOffset / sizeof(InstanceData));
+	GLintptr instanceBytes = 0;
+
+	for (uint32_t d = 0; d < frame.drawDataCount; d++)
+	{
+		DrawData& drawData = frame.drawData[d];
+		drawData.drawGeometry = nullptr;
+
+		// Count instances per distinct mask
+		drawData.maskGroups = ArenaVector<MaskGroup>(arena);
+		drawData.sortKey = UINT32_MAX;
+		size_t lastGroup = 0;
+
+		for (size_t i = 0; i < drawData.visibilityMasks.size(); i++)
+		{
+			const uint32_t mask = drawData.visibilityMasks[i];
+			if (mask == 0)
+			{
+				continue;
+			}
+
+			if (frame.depthSort)
+			{
+				drawData.sortKey = std::min(drawData.sortKey, drawData.depthKeys[i]);
+			}
+
+			// Neighbouring instances usually share a mask, so check the last hit first
+			if (lastGroup >= drawData.maskGroups.size() || drawData.maskGroups[lastGroup].mask != mask)
+			{
+				lastGroup = 0;
+				while (lastGroup < drawData.maskGroups.size() && drawData.maskGroups[lastGroup].mask != mask)
+				{
+					lastGroup++;
+				}
+
+				if (lastGroup == drawData.maskGroups.size())
+				{
+					drawData.maskGroups.push_back({ mask, 0, 0 });
+				}
+			}
+
+			drawData.maskGroups[lastGroup].count++;
+		}
+
+		if (drawData.maskGroups.empty())
+		{
+			continue;
+		}
+
+		// Evicted geometry is culled with its own bounds but drawn as whatever stands in for it
+		GeoID drawGeoID = drawData.geoID;
+		if (m_ResidencyManager)
+		{
+			drawGeoID = m_ResidencyManager->RequestDraw(drawData.geoID);
+			if (drawGeoID == 0)
+			{
+				continue;
+			}
+		}
+		drawData.drawGeometry = &m_GeometryManager->GetGeometry(drawGeoID);
+
+		// Pass 2: give every mask group a contiguous range so each view can address it with baseInstance
+		uint32_t visibleCount = 0;
+		for (MaskGroup& group : drawData.maskGroups)
+		{
+			group.offset = visibleCount;
+			visibleCount += group.count;
+		}
+
+		const size_t instanceDataSize = visibleCount * sizeof(InstanceData);
+		assert(instanceBytes + instanceDataSize <= INSTANCE_REGION_SIZE);
+
+		drawData.firstInstance = baseInstance;
+		baseInstance += visibleCount;
+		instanceBytes += instanceDataSize;
+	}
+
+	// The descriptors of the visible ranges follow the instances, aligned so they can be bound
+	// as a storage buffer range
+	const GLintptr alignment = m_StorageBufferAlignment;
+	frame.rangeDataOffset = (frame.instanceRegionOffset + instanceBytes + alignment - 1) / alignment * alignment;
+	InstanceRangeData* rangeData = reinterpret_cast<InstanceRangeData*>(m_InstanceDataPtr + frame.rangeDataOffset);
+
+	for (RangeDrawData& range : frame.ranges)
+	{
+		range.drawGeometry = nullptr;
+		if (range.visibilityMask == 0)
+		{
+			continue;
+		}
+
+		GeoID drawGeoID = range.geoID;
+		if (m_ResidencyManager)
+		{
+			drawGeoID = m_ResidencyManager->RequestDraw(range.geoID);
+			if (drawGeoID == 0)
+			{
+				continue;
+			}
+		}
+		range.drawGeometry = &m_GeometryManager->GetGeometry(drawGeoID);
+		range.rangeIndex = frame.rangeDataCount;
+		rangeData[frame.rangeDataCount++] = range.data;
+	}
+
+	if (frame.rangeDataCount > 0)
+	{
+		// DrawIndexed writes right behind, keep that on an InstanceData boundary
+		const GLintptr rangeEnd = frame.rangeDataOffset + frame.rangeDataCount * sizeof(InstanceRangeData) - frame.instanceRegionOffset;
+		instanceBytes = (rangeEnd + sizeof(InstanceData) - 1) / sizeof(InstanceData) * sizeof(InstanceData);
+		assert(instanceBytes <= INSTANCE_REGION_SIZE);
+	}
+
+	frame.instanceBytes = instanceBytes;
+	m_SortedFrames += frame.depthSort ? 1 : 0;
+
+	// Pass 3: scatter the visible instances straight into the persistently mapped buffer, every
+	// bucket owns its own range. Depth sorted frames scatter in key order, so each mask group's
+	// range comes out sorted while staying where its baseInstance points.
+	auto scatter = [&](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t d = begin; d < end; d++)
+		{
+			const DrawData& drawData = frame.drawData[d];
+			if (!drawData.drawGeometry)
+			{
+				continue;
+			}
+
+			LinearArena& threadArena = FrameArena::Get().GetThreadArena();
+			InstanceData* out = reinterpret_cast<InstanceData*>(m_InstanceDataPtr) + drawData.firstInstance;
+			ArenaVector<uint32_t> cursors(drawData.maskGroups.size(), 0, threadArena);
+			size_t lastGroup = 0;
+
+			auto place = [&](uint32_t i)
+			{
+				const uint32_t mask = drawData.visibilityMasks[i];
+				if (drawData.maskGroups[lastGroup].mask != mask)
+				{
+					lastGroup = 0;
+					while (drawData.maskGroups[lastGroup].mask != mask)
+					{
+						lastGroup++;
+					}
+				}
+
+				out[drawData.maskGroups[lastGroup].offset + cursors[lastGroup]++] = drawData.instanceData[i];
+			};
+
+			if (!frame.depthSort)
+			{
+				for (uint32_t i = 0; i < (uint32_t)drawData.instanceData.size(); i++)
+				{
+					if (drawData.visibilityMasks[i] != 0)
+					{
+						place(i);
+					}
+				}
+				continue;
+			}
+
+			const MaskGroup& lastMaskGroup = drawData.maskGroups.back();
+			const uint32_t visibleCount = lastMaskGroup.offset + lastMaskGroup.count;
+			ArenaVector<uint32_t> keys(visibleCount, 0, threadArena);
+			ArenaVector<uint32_t> indices(visibleCount, 0, threadArena);
+			ArenaVector<uint32_t> scratchKeys(visibleCount, 0, threadArena);
+			ArenaVector<uint32_t> scratchIndices(visibleCount, 0, threadArena);
+
+			uint32_t visible = 0;
+			for (uint32_t i = 0; i < (uint32_t)drawData.instanceData.size(); i++)
+			{
+				if (drawData.visibilityMasks[i] != 0)
+				{
+					keys[visible] = drawData.depthKeys[i];
+					indices[visible] = i;
+					visible++;
+				}
+			}
+
+			const auto sortStart = std::chrono::steady_clock::now();
+			RadixSort::Sort(keys.data(), indices.data(), visibleCount, scratchKeys.data(), scratchIndices.data(), jobSystem);
+			const auto sortTime = std::chrono::steady_clock::now() - sortStart;
+
+			m_SortTime.fetch_add((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(sortTime).count(), std::memory_order_relaxed);
+			m_SortedInstances.fetch_add(visibleCount, std::memory_order_relaxed);
+
+			for (uint32_t i : indices)
+			{
+				place(i);
+			}
+		}
+	};
+
+	if (jobSystem)
+	{
+		jobSystem->ParallelFor(frame.drawDataCount, 1, scatter);
+	}
+	else
+	{
+		scatter(0, frame.drawDataCount);
+	}
+
+	// Every view that sees a mask group gets a command pointing at the same instance range
+	auto forEachView = [](uint32_t mask, auto&& function)
+	{
+		for (uint32_t bits = mask; bits != 0; bits &= bits - 1)
+		{
+			ViewID viewID = 0;
+			while (((bits >> viewID) & 1) == 0)
+			{
+				viewID++;
+			}
+
+			function(viewID);
+		}
+	};
+
+	// Depth sorted transparent buckets go out as runs of one order across all of them instead of
+	// bucket by bucket
+	ArenaVector<SortedRun> transparentRuns(arena);
+	if (frame.depthSort)
+	{
+		SortTransparentRuns(frame, transparentRuns, jobSystem);
+	}
+	auto drawnAsRuns = [&](const DrawData& drawData)
+	{
+		return frame.depthSort && drawData.queue == RenderQueue::Transparent;
+	};
+
+	for (uint32_t d = 0; d < frame.drawDataCount; d++)
+	{
+		const DrawData& drawData = frame.drawData[d];
+		const uint32_t queue = (uint32_t)drawData.queue;
+		const size_t slot = (size_t)drawData.geoID * RENDER_QUEUE_COUNT + queue;
+		m_DrawDataSlots[slot] = 0;
+		m_SlotInstanceCounts[slot] = drawData.instanceCount;
+
+		if (!drawData.drawGeometry || drawnAsRuns(drawData))
+		{
+			continue;
+		}
+
+		for (const MaskGroup& group : drawData.maskGroups)
+		{
+			forEachView(group.mask, [&](ViewID viewID)
+			{
+				frame.views[viewID].commandCount[queue]++;
+				frame.views[viewID].visibleInstances += group.count;
+			});
+		}
+	}
+
+	for (const SortedRun& run : transparentRuns)
+	{
+		forEachView(run.mask, [&](ViewID viewID)
+		{
+			frame.views[viewID].commandCount[(uint32_t)RenderQueue::Transparent]++;
+			frame.views[viewID].visibleInstances += run.count;
+		});
+	}
+
+	for (const RangeDrawData& range : frame.ranges)
+	{
+		if (!range.drawGeometry)
+		{
+			continue;
+		}
+
+		forEachView(range.visibilityMask, [&](ViewID viewID)
+		{
+			frame.views[viewID].rangeCommandCount[(uint32_t)range.queue]++;
+			frame.views[viewID].visibleInstances += range.instanceCount;
+		});
+	}
+
+	// All views share one indirect buffer, each one owns a contiguous range of it per queue and
+	// source. The range commands come after every view's renderable commands.
+	frame.commandCount = 0;
+	for (View& view : frame.views)
+	{
+		for (uint32_t queue = 0; queue < RENDER_QUEUE_COUNT; queue++)
+		{
+			view.firstCommand[queue] = frame.commandCount;
+			frame.commandCount += view.commandCount[queue];
+		}
+	}
+	for (View& view : frame.views)
+	{
+		for (uint32_t queue = 0; queue < RENDER_QUEUE_COUNT; queue++)
+		{
+			view.firstRangeCommand[queue] = frame.commandCount;
+			frame.commandCount += view.rangeCommandCount[queue];
+		}
+	}
+
+	// Buckets with nearer instances first, the transparent ones of depth sorted frames follow as
+	// runs below
+	ArenaVector<uint32_t> bucketOrder(frame.drawDataCount, 0, arena);
+	for (uint32_t d = 0; d < frame.drawDataCount; d++)
+	{
+		bucketOrder[d] = d;
+	}
+	if (frame.depthSort)
+	{
+		std::sort(bucketOrder.begin(), bucketOrder.end(), [&](uint32_t a, uint32_t b) { return frame.drawData[a].sortKey < frame.drawData[b].sortKey; });
+	}
+
+	ArenaVector<DrawCommand> commands(frame.commandCount, DrawCommand{}, arena);
+	uint32_t viewCursors[MAX_VIEWS][RENDER_QUEUE_COUNT] = {};
+
+	for (uint32_t d : bucketOrder)
+	{
+		const DrawData& drawData = frame.drawData[d];
+		const uint32_t queue = (uint32_t)drawData.queue;
+		if (!drawData.drawGeometry || drawnAsRuns(drawData))
+		{
+			continue;
+		}
+
+		for (const MaskGroup& group : drawData.maskGroups)
+		{
+			DrawCommand drawCommand{};
+			drawCommand.elementCount = drawData.drawGeometry->elementCount;
+			drawCommand.instanceCount = group.count;
+			drawCommand.baseVertex = drawData.drawGeometry->baseVertex;
+			drawCommand.firstIndex = drawData.drawGeometry->firstIndex;
+			drawCommand.baseInstance = drawData.firstInstance + group.offset;
+
+			forEachView(group.mask, [&](ViewID viewID)
+			{
+				commands[frame.views[viewID].firstCommand[queue] + viewCursors[viewID][queue]++] = drawCommand;
+			});
+		}
+	}
+
+	// Back to front across buckets, every view gets the runs it sees in the order of view 0
+	const uint32_t transparentQueue = (uint32_t)RenderQueue::Transparent;
+	for (const SortedRun& run : transparentRuns)
+	{
+		const Geometry& geometry = *frame.drawData[run.drawData].drawGeometry;
+
+		DrawCommand drawCommand{};
+		drawCommand.elementCount = geometry.elementCount;
+		drawCommand.instanceCount = run.count;
+		drawCommand.baseVertex = geometry.baseVertex;
+		drawCommand.firstIndex = geometry.firstIndex;
+		drawCommand.baseInstance = run.firstInstance;
+
+		forEachView(run.mask, [&](ViewID viewID)
+		{
+			commands[frame.views[viewID].firstCommand[transparentQueue] + viewCursors[viewID][transparentQueue]++] = drawCommand;
+		});
+	}
+
+	// One command per range and view that sees it, baseInstance is the range index. Ranges aren't
+	// sorted inside, only against each other by their centers.
+	ArenaVector<uint32_t> rangeOrder(frame.ranges.size(), 0, arena);
+	for (uint32_t r = 0; r < (uint32_t)frame.ranges.size(); r++)
+	{
+		rangeOrder[r] = r;
+	}
+	if (frame.depthSort)
+	{
+		std::sort(rangeOrder.begin(), rangeOrder.end(), [&](uint32_t a, uint32_t b) { return frame.ranges[a].sortKey < frame.ranges[b].sortKey; });
+	}
+
+	uint32_t rangeCursors[MAX_VIEWS][RENDER_QUEUE_COUNT] = {};
+	for (uint32_t r : rangeOrder)
+	{
+		const RangeDrawData& range = frame.ranges[r];
+		const uint32_t queue = (uint32_t)range.queue;
+		if (!range.drawGeometry)
+		{
+			continue;
+		}
+
+		DrawCommand drawCommand{};
+		drawCommand.elementCount = range.drawGeometry->elementCount;
+		drawCommand.instanceCount = range.instanceCount;
+		drawCommand.baseVertex = range.drawGeometry->baseVertex;
+		drawCommand.firstIndex = range.drawGeometry->firstIndex;
+		drawCommand.baseInstance = range.rangeIndex;
+
+		forEachView(range.visibilityMask, [&](ViewID viewID)
+		{
+			commands[frame.views[viewID].firstRangeCommand[queue] + rangeCursors[viewID][queue]++] = drawCommand;
+		});
+	}
+
+	frame.drawPath = m_DrawPath;
+	if (frame.commandCount <= frame.commandCapacity)
+	{
+		WriteCommands(frame, commands.data(), frame.commandData);
+	}
+	else
+	{
+		// Too big for the ring slot, UploadScene finds these a buffer. It may run after the frame
+		// arena was reset, so they need a copy of their own.
+		frame.drawCommands.assign(commands.begin(), commands.end());
+	}
+
+	m_PackTime += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - packStart).count();
+}
+
+void Renderer::SortTransparentRuns(const FrameState& frame, ArenaVector<SortedRun>& runs, JobSystem* jobSystem)
+{
+	LinearArena& arena = FrameArena::Get().GetThreadArena();
+
+	// Every mask group of the drawn transparent buckets gets an index across all of them
+	ArenaVector<uint32_t> firstGroup(frame.drawDataCount, 0, arena);
+	ArenaVector<uint32_t> groupDrawData(arena);
+	uint32_t visibleCount = 0;
+	for (uint32_t d = 0; d < frame.drawDataCount; d++)
+	{
+		const DrawData& drawData = frame.drawData[d];
+		firstGroup[d] = (uint32_t)groupDrawData.size();
+		if (!drawData.drawGeometry || drawData.queue != RenderQueue::Transparent)
+		{
+			continue;
+		}
+
+		groupDrawData.insert(groupDrawData.end(), drawData.maskGroups.size(), d);
+		visibleCount += drawData.maskGroups.back().offset + drawData.maskGroups.back().count;
+	}
+
+	if (visibleCount == 0)
+	{
+		return;
+	}
+
+	ArenaVector<uint32_t> keys(visibleCount, 0, arena);
+	ArenaVector<uint32_t> groups(visibleCount, 0, arena);
+	ArenaVector<uint32_t> scratchKeys(visibleCount, 0, arena);
+	ArenaVector<uint32_t> scratchGroups(visibleCount, 0, arena);
+
+	uint32_t visible = 0;
+	for (uint32_t d = 0; d < frame.drawDataCount; d++)
+	{
+		const DrawData& drawData = frame.drawData[d];
+		if (!drawData.drawGeometry || drawData.queue != RenderQueue::Transparent)
+		{
+			continue;
+		}
+
+		size_t lastGroup = 0;
+		for (uint32_t i = 0; i < (uint32_t)drawData.instanceData.size(); i++)
+		{
+			const uint32_t mask = drawData.visibilityMasks[i];
+			if (mask == 0)
+			{
+				continue;
+			}
+
+			if (drawData.maskGroups[lastGroup].mask != mask)
+			{
+				lastGroup = 0;
+				while (drawData.maskGroups[lastGroup].mask != mask)
+				{
+					lastGroup++;
+				}
+			}
+
+			keys[visible] = drawData.depthKeys[i];
+			groups[visible] = firstGroup[d] + (uint32_t)lastGroup;
+			visible++;
+		}
+	}
+
+	const auto sortStart = std::chrono::steady_clock::now();
+	RadixSort::Sort(keys.data(), groups.data(), visibleCount, scratchKeys.data(), scratchGroups.data(), jobSystem);
+	const auto sortTime = std::chrono::steady_clock::now() - sortStart;
+
+	m_SortTime.fetch_add((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(sortTime).count(), std::memory_order_relaxed);
+	m_SortedInstances.fetch_add(visibleCount, std::memory_order_relaxed);
+
+	// Both sorts are stable and saw the instances in the same order, so a group's entries come
+	// out in the order scatter placed them and every run is a contiguous piece of its range
+	ArenaVector<uint32_t> cursors(groupDrawData.size(), 0, arena);
+	runs.reserve(visibleCount);
+	uint32_t runGroup = UINT32_MAX;
+	for (uint32_t group : groups)
+	{
+		if (group != runGroup)
+		{
+			const uint32_t d = groupDrawData[group];
+			const DrawData& drawData = frame.drawData[d];
+			const MaskGroup& maskGroup = drawData.maskGroups[group - firstGroup[d]];
+			runs.push_back({ maskGroup.mask, d, drawData.firstInstance + maskGroup.offset + cursors[group], 0 });
+			runGroup = group;
+		}
+
+		runs.back().count++;
+		cursors[group]++;
+	}
+}
+
+void Renderer::UploadScene(bool previousFrame)
+{
+	m_DrawFrame = previousFrame ? (m_BuildFrame + RENDERER_FRAME_SLOTS - 1) % RENDERER_FRAME_SLOTS : m_BuildFrame;
+	FrameState& frame = m_Frames[m_DrawFrame];
+
+	LOG_TRACE("Copied %d bytes into instance data buffer for %d views", (int)frame.instanceBytes, (int)frame.views.size())
+
+	if (frame.commandCount <= frame.commandCapacity)
+	{
+		return;
+	}
+
+	// Rare, the ring grows at the next BeginScene. Until then the frame gets a buffer of its own
+	// with the same layout, deleted once the slot is reused.
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	const CommandLayout layout = GetCommandLayout(frame.commandCount);
+
+	GLuint buffer = 0;
+	glCreateBuffers(1, &buffer);
+	glNamedBufferStorage(buffer, layout.size, nullptr, flags);
+
+	frame.commandBuffer = buffer;
+	frame.commandOffset = 0;
+	frame.commandData = (char*)glMapNamedBufferRange(buffer, 0, layout.size, flags);
+	frame.commandCapacity = frame.commandCount;
+	WriteCommands(frame, frame.drawCommands.data(), frame.commandData);
+
+	m_RetiredCommandBuffers.push_back(buffer);
+	m_RequiredCommandCapacity = std::max(m_RequiredCommandCapacity, frame.commandCount);
+}
+
+void Renderer::DrawView(ViewID viewID, GLenum mode, RenderQueue queue, InstanceSource source)
+{
+	// Drawn first even if the state below is already bound
+	FlushDraws();
+
+	const FrameState& frame = m_Frames[m_DrawFrame];
+	assert(viewID < frame.views.size());
+
+	uint32_t firstCommand, commandCount;
+	GLintptr drawCountOffset;
+	GetCommandList(frame, viewID, queue, source, firstCommand, commandCount, drawCountOffset);
+
+	if (commandCount == 0)
+	{
+		return;
+	}
+
+	if (source == InstanceSource::Ranges)
+	{
+		BindRangeBuffer(frame);
+	}
+
+	const CommandLayout layout = GetCommandLayout(frame.commandCapacity);
+
+	if (frame.drawPath == DrawPath::VertexPulling)
+	{
+		BindPullBuffers(frame);
+
+		const GLintptr commandOffset = frame.commandOffset + layout.pullCommands + firstCommand * sizeof(DrawArraysCommand);
+		if (m_UseIndirectCount)
+		{
+			MultiDrawArraysIndirectCount(mode, (const void*)commandOffset, drawCountOffset, commandCount);
+		}
+		else
+		{
+			glMultiDrawArraysIndirect(mode, (const void*)commandOffset, commandCount, 0);
+		}
+		return;
+	}
+
+	GLState& state = GLState::Get();
+	state.BindBuffer(GL_DRAW_INDIRECT_BUFFER, frame.commandBuffer);
+	if (m_UseIndirectCount)
+	{
+		state.BindBuffer(GL_PARAMETER_BUFFER, frame.commandBuffer);
+	}
+	state.BindVertexArray(source == InstanceSource::Ranges ? m_RangeVertexArray : m_VertexArray);
+
+	const GLintptr commandOffset = frame.commandOffset + layout.drawCommands + firstCommand * sizeof(DrawCommand);
+	if (m_UseIndirectCount)
+	{
+		MultiDrawElementsIndirectCount(mode, GL_UNSIGNED_INT, (const void*)commandOffset, drawCountOffset, commandCount);
+	}
+	else
+	{
+		glMultiDrawElementsIndirect(mode, GL_UNSIGNED_INT, (const void*)commandOffset, commandCount, 0);
+	}
+}
+
+void Renderer::DrawViewPointQuads(ViewID viewID, RenderQueue queue, InstanceSource source)
+{
+	FlushDraws();
+
+	const FrameState& frame = m_Frames[m_DrawFrame];
+	if (frame.drawPath == DrawPath::VertexAttributes)
+	{
+		DrawView(viewID, GL_POINTS, queue, source);
+		return;
+	}
+
+	assert(viewID < frame.views.size());
+
+	uint32_t firstCommand, commandCount;
+	GLintptr drawCountOffset;
+	GetCommandList(frame, viewID, queue, source, firstCommand, commandCount, drawCountOffset);
+
+	if (commandCount == 0)
+	{
+		return;
+	}
+
+	if (source == InstanceSource::Ranges)
+	{
+		BindRangeBuffer(frame);
+	}
+	BindPullBuffers(frame);
+
+	// The quad commands follow the line commands of all views
+	const CommandLayout layout = GetCommandLayout(frame.commandCapacity);
+	const GLintptr commandOffset = frame.commandOffset + layout.pullCommands + (frame.commandCount + firstCommand) * sizeof(DrawArraysCommand);
+
+	if (m_UseIndirectCount)
+	{
+		MultiDrawArraysIndirectCount(GL_TRIANGLE_STRIP, (const void*)commandOffset, drawCountOffset, commandCount);
+	}
+	else
+	{
+		glMultiDrawArraysIndirect(GL_TRIANGLE_STRIP, (const void*)commandOffset, commandCount, 0);
+	}
+}
+
+void Renderer::DrawIndexed(const Renderable& renderable, GLenum mode)
+{
+	assert(m_GeometryManager->GetGeometry(renderable.geoID).resident && "DrawIndexed doesn't go through the residency manager");
+	m_ImmediateDraws.push_back({ renderable.geoID, mode, renderable.modelTransform });
+	if (renderable.geoID >= m_ImmediateCommandSlots.size())
+	{
+		m_ImmediateCommandSlots.resize((size_t)renderable.geoID + 1, 0);
+	}
+	m_ImmediateDrawCount++;
+}
+
+void Renderer::FlushDraws()
+{
+	// Binding for the draws below runs GLState's hook, which lands back here
+	if (m_ImmediateDraws.empty() || m_FlushingDraws)
+	{
+		return;
+	}
+	m_FlushingDraws = true;
+
+	GLState& state = GLState::Get();
+	const bool keepOrder = state.IsEnabled(GL_BLEND) || !state.IsEnabled(GL_DEPTH_TEST);
+
+	state.PointSize(10.f);
+	state.BindVertexArray(m_VertexArray);
+	state.BindBuffer(GL_DRAW_INDIRECT_BUFFER, m_PersistentInstanceDataBuffer);
+	if (m_UseIndirectCount)
+	{
+		state.BindBuffer(GL_PARAMETER_BUFFER, m_PersistentInstanceDataBuffer);
+	}
+
+	FrameState& frame = m_Frames[m_DrawFrame];
+	size_t begin = 0;
+	while (begin < m_ImmediateDraws.size())
+	{
+		size_t end = begin + 1;
+		while (end < m_ImmediateDraws.size() && m_ImmediateDraws[end].mode == m_ImmediateDraws[begin].mode)
+		{
+			end++;
+		}
+		FlushDrawBatch(frame, begin, end, keepOrder);
+		begin = end;
+	}
+	m_ImmediateDraws.clear();
+
+	// Everything lands behind the drawn frame's instances. If BeginScene already fenced the slot,
+	// a later fence has to cover these draws as well.
+	if (frame.fence)
+	{
+		glDeleteSync(frame.fence);
+		frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	m_FlushingDraws = false;
+}
+
+void Renderer::FlushDrawBatch(FrameState& frame, size_t begin, size_t end, bool keepOrder)
+{
+	// One command per run of the same geometry when order matters, per geometry otherwise
+	m_ImmediateCommands.clear();
+	m_ImmediateDrawCommands.resize(end - begin);
+	for (size_t i = begin; i < end; i++)
+	{
+		const GeoID geoID = m_ImmediateDraws[i].geoID;
+		uint32_t command = (uint32_t)m_ImmediateCommands.size();
+		if (keepOrder)
+		{
+			if (i > begin && m_ImmediateDraws[i - 1].geoID == geoID)
+			{
+				command--;
+			}
+		}
+		else if (m_ImmediateCommandSlots[geoID] != 0)
+		{
+			command = m_ImmediateCommandSlots[geoID] - 1;
+		}
+
+		if (command == m_ImmediateCommands.size())
+		{
+			const Geometry& geometry = m_GeometryManager->GetGeometry(geoID);
+			m_ImmediateCommands.push_back({ (GLuint)geometry.elementCount, 0, geometry.firstIndex, geometry.baseVertex, 0 });
+			m_ImmediateCommandSlots[geoID] = command + 1;
+		}
+		m_ImmediateCommands[command].instanceCount++;
+		m_ImmediateDrawCommands[i - begin] = command;
+	}
+
+	// Instances of a command back to back, then the commands and their count
+	const GLintptr instanceOffset = frame.instanceRegionOffset + frame.instanceBytes + frame.immediateBytes;
+	const GLintptr commandOffset = instanceOffset + (GLintptr)((end - begin) * sizeof(InstanceData));
+	const GLintptr drawCountOffset = commandOffset + (GLintptr)(m_ImmediateCommands.size() * sizeof(DrawCommand));
+	const GLintptr batchEnd = drawCountOffset + (GLintptr)sizeof(GLuint);
+	frame.immediateBytes = (batchEnd - frame.instanceRegionOffset + sizeof(InstanceData) - 1) / sizeof(InstanceData) * sizeof(InstanceData) - frame.instanceBytes;
+	assert(frame.instanceBytes + frame.immediateBytes <= INSTANCE_REGION_SIZE);
+
+	uint32_t baseInstance = (uint32_t)(instanceOffset / sizeof(InstanceData));
+	for (DrawCommand& command : m_ImmediateCommands)
+	{
+		command.baseInstance = baseInstance;
+		baseInstance += command.instanceCount;
+		command.instanceCount = 0;
+	}
+
+	InstanceData* instances = (InstanceData*)m_InstanceDataPtr;
+	for (size_t i = begin; i < end; i++)
+	{
+		DrawCommand& command = m_ImmediateCommands[m_ImmediateDrawCommands[i - begin]];
+		instances[command.baseInstance + command.instanceCount].modelTransform = m_ImmediateDraws[i].modelTransform;
+		command.instanceCount++;
+		m_ImmediateCommandSlots[m_ImmediateDraws[i].geoID] = 0;
+	}
+	memcpy(m_InstanceDataPtr + commandOffset, m_ImmediateCommands.data(), m_ImmediateCommands.size() * sizeof(DrawCommand));
+	const GLuint commandCount = (GLuint)m_ImmediateCommands.size();
+	memcpy(m_InstanceDataPtr + drawCountOffset, &commandCount, sizeof(GLuint));
+
+	// Counted from the buffer wherever DrawView is, the parameter buffer it leaves bound is ours then
+	const GLenum mode = m_ImmediateDraws[begin].mode;
+	if (m_UseIndirectCount)
+	{
+		MultiDrawElementsIndirectCount(mode, GL_UNSIGNED_INT, (const void*)commandOffset, drawCountOffset, (GLsizei)commandCount);
+	}
+	else
+	{
+		glMultiDrawElementsIndirect(mode, GL_UNSIGNED_INT, (const void*)commandOffset, (GLsizei)commandCount, 0);
+	}
+	m_ImmediateMultiDrawCount++;
+	m_ImmediateCommandCount += m_ImmediateCommands.size();
+}
+
+void Renderer::LogStats() const
+{
+	if (m_ImmediateDrawCount > 0)
+	{
+		LOG_INFO("DrawIndexed: %llu draws in %llu multi-draws of %llu commands, %.1f draws per multi-draw",
+			(unsigned long long)m_ImmediateDrawCount, (unsigned long long)m_ImmediateMultiDrawCount, (unsigned long long)m_ImmediateCommandCount,
+			(double)m_ImmediateDrawCount / std::max<uint64_t>(m_ImmediateMultiDrawCount, 1))
+	}
+
+	if (m_CulledFrames > 0)
+	{
+		const double frames = (double)m_CulledFrames;
+		LOG_INFO("Culling: %.1f views per frame, %.3f ms cull and %.3f ms pack per frame",
+			m_CulledViews / frames, m_CullTime / 1e6 / frames, m_PackTime / 1e6 / frames)
+	}
+
+	if (m_SortedFrames == 0)
+	{
+		LOG_INFO("Depth sort: off")
+		return;
+	}
+
+	const double sortMs = m_SortTime.load() / 1e6;
+	LOG_INFO("Depth sort: %u frames, %.1f instances/frame, %.3f ms/frame summed over threads",
+		m_SortedFrames, (double)m_SortedInstances.load() / m_SortedFrames, sortMs / m_SortedFrames)
+}
+
+void Renderer::ExtractFrustumPlanes(const glm::mat4& viewProjection, glm::vec4* planes)
+{
+	// Gribb/Hartmann, glm is column major so row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+	auto row = [&](int i) { return glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]); };
+
+	planes[0] = row(3) + row(0); // left
+	planes[1] = row(3) - row(0); // right
+	planes[2] = row(3) + row(1); // bottom
+	planes[3] = row(3) - row(1); // top
+	planes[4] = row(3) + row(2); // near
+	planes[5] = row(3) - row(2); // far
+
+	for (int i = 0; i < 6; i++)
+	{
+		planes[i] = planes[i] / glm::length(glm::vec3(planes[i]));
+	}
+}
+
+void Renderer::GetRangeBounds(const InstanceRangeData& range, const Geometry& geometry, glm::vec3& center, float& radius)
+{
+	const glm::vec3 stride = glm::vec3(range.stride);
+	const glm::vec3 lastCell((float)range.countSeed.x - 1.f, (float)range.countSeed.y - 1.f, (float)range.countSeed.z - 1.f);
+
+	// Box around the cell origins, grown by how far the jitter can move them
+	const glm::vec3 localCenter = lastCell * stride * 0.5f;
+	const glm::vec3 halfSize = glm::abs(localCenter) + glm::abs(stride) * (range.stride.w * 0.5f);
+
+	// The rotation turns the geometry about its origin, so its sphere has to hold the origin too
+	const float instanceRadius = (glm::length(geometry.boundsCenter) + geometry.boundsRadius) * (1.f + range.jitter.y);
+
+	const glm::mat4& model = range.transform;
+	const float scale = std::max({
+		glm::length(glm::vec3(model[0])),
+		glm::length(glm::vec3(model[1])),
+		glm::length(glm::vec3(model[2]))
+	});
+
+	center = glm::vec3(model * glm::vec4(localCenter, 1.f));
+	radius = (glm::length(halfSize) + instanceRadius) * scale;
+}
+
+uint32_t Renderer::CalculateVisibilityMask(const std::vector<View>& views, const glm::vec3& center, float radius)
+{
+	uint32_t mask = 0;
+	for (uint32_t viewID = 0; viewID < views.size(); viewID++)
+	{
+		const glm::vec4* planes = views[viewID].frustumPlanes;
+
+		bool visible = true;
+		for (int i = 0; i < 6 && visible; i++)
+		{
+			visible = glm::dot(glm::vec3(planes[i]), center) + planes[i].w > -radius;
+		}
+
+		mask |= (uint32_t)visible << viewID;
+	}
+	return mask;
+}
+
+Renderer::CommandLayout Renderer::GetCommandLayout(uint32_t capacity) const
+{
+	const GLintptr alignment = m_StorageBufferAlignment;
+	auto align = [alignment](GLintptr offset) { return (offset + alignment - 1) / alignment * alignment; };
+
+	CommandLayout layout;
+	layout.drawCommands = 0;
+	layout.pullCommands = align(layout.drawCommands + capacity * sizeof(DrawCommand));
+	layout.pullDrawParams = align(layout.pullCommands + 2 * capacity * sizeof(DrawArraysCommand));
+	layout.drawCounts = align(layout.pullDrawParams + capacity * sizeof(PullDrawParams));
+	layout.size = align(layout.drawCounts + 2 * MAX_VIEWS * RENDER_QUEUE_COUNT * sizeof(GLuint));
+	return layout;
+}
+
+void Renderer::GrowCommandRing(uint32_t capacity)
+{
+	if (m_CommandRing)
+	{
+		m_RetiredCommandBuffers.push_back(m_CommandRing);
+	}
+
+	m_CommandRingCapacity = capacity;
+	m_CommandSlotSize = GetCommandLayout(capacity).size;
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	const GLsizeiptr size = m_CommandSlotSize * RENDERER_FRAME_SLOTS;
+
+	glCreateBuffers(1, &m_CommandRing);
+	glNamedBufferStorage(m_CommandRing, size, nullptr, flags);
+	m_CommandRingData = (char*)glMapNamedBufferRange(m_CommandRing, 0, size, flags);
+
+	LOG_INFO("Command ring holds %u commands per frame slot, %.2f KB", capacity, size / 1024.0)
+}
+
+void Renderer::ReleaseRetiredCommandBuffers()
+{
+	// Slots that still draw from a retired buffer keep it until they are rebuilt
+	auto inUse = [this](GLuint buffer)
+	{
+		for (const FrameState& frame : m_Frames)
+		{
+			if (frame.commandBuffer == buffer)
+			{
+				return true;
+			}
+		}
+		return false;
+	};
+
+	auto it = m_RetiredCommandBuffers.begin();
+	while (it != m_RetiredCommandBuffers.end())
+	{
+		if (inUse(*it))
+		{
+			++it;
+			continue;
+		}
+
+		GLState::Get().DeleteBuffers(1, &*it);
+		it = m_RetiredCommandBuffers.erase(it);
+	}
+}
+
+void Renderer::WriteCommands(const FrameState& frame, const DrawCommand* commands, char* slotData) const
+{
+	const CommandLayout layout = GetCommandLayout(frame.commandCapacity);
+	const uint32_t commandCount = frame.commandCount;
+
+	if (frame.drawPath == DrawPath::VertexPulling)
+	{
+		DrawArraysCommand* pullCommands = reinterpret_cast<DrawArraysCommand*>(slotData + layout.pullCommands);
+		PullDrawParams* drawParams = reinterpret_cast<PullDrawParams*>(slotData + layout.pullDrawParams);
+
+		for (uint32_t i = 0; i < commandCount; i++)
+		{
+			const DrawCommand& command = commands[i];
+			drawParams[i] = { command.firstIndex, command.baseVertex, command.baseInstance, command.elementCount };
+
+			// gl_VertexID runs over the index range, gl_BaseInstance finds the draw parameters
+			pullCommands[i] = { command.elementCount, command.instanceCount, command.firstIndex, i };
+
+			// One 4 vertex strip instance per point and instance
+			pullCommands[commandCount + i] = { 4, command.elementCount * command.instanceCount, 0, i };
+		}
+	}
+	else
+	{
+		DrawCommand* drawCommands = reinterpret_cast<DrawCommand*>(slotData + layout.drawCommands);
+		std::copy(commands, commands + commandCount, drawCommands);
+	}
+
+	GLuint* drawCounts = reinterpret_cast<GLuint*>(slotData + layout.drawCounts);
+	for (ViewID viewID = 0; viewID < frame.views.size(); viewID++)
+	{
+		for (uint32_t queue = 0; queue < RENDER_QUEUE_COUNT; queue++)
+		{
+			drawCounts[viewID * RENDER_QUEUE_COUNT + queue] = frame.views[viewID].commandCount[queue];
+			drawCounts[(MAX_VIEWS + viewID) * RENDER_QUEUE_COUNT + queue] = frame.views[viewID].rangeCommandCount[queue];
+		}
+	}
+}
+
+void Renderer::GetCommandList(const FrameState& frame, ViewID viewID, RenderQueue queue, InstanceSource source,
+	uint32_t& firstCommand, uint32_t& commandCount, GLintptr& drawCountOffset) const
+{
+	const View& view = frame.views[viewID];
+	uint32_t list = viewID * RENDER_QUEUE_COUNT + (uint32_t)queue;
+
+	if (source == InstanceSource::Ranges)
+	{
+		firstCommand = view.firstRangeCommand[(uint32_t)queue];
+		commandCount = view.rangeCommandCount[(uint32_t)queue];
+		list += MAX_VIEWS * RENDER_QUEUE_COUNT;
+	}
+	else
+	{
+		firstCommand = view.firstCommand[(uint32_t)queue];
+		commandCount = view.commandCount[(uint32_t)queue];
+	}
+
+	const CommandLayout layout = GetCommandLayout(frame.commandCapacity);
+	drawCountOffset = frame.commandOffset + layout.drawCounts + list * sizeof(GLuint);
+}
+
+void Renderer::BindRangeBuffer(const FrameState& frame)
+{
+	GLState::Get().BindBufferRange(GL_SHADER_STORAGE_BUFFER, INSTANCE_RANGES_BINDING, m_PersistentInstanceDataBuffer,
+		frame.rangeDataOffset, std::max<GLsizeiptr>(frame.rangeDataCount, 1) * sizeof(InstanceRangeData));
+}
+
+void Renderer::BindPullBuffers(const FrameState& frame)
+{
+	const CommandLayout layout = GetCommandLayout(frame.commandCapacity);
+
+	GLState& state = GLState::Get();
+	state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, PULL_POSITIONS_BINDING, m_VertexBufferID);
+	state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, PULL_INDICES_BINDING, m_ElementBufferID);
+	state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, PULL_INSTANCES_BINDING, m_PersistentInstanceDataBuffer);
+	state.BindBufferRange(GL_SHADER_STORAGE_BUFFER, PULL_DRAW_PARAMS_BINDING, frame.commandBuffer,
+		frame.commandOffset + layout.pullDrawParams, std::max<GLsizeiptr>(frame.commandCount, 1) * sizeof(PullDrawParams));
+
+	state.BindBuffer(GL_DRAW_INDIRECT_BUFFER, frame.commandBuffer);
+	if (m_UseIndirectCount)
+	{
+		state.BindBuffer(GL_PARAMETER_BUFFER, frame.commandBuffer);
+	}
+	state.BindVertexArray(m_EmptyVertexArray);
+}
@@ -0,0 +1,347 @@
+#include "FrameScheduler.h"
+#include "Framebuffer.h"
+#include "GeometryManager.h"
+#include "Renderer.h"
+#include "ShaderLibrary.h"
+#include "ShaderConstants.h"
+#include "ConstantBufferRing.h"
+#include "GLState.h"
+#include "Trace.h"
+
+#ifdef GL2_HEADLESS
+#include "HeadlessContext.h"
+#endif
+
+// Plays a recorded trace back through the Renderer as fast as possible and reports per-frame
+// timings, so a captured scene can be used as a repeatable benchmark.
+
+#define REPLAY_QUERY_RING 4 // GPU timer results are read this many frames later
+
+struct ReplaySettings
+{
+	std::string tracePath;
+	bool window = false;
+	int width = 1920;
+	int height = 1080;
+	uint32_t repeat = 1;
+	std::string csvPath;
+	DrawPath drawPath = DrawPath::VertexAttributes;
+};
+
+struct ReplayFrameTiming
+{
+	double cpu;   // BeginScene to the last DrawView
+	double gpu;   // Timer query around the same range
+	double frame; // Start to start, includes waiting on the GPU and presenting
+	uint32_t submits;
+};
+
+void PrintUsage()
+{
+	std::cout << "Usage: replay <trace> [--window] [--width <px>] [--height <px>] [--repeat <n>] [--csv <file>]\n"
+		"              [--draw-path attributes|pulling]\n";
+}
+
+bool ParseArguments(int argc, char** argv, ReplaySettings& settings)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string argument = argv[i];
+		const bool hasValue = i + 1 < argc;
+
+		if (argument == "--window") { settings.window = true; }
+		else if (argument == "--width" && hasValue) { settings.width = std::atoi(argv[++i]); }
+		else if (argument == "--height" && hasValue) { settings.height = std::atoi(argv[++i]); }
+		else if (argument == "--repeat" && hasValue) { settings.repeat = (uint32_t)std::atoi(argv[++i]); }
+		else if (argument == "--csv" && hasValue) { settings.csvPath = argv[++i]; }
+		else if (argument == "--draw-path" && hasValue)
+		{
+			const std::string drawPath = argv[++i];
+			if (drawPath == "attributes") { settings.drawPath = DrawPath::VertexAttributes; }
+			else if (drawPath == "pulling") { settings.drawPath = DrawPath::VertexPulling; }
+			else
+			{
+				LOG_ERROR("Unknown draw path [%s]", drawPath.c_str())
+				return false;
+			}
+		}
+		else if (argument[0] != '-' && settings.tracePath.empty()) { settings.tracePath = argument; }
+		else
+		{
+			LOG_ERROR("Unknown argument [%s]", argument.c_str())
+			return false;
+		}
+	}
+
+#ifndef GL2_HEADLESS
+	settings.window = true;
+#endif
+
+	return !settings.tracePath.empty() && settings.width > 0 && settings.height > 0 && settings.repeat > 0;
+}
+
+int main(int argc, char** argv)
+{
+	ReplaySettings settings;
+	if (!ParseArguments(argc, argv, settings))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	Trace trace;
+	if (!Trace::Load(settings.tracePath, trace))
+	{
+		return 1;
+	}
+
+	GLFWwindow* window = nullptr;
+
+#ifdef GL2_HEADLESS
+	HeadlessContext headlessContext;
+#endif
+
+	if (settings.window)
+	{
+		if (glfwInit() != GLFW_TRUE)
+		{
+			std::cout << "Couldn't initialize GLFW\n";
+			return 1;
+		}
+
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+		window = glfwCreateWindow(settings.width, settings.height, "Replay", NULL, NULL);
+		if (!window)
+		{
+			std::cout << "Couln't initialize window\n";
+			glfwTerminate();
+			return 1;
+		}
+
+		glfwMakeContextCurrent(window);
+
+		// Never wait for vblank, the point is to measure the renderer
+		glfwSwapInterval(0);
+	}
+	else
+	{
+#ifdef GL2_HEADLESS
+		if (!headlessContext.Create(4, 6))
+		{
+			std::cout << "Couldn't create headless context\n";
+			return 1;
+		}
+#endif
+	}
+
+	const GLenum glewStatus = glewInit();
+	if (glewStatus != GLEW_OK && !(!window && glewStatus == GLEW_ERROR_NO_GLX_DISPLAY))
+	{
+		std::cout << "Couldn't initialize GLEW\n";
+		return 1;
+	}
+
+	GLState::Get().Enable(GL_DEPTH_TEST);
+	glClearColor(0.16f, 0.2f, 0.35f, 1.f);
+
+	std::unique_ptr<Framebuffer> offscreenTarget;
+	if (!window)
+	{
+		offscreenTarget = std::make_unique<Framebuffer>(settings.width, settings.height);
+	}
+
+	// Same pipeline main draws the recorded scene with
+	ShaderLibrary shaderLibrary;
+	shaderLibrary.Declare("smoothSurface", {
+		"assets/shaders/basicVert.vs",
+		"assets/shaders/basicFrag.fs",
+		"assets/shaders/smoothSurface.gs",
+		});
+
+	ConstantBufferRing constantBufferRing;
+
+	MaterialConstants lineMaterial{};
+	lineMaterial.color = { 1.f, 1.f, 0.f, 1.f };
+	lineMaterial.curveSteps = 9;
+
+	ShaderDefines defines = { { "CURVE_STEPS", std::to_string(lineMaterial.curveSteps) } };
+	if (settings.drawPath == DrawPath::VertexPulling)
+	{
+		defines.push_back({ "VERTEX_PULLING", "1" });
+	}
+	const GLuint smoothSurfaceProgram = shaderLibrary.GetVariant(ShaderVariant("smoothSurface"_sid, defines));
+
+	GeometryManager geometryManager;
+	Renderer renderer(&geometryManager);
+	renderer.SetVertexBuffer(geometryManager.GetVertexBufferID());
+	renderer.SetElementBuffer(geometryManager.GetElementBufferID());
+	renderer.SetDrawPath(settings.drawPath);
+
+	GLuint timerQueries[REPLAY_QUERY_RING];
+	glCreateQueries(GL_TIME_ELAPSED, REPLAY_QUERY_RING, timerQueries);
+
+	const uint32_t totalFrames = (uint32_t)trace.frames.size() * settings.repeat;
+	std::vector<ReplayFrameTiming> timings(totalFrames);
+
+	auto readTimerQuery = [&](uint32_t frameIndex)
+	{
+		GLuint64 nanoseconds = 0;
+		glGetQueryObjectui64v(timerQueries[frameIndex % REPLAY_QUERY_RING], GL_QUERY_RESULT, &nanoseconds);
+		timings[frameIndex].gpu = nanoseconds / 1e9;
+	};
+
+	SteadyClock clock;
+	const double start = clock.Now();
+	double lastFrameStart = start;
+	uint32_t frameIndex = 0;
+
+	for (uint32_t pass = 0; pass < settings.repeat; pass++)
+	{
+		for (const TraceFrame& frame : trace.frames)
+		{
+			// Geometry only goes up once, later passes reuse it
+			if (pass == 0 && frame.geometryCount > 0)
+			{
+				for (uint32_t i = frame.firstGeometry; i < frame.firstGeometry + frame.geometryCount; i++)
+				{
+					const TraceGeometry& geometry = trace.geometry[i];
+					const GeoID geoID = geometryManager.AddGeometry(geometry.name, geometry.mesh);
+					if (geoID == 0)
+					{
+						LOG_ERROR("Couldn't add geometry [%s] of the trace", geometry.name.c_str())
+						return 1;
+					}
+
+					// IDs are handed out in order, so the recorded submits stay valid
+					assert(geoID == geometry.geoID);
+				}
+				renderer.SetGeoCount(geometryManager.GetGeoCount());
+			}
+
+			if (frameIndex >= REPLAY_QUERY_RING)
+			{
+				readTimerQuery(frameIndex - REPLAY_QUERY_RING);
+			}
+
+			const double frameStart = clock.Now();
+			if (frameIndex > 0)
+			{
+				timings[frameIndex - 1].frame = frameStart - lastFrameStart;
+			}
+			lastFrameStart = frameStart;
+
+			if (offscreenTarget)
+			{
+				offscreenTarget->Bind();
+			}
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+			glBeginQuery(GL_TIME_ELAPSED, timerQueries[frameIndex % REPLAY_QUERY_RING]);
+
+			renderer.BeginScene();
+			for (uint32_t i = frame.firstView; i < frame.firstView + frame.viewCount; i++)
+			{
+				renderer.AddView(trace.views[i].viewMatrix, trace.views[i].projectionMatrix);
+			}
+
+			for (uint32_t i = frame.firstSubmit; i < frame.firstSubmit + frame.submitCount; i++)
+			{
+				renderer.Submit({ trace.submits[i].geoID, trace.submits[i].modelTransform });
+			}
+
+			renderer.EndScene();
+
+			constantBufferRing.BeginFrame();
+			constantBufferRing.Push(GL_UNIFORM_BUFFER, MATERIAL_CONSTANTS_BINDING, lineMaterial);
+
+			GLState::Get().UseProgram(smoothSurfaceProgram);
+			for (ViewID viewID = 0; viewID < frame.viewCount; viewID++)
+			{
+				const TraceView& view = trace.views[frame.firstView + viewID];
+				constantBufferRing.Push(GL_UNIFORM_BUFFER, VIEW_CONSTANTS_BINDING, MakeViewConstants(view.viewMatrix, view.projectionMatrix));
+				renderer.DrawView(viewID);
+			}
+
+			constantBufferRing.EndFrame();
+			GLState::Get().EndFrame();
+			FrameArena::Get().Reset();
+
+			glEndQuery(GL_TIME_ELAPSED);
+
+			timings[frameIndex].cpu = clock.Now() - frameStart;
+			timings[frameIndex].submits = frame.submitCount;
+
+			if (window)
+			{
+				glfwSwapBuffers(window);
+				glfwPollEvents();
+			}
+
+			frameIndex++;
+		}
+	}
+
+	glFinish();
+	const double seconds = clock.Now() - start;
+
+	if (frameIndex > 0)
+	{
+		timings[frameIndex - 1].frame = seconds - (lastFrameStart - start);
+	}
+	for (uint32_t i = frameIndex > REPLAY_QUERY_RING ? frameIndex - REPLAY_QUERY_RING : 0; i < frameIndex; i++)
+	{
+		readTimerQuery(i);
+	}
+
+	FrameTimeHistogram cpuTimes;
+	FrameTimeHistogram gpuTimes;
+	FrameTimeHistogram frameTimes;
+	for (const ReplayFrameTiming& timing : timings)
+	{
+		cpuTimes.Add(timing.cpu);
+		gpuTimes.Add(timing.gpu);
+		frameTimes.Add(timing.frame);
+	}
+
+	auto logHistogram = [](const char* name, const FrameTimeHistogram& histogram)
+	{
+		LOG_INFO("%-10s mean %6.2fms  p50 %6.2fms  p95 %6.2fms  p99 %6.2fms  max %6.2fms",
+			name,
+			histogram.GetMean() * 1000.0,
+			histogram.GetPercentile(0.5) * 1000.0,
+			histogram.GetPercentile(0.95) * 1000.0,
+			histogram.GetPercentile(0.99) * 1000.0,
+			histogram.GetMax() * 1000.0)
+	};
+
+	LOG_INFO("Replayed %u frames at %dx%d in %.3f s, %.2f fps", frameIndex, settings.width, settings.height, seconds, frameIndex / seconds)
+	logHistogram("Frame", frameTimes);
+	logHistogram("CPU", cpuTimes);
+	logHistogram("GPU", gpuTimes);
+	geometryManager.LogStats();
+	GLState::Get().LogStats();
+
+	if (!settings.csvPath.empty())
+	{
+		std::ofstream csv(settings.csvPath);
+		csv << "frame,cpu_ms,gpu_ms,frame_ms,submits\n";
+		for (uint32_t i = 0; i < frameIndex; i++)
+		{
+			csv << i << ',' << timings[i].cpu * 1000.0 << ',' << timings[i].gpu * 1000.0 << ','
+				<< timings[i].frame * 1000.0 << ',' << timings[i].submits << '\n';
+		}
+		LOG_INFO("Wrote per-frame timings to [%s]", settings.csvPath.c_str())
+	}
+
+	glDeleteQueries(REPLAY_QUERY_RING, timerQueries);
+
+	if (window)
+	{
+		glfwTerminate();
+	}
+
+	return 0;
+}
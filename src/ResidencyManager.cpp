@@ -0,0 +1,220 @@
+#include "ResidencyManager.h"
+
+ResidencyManager::ResidencyManager(GeometryManager& geometryManager, const ResidencySettings& settings)
+	: m_GeometryManager(geometryManager)
+	, m_Settings(settings)
+	, m_CandidatesCollected(false)
+	, m_Placeholder(0)
+	, m_Frame(0)
+	, m_PlaceholderDraws(0)
+	, m_SkippedDraws(0)
+{
+	m_GeometryManager.SetKeepSourceData(true);
+}
+
+void ResidencyManager::SetPlaceholder(GeoID placeholder)
+{
+	m_Placeholder = placeholder;
+	if (placeholder != 0)
+	{
+		Pin(placeholder);
+	}
+}
+
+void ResidencyManager::SetFallback(GeoID geoID, GeoID fallback)
+{
+	GetEntry(geoID).fallback = fallback;
+	Pin(fallback);
+}
+
+void ResidencyManager::Pin(GeoID geoID)
+{
+	GetEntry(geoID).pinned = true;
+
+	// Pinned geometry has to be there whenever something falls back to it
+	if (!m_GeometryManager.IsResident(geoID) && !m_GeometryManager.MakeResident(geoID))
+	{
+		LOG_ERROR("Couldn't make pinned geometry %u resident", geoID)
+	}
+}
+
+GeoID ResidencyManager::RequestDraw(GeoID geoID)
+{
+	Entry& entry = GetEntry(geoID);
+	entry.lastVisibleFrame = m_Frame;
+
+	if (m_GeometryManager.IsResident(geoID))
+	{
+		return geoID;
+	}
+
+	if (!entry.queued)
+	{
+		entry.queued = true;
+		m_UploadQueue.push_back(geoID);
+	}
+
+	if (entry.fallback != 0 && m_GeometryManager.IsResident(entry.fallback))
+	{
+		m_PlaceholderDraws++;
+		return entry.fallback;
+	}
+
+	if (m_Placeholder != 0)
+	{
+		m_PlaceholderDraws++;
+		return m_Placeholder;
+	}
+
+	m_SkippedDraws++;
+	return 0;
+}
+
+void ResidencyManager::Update()
+{
+	m_CandidatesCollected = false;
+
+	// Geometry added since the last frame may have pushed us over
+	EvictFor(0);
+
+	// Stream in what became visible, oldest request first
+	size_t uploadedBytes = 0;
+	while (!m_UploadQueue.empty() && uploadedBytes < m_Settings.uploadBytesPerFrame)
+	{
+		const GeoID geoID = m_UploadQueue.front();
+		const size_t bytes = GeometryManager::GetGeometryBytes(m_GeometryManager.GetGeometry(geoID));
+
+		// Made resident some other way in the meantime, or too long ago to matter
+		if (m_GeometryManager.IsResident(geoID) || m_Frame - GetEntry(geoID).lastVisibleFrame > m_Settings.evictAfterFrames)
+		{
+			GetEntry(geoID).queued = false;
+			m_UploadQueue.pop_front();
+			continue;
+		}
+
+		if (!EvictFor(bytes))
+		{
+			break;
+		}
+
+		// Enough bytes are free but maybe not in one piece, evict more until a range fits
+		bool uploaded = m_GeometryManager.MakeResident(geoID);
+		while (!uploaded && EvictLeastRecentlyUsed())
+		{
+			uploaded = m_GeometryManager.MakeResident(geoID);
+		}
+
+		if (!uploaded)
+		{
+			break;
+		}
+
+		GetEntry(geoID).queued = false;
+		m_UploadQueue.pop_front();
+
+		uploadedBytes += bytes;
+		m_Stats.uploads++;
+	}
+
+	m_Stats.uploadedBytes += uploadedBytes;
+	m_Stats.uploadedBytesLastFrame = uploadedBytes;
+	m_Stats.residentVertexBytes = m_GeometryManager.GetResidentVertexBytes();
+	m_Stats.residentElementBytes = m_GeometryManager.GetResidentElementBytes();
+	m_Stats.residentBytes = m_Stats.residentVertexBytes + m_Stats.residentElementBytes;
+	m_Stats.pendingUploads = (uint32_t)m_UploadQueue.size();
+
+	m_Stats.residentGeometries = 0;
+	m_Stats.evictedGeometries = 0;
+	for (GeoID geoID = 1; geoID <= m_GeometryManager.GetGeoCount(); geoID++)
+	{
+		m_GeometryManager.IsResident(geoID) ? m_Stats.residentGeometries++ : m_Stats.evictedGeometries++;
+	}
+
+	LOG_TRACE("Residency: %zu bytes resident, %u uploads pending", m_Stats.residentBytes, m_Stats.pendingUploads)
+
+	m_Stats.placeholderDrawsLastFrame = m_PlaceholderDraws;
+	m_Stats.skippedDrawsLastFrame = m_SkippedDraws;
+	m_PlaceholderDraws = 0;
+	m_SkippedDraws = 0;
+
+	m_Frame++;
+}
+
+void ResidencyManager::LogStats() const
+{
+	const double mb = 1024.0 * 1024.0;
+	LOG_INFO("Residency: %.2f / %.2f MB resident (vertices %.2f MB, elements %.2f MB), %u geometries resident, %u evicted",
+		m_Stats.residentBytes / mb, m_Settings.budgetBytes / mb, m_Stats.residentVertexBytes / mb, m_Stats.residentElementBytes / mb,
+		m_Stats.residentGeometries, m_Stats.evictedGeometries)
+	LOG_INFO("Residency: %llu evictions, %llu uploads, %.2f MB streamed (%.2f MB/frame avg), %u pending, CPU copies %.2f MB encoded",
+		(unsigned long long)m_Stats.evictions, (unsigned long long)m_Stats.uploads, m_Stats.uploadedBytes / mb,
+		m_Frame ? m_Stats.uploadedBytes / mb / m_Frame : 0.0, m_Stats.pendingUploads, m_GeometryManager.GetSourceBytes() / mb)
+}
+
+ResidencyManager::Entry& ResidencyManager::GetEntry(GeoID geoID)
+{
+	if (geoID >= m_Entries.size())
+	{
+		m_Entries.resize(geoID + 1);
+	}
+	return m_Entries[geoID];
+}
+
+bool ResidencyManager::EvictFor(size_t bytes)
+{
+	while (m_GeometryManager.GetResidentBytes() + bytes > m_Settings.budgetBytes)
+	{
+		if (!EvictLeastRecentlyUsed())
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool ResidencyManager::EvictLeastRecentlyUsed()
+{
+	// Visibility doesn't change during Update, so one sorted list per frame is enough
+	if (!m_CandidatesCollected)
+	{
+		m_CandidatesCollected = true;
+		m_EvictionCandidates.clear();
+		for (GeoID geoID = 1; geoID <= m_GeometryManager.GetGeoCount(); geoID++)
+		{
+			if (IsEvictable(geoID, GetEntry(geoID)))
+			{
+				m_EvictionCandidates.push_back(geoID);
+			}
+		}
+
+		// Least recently visible at the back
+		std::sort(m_EvictionCandidates.begin(), m_EvictionCandidates.end(), [this](GeoID a, GeoID b)
+		{
+			return m_Entries[a].lastVisibleFrame > m_Entries[b].lastVisibleFrame;
+		});
+	}
+
+	while (!m_EvictionCandidates.empty())
+	{
+		const GeoID geoID = m_EvictionCandidates.back();
+		m_EvictionCandidates.pop_back();
+
+		if (m_GeometryManager.Evict(geoID))
+		{
+			m_Stats.evictions++;
+			LOG_DEBUG("Evicted geometry %u, last visible in frame %llu", geoID, (unsigned long long)m_Entries[geoID].lastVisibleFrame)
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool ResidencyManager::IsEvictable(GeoID geoID, const Entry& entry) const
+{
+	return !entry.pinned
+		&& m_Frame - entry.lastVisibleFrame >= m_Settings.evictAfterFrames
+		&& m_GeometryManager.HasSourceData(geoID)
+		&& m_GeometryManager.IsResident(geoID);
+}
@@ -0,0 +1,383 @@
+#include "ShaderLibrary.h"
+
+#include "ShaderConstants.h"
+
+ShaderVariant::ShaderVariant(StringID program, ShaderDefines defines)
+	: m_Program(program)
+	, m_Defines(std::move(defines))
+{
+	std::sort(m_Defines.begin(), m_Defines.end(), [](const ShaderDefine& a, const ShaderDefine& b) { return a.name < b.name; });
+
+	// Defines in a fixed order, so the same set always ends up with the same key
+	m_Key = m_Program.GetHash();
+	for (const ShaderDefine& define : m_Defines)
+	{
+		const std::string entry = define.name + "=" + define.value;
+		m_Key = (m_Key ^ StringID::Hash(entry.data(), entry.size())) * 0x100000001b3ull;
+	}
+}
+
+namespace
+{
+	double SecondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+ShaderLibrary::ShaderLibrary()
+	: m_ParallelCompile(ShaderLoader::SupportsParallelCompile())
+{
+	ShaderLoader::EnableParallelCompile();
+	LOG_INFO("Parallel shader compile: %s", m_ParallelCompile ? "on" : "not supported")
+}
+
+ShaderLibrary::~ShaderLibrary()
+{
+	for (auto& program : m_Programs)
+	{
+		glDeleteProgram(program.second->id);
+	}
+
+	for (auto& shader : m_Shaders)
+	{
+		glDeleteShader(shader.second.id);
+	}
+}
+
+void ShaderLibrary::Declare(const std::string& name, const std::vector<std::string>& paths)
+{
+	const StringID nameID = StringID::Register(name);
+	assert(m_Declarations.find(nameID) == m_Declarations.end() && "Program declared twice");
+
+	m_Declarations[nameID] = { name, paths };
+}
+
+GLuint ShaderLibrary::Register(const std::string& name, const std::vector<std::string>& paths)
+{
+	Declare(name, paths);
+	return GetVariant(StringID(name));
+}
+
+GLuint ShaderLibrary::GetVariant(const ShaderVariant& variant)
+{
+	Program* program = Request(variant);
+	if (!program)
+	{
+		return 0;
+	}
+
+	if (program->state == ShaderState::Compiling)
+	{
+		Finish(*program);
+	}
+
+	return program->state == ShaderState::Ready ? program->id : 0;
+}
+
+GLuint ShaderLibrary::TryGetVariant(const ShaderVariant& variant)
+{
+	Program* program = Request(variant);
+	if (!program)
+	{
+		return 0;
+	}
+
+	// Without parallel compiles Poll gets to it
+	if (program->state == ShaderState::Compiling && m_ParallelCompile && ShaderLoader::IsProgramDone(program->id))
+	{
+		Finish(*program);
+	}
+
+	return program->state == ShaderState::Ready ? program->id : 0;
+}
+
+ShaderState ShaderLibrary::GetState(const ShaderVariant& variant) const
+{
+	auto it = m_Variants.find(variant.GetKey());
+	if (it == m_Variants.end())
+	{
+		return ShaderState::Missing;
+	}
+
+	return it->second ? it->second->state : ShaderState::Failed;
+}
+
+void ShaderLibrary::WarmUp(const std::vector<ShaderVariant>& variants)
+{
+	for (const ShaderVariant& variant : variants)
+	{
+		Request(variant);
+	}
+}
+
+void ShaderLibrary::Poll()
+{
+	uint32_t finished = 0;
+	for (Program* program : m_Pending)
+	{
+		if (program->state != ShaderState::Compiling)
+		{
+			continue;
+		}
+
+		if (!m_ParallelCompile && finished > 0)
+		{
+			break;
+		}
+
+		if (ShaderLoader::IsProgramDone(program->id))
+		{
+			Finish(*program);
+			finished++;
+		}
+	}
+
+	// GetVariant may have finished some in between as well
+	m_Pending.erase(std::remove_if(m_Pending.begin(), m_Pending.end(), [](const Program* program)
+	{
+		return program->state != ShaderState::Compiling;
+	}), m_Pending.end());
+}
+
+GLint ShaderLibrary::GetUniformLocation(const ShaderVariant& variant, StringID uniform) const
+{
+	const Program* found = FindVariant(variant);
+	if (!found)
+	{
+		return -1;
+	}
+
+	auto it = found->uniforms.find(uniform);
+	return it != found->uniforms.end() ? it->second : -1;
+}
+
+GLint ShaderLibrary::GetUniformBlockBinding(const ShaderVariant& variant, StringID block) const
+{
+	const Program* found = FindVariant(variant);
+	if (!found)
+	{
+		return -1;
+	}
+
+	auto it = found->uniformBlocks.find(block);
+	return it != found->uniformBlocks.end() ? it->second : -1;
+}
+
+GLint ShaderLibrary::GetStorageBlockBinding(const ShaderVariant& variant, StringID block) const
+{
+	const Program* found = FindVariant(variant);
+	if (!found)
+	{
+		return -1;
+	}
+
+	auto it = found->storageBlocks.find(block);
+	return it != found->storageBlocks.end() ? it->second : -1;
+}
+
+void ShaderLibrary::LogStats() const
+{
+	LOG_INFO("Shaders: %zu variants of %zu programs, %zu programs linked, %zu shader objects for %u stages",
+		m_Variants.size(), m_Declarations.size(), m_Programs.size(), m_Shaders.size(), m_StageRequests)
+
+	size_t compiling = 0;
+	for (const Program* program : m_Pending)
+	{
+		compiling += program->state == ShaderState::Compiling;
+	}
+
+	LOG_INFO("Shaders: parallel compile %s, %.2f ms submitting and %.2f ms finishing on the calling thread, ready %.2f ms after submit at most, %zu compiling, %u failed",
+		m_ParallelCompile ? "on" : "off", m_SubmitSeconds * 1000.0, m_FinishSeconds * 1000.0, m_ReadySecondsMax * 1000.0, compiling, m_FailedPrograms)
+}
+
+ShaderLibrary::Program* ShaderLibrary::Request(const ShaderVariant& variant)
+{
+	auto it = m_Variants.find(variant.GetKey());
+	if (it != m_Variants.end())
+	{
+		return it->second;
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	Program* program = Compile(variant);
+	m_SubmitSeconds += SecondsSince(start);
+
+	m_Variants[variant.GetKey()] = program;
+	return program;
+}
+
+ShaderLibrary::Program* ShaderLibrary::Compile(const ShaderVariant& variant)
+{
+	auto declaration = m_Declarations.find(variant.GetProgram());
+	if (declaration == m_Declarations.end())
+	{
+		LOG_ERROR("No program declared as [%s]", StringID::GetString(variant.GetProgram()).c_str())
+		return nullptr;
+	}
+
+	std::vector<Shader*> stages;
+	std::vector<GLuint> shaders;
+	for (const std::string& path : declaration->second.paths)
+	{
+		Shader* shader = GetShader(path, variant.GetDefines());
+		if (!shader)
+		{
+			return nullptr;
+		}
+		stages.push_back(shader);
+		shaders.push_back(shader->id);
+	}
+
+	// Defines only some other stage cares about don't need a program of their own
+	std::sort(shaders.begin(), shaders.end());
+	std::unique_ptr<Program>& program = m_Programs[shaders];
+	if (program)
+	{
+		return program.get();
+	}
+
+	program = std::make_unique<Program>();
+	program->id = ShaderLoader::LinkProgram(shaders);
+	program->name = declaration->second.name;
+	program->defineCount = variant.GetDefines().size();
+	program->stages = std::move(stages);
+	program->submitTime = std::chrono::steady_clock::now();
+
+	m_Pending.push_back(program.get());
+	return program.get();
+}
+
+void ShaderLibrary::Finish(Program& program)
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	// A failed link only says which program, the compile logs say why
+	bool compiled = true;
+	for (Shader* shader : program.stages)
+	{
+		if (!shader->validated)
+		{
+			shader->compiled = ShaderLoader::ValidateShader(shader->id, shader->files);
+			shader->validated = true;
+		}
+		compiled &= shader->compiled;
+	}
+
+	if (!compiled || !ShaderLoader::ValidateProgram(program.id))
+	{
+		LOG_ERROR("Couldn't build program [%s] with %zu defines", program.name.c_str(), program.defineCount)
+		program.state = ShaderState::Failed;
+		m_FailedPrograms++;
+		m_FinishSeconds += SecondsSince(start);
+		return;
+	}
+
+	// Uniforms inside blocks report location -1 and are skipped
+	CollectResources(program.id, GL_UNIFORM, GL_LOCATION, program.uniforms);
+	CollectResources(program.id, GL_UNIFORM_BLOCK, GL_BUFFER_BINDING, program.uniformBlocks);
+	CollectResources(program.id, GL_SHADER_STORAGE_BLOCK, GL_BUFFER_BINDING, program.storageBlocks);
+
+	ValidateBlockBindings(program.name, program);
+
+	program.state = ShaderState::Ready;
+	m_FinishSeconds += SecondsSince(start);
+
+	const double readySeconds = SecondsSince(program.submitTime);
+	m_ReadySecondsMax = std::max(m_ReadySecondsMax, readySeconds);
+
+	LOG_DEBUG("Linked program [%s] (%zu defines) with %zu uniforms, %zu uniform blocks and %zu storage blocks, ready %.2f ms after submit",
+		program.name.c_str(), program.defineCount, program.uniforms.size(), program.uniformBlocks.size(), program.storageBlocks.size(),
+		readySeconds * 1000.0)
+}
+
+ShaderLibrary::Shader* ShaderLibrary::GetShader(const std::string& path, const ShaderDefines& defines)
+{
+	m_StageRequests++;
+
+	const ShaderSource* source = m_Preprocessor.Load(path);
+	if (!source)
+	{
+		assert(false);
+		return nullptr;
+	}
+
+	const std::string text = ShaderPreprocessor::Specialize(*source, defines);
+
+	Shader& shader = m_Shaders[text];
+	if (shader.id == 0)
+	{
+		shader.id = ShaderLoader::CompileShader(ShaderLoader::GetShaderType(path), text);
+		shader.files = source->files;
+	}
+
+	return &shader;
+}
+
+const ShaderLibrary::Program* ShaderLibrary::FindVariant(const ShaderVariant& variant) const
+{
+	auto it = m_Variants.find(variant.GetKey());
+	if (it == m_Variants.end() || !it->second || it->second->state != ShaderState::Ready)
+	{
+		LOG_ERROR("No compiled variant of program [%s]", StringID::GetString(variant.GetProgram()).c_str())
+		return nullptr;
+	}
+
+	return it->second;
+}
+
+void ShaderLibrary::CollectResources(GLuint program, GLenum interface, GLenum property, std::unordered_map<StringID, GLint, StringIDHash>& resources)
+{
+	GLint count = 0;
+	GLint maxNameLength = 0;
+	glGetProgramInterfaceiv(program, interface, GL_ACTIVE_RESOURCES, &count);
+	glGetProgramInterfaceiv(program, interface, GL_MAX_NAME_LENGTH, &maxNameLength);
+
+	std::string name;
+	for (GLint i = 0; i < count; i++)
+	{
+		GLint value = -1;
+		glGetProgramResourceiv(program, interface, i, 1, &property, 1, nullptr, &value);
+		if (value < 0)
+		{
+			continue;
+		}
+
+		GLsizei length = 0;
+		name.resize(maxNameLength);
+		glGetProgramResourceName(program, interface, i, maxNameLength, &length, &name[0]);
+		name.resize(length);
+
+		// Arrays are reported as name[0], look them up without the subscript
+		if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+		{
+			name.resize(name.size() - 3);
+		}
+
+		resources[StringID::Register(name)] = value;
+	}
+}
+
+void ShaderLibrary::ValidateBlockBindings(const std::string& name, const Program& program)
+{
+	const struct
+	{
+		StringID block;
+		GLint binding;
+	} uniformBlocks[] = {
+		{ "FrameConstants", FRAME_CONSTANTS_BINDING },
+		{ "ViewConstants", VIEW_CONSTANTS_BINDING },
+		{ "MaterialConstants", MATERIAL_CONSTANTS_BINDING },
+	};
+
+	for (const auto& expected : uniformBlocks)
+	{
+		auto it = program.uniformBlocks.find(expected.block);
+		if (it != program.uniformBlocks.end() && it->second != expected.binding)
+		{
+			LOG_ERROR("Program [%s] has block [%s] at binding %d instead of %d", name.c_str(),
+				StringID::GetString(expected.block).c_str(), it->second, expected.binding)
+			assert(false);
+		}
+	}
+}
@@ -0,0 +1,152 @@
+#include "ShaderPreprocessor.h"
+
+namespace
+{
+	std::string GetDirectory(const std::string& path)
+	{
+		const size_t slash = path.find_last_of("/\\");
+		return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+	}
+
+	bool StartsWithDirective(const std::string& line, const char* directive, size_t& end)
+	{
+		const size_t start = line.find_first_not_of(" \t");
+		const size_t length = strlen(directive);
+		if (start == std::string::npos || line.compare(start, length, directive) != 0)
+		{
+			return false;
+		}
+
+		end = start + length;
+		return true;
+	}
+}
+
+const ShaderSource* ShaderPreprocessor::Load(const std::string& path)
+{
+	auto it = m_Sources.find(path);
+	if (it != m_Sources.end())
+	{
+		return &it->second;
+	}
+
+	ShaderSource source;
+	if (!Expand(path, source))
+	{
+		return nullptr;
+	}
+
+	return &m_Sources.emplace(path, std::move(source)).first->second;
+}
+
+std::string ShaderPreprocessor::Specialize(const ShaderSource& source, const ShaderDefines& defines)
+{
+	std::string block;
+	for (const ShaderDefine& define : defines)
+	{
+		if (Mentions(source.text, define.name))
+		{
+			block += "#define " + define.name + " " + define.value + "\n";
+		}
+	}
+
+	if (block.empty())
+	{
+		return source.text;
+	}
+
+	// Nothing may come before #version, the defines go right behind it
+	size_t lineEnd = 0;
+	uint32_t versionLine = 0;
+	for (size_t lineStart = 0; lineStart < source.text.size(); lineStart = lineEnd + 1)
+	{
+		lineEnd = source.text.find('\n', lineStart);
+		if (lineEnd == std::string::npos)
+		{
+			lineEnd = source.text.size();
+		}
+
+		versionLine++;
+		size_t directiveEnd = 0;
+		if (StartsWithDirective(source.text.substr(lineStart, lineEnd - lineStart), "#version", directiveEnd))
+		{
+			const size_t insert = std::min(lineEnd + 1, source.text.size());
+			return source.text.substr(0, insert) + block + "#line " + std::to_string(versionLine + 1) + " 0\n" + source.text.substr(insert);
+		}
+	}
+
+	return block + "#line 1 0\n" + source.text;
+}
+
+bool ShaderPreprocessor::Expand(const std::string& path, ShaderSource& source)
+{
+	std::fstream file;
+	file.open(path);
+	if (!file.is_open())
+	{
+		LOG_ERROR("Couldn't open file at location [%s]", path.c_str())
+		return false;
+	}
+
+	const uint32_t fileIndex = (uint32_t)source.files.size();
+	source.files.push_back(path);
+
+	// The root file can't have anything in front of its #version
+	if (fileIndex > 0)
+	{
+		source.text += "#line 1 " + std::to_string(fileIndex) + "\n";
+	}
+
+	std::string line;
+	uint32_t lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		lineNumber++;
+
+		size_t directiveEnd = 0;
+		if (!StartsWithDirective(line, "#include", directiveEnd))
+		{
+			source.text += line;
+			source.text += '\n';
+			continue;
+		}
+
+		const size_t open = line.find('"', directiveEnd);
+		const size_t close = open == std::string::npos ? std::string::npos : line.find('"', open + 1);
+		if (close == std::string::npos)
+		{
+			LOG_ERROR("Malformed #include in [%s] line %u", path.c_str(), lineNumber)
+			return false;
+		}
+
+		const std::string includePath = GetDirectory(path) + line.substr(open + 1, close - open - 1);
+		if (std::find(source.files.begin(), source.files.end(), includePath) == source.files.end())
+		{
+			if (!Expand(includePath, source))
+			{
+				LOG_ERROR("Included from [%s] line %u", path.c_str(), lineNumber)
+				return false;
+			}
+		}
+
+		source.text += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
+	}
+
+	return true;
+}
+
+bool ShaderPreprocessor::Mentions(const std::string& text, const std::string& identifier)
+{
+	auto isIdentifierChar = [](char c) { return std::isalnum((unsigned char)c) || c == '_'; };
+
+	for (size_t at = text.find(identifier); at != std::string::npos; at = text.find(identifier, at + 1))
+	{
+		const size_t end = at + identifier.size();
+		if ((at == 0 || !isIdentifierChar(text[at - 1])) && (end == text.size() || !isIdentifierChar(text[end])))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,213 @@
+#include "TaskGraph.h"
+
+TaskID TaskGraph::Add(const std::string& name, std::function<void()> function, std::initializer_list<TaskID> dependencies, bool glThread)
+{
+	const TaskID taskID = (TaskID)m_Tasks.size();
+
+	m_Tasks.push_back(std::make_unique<Task>());
+	Task& task = *m_Tasks.back();
+	task.name = name;
+	task.function = std::move(function);
+	task.glThread = glThread;
+
+	SetDependencies(taskID, dependencies);
+	return taskID;
+}
+
+void TaskGraph::SetDependencies(TaskID taskID, std::initializer_list<TaskID> dependencies)
+{
+	Task& task = *m_Tasks[taskID];
+
+	for (TaskID dependency : task.dependencies)
+	{
+		auto& dependents = m_Tasks[dependency]->dependents;
+		dependents.erase(std::remove(dependents.begin(), dependents.end(), taskID), dependents.end());
+	}
+
+	task.dependencies.assign(dependencies);
+	for (TaskID dependency : task.dependencies)
+	{
+		assert(dependency < taskID && "Dependencies have to be added before the task");
+		m_Tasks[dependency]->dependents.push_back(taskID);
+	}
+}
+
+void TaskGraph::Run(JobSystem& jobSystem)
+{
+	const double start = Now();
+
+	m_Finished = 0;
+	for (auto& task : m_Tasks)
+	{
+		task->remaining = (uint32_t)task->dependencies.size();
+	}
+
+	JobCounter counter;
+	m_JobSystem = &jobSystem;
+	m_Counter = &counter;
+
+	for (TaskID taskID = 0; taskID < m_Tasks.size(); taskID++)
+	{
+		if (m_Tasks[taskID]->dependencies.empty())
+		{
+			Launch(taskID);
+		}
+	}
+
+	// GL tasks have priority on this thread, otherwise help with whatever is queued
+	while (m_Finished.load(std::memory_order_acquire) < m_Tasks.size())
+	{
+		TaskID glTask = (TaskID)-1;
+		{
+			std::lock_guard<std::mutex> lock(m_GLMutex);
+			if (!m_GLReady.empty())
+			{
+				glTask = m_GLReady.back();
+				m_GLReady.pop_back();
+			}
+		}
+
+		if (glTask != (TaskID)-1)
+		{
+			Execute(glTask);
+		}
+		else if (!jobSystem.RunPendingJob())
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	jobSystem.Wait(counter);
+	m_JobSystem = nullptr;
+	m_Counter = nullptr;
+
+	m_TotalWall += Now() - start;
+	m_Runs++;
+	UpdateCriticalPath();
+}
+
+void TaskGraph::LogStats() const
+{
+	if (m_Runs == 0)
+	{
+		return;
+	}
+
+	std::string chain;
+	for (auto it = m_LastCriticalChain.rbegin(); it != m_LastCriticalChain.rend(); ++it)
+	{
+		chain += (chain.empty() ? "" : " > ") + m_Tasks[*it]->name;
+	}
+
+	LOG_INFO("Task graph: %u runs, mean %.3f ms wall, %.3f ms critical path (last: %s)",
+		m_Runs, m_TotalWall * 1000.0 / m_Runs, m_TotalCriticalPath * 1000.0 / m_Runs, chain.c_str())
+
+	for (const auto& task : m_Tasks)
+	{
+		LOG_INFO("  %-12s mean %7.3f ms, critical in %5.1f%% of runs%s", task->name.c_str(), task->totalDuration * 1000.0 / m_Runs,
+			task->criticalRuns * 100.0 / m_Runs, task->glThread ? " (GL thread)" : "")
+	}
+}
+
+void TaskGraph::ResetStats()
+{
+	for (auto& task : m_Tasks)
+	{
+		task->totalDuration = 0.0;
+		task->criticalRuns = 0;
+	}
+
+	m_Runs = 0;
+	m_TotalWall = 0.0;
+	m_TotalCriticalPath = 0.0;
+}
+
+void TaskGraph::Launch(TaskID taskID)
+{
+	if (m_Tasks[taskID]->glThread)
+	{
+		std::lock_guard<std::mutex> lock(m_GLMutex);
+		m_GLReady.push_back(taskID);
+		return;
+	}
+
+	// Small enough for std::function to store inline
+	m_JobSystem->Run(*m_Counter, [this, taskID]()
+	{
+		Execute(taskID);
+	});
+}
+
+void TaskGraph::Execute(TaskID taskID)
+{
+	Task& task = *m_Tasks[taskID];
+
+	task.start = Now();
+	task.function();
+	task.end = Now();
+
+	for (TaskID dependent : task.dependents)
+	{
+		if (m_Tasks[dependent]->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			Launch(dependent);
+		}
+	}
+
+	m_Finished.fetch_add(1, std::memory_order_release);
+}
+
+void TaskGraph::UpdateCriticalPath()
+{
+	// Longest chain of durations through the graph, scheduling gaps don't count. Insertion order
+	// is topological, so one forward pass is enough.
+	std::vector<double>& pathEnd = m_PathEnd;
+	std::vector<TaskID>& previous = m_PathPrevious;
+	pathEnd.assign(m_Tasks.size(), 0.0);
+	previous.assign(m_Tasks.size(), (TaskID)-1);
+
+	TaskID last = 0;
+	for (TaskID taskID = 0; taskID < m_Tasks.size(); taskID++)
+	{
+		Task& task = *m_Tasks[taskID];
+		const double duration = task.end - task.start;
+		task.totalDuration += duration;
+
+		double longestDependency = 0.0;
+		for (TaskID dependency : task.dependencies)
+		{
+			if (pathEnd[dependency] > longestDependency)
+			{
+				longestDependency = pathEnd[dependency];
+				previous[taskID] = dependency;
+			}
+		}
+
+		pathEnd[taskID] = longestDependency + duration;
+		if (pathEnd[taskID] > pathEnd[last])
+		{
+			last = taskID;
+		}
+	}
+
+	if (m_Tasks.empty())
+	{
+		return;
+	}
+
+	m_LastCriticalPath = pathEnd[last];
+	m_TotalCriticalPath += m_LastCriticalPath;
+
+	// Back to front, LogStats prints it the other way around
+	m_LastCriticalChain.clear();
+	for (TaskID taskID = last; taskID != (TaskID)-1; taskID = previous[taskID])
+	{
+		m_Tasks[taskID]->criticalRuns++;
+		m_LastCriticalChain.push_back(taskID);
+	}
+}
+
+double TaskGraph::Now() const
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_Epoch).count();
+}
@@ -0,0 +1,718 @@
+#include "Terrain.h"
+#include "GLState.h"
+#include "JobSystem.h"
+
+#include <filesystem>
+
+namespace
+{
+	const char TILE_FILE_MAGIC[4] = { 'G', 'L', '2', 'H' };
+	const uint32_t TILE_FILE_VERSION = 1;
+
+	// Quadtree roots per selection job
+	const uint32_t SELECT_GRAIN_SIZE = 4;
+
+	double SecondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	bool IntersectsSphere(const glm::vec3& boxMin, const glm::vec3& boxMax, const glm::vec3& center, float radius)
+	{
+		const glm::vec3 closest = glm::clamp(center, boxMin, boxMax);
+		const glm::vec3 offset = closest - center;
+		return glm::dot(offset, offset) <= radius * radius;
+	}
+
+	// Corner furthest along each plane's normal, the box is outside if even that one is behind it
+	bool IntersectsFrustum(const glm::vec3& boxMin, const glm::vec3& boxMax, const glm::vec4* planes)
+	{
+		for (int i = 0; i < 6; i++)
+		{
+			const glm::vec3 corner(
+				planes[i].x >= 0.f ? boxMax.x : boxMin.x,
+				planes[i].y >= 0.f ? boxMax.y : boxMin.y,
+				planes[i].z >= 0.f ? boxMax.z : boxMin.z);
+
+			if (glm::dot(glm::vec3(planes[i]), corner) + planes[i].w < 0.f)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Smoothly interpolated hashes of the integer lattice, in [-1, 1]
+	float ValueNoise(double x, double z, uint32_t seed)
+	{
+		const double cellX = std::floor(x);
+		const double cellZ = std::floor(z);
+		const float fx = (float)(x - cellX);
+		const float fz = (float)(z - cellZ);
+		const float ux = fx * fx * (3.f - 2.f * fx);
+		const float uz = fz * fz * (3.f - 2.f * fz);
+
+		auto corner = [&](int64_t offsetX, int64_t offsetZ)
+		{
+			const uint32_t ix = (uint32_t)((int64_t)cellX + offsetX);
+			const uint32_t iz = (uint32_t)((int64_t)cellZ + offsetZ);
+			const uint32_t hash = InstanceRangeHash(seed ^ InstanceRangeHash(ix * 0x9e3779b1u ^ InstanceRangeHash(iz)));
+			return (float)(hash >> 8) * (2.f / 16777216.f) - 1.f;
+		};
+
+		const float h0 = corner(0, 0) + (corner(1, 0) - corner(0, 0)) * ux;
+		const float h1 = corner(0, 1) + (corner(1, 1) - corner(0, 1)) * ux;
+		return h0 + (h1 - h0) * uz;
+	}
+}
+
+Terrain::Terrain(GeometryManager& geometryManager, const TerrainSettings& settings)
+	: m_Settings(settings)
+	, m_PatchGeoID(0)
+	, m_TilePatches(0)
+	, m_TileSamples(0)
+	, m_RingTiles(0)
+	, m_Constants{}
+	, m_ConstantBuffer(0)
+	, m_HeightBuffer(0)
+	, m_Frame(0)
+	, m_InFlight(0)
+	, m_Stop(false)
+	, m_LoadSeconds(0.0)
+{
+	assert(m_Settings.levelCount >= 1 && m_Settings.levelCount <= TERRAIN_MAX_LEVELS);
+	assert(m_Settings.patchCells >= 2 && m_Settings.patchCells % 2 == 0);
+	assert(m_Settings.tileCells % m_Settings.patchCells == 0);
+	assert(m_Settings.rootCount > 0 && m_Settings.stagingTiles > 0);
+
+	m_TilePatches = m_Settings.tileCells / m_Settings.patchCells;
+	m_TileSamples = m_Settings.tileCells + 1;
+
+	// Missing tiles are written there, without the directory every write would fail
+	if (!m_Settings.tileDirectory.empty())
+	{
+		std::error_code error;
+		std::filesystem::create_directories(m_Settings.tileDirectory, error);
+		if (error)
+		{
+			LOG_ERROR("Couldn't create the tile directory [%s]: %s, generating every tile", m_Settings.tileDirectory.c_str(), error.message().c_str())
+			m_Settings.tileDirectory.clear();
+		}
+	}
+
+	// Level L needs its tiles within the range of level L + 1, where its nodes fill in for the
+	// quarters of the next level that are out of range, 2 * 2 * lodDistance * 2^L across. Ranges
+	// and tiles both double per level, so one ring size fits all of them. More than the map never.
+	const float tileSize = m_Settings.sampleSpacing * m_Settings.tileCells;
+	const uint32_t mapTiles = (m_Settings.rootCount << (m_Settings.levelCount - 1)) / m_TilePatches + 1;
+	m_RingTiles = std::min((uint32_t)(4.f * m_Settings.lodDistance / tileSize) + 2, mapTiles);
+
+	m_Ranges.resize(m_Settings.levelCount);
+	for (uint32_t level = 0; level < m_Settings.levelCount; level++)
+	{
+		m_Ranges[level] = m_Settings.lodDistance * (float)(1u << level);
+
+		// The top level has no level to morph into
+		if (level + 1 < m_Settings.levelCount)
+		{
+			const float previous = level > 0 ? m_Ranges[level - 1] : 0.f;
+			const float morphStart = m_Ranges[level] - (m_Ranges[level] - previous) * m_Settings.morphRatio;
+			m_Constants.morphRanges[level] = glm::vec4(morphStart, 1.f / (m_Ranges[level] - morphStart), 0.f, 0.f);
+		}
+	}
+
+	m_Constants.origin = glm::vec2(m_Settings.origin.x, m_Settings.origin.z);
+	m_Constants.patchSize = GetPatchSize(0);
+	m_Constants.sampleSpacing = m_Settings.sampleSpacing;
+	m_Constants.patchCells = m_Settings.patchCells;
+	m_Constants.tileCells = m_Settings.tileCells;
+	m_Constants.ringTiles = m_RingTiles;
+
+	glCreateBuffers(1, &m_ConstantBuffer);
+	glNamedBufferStorage(m_ConstantBuffer, sizeof(TerrainConstants), &m_Constants, 0);
+
+	m_Slots.resize((size_t)m_Settings.levelCount * m_RingTiles * m_RingTiles);
+	for (TileSlot& slot : m_Slots)
+	{
+		slot.patchBounds.resize((size_t)m_TilePatches * m_TilePatches);
+	}
+	glCreateBuffers(1, &m_HeightBuffer);
+	glNamedBufferStorage(m_HeightBuffer, GetResidentBytes(), nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+	// Unit grid in the xz plane, drawn as lines_adjacency along its rows and columns. The bounds
+	// cover the unit cube, patches scale y to their height range so the Renderer culls the box.
+	const uint32_t cells = m_Settings.patchCells;
+	const uint32_t rowVertices = cells + 1;
+
+	std::vector<float> vertices;
+	vertices.reserve((size_t)rowVertices * rowVertices * 3);
+	for (uint32_t z = 0; z <= cells; z++)
+	{
+		for (uint32_t x = 0; x <= cells; x++)
+		{
+			vertices.push_back((float)x / cells);
+			vertices.push_back(0.f);
+			vertices.push_back((float)z / cells);
+		}
+	}
+
+	std::vector<uint32_t> indices;
+	indices.reserve((size_t)rowVertices * cells * 8);
+	for (uint32_t line = 0; line <= cells; line++)
+	{
+		for (uint32_t i = 0; i < cells; i++)
+		{
+			const uint32_t segment[4] = { i > 0 ? i - 1 : 0, i, i + 1, std::min(i + 2, cells) };
+
+			for (uint32_t point : segment)
+			{
+				indices.push_back(line * rowVertices + point);
+			}
+			for (uint32_t point : segment)
+			{
+				indices.push_back(point * rowVertices + line);
+			}
+		}
+	}
+
+	const GLsizeiptr vertexBytes = (GLsizeiptr)(vertices.size() * sizeof(float));
+	EncodedMesh mesh = geometryManager.NeedsEncodedSource()
+		? GeometryManager::Encode(vertices.data(), vertexBytes, indices.data(), (uint32_t)indices.size())
+		: GeometryManager::Describe(vertices.data(), vertexBytes, (uint32_t)indices.size());
+	mesh.boundsCenter = glm::vec3(0.5f);
+	mesh.boundsRadius = std::sqrt(3.f) * 0.5f;
+
+	char name[64];
+	snprintf(name, sizeof(name), "terrainPatch_%u", cells);
+	m_PatchGeoID = geometryManager.AddGeometry(name, vertices.data(), indices.data(), std::move(mesh));
+	assert(m_PatchGeoID != 0 && "Geometry buffers are full");
+
+	// A level's patches lie within the range of the level above, a square of (4 * lodDistance /
+	// level 0 patch size) patches plus the parents straddling its edge, whatever the level. A root
+	// can't hold more than its full quadtree either. Every missing tile but a root's comes with a
+	// patch. Reserved up front so moving the camera into other roots doesn't allocate.
+	const size_t levelPatches = (size_t)std::ceil(4.f * m_Settings.lodDistance / GetPatchSize(0)) + 4;
+	const size_t viewPatches = m_Settings.levelCount * levelPatches * levelPatches;
+	const size_t treePatches = (size_t)1 << (2 * (m_Settings.levelCount - 1));
+
+	const uint32_t rootCount = m_Settings.rootCount * m_Settings.rootCount;
+	const size_t rootPatches = std::min(viewPatches, treePatches);
+	m_RootSelections.resize(rootCount);
+	for (RootSelection& selection : m_RootSelections)
+	{
+		selection.patches.reserve(rootPatches);
+		selection.missing.reserve(rootPatches + 1);
+	}
+	m_Patches.reserve(std::min(viewPatches, treePatches * rootCount));
+	m_Missing.reserve(m_Patches.capacity() + rootCount);
+
+	m_Staging.resize(m_Settings.stagingTiles);
+	m_FreeStaging.reserve(m_Settings.stagingTiles);
+	m_Requests.reserve(m_Settings.stagingTiles);
+	m_Loaded.reserve(m_Settings.stagingTiles);
+	for (uint32_t i = 0; i < m_Settings.stagingTiles; i++)
+	{
+		m_Staging[i].heights.resize((size_t)m_TileSamples * m_TileSamples);
+		m_Staging[i].patchBounds.resize((size_t)m_TilePatches * m_TilePatches);
+		m_FreeStaging.push_back(m_Settings.stagingTiles - 1 - i);
+	}
+
+	m_Thread = std::thread(&Terrain::LoaderLoop, this);
+}
+
+Terrain::~Terrain()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stop = true;
+	}
+	m_RequestCondition.notify_all();
+	m_Thread.join();
+
+	const GLuint buffers[] = { m_ConstantBuffer, m_HeightBuffer };
+	GLState::Get().DeleteBuffers(sizeof(buffers) / sizeof(GLuint), buffers);
+}
+
+void Terrain::Select(const glm::vec3& cameraPosition, const glm::mat4& viewProjection, JobSystem* jobSystem)
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	SelectContext context;
+	context.cameraPosition = cameraPosition;
+	Renderer::ExtractFrustumPlanes(viewProjection, context.frustumPlanes);
+
+	const uint32_t top = m_Settings.levelCount - 1;
+	const float rootSize = GetPatchSize(top);
+
+	auto selectRoots = [&](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t root = begin; root < end; root++)
+		{
+			RootSelection& selection = m_RootSelections[root];
+			selection.patches.clear();
+			selection.missing.clear();
+
+			const uint32_t x = root % m_Settings.rootCount;
+			const uint32_t z = root / m_Settings.rootCount;
+
+			// Out of range on the ground plane already, no need for its heights
+			const glm::vec2 rootMin = glm::vec2(m_Settings.origin.x, m_Settings.origin.z) + glm::vec2((float)x, (float)z) * rootSize;
+			const glm::vec2 closest = glm::clamp(glm::vec2(cameraPosition.x, cameraPosition.z), rootMin, rootMin + rootSize);
+			if (glm::distance(closest, glm::vec2(cameraPosition.x, cameraPosition.z)) > m_Ranges[top])
+			{
+				continue;
+			}
+
+			const TileKey key = GetPatchTile(top, x, z);
+			const TileSlot* tile = FindTile(key);
+			if (!tile)
+			{
+				selection.missing.push_back(key);
+				continue;
+			}
+
+			SelectNode(context, top, x, z, GetPatchBounds(*tile, x, z), selection);
+		}
+	};
+
+	const uint32_t rootCount = (uint32_t)m_RootSelections.size();
+	if (jobSystem)
+	{
+		jobSystem->ParallelFor(rootCount, SELECT_GRAIN_SIZE, selectRoots);
+	}
+	else
+	{
+		selectRoots(0, rootCount);
+	}
+
+	// Root order, so the same camera always gives the same patches in the same order
+	m_Patches.clear();
+	m_Missing.clear();
+	for (const RootSelection& selection : m_RootSelections)
+	{
+		m_Patches.insert(m_Patches.end(), selection.patches.begin(), selection.patches.end());
+		m_Missing.insert(m_Missing.end(), selection.missing.begin(), selection.missing.end());
+	}
+
+	for (const Patch& patch : m_Patches)
+	{
+		m_Slots[patch.slot].lastUsedFrame = m_Frame;
+	}
+
+	// Coarse tiles first, they unlock the finer levels. Neighbouring nodes miss the same tile.
+	std::sort(m_Missing.begin(), m_Missing.end(), [](const TileKey& a, const TileKey& b)
+	{
+		if (a.level != b.level) return a.level > b.level;
+		if (a.z != b.z) return a.z < b.z;
+		return a.x < b.x;
+	});
+	m_Missing.erase(std::unique(m_Missing.begin(), m_Missing.end()), m_Missing.end());
+
+	const double seconds = SecondsSince(start);
+	m_Stats.selectFrames++;
+	m_Stats.selectSecondsSum += seconds;
+	m_Stats.selectSecondsMax = std::max(m_Stats.selectSecondsMax, seconds);
+	m_Stats.patchesSum += m_Patches.size();
+	m_Stats.patchesMax = std::max(m_Stats.patchesMax, (uint32_t)m_Patches.size());
+}
+
+bool Terrain::SelectNode(const SelectContext& context, uint32_t level, uint32_t x, uint32_t z, const glm::vec2& bounds, RootSelection& selection) const
+{
+	const float size = GetPatchSize(level);
+	const glm::vec3 boxMin(m_Settings.origin.x + x * size, bounds.x, m_Settings.origin.z + z * size);
+	const glm::vec3 boxMax(boxMin.x + size, bounds.y, boxMin.z + size);
+
+	if (!IntersectsSphere(boxMin, boxMax, context.cameraPosition, m_Ranges[level]))
+	{
+		return false;
+	}
+
+	// Nothing to draw, but the parent must not draw it either
+	if (!IntersectsFrustum(boxMin, boxMax, context.frustumPlanes))
+	{
+		return true;
+	}
+
+	auto add = [&](uint32_t patchLevel, uint32_t patchX, uint32_t patchZ, const glm::vec2& patchBounds)
+	{
+		selection.patches.push_back({ patchLevel, patchX, patchZ, patchBounds, GetSlot(GetPatchTile(patchLevel, patchX, patchZ)) });
+	};
+
+	if (level == 0 || !IntersectsSphere(boxMin, boxMax, context.cameraPosition, m_Ranges[level - 1]))
+	{
+		add(level, x, z, bounds);
+		return true;
+	}
+
+	// All four children are in the same tile. Until it is there the node stays at this level, its
+	// neighbours may then be two levels apart for a few frames.
+	const TileKey childKey = GetPatchTile(level - 1, x * 2, z * 2);
+	const TileSlot* childTile = FindTile(childKey);
+	if (!childTile)
+	{
+		selection.missing.push_back(childKey);
+		add(level, x, z, bounds);
+		return true;
+	}
+
+	// Children out of their range are entirely beyond the next level's morph end, so they are drawn
+	// fully morphed, which is this level's grid
+	for (uint32_t childZ = z * 2; childZ < z * 2 + 2; childZ++)
+	{
+		for (uint32_t childX = x * 2; childX < x * 2 + 2; childX++)
+		{
+			const glm::vec2 childBounds = GetPatchBounds(*childTile, childX, childZ);
+			if (!SelectNode(context, level - 1, childX, childZ, childBounds, selection))
+			{
+				add(level - 1, childX, childZ, childBounds);
+			}
+		}
+	}
+	return true;
+}
+
+void Terrain::Submit(Renderer& renderer) const
+{
+	for (const Patch& patch : m_Patches)
+	{
+		const float size = GetPatchSize(patch.level);
+		const glm::vec3 corner(m_Settings.origin.x + patch.x * size, patch.bounds.x, m_Settings.origin.z + patch.z * size);
+
+		// y only matters for culling, the vertex shader takes the heights from the tile
+		const float height = std::max(patch.bounds.y - patch.bounds.x, 1e-3f);
+		const glm::mat4 transform = glm::scale(glm::translate(glm::mat4(1.f), corner), glm::vec3(size, height, size));
+
+		renderer.Submit({ m_PatchGeoID, transform, RenderQueue::Terrain });
+	}
+}
+
+void Terrain::Update(bool wait)
+{
+	size_t next = 0;
+	uint32_t uploads = 0;
+
+	while (true)
+	{
+		while (next < m_Missing.size() && !m_FreeStaging.empty())
+		{
+			const TileKey& key = m_Missing[next++];
+			const uint32_t slotIndex = GetSlot(key);
+			TileSlot& slot = m_Slots[slotIndex];
+
+			// Another tile of the ring is loading into the slot, or a frame in flight still reads it.
+			// Only happens while the camera moves quickly, the next Select asks again.
+			if ((slot.key == key && slot.state != TileState::Empty) || slot.state == TileState::Loading)
+			{
+				continue;
+			}
+			if (slot.state == TileState::Ready && slot.lastUsedFrame + RENDERER_FRAME_SLOTS > m_Frame)
+			{
+				continue;
+			}
+
+			if (slot.state == TileState::Ready)
+			{
+				m_Stats.tilesReplaced++;
+			}
+			slot.key = key;
+			slot.state = TileState::Loading;
+
+			const uint32_t stagingIndex = m_FreeStaging.back();
+			m_FreeStaging.pop_back();
+			m_Staging[stagingIndex].key = key;
+			m_Staging[stagingIndex].slot = slotIndex;
+			m_InFlight++;
+			m_Stats.tilesRequested++;
+
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_Requests.push_back(stagingIndex);
+			}
+			m_RequestCondition.notify_one();
+		}
+
+		while (wait || uploads < m_Settings.uploadTilesPerFrame)
+		{
+			uint32_t stagingIndex;
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				if (m_Loaded.empty())
+				{
+					break;
+				}
+
+				stagingIndex = m_Loaded.front();
+				m_Loaded.erase(m_Loaded.begin());
+			}
+
+			Upload(stagingIndex);
+			uploads++;
+		}
+
+		if (!wait || (m_InFlight == 0 && next == m_Missing.size()))
+		{
+			break;
+		}
+
+		if (m_InFlight > 0)
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_LoadedCondition.wait(lock, [this]() { return !m_Loaded.empty(); });
+		}
+	}
+
+	if (uploads > 0)
+	{
+		LOG_TRACE("Terrain: uploaded %u tiles, %u in flight", uploads, m_InFlight)
+	}
+
+	m_Missing.clear();
+	m_Frame++;
+}
+
+void Terrain::Upload(uint32_t stagingIndex)
+{
+	StagingTile& staging = m_Staging[stagingIndex];
+	TileSlot& slot = m_Slots[staging.slot];
+	assert(slot.key == staging.key && slot.state == TileState::Loading);
+
+	m_InFlight--;
+	m_FreeStaging.push_back(stagingIndex);
+
+	if (!staging.succeeded)
+	{
+		slot.state = TileState::Failed;
+		m_Stats.tilesFailed++;
+		return;
+	}
+
+	const GLsizeiptr tileBytes = (GLsizeiptr)staging.heights.size() * sizeof(float);
+	glNamedBufferSubData(m_HeightBuffer, staging.slot * tileBytes, tileBytes, staging.heights.data());
+
+	std::copy(staging.patchBounds.begin(), staging.patchBounds.end(), slot.patchBounds.begin());
+	slot.state = TileState::Ready;
+
+	m_Stats.tilesLoaded++;
+	m_Stats.tilesRead += staging.read;
+	m_Stats.tilesWritten += staging.written;
+}
+
+void Terrain::Bind() const
+{
+	GLState& state = GLState::Get();
+	state.BindBufferBase(GL_UNIFORM_BUFFER, TERRAIN_CONSTANTS_BINDING, m_ConstantBuffer);
+	state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, TERRAIN_HEIGHTS_BINDING, m_HeightBuffer);
+}
+
+size_t Terrain::GetResidentBytes() const
+{
+	return m_Slots.size() * m_TileSamples * m_TileSamples * sizeof(float);
+}
+
+size_t Terrain::GetMapBytes() const
+{
+	const size_t samples = ((size_t)m_Settings.rootCount * m_Settings.patchCells << (m_Settings.levelCount - 1)) + 1;
+	return samples * samples * sizeof(float);
+}
+
+const Terrain::TileSlot* Terrain::FindTile(const TileKey& key) const
+{
+	const TileSlot& slot = m_Slots[GetSlot(key)];
+	return slot.state == TileState::Ready && slot.key == key ? &slot : nullptr;
+}
+
+Terrain::TileKey Terrain::GetPatchTile(uint32_t level, uint32_t x, uint32_t z) const
+{
+	return { level, x / m_TilePatches, z / m_TilePatches };
+}
+
+glm::vec2 Terrain::GetPatchBounds(const TileSlot& tile, uint32_t x, uint32_t z) const
+{
+	return tile.patchBounds[(z % m_TilePatches) * m_TilePatches + x % m_TilePatches];
+}
+
+void Terrain::LoaderLoop()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	while (true)
+	{
+		m_RequestCondition.wait(lock, [this]() { return m_Stop || !m_Requests.empty(); });
+		if (m_Stop)
+		{
+			break;
+		}
+
+		const uint32_t stagingIndex = m_Requests.front();
+		m_Requests.erase(m_Requests.begin());
+
+		lock.unlock();
+		const auto start = std::chrono::steady_clock::now();
+		Load(m_Staging[stagingIndex]);
+		const double seconds = SecondsSince(start);
+		lock.lock();
+
+		m_LoadSeconds += seconds;
+		m_Loaded.push_back(stagingIndex);
+		m_LoadedCondition.notify_one();
+	}
+}
+
+void Terrain::Load(StagingTile& staging) const
+{
+	const TileKey& key = staging.key;
+	float* heights = staging.heights.data();
+	staging.succeeded = false;
+	staging.read = false;
+	staging.written = false;
+
+	if (m_Settings.tileDirectory.empty())
+	{
+		Generate(key, heights);
+	}
+	else
+	{
+		char path[512];
+		snprintf(path, sizeof(path), "%s/%u_%u_%u.gl2h", m_Settings.tileDirectory.c_str(), key.level, key.x, key.z);
+
+		staging.read = ReadTileFile(path, key.level, key.x, key.z, m_TileSamples, heights);
+		if (!staging.read)
+		{
+			Generate(key, heights);
+			staging.written = WriteTileFile(path, key.level, key.x, key.z, m_TileSamples, heights);
+		}
+	}
+
+	// Patches share their border samples with their neighbours
+	const uint32_t cells = m_Settings.patchCells;
+	for (uint32_t patchZ = 0; patchZ < m_TilePatches; patchZ++)
+	{
+		for (uint32_t patchX = 0; patchX < m_TilePatches; patchX++)
+		{
+			glm::vec2 bounds(FLT_MAX, -FLT_MAX);
+			for (uint32_t z = patchZ * cells; z <= (patchZ + 1) * cells; z++)
+			{
+				for (uint32_t x = patchX * cells; x <= (patchX + 1) * cells; x++)
+				{
+					const float height = heights[z * m_TileSamples + x];
+					bounds.x = std::min(bounds.x, height);
+					bounds.y = std::max(bounds.y, height);
+				}
+			}
+			staging.patchBounds[patchZ * m_TilePatches + patchX] = bounds;
+		}
+	}
+
+	staging.succeeded = true;
+}
+
+void Terrain::Generate(const TileKey& key, float* heights) const
+{
+	// Integer sample positions times the spacing, so a sample every level has lands on exactly the
+	// same height in all of them
+	const double spacing = (double)m_Settings.sampleSpacing * (double)(1u << key.level);
+	const uint64_t firstX = (uint64_t)key.x * m_Settings.tileCells;
+	const uint64_t firstZ = (uint64_t)key.z * m_Settings.tileCells;
+
+	for (uint32_t z = 0; z < m_TileSamples; z++)
+	{
+		for (uint32_t x = 0; x < m_TileSamples; x++)
+		{
+			heights[z * m_TileSamples + x] = m_Settings.origin.y + GenerateHeight((double)(firstX + x) * spacing, (double)(firstZ + z) * spacing);
+		}
+	}
+}
+
+float Terrain::GenerateHeight(double x, double z) const
+{
+	// Six octaves of value noise, the largest features a few hundred units across
+	double frequency = 1.0 / 256.0;
+	float amplitude = 1.f;
+	float height = 0.f;
+	float amplitudeSum = 0.f;
+
+	for (uint32_t octave = 0; octave < 6; octave++)
+	{
+		height += ValueNoise(x * frequency, z * frequency, m_Settings.seed + octave) * amplitude;
+		amplitudeSum += amplitude;
+		amplitude *= 0.5f;
+		frequency *= 2.0;
+	}
+
+	return height / amplitudeSum * m_Settings.heightScale;
+}
+
+void Terrain::LogStats()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stats.loadSeconds = m_LoadSeconds;
+	}
+
+	const double mb = 1024.0 * 1024.0;
+	LOG_INFO("Terrain: %u levels, %ux%u tile ring per level, %.2f MB of heights resident for a map of %.2f MB at level 0",
+		m_Settings.levelCount, m_RingTiles, m_RingTiles, GetResidentBytes() / mb, GetMapBytes() / mb)
+
+	LOG_INFO("Terrain: %llu tiles requested, %llu loaded, %llu read, %llu written, %llu failed, %llu replaced, %u in flight, %.3f s on the loader thread",
+		(unsigned long long)m_Stats.tilesRequested, (unsigned long long)m_Stats.tilesLoaded, (unsigned long long)m_Stats.tilesRead,
+		(unsigned long long)m_Stats.tilesWritten, (unsigned long long)m_Stats.tilesFailed, (unsigned long long)m_Stats.tilesReplaced,
+		m_InFlight, m_Stats.loadSeconds)
+
+	if (m_Stats.selectFrames > 0)
+	{
+		LOG_INFO("Terrain: %.1f patches per frame, %u max, select %.3f ms mean, %.3f ms max",
+			(double)m_Stats.patchesSum / m_Stats.selectFrames, m_Stats.patchesMax,
+			m_Stats.selectSecondsSum / m_Stats.selectFrames * 1000.0, m_Stats.selectSecondsMax * 1000.0)
+	}
+}
+
+bool Terrain::ReadTileFile(const char* path, uint32_t level, uint32_t x, uint32_t z, uint32_t samples, float* heights)
+{
+	// Not written yet, the caller generates it
+	FILE* file = fopen(path, "rb");
+	if (!file)
+	{
+		return false;
+	}
+
+	char magic[4] = {};
+	uint32_t header[5] = {};
+	const size_t count = (size_t)samples * samples;
+
+	bool read = fread(magic, sizeof(magic), 1, file) == 1;
+	read &= fread(header, sizeof(header), 1, file) == 1;
+	read &= memcmp(magic, TILE_FILE_MAGIC, sizeof(magic)) == 0;
+	read &= header[0] == TILE_FILE_VERSION && header[1] == level && header[2] == x && header[3] == z && header[4] == samples;
+	read = read && fread(heights, sizeof(float), count, file) == count;
+	read &= fgetc(file) == EOF;
+	fclose(file);
+
+	if (!read)
+	{
+		LOG_ERROR("[%s] is not a tile file of version %u for tile %u %u %u", path, TILE_FILE_VERSION, level, x, z)
+	}
+	return read;
+}
+
+bool Terrain::WriteTileFile(const char* path, uint32_t level, uint32_t x, uint32_t z, uint32_t samples, const float* heights)
+{
+	FILE* file = fopen(path, "wb");
+	if (!file)
+	{
+		LOG_ERROR("Couldn't open tile file [%s] for writing", path)
+		return false;
+	}
+
+	const uint32_t header[5] = { TILE_FILE_VERSION, level, x, z, samples };
+	const size_t count = (size_t)samples * samples;
+
+	bool written = fwrite(TILE_FILE_MAGIC, sizeof(TILE_FILE_MAGIC), 1, file) == 1;
+	written &= fwrite(header, sizeof(header), 1, file) == 1;
+	written &= fwrite(heights, sizeof(float), count, file) == count;
+	written &= fclose(file) == 0;
+
+	if (!written)
+	{
+		LOG_ERROR("Couldn't write tile file [%s]", path)
+	}
+	return written;
+}
@@ -0,0 +1,409 @@
+#include "Trace.h"
+#include "GeometryManager.h"
+
+namespace
+{
+	const char TRACE_MAGIC[4] = { 'G', 'L', '2', 'T' };
+
+	bool IsAffine(const glm::mat4& matrix)
+	{
+		return matrix[0][3] == 0.f && matrix[1][3] == 0.f && matrix[2][3] == 0.f && matrix[3][3] == 1.f;
+	}
+
+	// Submits may only reference geometry recorded before them, replay adds it before the frame
+	// and the renderer indexes its per geometry data with the ID unchecked
+	bool IsLoadedGeometry(const Trace& trace, uint32_t geoID)
+	{
+		return geoID != 0 && geoID <= trace.geometry.size();
+	}
+
+	// Bounds checked reads over the loaded file
+	class TraceCursor
+	{
+	public:
+		TraceCursor(const std::vector<uint8_t>& data)
+			: m_Data(data)
+		{
+		}
+
+		bool AtEnd() const { return m_Offset >= m_Data.size(); }
+		bool Failed() const { return m_Failed; }
+		size_t GetOffset() const { return m_Offset; }
+
+		template<typename T>
+		T Read()
+		{
+			T value{};
+			Read(&value, sizeof(T));
+			return value;
+		}
+
+		// Element count of an array that follows, fails without reading on if the rest of the file
+		// can't hold that many elements, so a corrupt count never turns into a huge allocation
+		template<typename T>
+		size_t ReadCount(size_t elementSize)
+		{
+			const size_t count = Read<T>();
+			if (m_Failed || count > (m_Data.size() - m_Offset) / elementSize)
+			{
+				m_Failed = true;
+				return 0;
+			}
+			return count;
+		}
+
+		void Read(void* data, size_t bytes)
+		{
+			if (m_Failed || m_Offset + bytes > m_Data.size())
+			{
+				m_Failed = true;
+				return;
+			}
+
+			memcpy(data, m_Data.data() + m_Offset, bytes);
+			m_Offset += bytes;
+		}
+
+	private:
+		const std::vector<uint8_t>& m_Data;
+		size_t m_Offset = 0;
+		bool m_Failed = false;
+	};
+}
+
+TraceRecorder::~TraceRecorder()
+{
+	Close();
+}
+
+bool TraceRecorder::Open(const std::string& path)
+{
+	Close();
+
+	m_File = fopen(path.c_str(), "wb");
+	if (!m_File)
+	{
+		LOG_ERROR("Couldn't open trace [%s] for writing", path.c_str())
+		return false;
+	}
+
+	Write(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+	Write((uint32_t)TRACE_VERSION);
+
+	LOG_INFO("Recording trace to [%s]", path.c_str())
+	return true;
+}
+
+void TraceRecorder::Close()
+{
+	if (!m_File)
+	{
+		return;
+	}
+
+	// Whatever was recorded outside of a frame still goes into the file
+	FlushRun();
+	m_BytesWritten += fwrite(m_Buffer.data(), 1, m_Buffer.size(), m_File);
+	m_Buffer.clear();
+
+	fclose(m_File);
+	m_File = nullptr;
+
+	LOG_INFO("Recorded %llu frames, %.2f MB", (unsigned long long)m_FrameCount, m_BytesWritten / (1024.0 * 1024.0))
+}
+
+void TraceRecorder::RecordGeometry(uint32_t geoID, const std::string& name, const EncodedMesh& mesh)
+{
+	if (!m_File)
+	{
+		return;
+	}
+
+	FlushRun();
+
+	Write(TraceRecord::Geometry);
+	Write(geoID);
+	Write((uint16_t)name.size());
+	Write(name.data(), name.size());
+	Write(mesh.vertexCount);
+	Write(mesh.vertexSize);
+	Write(mesh.indexCount);
+	Write(mesh.boundsCenter);
+	Write(mesh.boundsRadius);
+	Write((uint32_t)mesh.vertices.size());
+	Write(mesh.vertices.data(), mesh.vertices.size());
+	Write((uint32_t)mesh.indices.size());
+	Write(mesh.indices.data(), mesh.indices.size());
+}
+
+void TraceRecorder::BeginFrame()
+{
+	if (!m_File)
+	{
+		return;
+	}
+
+	FlushRun();
+	Write(TraceRecord::FrameBegin);
+}
+
+void TraceRecorder::RecordView(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix)
+{
+	if (!m_File)
+	{
+		return;
+	}
+
+	FlushRun();
+	Write(TraceRecord::View);
+	Write(viewMatrix);
+	Write(projectionMatrix);
+}
+
+void TraceRecorder::RecordSubmit(uint32_t geoID, const glm::mat4& modelTransform)
+{
+	if (!m_File)
+	{
+		return;
+	}
+
+	if (!IsAffine(modelTransform))
+	{
+		FlushRun();
+		Write(TraceRecord::SubmitFull);
+		Write(geoID);
+		Write(modelTransform);
+		return;
+	}
+
+	if (geoID != m_RunGeoID)
+	{
+		FlushRun();
+		m_RunGeoID = geoID;
+	}
+
+	for (int column = 0; column < 4; column++)
+	{
+		m_RunTransforms.push_back(modelTransform[column][0]);
+		m_RunTransforms.push_back(modelTransform[column][1]);
+		m_RunTransforms.push_back(modelTransform[column][2]);
+	}
+}
+
+void TraceRecorder::EndFrame()
+{
+	if (!m_File)
+	{
+		return;
+	}
+
+	FlushRun();
+	Write(TraceRecord::FrameEnd);
+
+	m_BytesWritten += fwrite(m_Buffer.data(), 1, m_Buffer.size(), m_File);
+	m_Buffer.clear();
+	m_FrameCount++;
+}
+
+void TraceRecorder::FlushRun()
+{
+	if (m_RunTransforms.empty())
+	{
+		return;
+	}
+
+	Write(TraceRecord::SubmitRun);
+	Write(m_RunGeoID);
+	Write((uint32_t)(m_RunTransforms.size() / 12));
+	Write(m_RunTransforms.data(), m_RunTransforms.size() * sizeof(float));
+
+	m_RunTransforms.clear();
+	m_RunGeoID = 0;
+}
+
+void TraceRecorder::Write(const void* data, size_t bytes)
+{
+	const uint8_t* begin = static_cast<const uint8_t*>(data);
+	m_Buffer.insert(m_Buffer.end(), begin, begin + bytes);
+}
+
+bool Trace::Load(const std::string& path, Trace& trace)
+{
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+	{
+		LOG_ERROR("Couldn't open trace at location [%s]", path.c_str())
+		return false;
+	}
+
+	std::vector<uint8_t> data((size_t)file.tellg());
+	file.seekg(0);
+	file.read((char*)data.data(), data.size());
+
+	trace = Trace();
+	TraceCursor cursor(data);
+
+	char magic[4];
+	cursor.Read(magic, sizeof(magic));
+	const uint32_t version = cursor.Read<uint32_t>();
+	if (cursor.Failed() || memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0 || version == 0 || version > TRACE_VERSION)
+	{
+		LOG_ERROR("[%s] is not a trace of version 1 to %u", path.c_str(), TRACE_VERSION)
+		return false;
+	}
+
+	TraceFrame frame{};
+	bool inFrame = false;
+	uint32_t assignedGeometry = 0;
+
+	while (!cursor.AtEnd() && !cursor.Failed())
+	{
+		const TraceRecord record = cursor.Read<TraceRecord>();
+		switch (record)
+		{
+		case TraceRecord::Geometry:
+		{
+			TraceGeometry geometry{};
+			geometry.geoID = cursor.Read<uint32_t>();
+
+			// Replay hands out IDs in order from 1, the recorded ones have to come out the same
+			if (!cursor.Failed() && geometry.geoID != trace.geometry.size() + 1)
+			{
+				LOG_ERROR("Geometry %u out of order in [%s] at offset %llu", geometry.geoID, path.c_str(), (unsigned long long)cursor.GetOffset())
+				return false;
+			}
+			geometry.name.resize(cursor.ReadCount<uint16_t>(1));
+			cursor.Read(geometry.name.data(), geometry.name.size());
+
+			if (version == 1)
+			{
+				std::vector<uint8_t> vertices(cursor.ReadCount<uint32_t>(1));
+				cursor.Read(vertices.data(), vertices.size());
+				std::vector<uint32_t> elements(cursor.ReadCount<uint32_t>(sizeof(uint32_t)));
+				cursor.Read(elements.data(), elements.size() * sizeof(uint32_t));
+				if (!cursor.Failed())
+				{
+					geometry.mesh = GeometryManager::Encode(vertices.data(), (GLsizeiptr)vertices.size(), elements.data(), (uint32_t)elements.size());
+				}
+			}
+			else
+			{
+				EncodedMesh& mesh = geometry.mesh;
+				mesh.vertexCount = cursor.Read<uint32_t>();
+				mesh.vertexSize = cursor.Read<uint32_t>();
+				mesh.indexCount = cursor.Read<uint32_t>();
+				mesh.boundsCenter = cursor.Read<glm::vec3>();
+				mesh.boundsRadius = cursor.Read<float>();
+				mesh.vertices.resize(cursor.ReadCount<uint32_t>(1));
+				cursor.Read(mesh.vertices.data(), mesh.vertices.size());
+				mesh.indices.resize(cursor.ReadCount<uint32_t>(1));
+				cursor.Read(mesh.indices.data(), mesh.indices.size());
+
+				// Decoding goes straight into ranges mapped for these counts, so they have to match
+				// the vertex format and fit the encoded data
+				if (!cursor.Failed() && (mesh.vertexSize != SIZE_OF_VERTEX
+					|| mesh.vertices.size() < MeshCodec::GetMinVertexBytes(mesh.vertexCount, mesh.vertexSize)
+					|| mesh.indices.size() < MeshCodec::GetMinIndexBytes(mesh.indexCount)))
+				{
+					LOG_ERROR("Geometry %u in [%s] has %u vertices of %u bytes and %u indices, which its data can't hold",
+						geometry.geoID, path.c_str(), mesh.vertexCount, mesh.vertexSize, mesh.indexCount)
+					return false;
+				}
+			}
+
+			trace.geometry.push_back(std::move(geometry));
+			break;
+		}
+
+		case TraceRecord::FrameBegin:
+			frame = TraceFrame{};
+			frame.firstView = (uint32_t)trace.views.size();
+			frame.firstSubmit = (uint32_t)trace.submits.size();
+			inFrame = true;
+			break;
+
+		case TraceRecord::View:
+		{
+			TraceView view{};
+			view.viewMatrix = cursor.Read<glm::mat4>();
+			view.projectionMatrix = cursor.Read<glm::mat4>();
+			trace.views.push_back(view);
+			break;
+		}
+
+		case TraceRecord::SubmitRun:
+		{
+			const uint32_t geoID = cursor.Read<uint32_t>();
+			if (!cursor.Failed() && !IsLoadedGeometry(trace, geoID))
+			{
+				LOG_ERROR("Submit of unknown geometry %u in [%s] at offset %llu", geoID, path.c_str(), (unsigned long long)cursor.GetOffset())
+				return false;
+			}
+
+			const size_t count = cursor.ReadCount<uint32_t>(12 * sizeof(float));
+			trace.submits.reserve(trace.submits.size() + count);
+			for (size_t i = 0; i < count && !cursor.Failed(); i++)
+			{
+				float affine[12];
+				cursor.Read(affine, sizeof(affine));
+
+				TraceSubmit submit{ geoID, glm::mat4(1.f) };
+				for (int column = 0; column < 4; column++)
+				{
+					submit.modelTransform[column] = glm::vec4(affine[column * 3], affine[column * 3 + 1], affine[column * 3 + 2], column == 3 ? 1.f : 0.f);
+				}
+				trace.submits.push_back(submit);
+			}
+			break;
+		}
+
+		case TraceRecord::SubmitFull:
+		{
+			TraceSubmit submit{};
+			submit.geoID = cursor.Read<uint32_t>();
+			if (!cursor.Failed() && !IsLoadedGeometry(trace, submit.geoID))
+			{
+				LOG_ERROR("Submit of unknown geometry %u in [%s] at offset %llu", submit.geoID, path.c_str(), (unsigned long long)cursor.GetOffset())
+				return false;
+			}
+
+			submit.modelTransform = cursor.Read<glm::mat4>();
+			trace.submits.push_back(submit);
+			break;
+		}
+
+		case TraceRecord::FrameEnd:
+			if (!inFrame)
+			{
+				LOG_ERROR("Frame end without a begin in [%s] at offset %llu", path.c_str(), (unsigned long long)cursor.GetOffset())
+				return false;
+			}
+
+			// Geometry recorded during the frame is referenced by its submits, so the frame owns
+			// everything that wasn't added before an earlier one
+			frame.firstGeometry = assignedGeometry;
+			frame.geometryCount = (uint32_t)trace.geometry.size() - assignedGeometry;
+			frame.viewCount = (uint32_t)trace.views.size() - frame.firstView;
+			frame.submitCount = (uint32_t)trace.submits.size() - frame.firstSubmit;
+			assignedGeometry = (uint32_t)trace.geometry.size();
+
+			trace.frames.push_back(frame);
+			inFrame = false;
+			break;
+
+		default:
+			LOG_ERROR("Unknown record %u in [%s] at offset %llu", (uint32_t)record, path.c_str(), (unsigned long long)cursor.GetOffset())
+			return false;
+		}
+	}
+
+	if (cursor.Failed())
+	{
+		LOG_ERROR("Trace [%s] is truncated", path.c_str())
+		return false;
+	}
+
+	LOG_INFO("Loaded trace [%s]: %u frames, %u geometries, %u submits", path.c_str(),
+		(uint32_t)trace.frames.size(), (uint32_t)trace.geometry.size(), (uint32_t)trace.submits.size())
+	return true;
+}
@@ -1,8 +1,10 @@
 #version 460
 
+#include "constants.glsl"
+
 out vec4 color;
 
 void main()
 {
-    color = vec4(1, 1, 0, 1.0);
+    color = u_Color;
 }
@@ -1,14 +1,78 @@
-		#version 460
-		layout(location = 0) in vec3 a_Position;
-		layout(location = 1) in mat4 a_ModelMat;
-
-		uniform mat4 u_ViewMat;
-		uniform mat4 u_PerspectiveMat;
-		out mat4 gsModelMat;
-
-		void main()
-		{
-		gsModelMat = a_ModelMat;
-		//gl_Position = u_PerspectiveMat * u_ViewMat * a_ModelMat * vec4(a_Position, 1.0);
-		gl_Position = vec4(a_Position, 1.0);
-		}
\ No newline at end of file
+#version 460
+
+// Feeds the geometry shaders a point in model space and the instance's model matrix.
+// VERTEX_PULLING reads both from storage buffers instead of vertex attributes. That variant is
+// drawn with glMultiDrawArraysIndirect, gl_VertexID walks the index range of the command and
+// gl_BaseInstance holds the command index. INSTANCE_RANGES expands the model matrix from the
+// range descriptor the command points at instead of reading it. TERRAIN places and morphs the
+// vertices of terrain patches itself and hands on world positions with an identity matrix.
+
+out mat4 gsModelMat;
+
+#if INSTANCE_RANGES && TERRAIN
+#error INSTANCE_RANGES and TERRAIN can't be combined
+#endif
+
+#if INSTANCE_RANGES
+#include "instanceRange.glsl"
+#endif
+
+#if TERRAIN
+#include "terrain.glsl"
+#endif
+
+#if VERTEX_PULLING
+
+#include "pulling.glsl"
+
+void main()
+{
+	DrawParams draw = b_Draws[gl_BaseInstance];
+	uint vertex = uint(int(b_Indices[gl_VertexID]) + draw.baseVertex);
+
+#if INSTANCE_RANGES
+	// firstInstance is the range index here
+	gsModelMat = RangeModelMat(draw.firstInstance, uint(gl_InstanceID));
+#else
+	gsModelMat = b_ModelMats[draw.firstInstance + gl_InstanceID];
+#endif
+
+#if TERRAIN
+	gl_Position = vec4(TerrainPosition(gsModelMat, PullPosition(vertex)), 1.0);
+	gsModelMat = mat4(1.0);
+#else
+	gl_Position = vec4(PullPosition(vertex), 1.0);
+#endif
+}
+
+#else
+
+layout(location = 0) in vec3 a_Position;
+
+#if INSTANCE_RANGES
+
+// Drawn without the model matrix attributes, the base instance is the range index
+void main()
+{
+	gsModelMat = RangeModelMat(uint(gl_BaseInstance), uint(gl_InstanceID));
+	gl_Position = vec4(a_Position, 1.0);
+}
+
+#else
+
+layout(location = 1) in mat4 a_ModelMat;
+
+void main()
+{
+#if TERRAIN
+	gsModelMat = mat4(1.0);
+	gl_Position = vec4(TerrainPosition(a_ModelMat, a_Position), 1.0);
+#else
+	gsModelMat = a_ModelMat;
+	gl_Position = vec4(a_Position, 1.0);
+#endif
+}
+
+#endif
+
+#endif
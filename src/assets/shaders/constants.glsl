@@ -0,0 +1,23 @@
+// Uniform blocks shared by all stages, mirrored by the structs in ShaderConstants.h. Blocks a
+// stage doesn't read are inactive and cost nothing.
+
+layout(std140, binding = 0) uniform FrameConstants
+{
+	float u_Time;
+	float u_DeltaTime;
+	uint u_FrameIndex;
+};
+
+layout(std140, binding = 1) uniform ViewConstants
+{
+	mat4 u_ViewMat;
+	mat4 u_PerspectiveMat;
+	mat4 u_ViewProjectionMat;
+	vec4 u_CameraPosition;
+};
+
+layout(std140, binding = 2) uniform MaterialConstants
+{
+	vec4 u_Color;
+	int uSteps;
+};
@@ -0,0 +1,257 @@
+#version 460
+
+// Frustum culling for GpuCulling, the instances and their geometry stay on the GPU and the passes
+// write the indirect commands the draws consume. CULL_PASS picks the pass:
+//   1  one invocation per instance: sphere against the planes, rank among the visible instances
+//      of its workgroup, visible count per workgroup
+//   2  a single workgroup: prefix sum over the workgroup counts, then one command per geometry
+//      with visible instances and the draw count
+//   3  one invocation per instance: copies the visible model matrices to their rank
+// Instances are sorted by geometry, so ranking them in order leaves every geometry's visible
+// instances contiguous and in submission order. Nothing depends on atomics, the output is the
+// same on every run. Mirrored by GpuCulling::CheckAgainstCpu.
+
+layout(local_size_x = GROUP_SIZE) in;
+
+struct CullInstance
+{
+	mat4 modelTransform;
+	uint geometry;
+	uint padding0;
+	uint padding1;
+	uint padding2;
+};
+
+struct CullGeometry
+{
+	vec4 bounds;
+	uint firstInstance;
+	uint instanceCount;
+	uint elementCount;
+	uint firstIndex;
+	int baseVertex;
+	uint padding0;
+	uint padding1;
+	uint padding2;
+};
+
+struct DrawCommand
+{
+	uint elementCount;
+	uint instanceCount;
+	uint firstIndex;
+	int baseVertex;
+	uint baseInstance;
+};
+
+struct DrawArraysCommand
+{
+	uint count;
+	uint instanceCount;
+	uint first;
+	uint baseInstance;
+};
+
+// DrawParams of pulling.glsl
+struct PullDrawParams
+{
+	uint firstIndex;
+	int baseVertex;
+	uint firstInstance;
+	uint elementCount;
+};
+
+layout(std140, binding = 3) uniform CullConstants
+{
+	vec4 u_FrustumPlanes[6];
+	uint u_InstanceCount;
+	uint u_GeometryCount;
+	uint u_BlockCount;
+};
+
+#define VISIBLE_BIT 0x80000000u
+
+layout(std430, binding = 0) readonly buffer CullInstanceBuffer { CullInstance b_Instances[]; };
+layout(std430, binding = 1) readonly buffer CullGeometryBuffer { CullGeometry b_Geometry[]; };
+
+// Rank inside the workgroup, VISIBLE_BIT set for visible instances
+layout(std430, binding = 2) coherent buffer RankBuffer { uint b_Ranks[]; };
+
+// Visible instances per workgroup, turned into offsets by pass 2
+layout(std430, binding = 3) coherent buffer BlockBuffer
+{
+	uint b_DrawCount; // read by glMultiDraw*IndirectCount
+	uint b_VisibleCount;
+	uint b_Padding0;
+	uint b_Padding1;
+	uint b_Blocks[];
+};
+
+layout(std430, binding = 4) writeonly buffer VisibleBuffer { mat4 b_Visible[]; };
+layout(std430, binding = 5) writeonly buffer CommandBuffer { DrawCommand b_Commands[]; };
+
+// Line commands then quad commands, u_GeometryCount each, like the Renderer's pull commands
+layout(std430, binding = 6) writeonly buffer PullCommandBuffer { DrawArraysCommand b_PullCommands[]; };
+layout(std430, binding = 7) writeonly buffer PullDrawParamsBuffer { PullDrawParams b_PullDrawParams[]; };
+
+shared uint s_Scan[GROUP_SIZE];
+
+// Exclusive prefix sum over the workgroup, every invocation has to take part
+uint GroupExclusiveScan(uint value, out uint total)
+{
+	uint i = gl_LocalInvocationIndex;
+	s_Scan[i] = value;
+	barrier();
+
+	for (uint offset = 1u; offset < GROUP_SIZE; offset <<= 1)
+	{
+		uint add = i >= offset ? s_Scan[i - offset] : 0u;
+		barrier();
+		s_Scan[i] += add;
+		barrier();
+	}
+
+	total = s_Scan[GROUP_SIZE - 1];
+	uint result = s_Scan[i] - value;
+
+	// The next call writes s_Scan again
+	barrier();
+	return result;
+}
+
+#if CULL_PASS == 1
+
+bool IsVisible(CullInstance instance)
+{
+	CullGeometry geometry = b_Geometry[instance.geometry];
+	mat4 model = instance.modelTransform;
+
+	vec3 center = vec3(model * vec4(geometry.bounds.xyz, 1.0));
+	float scale = max(length(model[0].xyz), max(length(model[1].xyz), length(model[2].xyz)));
+	float radius = geometry.bounds.w * scale;
+
+	for (int i = 0; i < 6; i++)
+	{
+		if (dot(u_FrustumPlanes[i].xyz, center) + u_FrustumPlanes[i].w <= -radius)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void main()
+{
+	uint index = gl_GlobalInvocationID.x;
+	bool visible = index < u_InstanceCount && IsVisible(b_Instances[index]);
+
+	uint total;
+	uint rank = GroupExclusiveScan(visible ? 1u : 0u, total);
+
+	if (index < u_InstanceCount)
+	{
+		b_Ranks[index] = rank | (visible ? VISIBLE_BIT : 0u);
+	}
+
+	if (gl_LocalInvocationIndex == 0u)
+	{
+		b_Blocks[gl_WorkGroupID.x] = total;
+	}
+}
+
+#elif CULL_PASS == 2
+
+// Visible instances in front of instance, all of them for the end of the array
+uint VisibleBefore(uint instance, uint visibleCount)
+{
+	if (instance >= u_InstanceCount)
+	{
+		return visibleCount;
+	}
+	return b_Blocks[instance / GROUP_SIZE] + (b_Ranks[instance] & ~VISIBLE_BIT);
+}
+
+void main()
+{
+	uint invocation = gl_LocalInvocationIndex;
+
+	uint visibleCount = 0u;
+	for (uint base = 0u; base < u_BlockCount; base += GROUP_SIZE)
+	{
+		uint block = base + invocation;
+		uint total;
+		uint offset = GroupExclusiveScan(block < u_BlockCount ? b_Blocks[block] : 0u, total);
+
+		if (block < u_BlockCount)
+		{
+			b_Blocks[block] = visibleCount + offset;
+		}
+		visibleCount += total;
+	}
+
+	memoryBarrierBuffer();
+	barrier();
+
+	uint drawCount = 0u;
+	for (uint base = 0u; base < u_GeometryCount; base += GROUP_SIZE)
+	{
+		uint index = base + invocation;
+		uint firstVisible = 0u;
+		uint count = 0u;
+		CullGeometry geometry;
+
+		if (index < u_GeometryCount)
+		{
+			geometry = b_Geometry[index];
+			firstVisible = VisibleBefore(geometry.firstInstance, visibleCount);
+			count = VisibleBefore(geometry.firstInstance + geometry.instanceCount, visibleCount) - firstVisible;
+		}
+
+		uint total;
+		uint slot = drawCount + GroupExclusiveScan(count > 0u ? 1u : 0u, total);
+
+		if (count > 0u)
+		{
+			b_Commands[slot] = DrawCommand(geometry.elementCount, count, geometry.firstIndex, geometry.baseVertex, firstVisible);
+			b_PullCommands[slot] = DrawArraysCommand(geometry.elementCount, count, geometry.firstIndex, slot);
+			b_PullCommands[u_GeometryCount + slot] = DrawArraysCommand(4u, geometry.elementCount * count, 0u, slot);
+			b_PullDrawParams[slot] = PullDrawParams(geometry.firstIndex, geometry.baseVertex, firstVisible, geometry.elementCount);
+		}
+		drawCount += total;
+	}
+
+	// Without ARB_indirect_parameters every command is drawn, the ones past the count draw nothing
+	for (uint slot = drawCount + invocation; slot < u_GeometryCount; slot += GROUP_SIZE)
+	{
+		b_Commands[slot] = DrawCommand(0u, 0u, 0u, 0, 0u);
+		b_PullCommands[slot] = DrawArraysCommand(0u, 0u, 0u, slot);
+		b_PullCommands[u_GeometryCount + slot] = DrawArraysCommand(0u, 0u, 0u, slot);
+	}
+
+	if (invocation == 0u)
+	{
+		b_DrawCount = drawCount;
+		b_VisibleCount = visibleCount;
+	}
+}
+
+#elif CULL_PASS == 3
+
+void main()
+{
+	uint index = gl_GlobalInvocationID.x;
+	if (index >= u_InstanceCount)
+	{
+		return;
+	}
+
+	uint rank = b_Ranks[index];
+	if ((rank & VISIBLE_BIT) != 0u)
+	{
+		b_Visible[b_Blocks[gl_WorkGroupID.x] + (rank & ~VISIBLE_BIT)] = b_Instances[index].modelTransform;
+	}
+}
+
+#else
+#error CULL_PASS has to be 1, 2 or 3
+#endif
@@ -0,0 +1,52 @@
+// Instance ranges submitted with Renderer::SubmitRange, mirrored by InstanceRangeData and
+// InstanceRangeTransform in ShaderConstants.h. One descriptor stands for a whole grid, array or
+// scatter, every instance derives its model matrix from gl_InstanceID.
+
+struct InstanceRange
+{
+	mat4 transform;
+	vec4 stride;     // w is the position jitter as a fraction of the stride
+	uvec4 countSeed; // w seeds the jitter
+	vec4 jitter;     // x rotation about the local y axis in radians, y scale as a fraction
+};
+
+layout(std430, binding = 4) readonly buffer InstanceRangeBuffer { InstanceRange b_Ranges[]; };
+
+uint RangeHash(uint x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+// [0, 1), stream picks one of the independent values of an instance
+float RangeRandom(uint seed, uint instance, uint stream)
+{
+	return float(RangeHash(seed ^ RangeHash(instance * 8u + stream)) >> 8) * (1.0 / 16777216.0);
+}
+
+// Cells run along x first, then y, then z
+mat4 RangeModelMat(uint rangeIndex, uint instance)
+{
+	InstanceRange range = b_Ranges[rangeIndex];
+	uint seed = range.countSeed.w;
+
+	uvec3 cell = uvec3(instance % range.countSeed.x, instance / range.countSeed.x % range.countSeed.y, instance / (range.countSeed.x * range.countSeed.y));
+	vec3 jitter = vec3(RangeRandom(seed, instance, 0u), RangeRandom(seed, instance, 1u), RangeRandom(seed, instance, 2u)) - 0.5;
+	vec3 position = vec3(cell) * range.stride.xyz + jitter * range.stride.xyz * range.stride.w;
+
+	float angle = (RangeRandom(seed, instance, 3u) * 2.0 - 1.0) * range.jitter.x;
+	float scale = 1.0 + (RangeRandom(seed, instance, 4u) * 2.0 - 1.0) * range.jitter.y;
+	float c = cos(angle) * scale;
+	float s = sin(angle) * scale;
+
+	mat4 local = mat4(
+		c, 0.0, -s, 0.0,
+		0.0, scale, 0.0, 0.0,
+		s, 0.0, c, 0.0,
+		position, 1.0);
+	return range.transform * local;
+}
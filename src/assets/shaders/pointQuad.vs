@@ -0,0 +1,35 @@
+#version 460
+
+// Replaces pointsToSquare.gs on the vertex pulling path. Every point is one instance of a
+// 4 vertex triangle strip, gl_VertexID picks the corner. INSTANCE_RANGES expands the model
+// matrices from a range descriptor.
+
+#include "constants.glsl"
+#include "pulling.glsl"
+
+#if INSTANCE_RANGES
+#include "instanceRange.glsl"
+#endif
+
+void main()
+{
+	DrawParams draw = b_Draws[gl_BaseInstance];
+
+	// Instances run over all points of the first model instance, then the next one
+	uint point = uint(gl_InstanceID) % draw.elementCount;
+	uint instance = uint(gl_InstanceID) / draw.elementCount;
+	uint vertex = uint(int(b_Indices[draw.firstIndex + point]) + draw.baseVertex);
+
+	vec3 position = PullPosition(vertex);
+
+	// Same corners as pointsToSquare.gs: top left, top right, bottom left, bottom right
+	vec2 corner = vec2((gl_VertexID & 1) == 0 ? -0.25 : 0.25, (gl_VertexID & 2) == 0 ? 0.25 : -0.25);
+
+#if INSTANCE_RANGES
+	mat4 modelMat = RangeModelMat(draw.firstInstance, instance);
+#else
+	mat4 modelMat = b_ModelMats[draw.firstInstance + instance];
+#endif
+
+	gl_Position = u_ViewProjectionMat * modelMat * vec4(position + vec3(corner, 0.0), 1.0);
+}
@@ -2,8 +2,7 @@
 layout(points) in;
 layout(triangle_strip, max_vertices=4) out;
 in mat4 gsModelMat[];
-uniform mat4 u_ViewMat;
-uniform mat4 u_PerspectiveMat;
+#include "constants.glsl"
 void main()
 {
 vec4 offset = vec4(-0.25, 0.25, 0.0, 0.0); // oben links
@@ -0,0 +1,20 @@
+// Storage buffers of the vertex pulling path, bound by Renderer::BindPullBuffers
+
+struct DrawParams
+{
+	uint firstIndex;
+	int baseVertex;
+	uint firstInstance;
+	uint elementCount;
+};
+
+// vec3 arrays would be padded to 16 bytes in std430, the vertex buffer is tightly packed
+layout(std430, binding = 0) readonly buffer PositionBuffer { float b_Positions[]; };
+layout(std430, binding = 1) readonly buffer IndexBuffer { uint b_Indices[]; };
+layout(std430, binding = 2) readonly buffer InstanceBuffer { mat4 b_ModelMats[]; };
+layout(std430, binding = 3) readonly buffer DrawParamsBuffer { DrawParams b_Draws[]; };
+
+vec3 PullPosition(uint vertex)
+{
+	return vec3(b_Positions[vertex * 3], b_Positions[vertex * 3 + 1], b_Positions[vertex * 3 + 2]);
+}
@@ -0,0 +1,55 @@
+#version 460
+
+// Draws the segment p1-p2 of every lines_adjacency primitive as a Catmull-Rom curve, p0 and p3
+// only shape the tangents at the ends. Neighbouring segments of a strip share their tangents, so
+// the curves join smoothly. The segment count comes from MaterialConstants, the CURVE_STEPS
+// variant bakes it in so the loop has a constant trip count.
+
+#include "constants.glsl"
+
+#define MAX_CURVE_STEPS 64
+
+#ifdef CURVE_STEPS
+#if CURVE_STEPS < 1 || CURVE_STEPS > MAX_CURVE_STEPS
+#error CURVE_STEPS out of range
+#endif
+#endif
+
+layout(lines_adjacency) in;
+layout(line_strip, max_vertices = MAX_CURVE_STEPS + 1) out;
+
+in mat4 gsModelMat[];
+
+vec4 CatmullRom(vec4 p0, vec4 p1, vec4 p2, vec4 p3, float t)
+{
+	float t2 = t * t;
+	float t3 = t2 * t;
+
+	return 0.5 * (2.0 * p1
+		+ (p2 - p0) * t
+		+ (2.0 * p0 - 5.0 * p1 + 4.0 * p2 - p3) * t2
+		+ (3.0 * p1 - p0 - 3.0 * p2 + p3) * t3);
+}
+
+void main()
+{
+	// All four points belong to the same instance, interpolate in world space
+	vec4 p0 = gsModelMat[0] * gl_in[0].gl_Position;
+	vec4 p1 = gsModelMat[1] * gl_in[1].gl_Position;
+	vec4 p2 = gsModelMat[2] * gl_in[2].gl_Position;
+	vec4 p3 = gsModelMat[3] * gl_in[3].gl_Position;
+
+#ifdef CURVE_STEPS
+	const int steps = CURVE_STEPS;
+#else
+	int steps = clamp(uSteps, 1, MAX_CURVE_STEPS);
+#endif
+
+	for (int i = 0; i <= steps; i++)
+	{
+		gl_Position = u_ViewProjectionMat * CatmullRom(p0, p1, p2, p3, float(i) / float(steps));
+		EmitVertex();
+	}
+
+	EndPrimitive();
+}
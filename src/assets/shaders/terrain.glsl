@@ -0,0 +1,71 @@
+// Terrain patches submitted by Terrain::Submit, mirrored by TerrainConstants in ShaderConstants.h.
+// Every patch is the same grid of unit size, its model matrix only places and scales it: the
+// corner sits in model[3].xz and model[0].x is the edge length, which also gives the level. Heights
+// come from the patch's tile in the ring of tile slots of its level, see Terrain::GetSlot.
+
+#include "constants.glsl"
+
+#define TERRAIN_MAX_LEVELS 12
+
+layout(std140, binding = 4) uniform TerrainConstants
+{
+	vec4 u_MorphRanges[TERRAIN_MAX_LEVELS];
+	vec2 u_TerrainOrigin;
+	float u_PatchSize;
+	float u_SampleSpacing;
+	uint u_PatchCells;
+	uint u_TileCells;
+	uint u_RingTiles;
+};
+
+// (u_TileCells + 1)^2 samples per slot, rows along x. Neighbouring tiles share their border samples.
+layout(std430, binding = 5) readonly buffer TerrainHeightBuffer { float b_TerrainHeights[]; };
+
+uint TerrainSlot(uint level, uvec2 tile)
+{
+	return (level * u_RingTiles + tile.y % u_RingTiles) * u_RingTiles + tile.x % u_RingTiles;
+}
+
+// Bilinear between the samples around position, in samples from the tile's corner
+float TerrainHeight(uint slot, vec2 position)
+{
+	uint samples = u_TileCells + 1u;
+	vec2 base = min(floor(position), vec2(float(u_TileCells - 1u)));
+	vec2 weight = position - base;
+
+	uint i = slot * samples * samples + uint(base.y) * samples + uint(base.x);
+	float h0 = mix(b_TerrainHeights[i], b_TerrainHeights[i + 1u], weight.x);
+	float h1 = mix(b_TerrainHeights[i + samples], b_TerrainHeights[i + samples + 1u], weight.x);
+	return mix(h0, h1, weight.y);
+}
+
+// World position of the grid vertex at gridPosition.xz in [0, 1]. Past the morph start of its level
+// the odd vertices slide onto their even neighbours, so a patch has turned into the next level's
+// grid by the time it borders a patch of that level and the two share every edge vertex.
+vec3 TerrainPosition(mat4 model, vec3 gridPosition)
+{
+	float size = model[0].x;
+	uint level = uint(findMSB(uint(round(size / u_PatchSize))));
+	float spacing = u_SampleSpacing * float(1u << level);
+	float tileSize = spacing * float(u_TileCells);
+
+	// Relative to the map's corner, where the tile grid starts
+	vec2 corner = model[3].xz - u_TerrainOrigin;
+	uvec2 tile = uvec2(floor((corner + 0.5 * size) / tileSize));
+	uint slot = TerrainSlot(level, tile);
+	vec2 tileCorner = vec2(tile) * tileSize;
+
+	vec2 grid = gridPosition.xz;
+	vec2 position = corner + grid * size;
+	float height = TerrainHeight(slot, (position - tileCorner) / spacing);
+
+	vec3 world = vec3(position.x + u_TerrainOrigin.x, height, position.y + u_TerrainOrigin.y);
+	vec2 range = u_MorphRanges[level].xy;
+	float morph = clamp((distance(world, u_CameraPosition.xyz) - range.x) * range.y, 0.0, 1.0);
+
+	vec2 odd = fract(grid * float(u_PatchCells) * 0.5) * 2.0 / float(u_PatchCells);
+	position -= odd * size * morph;
+	height = TerrainHeight(slot, (position - tileCorner) / spacing);
+
+	return vec3(position.x + u_TerrainOrigin.x, height, position.y + u_TerrainOrigin.y);
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+// Counts calls to the global operator new in builds with GL2_COUNT_ALLOCATIONS, across all threads.
+// Lets a test check that a steady state frame doesn't touch the heap. Disabled builds always
+// report 0 and keep the default operator new.
+class AllocationCounter
+{
+public:
+	static bool IsEnabled();
+	static uint64_t GetCount();
+};
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "GeometryManager.h"
+#include "MeshGenerator.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// 0 is never a valid asset
+typedef uint32_t AssetID;
+
+enum class AssetState : uint8_t
+{
+	Loading, // queued, on a loader thread or waiting for upload budget
+	Ready,
+	Failed
+};
+
+struct AssetLoaderSettings
+{
+	// Loader threads, separate from the JobSystem so a slow read never holds up a frame's stages
+	uint32_t threadCount = 2;
+
+	// Vertex plus element bytes Update uploads per frame. The first mesh of a frame always goes
+	// up, so one larger than the budget can't get stuck.
+	size_t uploadBytesPerFrame = 1024 * 1024 * 2; // 2mb
+};
+
+struct AssetLoaderStats
+{
+	uint64_t requested = 0;
+	uint64_t loaded = 0;
+	uint64_t failed = 0;
+	uint64_t uploadedBytes = 0;
+
+	// Reading, generating, decoding and encoding, summed over the loader threads
+	double loadSeconds = 0.0;
+
+	// Request to Ready
+	double latencySum = 0.0;
+	double latencyMax = 0.0;
+	uint64_t latencyFramesMax = 0;
+
+	// What Update costs the GL thread in frames that uploaded something
+	double uploadSecondsSum = 0.0;
+	double uploadSecondsMax = 0.0;
+	size_t uploadedBytesMax = 0;
+	uint64_t uploadFrames = 0;
+};
+
+// Loads geometry in the background. Meshes are read from mesh files or generated and decoded into
+// plain vertex and element arrays on loader threads, encoded there too if the GeometryManager keeps
+// or records sources. Update hands them to the GeometryManager on the GL thread, oldest first and
+// no more than the upload budget per frame, so loading thousands of meshes mid-session costs each
+// frame a bounded number of buffer copies. Callers draw through GetGeoID and substitute or skip
+// assets that aren't Ready yet.
+//
+// Requests and Update have the same restrictions as GeometryManager::AddGeometry: GL thread, not
+// while a frame's stages run. GetState and GetGeoID are safe from the stages.
+class AssetLoader
+{
+public:
+	AssetLoader(GeometryManager& geometryManager, const AssetLoaderSettings& settings = AssetLoaderSettings());
+
+	// Drops whatever hasn't been loaded yet
+	~AssetLoader();
+
+	AssetLoader(const AssetLoader&) = delete;
+	AssetLoader& operator=(const AssetLoader&) = delete;
+
+	// Queues a load and returns right away. Requesting a name again returns the first asset, a
+	// name that is already in the GeometryManager is Ready immediately.
+	AssetID LoadMeshFile(const std::string& name, const std::string& path);
+	AssetID LoadGenerated(const MeshDesc& desc);
+
+	AssetState GetState(AssetID asset) const
+	{
+		assert(asset != 0 && asset < m_Assets.size());
+		return m_Assets[asset].state;
+	}
+
+	// 0 until the asset is Ready
+	GeoID GetGeoID(AssetID asset) const
+	{
+		assert(asset != 0 && asset < m_Assets.size());
+		return m_Assets[asset].geoID;
+	}
+
+	// Assets that are neither Ready nor Failed
+	uint32_t GetPendingCount() const { return m_Pending; }
+
+	// Once per frame, see above. Uploads decoded meshes up to the budget.
+	void Update();
+
+	AssetLoaderStats GetStats();
+	void LogStats();
+
+	// Mesh files hold one EncodedMesh of SIZE_OF_VERTEX byte positions:
+	//   "GL2M" u32 version, u32 vertex count, u32 vertex size, u32 index count, vec3 bounds center,
+	//   f32 bounds radius, u32 bytes, MeshCodec vertices, u32 bytes, MeshCodec indices
+	static bool ReadMeshFile(const std::string& path, EncodedMesh& mesh);
+	static bool WriteMeshFile(const std::string& path, const EncodedMesh& mesh);
+
+private:
+	struct Request
+	{
+		AssetID asset = 0;
+		std::string name;
+
+		// Generated from desc when path is empty
+		std::string path;
+		MeshDesc desc;
+
+		// Decided on the GL thread when requested, the loader threads don't touch the GeometryManager
+		bool encode = false;
+	};
+
+	struct LoadedMesh
+	{
+		AssetID asset = 0;
+		std::string name;
+		bool succeeded = false;
+
+		std::vector<float> vertices;
+		std::vector<uint32_t> indices;
+
+		// Counts and bounds, plus the encoded data if the request asked for it
+		EncodedMesh mesh;
+	};
+
+	struct Asset
+	{
+		GeoID geoID = 0;
+		AssetState state = AssetState::Loading;
+		std::chrono::steady_clock::time_point requestTime;
+		uint64_t requestFrame = 0;
+	};
+
+	AssetID Queue(Request&& request);
+
+	void LoaderLoop();
+	static void Load(const Request& request, LoadedMesh& loaded);
+
+	// Hands a loaded mesh to the GeometryManager, returns the bytes uploaded
+	size_t Upload(LoadedMesh& loaded);
+
+private:
+	GeometryManager& m_GeometryManager;
+	AssetLoaderSettings m_Settings;
+
+	// GL thread only. Indexed by AssetID, slot 0 is unused.
+	std::vector<Asset> m_Assets;
+	std::unordered_map<StringID, AssetID, StringIDHash> m_NameToAsset;
+	uint32_t m_Pending = 0;
+	uint64_t m_Frame = 0;
+	AssetLoaderStats m_Stats;
+
+	// Loader side, everything below is guarded by m_Mutex
+	std::mutex m_Mutex;
+	std::condition_variable m_RequestCondition;
+	std::deque<Request> m_Requests;
+	std::deque<std::unique_ptr<LoadedMesh>> m_Loaded;
+	bool m_Stop = false;
+	double m_LoadSeconds = 0.0;
+
+	std::vector<std::thread> m_Threads;
+};
@@ -0,0 +1,238 @@
+#pragma once
+
+struct CameraInput
+{
+	// x: right, y: up, z: forward, each component in [-1, 1]
+	glm::vec3 move = glm::vec3(0.f);
+
+	// Cursor movement in pixels since the last update
+	glm::vec2 look = glm::vec2(0.f);
+
+	bool fast = false;
+};
+
+class Camera
+{
+public:
+	Camera(float aspectRatio)
+		:m_AspectRatio(aspectRatio)
+	{
+	}
+
+	glm::mat4& GetViewMatrix()
+	{
+		if (m_ViewIsDirty)
+		{
+			m_ViewIsDirty = false;
+
+			const glm::vec3 position = glm::mix(m_PreviousPosition, m_Position, m_InterpolationAlpha);
+			const glm::vec3 rotation = glm::mix(m_PreviousRotation, m_Rotation, m_InterpolationAlpha);
+
+			m_ViewMatrix = glm::lookAt(
+				position,
+				position + CalculateForwardVector(rotation),
+				m_Up
+			);
+		}
+		return m_ViewMatrix;
+	}
+
+	glm::mat4& GetPerspectiveMatrix()
+	{
+		if (m_PerspectiveIsDirty)
+		{
+			m_PerspectiveIsDirty = false;
+
+			m_PerspectiveProjection = glm::perspective(
+				glm::radians(m_Fov),
+				m_AspectRatio,
+				m_NearZ,
+				m_FarZ
+			);
+		}
+
+		return m_PerspectiveProjection;
+	}
+
+	// Polls keys and accumulates cursor movement until the next Update consumes it
+	void SampleInput(GLFWwindow* context)
+	{
+		m_Input.move = glm::vec3(0.f);
+		m_Input.fast = glfwGetKey(context, GLFW_KEY_E);
+
+		if (glfwGetKey(context, GLFW_KEY_W))            m_Input.move.z += 1.f;
+		if (glfwGetKey(context, GLFW_KEY_S))            m_Input.move.z -= 1.f;
+		if (glfwGetKey(context, GLFW_KEY_D))            m_Input.move.x += 1.f;
+		if (glfwGetKey(context, GLFW_KEY_A))            m_Input.move.x -= 1.f;
+		if (glfwGetKey(context, GLFW_KEY_SPACE))        m_Input.move.y += 1.f;
+		if (glfwGetKey(context, GLFW_KEY_LEFT_CONTROL)) m_Input.move.y -= 1.f;
+
+		double currentCursorX, currentCursorY;
+		glfwGetCursorPos(context, &currentCursorX, &currentCursorY);
+
+		// The first sample only establishes the reference position
+		if (m_HasCursor)
+		{
+			m_Input.look.x += (float)(currentCursorX - m_CursorLastX);
+			m_Input.look.y += (float)(currentCursorY - m_CursorLastY);
+		}
+
+		m_HasCursor = true;
+		m_CursorLastX = currentCursorX;
+		m_CursorLastY = currentCursorY;
+	}
+
+	void SetInput(const CameraInput& input)
+	{
+		m_Input = input;
+	}
+
+	// Advances the simulated state by one step. The previous state is kept for Interpolate.
+	void Update(const float dt)
+	{
+		m_PreviousPosition = m_Position;
+		m_PreviousRotation = m_Rotation;
+
+		// Preven't the camera from losing horizontal speed when looking up or down
+		const glm::vec3 forward = CalculateForwardVector(m_Rotation);
+		const glm::vec3 horizontalDir = { forward.x, 0, forward.z };
+		const glm::vec3 direction = glm::normalize(horizontalDir);
+
+		float moveSpeed = m_BaseSpeed;
+		if(m_Input.fast)
+		{
+			moveSpeed *= m_SpeedModifier;
+		}
+
+		const glm::vec3 forwardStep = glm::vec3(direction.x, 0, direction.z) * m_Input.move.z;
+		const glm::vec3 rightStep = glm::vec3(-direction.z, 0, direction.x) * m_Input.move.x;
+		const glm::vec3 upStep = glm::vec3(0.f, 1.f, 0.f) * m_Input.move.y;
+
+		if (m_Input.move != glm::vec3(0.f))
+		{
+			Translate((forwardStep + rightStep + upStep) * moveSpeed * dt);
+		}
+
+		// Cursor movement is consumed by the first step after it was sampled
+		if(abs(m_Input.look.x) > m_MouseThreshhold || abs(m_Input.look.y) > m_MouseThreshhold)
+			Rotate(glm::vec3(-m_Input.look.y, m_Input.look.x, 0) * m_LookSensitivity);
+
+		m_Input.look = glm::vec2(0.f);
+	}
+
+	// Moves to a scripted pose as one simulation step, so Interpolate still blends from the last one
+	void StepTo(const glm::vec3& position, const glm::vec3& rotation)
+	{
+		m_PreviousPosition = m_Position;
+		m_PreviousRotation = m_Rotation;
+
+		m_Position = position;
+		m_Rotation = rotation;
+		m_Rotation.x = std::clamp(m_Rotation.x, -89.f, 89.f);
+
+		m_ViewIsDirty = true;
+	}
+
+	// Blends between the last two simulated states for rendering, alpha in [0, 1]
+	void Interpolate(float alpha)
+	{
+		m_InterpolationAlpha = alpha;
+		m_ViewIsDirty = true;
+	}
+
+	void SetAspectRatio(float aspectRatio)
+	{
+		m_PerspectiveIsDirty = true;
+		m_AspectRatio = aspectRatio;
+	}
+
+	void SetFov(float fov)
+	{
+		m_PerspectiveIsDirty = true;
+		m_Fov = fov;
+	}
+
+	void SetNearFarPlane(float near, float far)
+	{
+		m_PerspectiveIsDirty = true;
+		m_NearZ = near;
+		m_FarZ = far;
+	}
+
+	void SetPosition(const glm::vec3& position)
+	{
+		m_Position = position;
+		m_PreviousPosition = position;
+		m_ViewIsDirty = true;
+	}
+
+	void Translate(glm::vec3&& step)
+	{
+		m_Position += step;
+		m_ViewIsDirty = true;
+	}
+
+	void SetRotation(const glm::vec3& rotation)
+	{
+		m_Rotation = rotation;
+		m_Rotation.x = std::clamp(m_Rotation.x, -89.f, 89.f);
+		m_PreviousRotation = m_Rotation;
+
+		m_ViewIsDirty = true;
+	}
+
+	void Rotate(const glm::vec3& angles)
+	{
+		m_Rotation += angles;
+		m_Rotation.x = std::clamp(m_Rotation.x, -89.f, 89.f);
+
+		LOG_TRACE("%f, %f, %f", m_Rotation.x,m_Rotation.y, m_Rotation.z)
+		m_ViewIsDirty = true;
+	}
+
+	const glm::vec3& GetPosition() const { return m_Position; }
+	const glm::vec3& GetRotation() const { return m_Rotation; }
+
+private:
+
+	[[nodiscard]] static glm::vec3 CalculateForwardVector(const glm::vec3& rotation)
+	{
+		return
+		{
+			cos(glm::radians(rotation.x)) * cos(glm::radians(rotation.y)),
+			sin(glm::radians(rotation.x)),
+			sin(glm::radians(rotation.y)) * cos(glm::radians(rotation.x))
+		};
+	}
+
+private:
+	glm::mat4 m_ViewMatrix = glm::mat4(1.f);
+	glm::mat4 m_PerspectiveProjection = glm::mat4(1.f);
+
+	glm::vec3 m_Position = {0.f, 0.f, 5.f};
+	glm::vec3 m_Rotation = {0.f, -90.f, 0.f};
+	glm::vec3 m_Up = {0.f, 1.f, 0.f};
+
+	glm::vec3 m_PreviousPosition = m_Position;
+	glm::vec3 m_PreviousRotation = m_Rotation;
+	float m_InterpolationAlpha = 1.f;
+
+	float m_Fov = 45.f;
+	float m_AspectRatio;
+	float m_NearZ = 0.1f;
+	float m_FarZ = 1000.f;
+
+	bool m_ViewIsDirty = true;
+	bool m_PerspectiveIsDirty = true;
+
+	float m_BaseSpeed = 2.f;
+	float m_SpeedModifier = 10.f;
+	float m_LookSensitivity = 0.1f; // degrees per pixel
+
+	CameraInput m_Input;
+
+	bool m_HasCursor = false;
+	double m_CursorLastX = 0;
+	double m_CursorLastY = 0;
+	double m_MouseThreshhold = 0.0001;
+};
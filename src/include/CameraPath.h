@@ -0,0 +1,33 @@
+#pragma once
+
+struct CameraKeyframe
+{
+	float time;
+	glm::vec3 position;
+	glm::vec3 rotation; // pitch, yaw, roll in degrees, same convention as Camera
+};
+
+// Scripted camera movement for runs without input. Positions follow a Catmull-Rom spline
+// through the keyframes, rotations are interpolated linearly.
+class CameraPath
+{
+public:
+	// One keyframe per line: time x y z pitch yaw, lines starting with # are ignored
+	static bool LoadFromFile(const std::string& path, CameraPath& cameraPath);
+
+	// Circles around center once per period while looking at it
+	static CameraPath Orbit(const glm::vec3& center, float radius, float height, float period);
+
+	void AddKeyframe(const CameraKeyframe& keyframe);
+
+	// Wraps around after the last keyframe when looping, otherwise holds the last pose
+	void Sample(float time, glm::vec3& position, glm::vec3& rotation) const;
+
+	void SetLooping(bool looping) { m_Looping = looping; }
+	float GetDuration() const { return m_Keyframes.empty() ? 0.f : m_Keyframes.back().time; }
+	bool IsEmpty() const { return m_Keyframes.empty(); }
+
+private:
+	std::vector<CameraKeyframe> m_Keyframes;
+	bool m_Looping = true;
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <chrono>
+
+// Time source for the frame scheduler, in seconds. Swap in a ManualClock to drive the
+// scheduling logic deterministically.
+class Clock
+{
+public:
+	virtual ~Clock() = default;
+
+	virtual double Now() = 0;
+	virtual void SleepUntil(double time) = 0;
+};
+
+class SteadyClock : public Clock
+{
+public:
+	SteadyClock()
+		: m_Start(std::chrono::steady_clock::now())
+	{
+	}
+
+	double Now() override
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_Start).count();
+	}
+
+	void SleepUntil(double time) override
+	{
+		// The OS sleep is coarse, so sleep most of the way and spin the rest
+		const double spinTime = 0.002;
+		double now = Now();
+		if (time - now > spinTime)
+		{
+			std::this_thread::sleep_for(std::chrono::duration<double>(time - now - spinTime));
+		}
+
+		while (Now() < time)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+private:
+	std::chrono::steady_clock::time_point m_Start;
+};
+
+class ManualClock : public Clock
+{
+public:
+	double Now() override
+	{
+		return m_Time;
+	}
+
+	void SleepUntil(double time) override
+	{
+		m_Time = std::max(m_Time, time);
+	}
+
+	void Advance(double seconds)
+	{
+		m_Time += seconds;
+	}
+
+private:
+	double m_Time = 0.0;
+};
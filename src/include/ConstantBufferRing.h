@@ -0,0 +1,58 @@
+#pragma once
+
+#include "GLState.h"
+
+#define CONSTANT_BUFFER_REGION_SIZE 1024 * 64 // 64kb per frame
+#define CONSTANT_BUFFER_REGION_COUNT 3
+
+// One persistently mapped buffer split into per-frame regions, each guarded by a fence. Constant
+// updates are a memcpy into the current region plus glBindBufferRange through GLState, no
+// glUniform* calls and no buffer orphaning. Works for uniform blocks and shader storage blocks
+// alike.
+class ConstantBufferRing
+{
+public:
+	ConstantBufferRing(GLsizeiptr regionSize = CONSTANT_BUFFER_REGION_SIZE, uint32_t regionCount = CONSTANT_BUFFER_REGION_COUNT);
+	~ConstantBufferRing();
+
+	ConstantBufferRing(const ConstantBufferRing&) = delete;
+	ConstantBufferRing& operator=(const ConstantBufferRing&) = delete;
+
+	// Moves on to the next region, only waits if the GPU is more than regionCount frames behind
+	void BeginFrame();
+
+	// Fences the region written since BeginFrame
+	void EndFrame();
+
+	// Copies data into the current region and binds that range to the indexed target
+	template<typename T>
+	void Push(GLenum target, GLuint binding, const T& data)
+	{
+		const GLintptr offset = Allocate(sizeof(T));
+		memcpy(m_Data + offset, &data, sizeof(T));
+		GLState::Get().BindBufferRange(target, binding, m_Buffer, offset, sizeof(T));
+	}
+
+	// Reserves size bytes in the current region, aligned for both uniform and storage bindings.
+	// Returns the offset into the buffer.
+	GLintptr Allocate(GLsizeiptr size);
+
+	GLuint GetBufferID() const { return m_Buffer; }
+	char* GetMappedPointer() const { return m_Data; }
+
+	// High-water mark of a single region, to size CONSTANT_BUFFER_REGION_SIZE
+	GLsizeiptr GetPeakRegionUsage() const { return m_PeakUsage; }
+
+private:
+	GLsizeiptr m_RegionSize;
+	uint32_t m_RegionCount;
+	GLint m_Alignment;
+
+	GLuint m_Buffer;
+	char* m_Data;
+
+	std::vector<GLsync> m_Fences;
+	uint32_t m_Region;
+	GLintptr m_RegionTop;
+	GLsizeiptr m_PeakUsage;
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <mutex>
+
+// Bump allocator for data that lives at most until the end of the frame. Nothing is freed on its
+// own, Reset drops everything at once. Memory comes in blocks, when a frame needed more than the
+// first one Reset merges them into a single block of the combined size, so after a few frames
+// the arena settles on one block and stops going to the heap.
+class LinearArena
+{
+public:
+	explicit LinearArena(size_t initialSize = 64 * 1024);
+
+	LinearArena(const LinearArena&) = delete;
+	LinearArena& operator=(const LinearArena&) = delete;
+
+	void* Allocate(size_t size, size_t alignment);
+	void Reset();
+
+	// Bytes handed out since the last Reset, including alignment padding
+	size_t GetUsed() const { return m_Used; }
+	size_t GetHighWater() const { return m_HighWater; }
+	size_t GetCapacity() const;
+
+	// How often the arena had to get memory from the heap
+	uint32_t GetBlockAllocations() const { return m_BlockAllocations; }
+
+private:
+	struct Block
+	{
+		std::unique_ptr<char[]> data;
+		size_t size;
+	};
+
+	void AddBlock(size_t minimumSize);
+
+private:
+	std::vector<Block> m_Blocks;
+	size_t m_Offset;
+
+	size_t m_Used;
+	size_t m_HighWater;
+	uint32_t m_BlockAllocations;
+};
+
+// One LinearArena per thread that allocates transient frame data, so jobs never contend for one.
+// All of them are reset together at the end of the frame, when no job runs and nothing built
+// during the frame is read anymore.
+class FrameArena
+{
+public:
+	static FrameArena& Get();
+
+	// Created on first use from a thread
+	LinearArena& GetThreadArena();
+
+	// Between frames only
+	void Reset();
+
+	// Peak usage and capacity of every thread's arena
+	void LogStats() const;
+
+private:
+	mutable std::mutex m_Mutex;
+	std::vector<std::unique_ptr<LinearArena>> m_Arenas;
+};
+
+// Lets STL containers live in a LinearArena. deallocate does nothing, the memory comes back with
+// the arena's Reset, so containers have to be recreated every frame rather than kept around.
+// Grow a container only on the thread that owns the arena it was created with.
+template<typename T>
+class ArenaAllocator
+{
+public:
+	typedef T value_type;
+
+	// Assigning a fresh container over last frame's one has to take the new arena along
+	typedef std::true_type propagate_on_container_copy_assignment;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+
+	ArenaAllocator() = default;
+	ArenaAllocator(LinearArena& arena) : m_Arena(&arena) {}
+
+	template<typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : m_Arena(other.GetArena()) {}
+
+	T* allocate(size_t count)
+	{
+		assert(m_Arena && "Container was created without an arena");
+		return static_cast<T*>(m_Arena->Allocate(count * sizeof(T), alignof(T)));
+	}
+
+	void deallocate(T*, size_t) {}
+
+	LinearArena* GetArena() const { return m_Arena; }
+
+	template<typename U>
+	bool operator==(const ArenaAllocator<U>& other) const { return m_Arena == other.GetArena(); }
+
+	template<typename U>
+	bool operator!=(const ArenaAllocator<U>& other) const { return m_Arena != other.GetArena(); }
+
+private:
+	LinearArena* m_Arena = nullptr;
+};
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
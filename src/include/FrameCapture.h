@@ -0,0 +1,136 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+enum class CaptureFormat
+{
+	Raw, // RGBA8, top row first, no header
+	PPM, // binary P6 per frame, concatenated unless the output path contains a %d style frame number
+	Y4M  // YUV4MPEG2 420, ready for ffmpeg -i
+};
+
+struct FrameCaptureSettings
+{
+	// File path, path with a %d style frame number such as %05d (PPM only) or "|command" to pipe
+	// into a process.
+	// stdout is not an option since the log goes there.
+	std::string output;
+	CaptureFormat format = CaptureFormat::Y4M;
+
+	// Pixel pack buffers in flight, a frame is read back this many frames after it was issued at the latest
+	uint32_t ringSize = 4;
+
+	// CPU copies waiting for the writer, frames are dropped instead of stalling when this runs full
+	uint32_t maxQueuedFrames = 8;
+
+	// Only written into the Y4M header
+	uint32_t frameRate = 60;
+};
+
+struct FrameCaptureStats
+{
+	uint64_t issued = 0;
+	uint64_t written = 0;
+	uint64_t droppedGpu = 0;    // every pixel pack buffer was still in flight, or waiting for one failed
+	uint64_t droppedWriter = 0; // writer queue was full
+	uint64_t bytesWritten = 0;
+
+	// Issue to handoff
+	double latencySum = 0.0;
+	double latencyMax = 0.0;
+	uint64_t latencyFramesSum = 0;
+
+	double firstIssueTime = -1.0;
+	double lastWriteTime = 0.0;
+};
+
+// Reads frames back through a ring of persistently mapped pixel pack buffers guarded by fences.
+// Capture never waits on the GPU: finished buffers are picked up on later calls, copied into a
+// pooled CPU frame and handed to a writer thread that converts and streams them out.
+class FrameCapture
+{
+public:
+	FrameCapture(int width, int height, const FrameCaptureSettings& settings);
+	~FrameCapture();
+
+	FrameCapture(const FrameCapture&) = delete;
+	FrameCapture& operator=(const FrameCapture&) = delete;
+
+	bool IsOpen() const { return m_Writer.joinable(); }
+
+	// Call after the frame is drawn and before it is presented. 0 reads the back buffer.
+	void Capture(GLuint framebuffer);
+
+	// Blocks until every issued frame is written, only meant for shutdown
+	void Flush();
+
+	FrameCaptureStats GetStats();
+	void LogStats();
+
+	static bool ParseFormat(const std::string& name, CaptureFormat& format);
+
+private:
+	struct Slot
+	{
+		GLuint buffer = 0;
+		const uint8_t* mapped = nullptr;
+		GLsync fence = nullptr;
+		uint64_t frameIndex = 0;
+		double issueTime = 0.0;
+	};
+
+	struct Frame
+	{
+		std::vector<uint8_t> pixels;
+		uint64_t frameIndex = 0;
+	};
+
+	// Hands every finished slot to the writer, oldest first. Only blocks when wait is set.
+	void Poll(bool wait);
+	void Handoff(Slot& slot);
+
+	void WriterLoop();
+	void WriteFrame(const Frame& frame);
+
+	double Now() const;
+
+private:
+	int m_Width;
+	int m_Height;
+	size_t m_FrameBytes;
+	FrameCaptureSettings m_Settings;
+
+	std::vector<Slot> m_Slots;
+	uint32_t m_NextSlot = 0;
+	uint64_t m_FrameCounter = 0;
+
+	FILE* m_Output = nullptr;
+	bool m_IsPipe = false;
+	bool m_FilePerFrame = false;
+
+	// Output path around the frame number of m_FilePerFrame, see SplitFramePattern
+	std::string m_FramePathPrefix;
+	std::string m_FramePathSuffix;
+	int m_FramePathWidth = 0;
+	bool m_FramePathZeroPad = false;
+
+	// Writer side, everything below is guarded by m_Mutex
+	std::mutex m_Mutex;
+	std::condition_variable m_QueueCondition;
+	std::condition_variable m_IdleCondition;
+	std::deque<std::unique_ptr<Frame>> m_Queue;
+	std::vector<std::unique_ptr<Frame>> m_FreeFrames;
+	uint32_t m_AllocatedFrames = 0;
+	bool m_WriterBusy = false;
+	bool m_Stop = false;
+	FrameCaptureStats m_Stats;
+
+	// Only touched by the writer thread
+	std::vector<uint8_t> m_ConvertBuffer;
+
+	std::thread m_Writer;
+	std::chrono::steady_clock::time_point m_Start;
+};
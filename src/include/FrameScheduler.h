@@ -0,0 +1,107 @@
+#pragma once
+
+#include "Clock.h"
+
+#include <deque>
+
+#define HISTOGRAM_BUCKET_WIDTH 0.00025 // 0.25ms
+#define HISTOGRAM_BUCKET_COUNT 400     // everything above 100ms ends up in the last bucket
+
+class FrameTimeHistogram
+{
+public:
+	void Add(double seconds);
+	void Reset();
+
+	// p in [0, 1], resolution is one bucket
+	double GetPercentile(double p) const;
+	double GetMean() const { return m_Count ? m_Sum / m_Count : 0.0; }
+	double GetMax() const { return m_Max; }
+	uint32_t GetCount() const { return m_Count; }
+
+private:
+	uint32_t m_Buckets[HISTOGRAM_BUCKET_COUNT] = { 0 };
+	uint32_t m_Count = 0;
+	double m_Sum = 0.0;
+	double m_Max = 0.0;
+};
+
+struct FrameSchedulerSettings
+{
+	// Simulation always advances in steps of this size, independent of the render rate
+	double fixedTimestep = 1.0 / 120.0;
+
+	// Caps the catch-up work after a hitch, the remaining backlog is dropped
+	uint32_t maxStepsPerFrame = 8;
+
+	// CPU may run at most this many frames ahead of the GPU, 0 disables the fences
+	uint32_t maxFramesInFlight = 2;
+
+	// Paces frames to this rate when > 0, on top of whatever the swap interval does
+	double targetFrameRate = 0.0;
+
+	// Waits for the GPU and the frame slot before sampling input instead of after the update,
+	// so the input is as fresh as possible when the frame is submitted
+	bool lowLatency = false;
+
+	// Logs and resets the histograms every n seconds, 0 disables reporting
+	double reportInterval = 5.0;
+};
+
+class FrameScheduler
+{
+public:
+	struct Callbacks
+	{
+		std::function<void()> sampleInput;
+		std::function<void(double dt)> update;
+		std::function<void(double alpha)> render;
+		std::function<void()> present;
+	};
+
+	FrameScheduler(Clock& clock, const FrameSchedulerSettings& settings);
+	~FrameScheduler();
+
+	void RunFrame(const Callbacks& callbacks);
+
+	void SetLowLatency(bool lowLatency) { m_Settings.lowLatency = lowLatency; }
+	const FrameSchedulerSettings& GetSettings() const { return m_Settings; }
+
+	double GetSimulationTime() const { return m_SimulationTime; }
+	uint64_t GetFrameIndex() const { return m_FrameIndex; }
+	uint64_t GetStepCount() const { return m_StepCount; }
+	uint64_t GetDroppedSteps() const { return m_DroppedSteps; }
+
+	const FrameTimeHistogram& GetFrameTimes() const { return m_FrameTimes; }
+	const FrameTimeHistogram& GetCpuTimes() const { return m_CpuTimes; }
+	const FrameTimeHistogram& GetInputLatencies() const { return m_InputLatencies; }
+
+	void LogStats() const;
+
+private:
+	void WaitForFrameSlot();
+	void WaitForGpu();
+	void SignalGpu();
+
+private:
+	Clock& m_Clock;
+	FrameSchedulerSettings m_Settings;
+
+	double m_Accumulator = 0.0;
+	double m_SimulationTime = 0.0;
+	double m_LastUpdateTime = -1.0;
+	double m_LastFrameStart = -1.0;
+	double m_NextFrameTime = -1.0;
+	double m_LastReportTime = 0.0;
+
+	uint64_t m_FrameIndex = 0;
+	uint64_t m_StepCount = 0;
+	uint64_t m_DroppedSteps = 0;
+
+	std::deque<GLsync> m_GpuFences;
+
+	// Frame start to frame start, frame start to present, input sample to present
+	FrameTimeHistogram m_FrameTimes;
+	FrameTimeHistogram m_CpuTimes;
+	FrameTimeHistogram m_InputLatencies;
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+// RGBA8 color texture plus 24 bit depth renderbuffer
+class Framebuffer
+{
+public:
+	Framebuffer(int width, int height);
+	~Framebuffer();
+
+	Framebuffer(const Framebuffer&) = delete;
+	Framebuffer& operator=(const Framebuffer&) = delete;
+
+	// Binds for drawing and sets the viewport to the full size
+	void Bind();
+	static void BindDefault(int width, int height);
+
+	void Resize(int width, int height);
+
+	GLuint GetID() const { return m_Framebuffer; }
+	GLuint GetColorTexture() const { return m_ColorTexture; }
+	int GetWidth() const { return m_Width; }
+	int GetHeight() const { return m_Height; }
+
+private:
+	void CreateAttachments();
+	void DeleteAttachments();
+
+private:
+	GLuint m_Framebuffer = 0;
+	GLuint m_ColorTexture = 0;
+	GLuint m_DepthRenderbuffer = 0;
+
+	int m_Width;
+	int m_Height;
+};
@@ -0,0 +1,149 @@
+#pragma once
+
+// Highest indexed uniform and storage buffer binding the cache keeps, see ShaderConstants.h
+#define GL_STATE_MAX_BUFFER_BINDINGS 16
+
+// Shadows the GL state that changes between draws and drops the calls that would set what is
+// already set: the program, the vertex array, the indirect, parameter and pixel pack buffer
+// bindings, indexed uniform and storage buffer ranges, the polygon mode, the point size and the
+// depth and blend state. Everything starts out unknown, so the first call of each kind always goes
+// through.
+//
+// GL thread only. Every change of that state has to go through here, a direct glUseProgram or
+// glBindBuffer behind its back leaves the cache wrong until Invalidate. Buffers that may still
+// be bound are deleted through DeleteBuffers, GL unbinds them and the name can come back for a new
+// buffer.
+class GLState
+{
+public:
+	enum class Call : uint32_t
+	{
+		UseProgram,
+		BindVertexArray,
+		BindBuffer,
+		BindBufferRange,
+		PolygonMode,
+		PointSize,
+		Capability,
+		DepthMask,
+		BlendFunc,
+		Count
+	};
+
+	static GLState& Get();
+
+	GLState(const GLState&) = delete;
+	GLState& operator=(const GLState&) = delete;
+
+	void UseProgram(GLuint program);
+	void BindVertexArray(GLuint vertexArray);
+
+	// GL_DRAW_INDIRECT_BUFFER, GL_PARAMETER_BUFFER or GL_PIXEL_PACK_BUFFER
+	void BindBuffer(GLenum target, GLuint buffer);
+
+	// GL_UNIFORM_BUFFER or GL_SHADER_STORAGE_BUFFER. Base binds the whole buffer.
+	void BindBufferBase(GLenum target, GLuint index, GLuint buffer);
+	void BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+	// Front and back
+	void PolygonMode(GLenum mode);
+	void PointSize(float size);
+
+	// GL_DEPTH_TEST, GL_BLEND or GL_CULL_FACE
+	void Enable(GLenum capability);
+	void Disable(GLenum capability);
+
+	void DepthMask(GLboolean mask);
+	void BlendFunc(GLenum sourceFactor, GLenum destinationFactor);
+
+	// Drops the buffers from every cached binding before deleting them
+	void DeleteBuffers(GLsizei count, const GLuint* buffers);
+
+	// False while unknown
+	bool IsEnabled(GLenum capability) const;
+
+	// Runs before any call that changes state, so draws recorded for later go out with the state
+	// they were recorded under, see Renderer::DrawIndexed. Calls it makes itself don't run it again.
+	void SetBeforeChange(std::function<void()> beforeChange) { m_BeforeChange = std::move(beforeChange); }
+
+	// Forgets everything, after state was changed without going through here
+	void Invalidate();
+
+	// Once per frame, adds the calls since the last EndFrame to the totals
+	void EndFrame();
+
+	// Since the last EndFrame
+	uint64_t GetFrameIssuedCount() const { return m_FrameIssued; }
+	uint64_t GetFrameElidedCount() const { return m_FrameElided; }
+
+	uint64_t GetIssuedCount(Call call) const { return m_Issued[(uint32_t)call]; }
+	uint64_t GetElidedCount(Call call) const { return m_Elided[(uint32_t)call]; }
+
+	// Issued and elided calls per frame, in total and per kind of call
+	void LogStats() const;
+
+private:
+	struct BufferRange
+	{
+		GLuint buffer;
+		GLintptr offset;
+
+		// 0 for a base binding
+		GLsizeiptr size;
+
+		bool operator==(const BufferRange& other) const { return buffer == other.buffer && offset == other.offset && size == other.size; }
+	};
+
+	enum Capability : uint32_t
+	{
+		DepthTest,
+		Blend,
+		CullFace,
+		CapabilityCount
+	};
+
+	// Unknown until set
+	template<typename T>
+	struct Cached
+	{
+		T value{};
+		bool known = false;
+	};
+
+	GLState();
+
+	// Counts the call and says whether it has to be issued, updating the cached value if so
+	template<typename T>
+	bool Change(Call call, Cached<T>& cached, const T& value);
+
+	template<typename T>
+	bool Elide(Call call, const Cached<T>& cached, const T& value);
+
+	void SetCapability(GLenum capability, bool enabled);
+
+	static uint32_t GetBufferTarget(GLenum target);
+	static uint32_t GetIndexedTarget(GLenum target);
+	static uint32_t GetCapability(GLenum capability);
+
+private:
+	Cached<GLuint> m_Program;
+	Cached<GLuint> m_VertexArray;
+	Cached<GLuint> m_Buffers[3];
+	Cached<BufferRange> m_BufferRanges[2][GL_STATE_MAX_BUFFER_BINDINGS];
+	Cached<GLenum> m_PolygonMode;
+	Cached<float> m_PointSize;
+	Cached<bool> m_Capabilities[CapabilityCount];
+	Cached<GLboolean> m_DepthMask;
+	Cached<std::pair<GLenum, GLenum>> m_BlendFunc;
+
+	std::function<void()> m_BeforeChange;
+	bool m_InBeforeChange;
+
+	// Totals, and the calls of the frame that is still running
+	uint64_t m_Issued[(uint32_t)Call::Count];
+	uint64_t m_Elided[(uint32_t)Call::Count];
+	uint64_t m_FrameIssued;
+	uint64_t m_FrameElided;
+	uint64_t m_MaxFrameIssued;
+	uint64_t m_Frames;
+};
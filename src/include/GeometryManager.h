@@ -0,0 +1,457 @@
+#pragma once
+
+#include "MeshCodec.h"
+#include "RangeAllocator.h"
+#include "StringID.h"
+#include "Trace.h"
+
+#define VERTEX_BUFFER_SIZE 1024 * 1024 * 16 //16mb
+#define ELEMENT_BUFFER_SIZE 1024 * 1024 * 16 //16mb
+
+struct Geometry
+{
+	GLsizei elementCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+
+	// Bounding sphere in model space, used for culling
+	glm::vec3 boundsCenter;
+	float boundsRadius;
+
+	uint32_t vertexCount;
+
+	// Evicted geometry keeps its bounds but elementCount, firstIndex and baseVertex are stale
+	bool resident;
+};
+
+#define SIZE_OF_VERTEX 12 // in bytes
+
+typedef uint32_t GeoID;
+class GeometryManager
+{
+public:
+	GeometryManager()
+		: m_VertexBuffer(0)
+		, m_ElementBuffer(0)
+		, m_VertexAllocator(VERTEX_BUFFER_SIZE / SIZE_OF_VERTEX)
+		, m_ElementAllocator(ELEMENT_BUFFER_SIZE / sizeof(uint32_t))
+		, m_KeepSourceData(false)
+		, m_SourceBytes(0)
+		, m_DecodedBytes(0)
+		, m_DecodedFromBytes(0)
+		, m_DecodeSeconds(0.0)
+		, m_TraceRecorder(nullptr)
+	{
+		glCreateBuffers(1, &m_VertexBuffer);
+		glNamedBufferData(m_VertexBuffer, VERTEX_BUFFER_SIZE, nullptr, GL_STATIC_DRAW);
+
+		glCreateBuffers(1, &m_ElementBuffer);
+		glNamedBufferData(m_ElementBuffer, ELEMENT_BUFFER_SIZE, nullptr, GL_STATIC_DRAW);
+
+		// GeoID 0 means no geometry, keep its slot so IDs index the vector directly
+		m_Geometry.emplace_back();
+		m_Sources.emplace_back();
+	}
+
+	~GeometryManager()
+	{
+		// delete buffers
+	}
+
+	// TODO Rausfinden was baseVertex und firstIndex sind
+
+	GeoID AddGeometry(const std::string& name, const void* vertexData, GLsizeiptr bytes, const uint32_t* elementData, uint32_t elementCount)
+	{
+		const GeoID geoID = AddSlot(name);
+
+		Geometry& geometry = m_Geometry[geoID];
+		geometry.elementCount = elementCount;
+		geometry.vertexCount = (uint32_t)(bytes / SIZE_OF_VERTEX);
+		geometry.resident = false;
+		CalculateBounds(geometry, static_cast<const float*>(vertexData), geometry.vertexCount);
+
+		const bool uploaded = Upload(geometry, vertexData, elementData);
+		assert(uploaded && "Geometry buffers are full");
+
+		// The CPU copy for uploading it again after an eviction and the trace both keep it encoded
+		if (NeedsEncodedSource())
+		{
+			EncodedMesh mesh = Encode(geometry, vertexData, elementData);
+			if (m_TraceRecorder)
+			{
+				m_TraceRecorder->RecordGeometry(geoID, name, mesh);
+			}
+			if (m_KeepSourceData)
+			{
+				KeepSource(geoID, std::move(mesh));
+			}
+		}
+
+		return geoID;
+	}
+
+	// Decodes straight into the geometry buffers, so meshes loaded from disk never exist
+	// uncompressed in CPU memory. Returns 0 and adds nothing if the buffers are full or the mesh
+	// doesn't decode.
+	GeoID AddGeometry(const std::string& name, const EncodedMesh& mesh)
+	{
+		// The decoder writes vertexSize bytes per vertex into ranges sized for SIZE_OF_VERTEX
+		if (mesh.vertexSize != SIZE_OF_VERTEX)
+		{
+			LOG_ERROR("[%s] has %u byte vertices, expected %u", name.c_str(), mesh.vertexSize, (uint32_t)SIZE_OF_VERTEX)
+			return 0;
+		}
+
+		Geometry geometry{};
+		geometry.elementCount = mesh.indexCount;
+		geometry.vertexCount = mesh.vertexCount;
+		geometry.boundsCenter = mesh.boundsCenter;
+		geometry.boundsRadius = mesh.boundsRadius;
+		if (!Upload(geometry, mesh))
+		{
+			return 0;
+		}
+
+		const GeoID geoID = AddSlot(name);
+		m_Geometry[geoID] = geometry;
+
+		if (m_TraceRecorder)
+		{
+			m_TraceRecorder->RecordGeometry(geoID, name, mesh);
+		}
+		if (m_KeepSourceData)
+		{
+			KeepSource(geoID, EncodedMesh(mesh));
+		}
+
+		return geoID;
+	}
+
+	// For meshes generated or decoded off the GL thread. mesh carries their counts and bounds, see
+	// Describe, plus the encoded data whenever NeedsEncodedSource. Returns 0 instead of asserting
+	// when the buffers are full.
+	GeoID AddGeometry(const std::string& name, const void* vertexData, const uint32_t* elementData, EncodedMesh&& mesh)
+	{
+		assert(mesh.vertexSize == SIZE_OF_VERTEX);
+
+		Geometry geometry{};
+		geometry.elementCount = mesh.indexCount;
+		geometry.vertexCount = mesh.vertexCount;
+		geometry.boundsCenter = mesh.boundsCenter;
+		geometry.boundsRadius = mesh.boundsRadius;
+		if (!Upload(geometry, vertexData, elementData))
+		{
+			return 0;
+		}
+
+		const GeoID geoID = AddSlot(name);
+		m_Geometry[geoID] = geometry;
+
+		if (m_TraceRecorder)
+		{
+			m_TraceRecorder->RecordGeometry(geoID, name, mesh);
+		}
+		if (m_KeepSourceData)
+		{
+			KeepSource(geoID, std::move(mesh));
+		}
+
+		return geoID;
+	}
+
+	// What AddGeometry keeps and records, vertexData holds SIZE_OF_VERTEX byte positions
+	static EncodedMesh Encode(const void* vertexData, GLsizeiptr bytes, const uint32_t* elementData, uint32_t elementCount)
+	{
+		EncodedMesh mesh = Describe(vertexData, bytes, elementCount);
+		MeshCodec::EncodeVertices(vertexData, mesh.vertexCount, mesh.vertexSize, mesh.vertices);
+		MeshCodec::EncodeIndices(elementData, mesh.indexCount, mesh.indices);
+		return mesh;
+	}
+
+	// Counts and bounds only, for AddGeometry calls that don't need the encoded data
+	static EncodedMesh Describe(const void* vertexData, GLsizeiptr bytes, uint32_t elementCount)
+	{
+		Geometry geometry{};
+		geometry.elementCount = elementCount;
+		geometry.vertexCount = (uint32_t)(bytes / SIZE_OF_VERTEX);
+		CalculateBounds(geometry, static_cast<const float*>(vertexData), geometry.vertexCount);
+
+		EncodedMesh mesh;
+		mesh.vertexCount = geometry.vertexCount;
+		mesh.vertexSize = SIZE_OF_VERTEX;
+		mesh.indexCount = geometry.elementCount;
+		mesh.boundsCenter = geometry.boundsCenter;
+		mesh.boundsRadius = geometry.boundsRadius;
+		return mesh;
+	}
+
+	// Whether AddGeometry keeps or records an encoded copy, so callers can encode ahead of time
+	bool NeedsEncodedSource() const
+	{
+		return m_KeepSourceData || m_TraceRecorder;
+	}
+
+	// Keeps a CPU copy of every geometry added from here on, which makes it evictable
+	void SetKeepSourceData(bool keepSourceData)
+	{
+		m_KeepSourceData = keepSourceData;
+	}
+
+	bool HasSourceData(GeoID geoID) const
+	{
+		assert(geoID < m_Sources.size());
+		return !m_Sources[geoID].vertices.empty();
+	}
+
+	// Frees the GPU copy, the geometry must not be drawn until MakeResident succeeds
+	bool Evict(GeoID geoID)
+	{
+		Geometry& geometry = GetGeometry(geoID);
+		if (!geometry.resident || !HasSourceData(geoID))
+		{
+			return false;
+		}
+
+		m_VertexAllocator.Free(geometry.baseVertex, geometry.vertexCount);
+		m_ElementAllocator.Free(geometry.firstIndex, geometry.elementCount);
+		geometry.resident = false;
+		return true;
+	}
+
+	// Uploads an evicted geometry from its CPU copy. Fails if neither buffer has a free range
+	// large enough, evict more and try again.
+	bool MakeResident(GeoID geoID)
+	{
+		Geometry& geometry = GetGeometry(geoID);
+		if (geometry.resident)
+		{
+			return true;
+		}
+
+		assert(HasSourceData(geoID));
+		return Upload(geometry, m_Sources[geoID]);
+	}
+
+	bool IsResident(GeoID geoID)
+	{
+		return GetGeometry(geoID).resident;
+	}
+
+	static size_t GetGeometryBytes(const Geometry& geometry)
+	{
+		return (size_t)geometry.vertexCount * SIZE_OF_VERTEX + (size_t)geometry.elementCount * sizeof(uint32_t);
+	}
+
+	size_t GetResidentVertexBytes() const { return m_VertexAllocator.GetUsed() * SIZE_OF_VERTEX; }
+	size_t GetResidentElementBytes() const { return m_ElementAllocator.GetUsed() * sizeof(uint32_t); }
+	size_t GetResidentBytes() const { return GetResidentVertexBytes() + GetResidentElementBytes(); }
+
+	// Encoded size of the CPU copies kept with SetKeepSourceData
+	size_t GetSourceBytes() const { return m_SourceBytes; }
+
+	// Decode throughput of everything uploaded from encoded meshes
+	void LogStats() const
+	{
+		if (m_DecodedBytes == 0)
+		{
+			return;
+		}
+
+		const double mb = 1024.0 * 1024.0;
+		LOG_INFO("Geometry: decoded %.2f MB from %.2f MB (%.2fx) in %.3f ms, %.2f GB/s with the %s decoder",
+			m_DecodedBytes / mb, m_DecodedFromBytes / mb, (double)m_DecodedBytes / m_DecodedFromBytes,
+			m_DecodeSeconds * 1000.0, m_DecodedBytes / m_DecodeSeconds / 1e9, MeshCodec::GetDecoderName())
+	}
+
+	// Every AddGeometry from here on ends up in the trace
+	void SetTraceRecorder(TraceRecorder* traceRecorder)
+	{
+		m_TraceRecorder = traceRecorder;
+	}
+
+	GLuint GetVertexBufferID()
+	{
+		return m_VertexBuffer;
+	}
+
+	GLuint GetElementBufferID()
+	{
+		return m_ElementBuffer;
+	}
+
+	size_t GetGeoCount()
+	{
+		return m_Geometry.size() - 1;
+	}
+
+	// Only meant for setup, keep the result instead of looking it up every frame
+	GeoID GetID(StringID name) const
+	{
+		auto it = m_NameToGeoID.find(name);
+		if(it == m_NameToGeoID.end())
+		{
+			return 0;
+		}
+
+		return it->second;
+	}
+
+	Geometry& GetGeometry(GeoID geoID)
+	{
+		assert(geoID != 0 && geoID < m_Geometry.size());
+		return m_Geometry[geoID];
+	}
+
+private:
+	GeoID AddSlot(const std::string& name)
+	{
+		const GeoID geoID = (GeoID)m_Geometry.size();
+		const StringID nameID = StringID::Register(name);
+		assert(m_NameToGeoID.find(nameID) == m_NameToGeoID.end());
+		m_NameToGeoID[nameID] = geoID;
+
+		m_Geometry.emplace_back();
+		m_Sources.emplace_back();
+		return geoID;
+	}
+
+	void KeepSource(GeoID geoID, EncodedMesh&& mesh)
+	{
+		m_SourceBytes += mesh.GetEncodedBytes();
+		m_Sources[geoID] = std::move(mesh);
+	}
+
+	static EncodedMesh Encode(const Geometry& geometry, const void* vertexData, const uint32_t* elementData)
+	{
+		EncodedMesh mesh;
+		mesh.vertexCount = geometry.vertexCount;
+		mesh.vertexSize = SIZE_OF_VERTEX;
+		mesh.indexCount = geometry.elementCount;
+		mesh.boundsCenter = geometry.boundsCenter;
+		mesh.boundsRadius = geometry.boundsRadius;
+		MeshCodec::EncodeVertices(vertexData, mesh.vertexCount, mesh.vertexSize, mesh.vertices);
+		MeshCodec::EncodeIndices(elementData, mesh.indexCount, mesh.indices);
+		return mesh;
+	}
+
+	bool Allocate(Geometry& geometry)
+	{
+		size_t firstVertex = 0;
+		size_t firstIndex = 0;
+		if (!m_VertexAllocator.Allocate(geometry.vertexCount, firstVertex))
+		{
+			return false;
+		}
+		if (!m_ElementAllocator.Allocate(geometry.elementCount, firstIndex))
+		{
+			m_VertexAllocator.Free(firstVertex, geometry.vertexCount);
+			return false;
+		}
+
+		geometry.baseVertex = (GLint)firstVertex;
+		geometry.firstIndex = (GLuint)firstIndex;
+		geometry.resident = true;
+		return true;
+	}
+
+	bool Upload(Geometry& geometry, const void* vertexData, const uint32_t* elementData)
+	{
+		if (!Allocate(geometry))
+		{
+			return false;
+		}
+
+		glNamedBufferSubData(m_VertexBuffer, (GLintptr)geometry.baseVertex * SIZE_OF_VERTEX, (GLsizeiptr)geometry.vertexCount * SIZE_OF_VERTEX, vertexData);
+		glNamedBufferSubData(m_ElementBuffer, (GLintptr)geometry.firstIndex * sizeof(uint32_t), (GLsizeiptr)geometry.elementCount * sizeof(uint32_t), elementData);
+		return true;
+	}
+
+	// Decodes into the driver's staging memory for the ranges instead of going through a CPU copy
+	bool Upload(Geometry& geometry, const EncodedMesh& mesh)
+	{
+		if (!Allocate(geometry))
+		{
+			return false;
+		}
+
+		const GLsizeiptr vertexBytes = (GLsizeiptr)geometry.vertexCount * SIZE_OF_VERTEX;
+		const GLsizeiptr elementBytes = (GLsizeiptr)geometry.elementCount * sizeof(uint32_t);
+		const GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+
+		void* vertices = vertexBytes > 0 ? glMapNamedBufferRange(m_VertexBuffer, (GLintptr)geometry.baseVertex * SIZE_OF_VERTEX, vertexBytes, access) : nullptr;
+		void* elements = elementBytes > 0 ? glMapNamedBufferRange(m_ElementBuffer, (GLintptr)geometry.firstIndex * sizeof(uint32_t), elementBytes, access) : nullptr;
+
+		const auto start = std::chrono::steady_clock::now();
+		const bool decoded = (vertices || vertexBytes == 0) && (elements || elementBytes == 0)
+			&& MeshCodec::Decode(mesh, vertices, static_cast<uint32_t*>(elements));
+		m_DecodeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		if (vertices)
+		{
+			glUnmapNamedBuffer(m_VertexBuffer);
+		}
+		if (elements)
+		{
+			glUnmapNamedBuffer(m_ElementBuffer);
+		}
+
+		if (!decoded)
+		{
+			LOG_ERROR("Couldn't decode a mesh with %u vertices and %u indices", geometry.vertexCount, geometry.elementCount)
+			m_VertexAllocator.Free(geometry.baseVertex, geometry.vertexCount);
+			m_ElementAllocator.Free(geometry.firstIndex, geometry.elementCount);
+			geometry.resident = false;
+			return false;
+		}
+
+		m_DecodedBytes += mesh.GetDecodedBytes();
+		m_DecodedFromBytes += mesh.GetEncodedBytes();
+		return true;
+	}
+
+	static void CalculateBounds(Geometry& geometry, const float* positions, GLsizeiptr vertexCount)
+	{
+		glm::vec3 min(FLT_MAX);
+		glm::vec3 max(-FLT_MAX);
+		for (GLsizeiptr i = 0; i < vertexCount; i++)
+		{
+			const glm::vec3 position(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2]);
+			min = glm::min(min, position);
+			max = glm::max(max, position);
+		}
+
+		geometry.boundsCenter = (min + max) * 0.5f;
+		geometry.boundsRadius = 0.f;
+		for (GLsizeiptr i = 0; i < vertexCount; i++)
+		{
+			const glm::vec3 position(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2]);
+			geometry.boundsRadius = std::max(geometry.boundsRadius, glm::length(position - geometry.boundsCenter));
+		}
+	}
+
+private:
+	GLuint m_VertexBuffer;
+	GLuint m_ElementBuffer;
+
+	// In vertices and indices
+	RangeAllocator m_VertexAllocator;
+	RangeAllocator m_ElementAllocator;
+
+	bool m_KeepSourceData;
+
+	// Indexed by GeoID, empty for geometry added without SetKeepSourceData
+	std::vector<EncodedMesh> m_Sources;
+	size_t m_SourceBytes;
+
+	size_t m_DecodedBytes;
+	size_t m_DecodedFromBytes;
+	double m_DecodeSeconds;
+
+	TraceRecorder* m_TraceRecorder;
+
+	std::unordered_map<StringID, GeoID, StringIDHash> m_NameToGeoID;
+
+	// Indexed by GeoID, slot 0 is unused. Don't hold on to references while geometry is added.
+	std::vector<Geometry> m_Geometry;
+
+};
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "Renderer.h"
+
+class ShaderLibrary;
+
+struct GpuCullingStats
+{
+	uint32_t instanceCount = 0;
+	uint32_t geometryCount = 0;
+
+	// Timer query around the three passes, read a few frames late
+	uint64_t culledFrames = 0;
+	double gpuSecondsSum = 0.0;
+	double gpuSecondsMax = 0.0;
+
+	// CheckAgainstCpu results
+	uint64_t checkedFrames = 0;
+	uint64_t mismatchedFrames = 0;
+	uint64_t visibleInstancesChecked = 0;
+};
+
+// GPU driven alternative to Renderer::Submit for instances that don't move. The instances and the
+// bounds of their geometry are uploaded once with SetInstances and stay in storage buffers. Cull
+// runs gpuCull.cs against the frustum: every instance is tested, the visible ones are compacted
+// with prefix sums and the compute passes write the indirect commands and the draw count, so
+// nothing per instance crosses the bus per frame and the CPU never sees the result.
+//
+// Draws like the Renderer does on both draw paths, with the same programs. There is one view and
+// no render queues, transparent renderables are drawn as opaque. The geometry has to stay
+// resident, pin it when a ResidencyManager is in use. GL thread only.
+class GpuCulling
+{
+public:
+	GpuCulling(GeometryManager& geometryManager, ShaderLibrary& shaderLibrary);
+	~GpuCulling();
+
+	GpuCulling(const GpuCulling&) = delete;
+	GpuCulling& operator=(const GpuCulling&) = delete;
+
+	// Replaces all instances. Sorted by geometry on the way, draws keep submission order per geometry.
+	void SetInstances(const std::vector<Renderable>& renderables);
+
+	// Dispatches the culling passes, the draws until the next Cull use their result
+	void Cull(const glm::mat4& viewProjection);
+
+	// Same contract as Renderer::DrawView and DrawViewPointQuads
+	void Draw(DrawPath drawPath, GLenum mode = GL_LINES_ADJACENCY);
+	void DrawPointQuads(DrawPath drawPath);
+
+	// Reads the last Cull's commands and instances back and compares them with the same culling
+	// done on the CPU. Stalls until the GPU is done, meant for tests. Instances whose sphere
+	// touches a plane within float tolerance may land either way, only counts are compared then.
+	bool CheckAgainstCpu();
+
+	const GpuCullingStats& GetStats() const { return m_Stats; }
+	void LogStats() const;
+
+private:
+	// glMultiDrawElementsIndirect and glMultiDrawArraysIndirect layouts, written by gpuCull.cs
+	struct DrawCommand
+	{
+		GLuint elementCount;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+
+	struct DrawArraysCommand
+	{
+		GLuint count;
+		GLuint instanceCount;
+		GLuint first;
+		GLuint baseInstance;
+	};
+
+	// Byte offsets inside m_CommandBuffer, aligned so each section can be bound as a storage buffer
+	struct CommandLayout
+	{
+		GLintptr drawCommands;   // DrawCommand[geometryCount]
+		GLintptr pullCommands;   // DrawArraysCommand[2 * geometryCount], line commands then quad commands
+		GLintptr pullDrawParams; // PullDrawParams[geometryCount]
+		GLsizeiptr size;
+	};
+
+	// Header of m_BlockBuffer, followed by one count per workgroup
+	struct BlockHeader
+	{
+		GLuint drawCount;
+		GLuint visibleCount;
+		GLuint padding[2];
+	};
+
+	CommandLayout GetCommandLayout(uint32_t geometryCount) const;
+
+	// (Re)creates the buffers when the instance or geometry count outgrows them
+	void ReserveBuffers(uint32_t instanceCount, uint32_t geometryCount);
+
+	void BindCullBuffers();
+	void BindPullBuffers();
+
+	// Reads back the queries that are about to be reused
+	void ReadTimerQueries();
+
+private:
+	GeometryManager& m_GeometryManager;
+
+	GLuint m_CullPrograms[3];
+
+	uint32_t m_InstanceCount;
+	uint32_t m_GeometryCount;
+	uint32_t m_InstanceCapacity;
+	uint32_t m_GeometryCapacity;
+
+	// CPU copies for CheckAgainstCpu, same order as on the GPU
+	std::vector<CullInstanceData> m_Instances;
+	std::vector<CullGeometryData> m_Geometry;
+	CullConstants m_Constants;
+
+	GLuint m_ConstantBuffer;
+	GLuint m_InstanceBuffer;
+	GLuint m_GeometryBuffer;
+	GLuint m_RankBuffer;
+	GLuint m_BlockBuffer;
+	GLuint m_VisibleBuffer;
+	GLuint m_CommandBuffer;
+
+	// Positions and indices plus the visible model matrices as attributes 1 to 4
+	GLuint m_VertexArray;
+	GLuint m_EmptyVertexArray;
+
+	GLint m_StorageBufferAlignment;
+	bool m_UseIndirectCount;
+
+	static constexpr uint32_t TIMER_QUERY_COUNT = 4;
+	GLuint m_TimerQueries[TIMER_QUERY_COUNT];
+	uint64_t m_TimerQueriesIssued;
+	uint64_t m_TimerQueriesRead;
+
+	GpuCullingStats m_Stats;
+};
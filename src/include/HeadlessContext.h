@@ -0,0 +1,45 @@
+#pragma once
+
+#ifdef GL2_USE_OSMESA
+#include <GL/osmesa.h>
+#else
+#ifndef EGL_NO_X11
+#define EGL_NO_X11 // keeps Xlib macros out of every file including this
+#endif
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+// Offscreen OpenGL context without a window or display server. Uses an EGL surfaceless
+// context by default, or OSMesa when built with GL2_USE_OSMESA. Both work on Mesa llvmpipe.
+// There is no default framebuffer, render into a Framebuffer instead.
+class HeadlessContext
+{
+public:
+	HeadlessContext() = default;
+	~HeadlessContext();
+
+	HeadlessContext(const HeadlessContext&) = delete;
+	HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+	// Tries every version from the requested one down to 4.5 and makes the context current
+	bool Create(int majorVersion, int minorVersion);
+	void Destroy();
+
+	int GetMajorVersion() const { return m_MajorVersion; }
+	int GetMinorVersion() const { return m_MinorVersion; }
+
+private:
+#ifdef GL2_USE_OSMESA
+	OSMesaContext m_Context = nullptr;
+
+	// OSMesa insists on a color buffer even if nothing ever renders into it
+	std::vector<uint8_t> m_DummyBuffer;
+#else
+	EGLDisplay m_Display = EGL_NO_DISPLAY;
+	EGLContext m_Context = EGL_NO_CONTEXT;
+#endif
+
+	int m_MajorVersion = 0;
+	int m_MinorVersion = 0;
+};
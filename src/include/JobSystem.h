@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+// Counts jobs that haven't finished yet, Wait on it to join them
+class JobCounter
+{
+public:
+	bool IsDone() const { return m_Pending.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class JobSystem;
+	std::atomic<uint32_t> m_Pending{ 0 };
+};
+
+struct JobSystemStats
+{
+	double wallSeconds = 0.0;
+
+	// Summed over all threads, including time external threads spent helping in Wait
+	double busySeconds = 0.0;
+
+	uint32_t threadCount = 0;
+	uint64_t jobs = 0;
+	uint64_t steals = 0;
+
+	double GetUtilization() const { return wallSeconds > 0.0 ? busySeconds / (wallSeconds * threadCount) : 0.0; }
+};
+
+// Fixed pool of workers with one queue each. Workers push and pop their own queue at the back and
+// steal from the front of the others when it runs dry, so nested jobs stay on the thread that
+// spawned them while idle threads pick up the oldest, usually biggest, work. Threads outside the
+// pool share one extra queue and execute jobs while they Wait instead of blocking.
+class JobSystem
+{
+public:
+	// 0 workers uses one per hardware thread minus the one that waits
+	explicit JobSystem(uint32_t workerCount = 0);
+	~JobSystem();
+
+	// Shared instance, started on first use
+	static JobSystem& Get();
+
+	void Run(JobCounter& counter, std::function<void()> job);
+
+	// Executes queued jobs on the calling thread until counter reaches zero
+	void Wait(JobCounter& counter);
+
+	// Splits [0, count) into chunks of at least grainSize and waits for all of them. Runs inline
+	// when there is only one chunk. The job is only referenced, so a lambda with many captures
+	// doesn't cost a heap allocated std::function per call.
+	template<typename Function>
+	void ParallelFor(uint32_t count, uint32_t grainSize, const Function& job)
+	{
+		ParallelForChunks(count, grainSize, [&job](uint32_t begin, uint32_t end) { job(begin, end); });
+	}
+
+	// Executes one queued job on the calling thread, false if every queue was empty
+	bool RunPendingJob();
+
+	// Workers plus the waiting thread
+	uint32_t GetThreadCount() const { return (uint32_t)m_Workers.size() + 1; }
+
+	JobSystemStats GetStats() const;
+	void ResetStats();
+	void LogStats() const;
+
+private:
+	struct Job
+	{
+		std::function<void()> function;
+		JobCounter* counter;
+	};
+
+	// Ring buffer that only ever grows, so pushing and popping jobs stays off the heap once it
+	// is big enough
+	struct Queue
+	{
+		std::mutex mutex;
+		std::vector<Job> jobs;
+		size_t head = 0;
+		size_t count = 0;
+
+		void PushBack(Job&& job);
+		void PopBack(Job& job);
+		void PopFront(Job& job);
+	};
+
+	void ParallelForChunks(uint32_t count, uint32_t grainSize, const std::function<void(uint32_t begin, uint32_t end)>& job);
+
+	void WorkerLoop(uint32_t queueIndex);
+
+	// Own queue first, then the others
+	bool FindJob(uint32_t queueIndex, Job& job);
+	void Execute(Job& job, uint32_t queueIndex);
+
+	uint32_t GetCallerQueue() const;
+
+private:
+	// Index 0 belongs to threads outside the pool, worker i owns i + 1
+	std::vector<std::unique_ptr<Queue>> m_Queues;
+	std::vector<std::thread> m_Workers;
+
+	std::atomic<uint32_t> m_QueuedJobs;
+	std::atomic<bool> m_Quit;
+	std::mutex m_WakeMutex;
+	std::condition_variable m_WakeCondition;
+
+	// Per queue index, in nanoseconds
+	std::unique_ptr<std::atomic<uint64_t>[]> m_BusyTime;
+	std::atomic<uint64_t> m_JobCount;
+	std::atomic<uint64_t> m_StealCount;
+	std::chrono::steady_clock::time_point m_StatsStart;
+};
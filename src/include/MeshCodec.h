@@ -0,0 +1,66 @@
+#pragma once
+
+// Vertices per block of the vertex codec, every block starts with fresh group headers
+#define MESH_CODEC_VERTEX_BLOCK_SIZE 256
+
+// Largest vertex the vertex codec accepts, in bytes. Vertices are encoded as 32 bit words, so
+// the size also has to be a multiple of 4.
+#define MESH_CODEC_MAX_VERTEX_SIZE 64
+
+// A mesh as it is stored on disk and kept around for re-uploads, see MeshCodec
+struct EncodedMesh
+{
+	uint32_t vertexCount = 0;
+	uint32_t vertexSize = 0;
+	uint32_t indexCount = 0;
+
+	// Bounding sphere of the positions. Decoding goes straight into GPU memory, so there is
+	// nothing to compute it from afterwards.
+	glm::vec3 boundsCenter = glm::vec3(0.f);
+	float boundsRadius = 0.f;
+
+	std::vector<uint8_t> vertices;
+	std::vector<uint8_t> indices;
+
+	size_t GetEncodedBytes() const { return vertices.size() + indices.size(); }
+	size_t GetDecodedBytes() const { return (size_t)vertexCount * vertexSize + (size_t)indexCount * sizeof(uint32_t); }
+};
+
+// Lossless codecs for vertex and index buffers.
+//
+// Indices are coded against a FIFO of recently seen vertices: a hit costs 4 bits, the next
+// unseen vertex too, anything else 4 bits plus a varint delta. It doesn't assume triangles,
+// the same buffers are drawn as lines adjacency and points.
+//
+// Vertices are split into 32 bit words. Each word is delta coded against the same word of the
+// previous vertex, zigzagged and transposed into 4 byte planes, so the mostly zero high bytes
+// of small deltas end up next to each other. Every plane is bit packed in groups of 16 bytes
+// at 0, 2, 4 or 8 bits per byte. The decoder does the unpacking, transposition and prefix sum
+// 16 vertices at a time with SSE2 or NEON, or with plain C++ on anything else (or when built
+// with GL2_MESH_CODEC_SCALAR), and writes whole blocks to the output in order, which suits
+// mapped GPU memory.
+class MeshCodec
+{
+public:
+	// Appends to encoded. vertexSize is a multiple of 4, at most MESH_CODEC_MAX_VERTEX_SIZE.
+	static void EncodeVertices(const void* vertices, uint32_t vertexCount, uint32_t vertexSize, std::vector<uint8_t>& encoded);
+	static void EncodeIndices(const uint32_t* indices, uint32_t indexCount, std::vector<uint8_t>& encoded);
+
+	// False if the data is truncated or wasn't produced for this many vertices or indices
+	static bool DecodeVertices(const uint8_t* encoded, size_t encodedBytes, void* vertices, uint32_t vertexCount, uint32_t vertexSize);
+	static bool DecodeIndices(const uint8_t* encoded, size_t encodedBytes, uint32_t* indices, uint32_t indexCount);
+
+	static bool Decode(const EncodedMesh& mesh, void* vertices, uint32_t* indices)
+	{
+		return DecodeVertices(mesh.vertices.data(), mesh.vertices.size(), vertices, mesh.vertexCount, mesh.vertexSize)
+			&& DecodeIndices(mesh.indices.data(), mesh.indices.size(), indices, mesh.indexCount);
+	}
+
+	// Fewest encoded bytes that can hold this many vertices or indices, so corrupt counts are
+	// caught before anything is allocated or mapped for them. vertexSize has to be valid.
+	static size_t GetMinVertexBytes(uint32_t vertexCount, uint32_t vertexSize);
+	static size_t GetMinIndexBytes(uint32_t indexCount);
+
+	// Name of the decoder this build uses
+	static const char* GetDecoderName();
+};
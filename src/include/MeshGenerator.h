@@ -0,0 +1,102 @@
+#pragma once
+
+#include "GeometryManager.h"
+
+enum class MeshShape : uint32_t
+{
+	UVSphere,
+	Icosphere,
+	Cube,
+	PlaneGrid,
+	Cylinder,
+	Torus
+};
+
+// Positions only (3 floats per vertex, see SIZE_OF_VERTEX), unit sized and centered at the origin
+struct MeshData
+{
+	std::vector<float> vertices;
+	std::vector<uint32_t> indices;
+
+	uint32_t GetVertexCount() const { return (uint32_t)vertices.size() / 3; }
+	uint32_t GetIndexCount() const { return (uint32_t)indices.size(); }
+};
+
+struct MeshDesc
+{
+	MeshShape shape = MeshShape::UVSphere;
+
+	// UVSphere:  slices, stacks
+	// Icosphere: subdivision level, unused
+	// Cube:      segments per face edge, unused
+	// PlaneGrid: segments along x, segments along z
+	// Cylinder:  slices, stacks
+	// Torus:     segments around the ring, segments around the tube
+	uint32_t segmentsU = 16;
+	uint32_t segmentsV = 16;
+
+	// Tube radius relative to the ring radius, only used by the torus
+	float tubeRadius = 0.25f;
+
+	bool operator==(const MeshDesc& other) const
+	{
+		return shape == other.shape
+			&& segmentsU == other.segmentsU
+			&& segmentsV == other.segmentsV
+			&& tubeRadius == other.tubeRadius;
+	}
+
+	std::string GetName() const;
+
+	// The fields the shape doesn't use zeroed and the tube radius rounded the way GetName prints
+	// it, so two descs with the same key are the same mesh under the same name
+	MeshDesc GetKey() const;
+};
+
+struct MeshDescHash
+{
+	size_t operator()(const MeshDesc& desc) const
+	{
+		size_t hash = std::hash<uint32_t>()((uint32_t)desc.shape);
+		hash = hash * 31 + std::hash<uint32_t>()(desc.segmentsU);
+		hash = hash * 31 + std::hash<uint32_t>()(desc.segmentsV);
+		hash = hash * 31 + std::hash<float>()(desc.tubeRadius);
+		return hash;
+	}
+};
+
+class MeshGenerator
+{
+public:
+	static MeshData Generate(const MeshDesc& desc);
+
+	static MeshData UVSphere(uint32_t slices, uint32_t stacks);
+	static MeshData Icosphere(uint32_t subdivisions);
+	static MeshData Cube(uint32_t segments);
+	static MeshData PlaneGrid(uint32_t segmentsX, uint32_t segmentsZ);
+	static MeshData Cylinder(uint32_t slices, uint32_t stacks);
+	static MeshData Torus(uint32_t ringSegments, uint32_t tubeSegments, float tubeRadius);
+};
+
+// Generates every (shape, parameters) combination once and keeps the GeoID it was registered under.
+// A name the AssetLoader or anyone else already registered is reused instead of generated again.
+class MeshCache
+{
+public:
+	MeshCache(GeometryManager& geometryManager)
+		: m_GeometryManager(geometryManager)
+	{
+	}
+
+	GeoID Get(const MeshDesc& desc);
+
+	size_t GetHitCount() const { return m_Hits; }
+	size_t GetMissCount() const { return m_Misses; }
+
+private:
+	GeometryManager& m_GeometryManager;
+	std::unordered_map<MeshDesc, GeoID, MeshDescHash> m_Cache;
+
+	size_t m_Hits = 0;
+	size_t m_Misses = 0;
+};
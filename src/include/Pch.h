@@ -1,14 +1,29 @@
 #pragma once
 
 #include <algorithm>
+#include <cassert>
+#include <cfloat>
 #include <cmath>
+#include <cstring>
+#include <functional>
 #include <iostream>
 #include <set>
 #include <string>
 #include <sstream>
+#include <thread>
 #include <fstream>
 #include <unordered_map>
 #include <memory>
 #include <vector>
 
+#define GLEW_STATIC
+#define GLFW_INCLUDE_NONE
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
 #include "Logger.h"
\ No newline at end of file
@@ -0,0 +1,29 @@
+#pragma once
+
+class JobSystem;
+
+// Keys per job of the parallel passes, smaller inputs are sorted on the calling thread
+#define RADIX_SORT_GRAIN_SIZE 16384
+
+// Stable LSD radix sort of 32 bit keys that each carry a 32 bit value, 8 bits per pass. Passes
+// in which every key has the same digit are skipped, so keys that only differ in their low bytes
+// cost less. With a job system large inputs are split into chunks that histogram and scatter in
+// parallel, chunk order keeps the sort stable.
+class RadixSort
+{
+public:
+	// scratchKeys and scratchValues need room for count entries, the result ends up in keys and values
+	static void Sort(uint32_t* keys, uint32_t* values, uint32_t count, uint32_t* scratchKeys, uint32_t* scratchValues, JobSystem* jobSystem = nullptr);
+
+	// Maps a float onto a key that sorts in the same order, negative values included
+	static uint32_t FloatKey(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+	}
+
+private:
+	static void SortSerial(uint32_t* keys, uint32_t* values, uint32_t count, uint32_t* scratchKeys, uint32_t* scratchValues);
+	static void SortParallel(uint32_t* keys, uint32_t* values, uint32_t count, uint32_t* scratchKeys, uint32_t* scratchValues, JobSystem& jobSystem);
+};
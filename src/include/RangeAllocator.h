@@ -0,0 +1,93 @@
+#pragma once
+
+#include <map>
+
+// First fit allocator over [0, capacity) in arbitrary units, freed ranges are merged with their
+// neighbours. Used to place geometry in the shared vertex and element buffers once geometry can
+// be evicted and uploaded again.
+class RangeAllocator
+{
+public:
+	RangeAllocator(size_t capacity)
+		: m_Capacity(capacity)
+		, m_Used(0)
+	{
+		m_FreeRanges[0] = capacity;
+	}
+
+	bool Allocate(size_t size, size_t& offset)
+	{
+		for (auto it = m_FreeRanges.begin(); it != m_FreeRanges.end(); ++it)
+		{
+			if (it->second < size)
+			{
+				continue;
+			}
+
+			offset = it->first;
+			const size_t remaining = it->second - size;
+			m_FreeRanges.erase(it);
+
+			if (remaining > 0)
+			{
+				m_FreeRanges[offset + size] = remaining;
+			}
+
+			m_Used += size;
+			return true;
+		}
+
+		return false;
+	}
+
+	void Free(size_t offset, size_t size)
+	{
+		assert(offset + size <= m_Capacity);
+		m_Used -= size;
+
+		auto next = m_FreeRanges.lower_bound(offset);
+		assert(next == m_FreeRanges.end() || next->first >= offset + size);
+
+		// Merge with the following range
+		if (next != m_FreeRanges.end() && next->first == offset + size)
+		{
+			size += next->second;
+			next = m_FreeRanges.erase(next);
+		}
+
+		// And with the preceding one
+		if (next != m_FreeRanges.begin())
+		{
+			auto previous = std::prev(next);
+			assert(previous->first + previous->second <= offset);
+
+			if (previous->first + previous->second == offset)
+			{
+				previous->second += size;
+				return;
+			}
+		}
+
+		m_FreeRanges[offset] = size;
+	}
+
+	size_t GetCapacity() const { return m_Capacity; }
+	size_t GetUsed() const { return m_Used; }
+
+	size_t GetLargestFreeRange() const
+	{
+		size_t largest = 0;
+		for (const auto& range : m_FreeRanges)
+		{
+			largest = std::max(largest, range.second);
+		}
+		return largest;
+	}
+
+private:
+	size_t m_Capacity;
+	size_t m_Used;
+
+	// offset -> size
+	std::map<size_t, size_t> m_FreeRanges;
+};
@@ -0,0 +1,471 @@
+#pragma once
+
+#include "GeometryManager.h"
+#include "ShaderConstants.h"
+#include "FrameArena.h"
+
+#include <atomic>
+
+// Each queue gets its own command range per view and is drawn with its own DrawView call.
+// With depth sorting on, opaque instances are ordered front to back so early depth testing
+// rejects what they hide, transparent ones back to front so they blend correctly. Terrain holds
+// the patches Terrain::Submit emits, drawn opaque with the TERRAIN program variant.
+enum class RenderQueue : uint32_t
+{
+	Opaque,
+	Transparent,
+	Terrain
+};
+
+#define RENDER_QUEUE_COUNT 3
+
+struct Renderable
+{
+	GeoID geoID;
+	glm::mat4 modelTransform;
+	RenderQueue queue = RenderQueue::Opaque;
+};
+
+// A regular grid, a row or a seeded scatter of one geometry, submitted as a single descriptor
+// instead of one Renderable per instance. Instance (x, y, z) sits at transform * (x, y, z) * stride,
+// shifted, turned and scaled by the jitter. The INSTANCE_RANGES shader variants expand it from
+// gl_InstanceID, see instanceRange.glsl, so what a range costs the CPU and the bus doesn't depend
+// on its instance count. The whole range is culled as one sphere and drawn in submission order.
+struct InstanceRange
+{
+	GeoID geoID;
+	glm::mat4 transform = glm::mat4(1.f);
+	glm::vec3 stride = glm::vec3(1.f);
+	glm::uvec3 count = glm::uvec3(1, 1, 1);
+
+	// Scatters are grids with jitter, position as a fraction of the stride, rotation about the
+	// local y axis in radians and scale as a fraction of 1
+	uint32_t seed = 0;
+	float positionJitter = 0.f;
+	float rotationJitter = 0.f;
+	float scaleJitter = 0.f;
+
+	RenderQueue queue = RenderQueue::Opaque;
+
+	uint32_t GetInstanceCount() const { return count.x * count.y * count.z; }
+};
+
+// Which submissions a DrawView call draws. Both are packed into the same command ring, ranges need
+// the INSTANCE_RANGES variant of the bound program.
+enum class InstanceSource
+{
+	Renderables,
+	Ranges
+};
+
+#define INSTANCE_BUFFER_DATA_SIZE 1024 * 1024 * 128 // 128mb
+#define MAX_VIEWS 32 // one bit per view in the visibility mask
+
+// One frame being built, one being drawn and one the GPU may still be reading. Each owns a
+// region of the instance buffer.
+#define RENDERER_FRAME_SLOTS 3
+#define INSTANCE_REGION_SIZE ((INSTANCE_BUFFER_DATA_SIZE) / RENDERER_FRAME_SLOTS / 64 * 64)
+#define INSTANCE_REGION_CAPACITY (INSTANCE_REGION_SIZE / 64) // 64 byte instances per region
+
+// Instances per culling job
+#define CULL_GRAIN_SIZE 2048
+
+// Draw commands per frame slot the command ring starts with, it grows when a frame needs more
+#define COMMAND_RING_INITIAL_CAPACITY 1024
+
+typedef uint32_t ViewID;
+
+class TraceRecorder;
+class ResidencyManager;
+class JobSystem;
+
+enum class DrawPath
+{
+	// VAO with a vertex buffer binding and per-instance model matrix attributes
+	VertexAttributes,
+
+	// No vertex attributes, shaders fetch indices, positions and model matrices from storage
+	// buffers (basicVert.vs with VERTEX_PULLING, pointQuad.vs)
+	VertexPulling
+};
+
+// Core since 4.6, ARB_indirect_parameters has the same entry points with a suffix
+inline void MultiDrawElementsIndirectCount(GLenum mode, GLenum type, const void* indirect, GLintptr drawCount, GLsizei maxDrawCount)
+{
+	if (GLEW_VERSION_4_6)
+	{
+		glMultiDrawElementsIndirectCount(mode, type, indirect, drawCount, maxDrawCount, 0);
+	}
+	else
+	{
+		glMultiDrawElementsIndirectCountARB(mode, type, indirect, drawCount, maxDrawCount, 0);
+	}
+}
+
+inline void MultiDrawArraysIndirectCount(GLenum mode, const void* indirect, GLintptr drawCount, GLsizei maxDrawCount)
+{
+	if (GLEW_VERSION_4_6)
+	{
+		glMultiDrawArraysIndirectCount(mode, indirect, drawCount, maxDrawCount, 0);
+	}
+	else
+	{
+		glMultiDrawArraysIndirectCountARB(mode, indirect, drawCount, maxDrawCount, 0);
+	}
+}
+
+class Renderer
+{
+private:
+	struct InstanceData
+	{
+		glm::mat4 modelTransform = glm::mat4(1.f);
+	};
+
+	struct DrawCommand
+	{
+		GLuint elementCount;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+
+	// glMultiDrawArraysIndirect layout for the pulling path, baseInstance holds the command index
+	struct DrawArraysCommand
+	{
+		GLuint count;
+		GLuint instanceCount;
+		GLuint first;
+		GLuint baseInstance;
+	};
+
+	struct View
+	{
+		glm::vec4 frustumPlanes[6];
+
+		// Row of the view matrix that gives the distance in front of the camera, dot it with a
+		// world position
+		glm::vec4 depthAxis;
+
+		// Ranges inside the shared indirect buffer per RenderQueue, filled in by EndScene. The
+		// instance range commands of all views follow the renderable commands of all views.
+		uint32_t firstCommand[RENDER_QUEUE_COUNT];
+		uint32_t commandCount[RENDER_QUEUE_COUNT];
+		uint32_t firstRangeCommand[RENDER_QUEUE_COUNT];
+		uint32_t rangeCommandCount[RENDER_QUEUE_COUNT];
+		uint32_t visibleInstances;
+	};
+
+	// Instances of one bucket that are visible in exactly the same set of views
+	struct MaskGroup
+	{
+		uint32_t mask;
+		uint32_t count;
+		uint32_t offset;
+	};
+
+	struct DrawData
+	{
+		GeoID geoID;
+		RenderQueue queue;
+		uint32_t instanceCount;
+
+		// Frame arena memory, recreated whenever the slot is used again
+		ArenaVector<InstanceData> instanceData{};
+
+		// Written by CullScene, one per instance. Depth keys only when the frame is depth sorted.
+		ArenaVector<uint32_t> visibilityMasks{};
+		ArenaVector<uint32_t> depthKeys{};
+
+		// Smallest depth key of the visible instances, orders the buckets' commands
+		uint32_t sortKey;
+
+		// Written by PackScene
+		ArenaVector<MaskGroup> maskGroups{};
+		const Geometry* drawGeometry;
+		uint32_t firstInstance;
+	};
+
+	// Consecutive instances of one mask group in the depth order of all transparent buckets
+	struct SortedRun
+	{
+		uint32_t mask;
+		uint32_t drawData;
+		uint32_t firstInstance;
+		uint32_t count;
+	};
+
+	// One SubmitRange call
+	struct RangeDrawData
+	{
+		GeoID geoID;
+		RenderQueue queue;
+		uint32_t instanceCount;
+		InstanceRangeData data;
+
+		// Written by CullScene
+		uint32_t visibilityMask;
+		uint32_t sortKey;
+
+		// Written by PackScene, nullptr if the range isn't drawn
+		const Geometry* drawGeometry;
+		uint32_t rangeIndex;
+	};
+
+	// Everything one frame needs from BeginScene until its draws are fenced. Slots are reused,
+	// so the vectors keep their allocations from frame to frame.
+	struct FrameState
+	{
+		std::vector<DrawData> drawData;
+		uint32_t drawDataCount = 0;
+
+		std::vector<View> views;
+
+		std::vector<RangeDrawData> ranges;
+
+		// Byte offset of the visible ranges' descriptors inside the instance buffer, right behind
+		// the slot's instances. The range commands index them from there.
+		GLintptr rangeDataOffset = 0;
+		uint32_t rangeDataCount = 0;
+
+		// Where PackScene writes the indirect data, the slot's range of the command ring. A frame
+		// with more commands than that keeps a copy in drawCommands and UploadScene moves them
+		// into a buffer of their own.
+		GLuint commandBuffer = 0;
+		char* commandData = nullptr;
+		GLintptr commandOffset = 0;
+		uint32_t commandCapacity = 0;
+		uint32_t commandCount = 0;
+		std::vector<DrawCommand> drawCommands;
+
+		// Snapshot of m_DrawPath when the frame was packed
+		DrawPath drawPath = DrawPath::VertexAttributes;
+
+		// Snapshot of m_DepthSort when the frame was started
+		bool depthSort = false;
+
+		// Byte offset of the slot's region inside the instance buffer and how much of it is used
+		GLintptr instanceRegionOffset = 0;
+		GLintptr instanceBytes = 0;
+
+		// Written behind instanceBytes by FlushDraws while the slot is the drawn frame
+		GLintptr immediateBytes = 0;
+
+		// Signaled once the GPU is done with everything drawn from this slot
+		GLsync fence = nullptr;
+	};
+
+	// Byte offsets of the indirect data inside one frame slot of the command ring. Every section
+	// starts at the storage buffer offset alignment so the draw parameters can be bound directly.
+	struct CommandLayout
+	{
+		GLintptr drawCommands;   // DrawCommand[capacity], attribute path
+		GLintptr pullCommands;   // DrawArraysCommand[2 * capacity], line commands then quad commands
+		GLintptr pullDrawParams; // PullDrawParams[capacity]
+		GLintptr drawCounts;     // GLuint[2 * MAX_VIEWS * RENDER_QUEUE_COUNT], read by glMultiDraw*IndirectCount, renderables then ranges
+		GLsizeiptr size;
+	};
+
+	// One DrawIndexed call, waiting for FlushDraws
+	struct ImmediateDraw
+	{
+		GeoID geoID;
+		GLenum mode;
+		glm::mat4 modelTransform;
+	};
+
+	// Fixed size piece of one bucket, so a single large bucket still spreads over all threads
+	struct CullChunk
+	{
+		uint32_t drawData;
+		uint32_t begin;
+		uint32_t end;
+	};
+
+public:
+	Renderer(GeometryManager* geometryManager);
+	~Renderer();
+
+	void SetVertexBuffer(GLuint vertexBufferID);
+	void SetElementBuffer(GLuint elementBufferID);
+	void SetGeoCount(size_t count);
+
+	// Takes effect with the next PackScene, frames packed before keep their path. Bind programs
+	// for GetDrawnFramePath when drawing.
+	void SetDrawPath(DrawPath drawPath) { m_DrawPath = drawPath; }
+	DrawPath GetDrawPath() const { return m_DrawPath; }
+	DrawPath GetDrawnFramePath() const { return m_Frames[m_DrawFrame].drawPath; }
+
+	// Sorts instances and buckets by their depth in view 0, starting with the next BeginScene.
+	// Off keeps submission order.
+	void SetDepthSort(bool depthSort) { m_DepthSort = depthSort; }
+	bool GetDepthSort() const { return m_DepthSort; }
+
+	// Substitutes fallbacks for evicted geometry and reports what is visible, nullptr keeps
+	// everything resident
+	void SetResidencyManager(ResidencyManager* residencyManager) { m_ResidencyManager = residencyManager; }
+
+	// Records views, submits and frame boundaries, nullptr stops recording
+	void SetTraceRecorder(TraceRecorder* traceRecorder) { m_TraceRecorder = traceRecorder; }
+
+	// Starts building the next frame slot, waits until the GPU is done with it. GL thread only.
+	void BeginScene();
+
+	// Views are registered per frame between BeginScene and EndScene. One pass culls against all of
+	// them and each gets its own command lists, but depth keys come from view 0 only: with depth
+	// sorting on, every other view draws in the first view's order.
+	ViewID AddView(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
+
+	void Submit(const Renderable& renderable);
+
+	// Recorded into traces as the instances it expands to, replays draw those as renderables
+	void SubmitRange(const InstanceRange& range);
+
+	// Culls every instance against all views in a single pass, uploads the visible instances
+	// once and builds one indirect command range per view. Drawing happens in DrawView.
+	// Same as CullScene, PackScene and UploadScene in a row.
+	void EndScene(JobSystem* jobSystem = nullptr);
+
+	// The CPU half of EndScene. Makes no GL calls, so AddView, Submit, CullScene and PackScene can
+	// run on a worker while the GL thread draws the previous frame. Spread over jobSystem if given.
+	void CullScene(JobSystem* jobSystem = nullptr);
+	void PackScene(JobSystem* jobSystem = nullptr);
+
+	// Makes the packed frame the one DrawView draws. Its commands are already in the mapped command
+	// ring unless it outgrew it. GL thread only. A pipelined caller picks the frame before the one
+	// currently being built instead.
+	void UploadScene(bool previousFrame = false);
+
+	// Caller is responsible for binding the target, viewport, blend state and the matching view uniforms.
+	// Binds through GLState and leaves its vertex array and buffers bound for the next draw.
+	void DrawView(ViewID viewID, GLenum mode = GL_LINES_ADJACENCY, RenderQueue queue = RenderQueue::Opaque,
+		InstanceSource source = InstanceSource::Renderables);
+
+	// Draws every element as a screen facing quad. The attribute path draws points for
+	// pointsToSquare.gs to expand, the pulling path instances a 4 vertex strip per point.
+	void DrawViewPointQuads(ViewID viewID, RenderQueue queue = RenderQueue::Opaque,
+		InstanceSource source = InstanceSource::Renderables);
+
+	// Keeps the call per object interface, but only records the draw. FlushDraws sorts what was
+	// recorded into one instanced glMultiDrawElementsIndirect per run of the same mode, drawn with
+	// the state bound when it was recorded: GLState flushes before every change it lets through.
+	// With blending on or depth testing off draws keep their order, otherwise the instances of a
+	// geometry are merged into one command. Attribute path only, bind a program for it.
+	void DrawIndexed(const Renderable& renderable, GLenum mode = GL_LINES_ADJACENCY);
+
+	// Draws what DrawIndexed recorded. DrawView, DrawViewPointQuads and BeginScene call it, callers
+	// only need to before touching state GLState doesn't track, like the framebuffer, or reading back.
+	void FlushDraws();
+
+	// Of the frame DrawView draws
+	size_t GetViewCount() const { return m_Frames[m_DrawFrame].views.size(); }
+	uint32_t GetVisibleInstanceCount(ViewID viewID) const { return m_Frames[m_DrawFrame].views[viewID].visibleInstances; }
+
+	// Cull and pack time per frame, time spent in the depth sort, summed over threads, and how
+	// DrawIndexed calls were batched
+	void LogStats() const;
+
+	// Normalized left, right, bottom, top, near and far planes, inside is positive
+	static void ExtractFrustumPlanes(const glm::mat4& viewProjection, glm::vec4* planes);
+
+private:
+	static uint32_t CalculateVisibilityMask(const std::vector<View>& views, const glm::vec3& center, float radius);
+
+	CommandLayout GetCommandLayout(uint32_t capacity) const;
+
+	// Recreates the ring with room for capacity commands per slot. The old buffer stays alive
+	// until no frame slot points into it anymore.
+	void GrowCommandRing(uint32_t capacity);
+	void ReleaseRetiredCommandBuffers();
+
+	// Bounding sphere of every instance of the range, jitter included
+	static void GetRangeBounds(const InstanceRangeData& range, const Geometry& geometry, glm::vec3& center, float& radius);
+
+	// Merges the visible instances of the depth sorted transparent buckets into one back to front
+	// order and cuts it into runs, so blending holds across geometries and mask groups and not
+	// just inside each of them. Runs index the instances scatter already placed.
+	void SortTransparentRuns(const FrameState& frame, ArenaVector<SortedRun>& runs, JobSystem* jobSystem);
+
+	// commands holds frame.commandCount entries ordered by view, then queue
+	void WriteCommands(const FrameState& frame, const DrawCommand* commands, char* slotData) const;
+
+	// Draws m_ImmediateDraws[begin, end), which share their mode
+	void FlushDrawBatch(FrameState& frame, size_t begin, size_t end, bool keepOrder);
+
+	void BindPullBuffers(const FrameState& frame);
+	void BindRangeBuffer(const FrameState& frame);
+
+	// First command and count of a view's command list for queue and source, and the offset of its
+	// draw count inside the frame's slot
+	void GetCommandList(const FrameState& frame, ViewID viewID, RenderQueue queue, InstanceSource source,
+		uint32_t& firstCommand, uint32_t& commandCount, GLintptr& drawCountOffset) const;
+
+private:
+	GeometryManager* m_GeometryManager;
+	TraceRecorder* m_TraceRecorder;
+	ResidencyManager* m_ResidencyManager;
+	DrawPath m_DrawPath;
+
+	FrameState m_Frames[RENDERER_FRAME_SLOTS];
+	uint32_t m_BuildFrame;
+	uint32_t m_DrawFrame;
+
+	// Indexed by GeoID * RENDER_QUEUE_COUNT + queue, position in the build frame's drawData plus
+	// one, 0 if nothing was submitted this frame
+	std::vector<uint32_t> m_DrawDataSlots;
+
+	// Indexed the same way, instances submitted the last frame the slot was used, to reserve for
+	std::vector<uint32_t> m_SlotInstanceCounts;
+
+	bool m_DepthSort;
+	std::atomic<uint64_t> m_SortTime;
+	std::atomic<uint64_t> m_SortedInstances;
+	uint32_t m_SortedFrames;
+
+	// Wall time of CullScene and PackScene, to compare one pass over several views with one per view
+	uint64_t m_CullTime;
+	uint64_t m_PackTime;
+	uint64_t m_CulledViews;
+	uint64_t m_CulledFrames;
+
+	GLuint m_VertexArray;
+
+	// Positions and indices only, the attribute path draws instance ranges with it
+	GLuint m_RangeVertexArray;
+	GLuint m_InstanceDataBuffer[2];
+	GLuint m_PersistentInstanceDataBuffer;
+	// Persistently mapped, one slot per frame slot, fenced together with the instance regions
+	GLuint m_CommandRing;
+	char* m_CommandRingData;
+	uint32_t m_CommandRingCapacity;
+	GLsizeiptr m_CommandSlotSize;
+	uint32_t m_RequiredCommandCapacity;
+	std::vector<GLuint> m_RetiredCommandBuffers;
+
+	GLint m_StorageBufferAlignment;
+
+	// ARB_indirect_parameters or GL 4.6, the draw count comes from the ring instead of the CPU
+	bool m_UseIndirectCount;
+
+	GLuint m_VertexBufferID;
+	GLuint m_ElementBufferID;
+	GLuint m_EmptyVertexArray;
+
+	std::vector<ImmediateDraw> m_ImmediateDraws;
+	bool m_FlushingDraws;
+
+	// Scratch for FlushDraws. Per GeoID the batch's command plus one, 0 if it has none yet, and per
+	// draw its command.
+	std::vector<uint32_t> m_ImmediateCommandSlots;
+	std::vector<uint32_t> m_ImmediateDrawCommands;
+	std::vector<DrawCommand> m_ImmediateCommands;
+
+	uint64_t m_ImmediateDrawCount;
+	uint64_t m_ImmediateMultiDrawCount;
+	uint64_t m_ImmediateCommandCount;
+
+	char* m_InstanceDataPtr;
+
+	size_t m_GeoManagerGeoCount;
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "GeometryManager.h"
+
+#include <deque>
+
+struct ResidencySettings
+{
+	// Vertex plus element bytes that may be resident at once
+	size_t budgetBytes = VERTEX_BUFFER_SIZE + ELEMENT_BUFFER_SIZE;
+
+	// Geometry has to be invisible for this many frames before it can be evicted
+	uint32_t evictAfterFrames = 120;
+
+	// Upload bandwidth for streaming evicted geometry back in
+	size_t uploadBytesPerFrame = 1024 * 1024 * 4; // 4mb
+};
+
+struct ResidencyStats
+{
+	size_t residentBytes = 0;
+	size_t residentVertexBytes = 0;
+	size_t residentElementBytes = 0;
+	uint32_t residentGeometries = 0;
+	uint32_t evictedGeometries = 0;
+	uint32_t pendingUploads = 0;
+
+	uint64_t evictions = 0;
+	uint64_t uploads = 0;
+	uint64_t uploadedBytes = 0;
+	size_t uploadedBytesLastFrame = 0;
+
+	// Visible geometries that were drawn as their fallback or skipped because they weren't resident
+	uint32_t placeholderDrawsLastFrame = 0;
+	uint32_t skippedDrawsLastFrame = 0;
+};
+
+// Keeps GeometryManager under a memory budget. Geometry that hasn't been visible for a while is
+// evicted least recently used first once the budget runs out. Visible geometry that isn't resident
+// is queued for upload from its CPU copy and drawn as its fallback (a lower LOD) or the placeholder
+// until it is back.
+class ResidencyManager
+{
+public:
+	// Has to be created before the geometry it manages is added, only that gets a CPU copy
+	ResidencyManager(GeometryManager& geometryManager, const ResidencySettings& settings = ResidencySettings());
+
+	// Never evicted. Drawn for any non-resident geometry without a fallback, 0 skips those draws.
+	void SetPlaceholder(GeoID placeholder);
+
+	// Drawn instead of geoID while it streams in, usually a lower LOD. Pins the fallback.
+	void SetFallback(GeoID geoID, GeoID fallback);
+
+	void Pin(GeoID geoID);
+
+	// Called by the Renderer for every geometry with a visible instance. Returns the geometry to
+	// draw this frame, 0 if there is nothing to draw.
+	GeoID RequestDraw(GeoID geoID);
+
+	// Once per frame after EndScene: evicts down to the budget and streams queued geometry in
+	void Update();
+
+	void SetBudget(size_t budgetBytes) { m_Settings.budgetBytes = budgetBytes; }
+	const ResidencySettings& GetSettings() const { return m_Settings; }
+
+	const ResidencyStats& GetStats() const { return m_Stats; }
+	void LogStats() const;
+
+private:
+	struct Entry
+	{
+		uint64_t lastVisibleFrame = 0;
+		GeoID fallback = 0;
+		bool pinned = false;
+		bool queued = false;
+	};
+
+	Entry& GetEntry(GeoID geoID);
+
+	// Evicts least recently visible geometry until bytes more fit into the budget. Returns false
+	// if there isn't enough idle geometry.
+	bool EvictFor(size_t bytes);
+	bool EvictLeastRecentlyUsed();
+
+	bool IsEvictable(GeoID geoID, const Entry& entry) const;
+
+private:
+	GeometryManager& m_GeometryManager;
+	ResidencySettings m_Settings;
+	ResidencyStats m_Stats;
+
+	// Indexed by GeoID, IDs are handed out densely
+	std::vector<Entry> m_Entries;
+	std::deque<GeoID> m_UploadQueue;
+	std::vector<GeoID> m_EvictionCandidates;
+	bool m_CandidatesCollected;
+
+	GeoID m_Placeholder;
+	uint64_t m_Frame;
+
+	uint32_t m_PlaceholderDraws;
+	uint32_t m_SkippedDraws;
+};
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <cstddef>
+
+// C++ mirrors of the uniform and storage blocks declared in assets/shaders/constants.glsl and
+// pulling.glsl. Binding points are fixed with layout(binding = N) on the GLSL side, keep both
+// in sync.
+
+#define FRAME_CONSTANTS_BINDING 0
+#define VIEW_CONSTANTS_BINDING 1
+#define MATERIAL_CONSTANTS_BINDING 2
+#define CULL_CONSTANTS_BINDING 3
+#define TERRAIN_CONSTANTS_BINDING 4
+
+// Storage buffer bindings of the vertex pulling path, see pulling.glsl
+#define PULL_POSITIONS_BINDING 0
+#define PULL_INDICES_BINDING 1
+#define PULL_INSTANCES_BINDING 2
+#define PULL_DRAW_PARAMS_BINDING 3
+
+// Descriptors of the INSTANCE_RANGES shader variants on both draw paths, see instanceRange.glsl
+#define INSTANCE_RANGES_BINDING 4
+
+// Height tiles of the TERRAIN shader variant, see terrain.glsl
+#define TERRAIN_HEIGHTS_BINDING 5
+
+// LOD levels TerrainConstants has morph ranges for, the same constant is in terrain.glsl
+#define TERRAIN_MAX_LEVELS 12
+
+// Storage buffer bindings of the gpuCull.cs passes. They overlap the draw bindings above, every
+// user binds what it reads right before it dispatches or draws.
+#define CULL_INSTANCES_BINDING 0
+#define CULL_GEOMETRY_BINDING 1
+#define CULL_RANKS_BINDING 2
+#define CULL_BLOCKS_BINDING 3
+#define CULL_VISIBLE_BINDING 4
+#define CULL_COMMANDS_BINDING 5
+#define CULL_PULL_COMMANDS_BINDING 6
+#define CULL_PULL_DRAW_PARAMS_BINDING 7
+
+// Invocations per workgroup of gpuCull.cs, handed to the shader as GROUP_SIZE
+#define GPU_CULL_GROUP_SIZE 256
+
+// Fails the build if a member drifts from the offset the block layout gives it in GLSL
+#define CHECK_BLOCK_OFFSET(type, member, offset) \
+	static_assert(offsetof(type, member) == offset, #type "::" #member " doesn't match the GLSL block layout");
+
+// Blocks are bound with glBindBufferRange, std140 rounds their size up to a vec4
+#define CHECK_BLOCK_SIZE(type, size) \
+	static_assert(sizeof(type) == size && sizeof(type) % 16 == 0, #type " doesn't match the GLSL block size");
+
+// layout(std140, binding = FRAME_CONSTANTS_BINDING) uniform FrameConstants
+struct FrameConstants
+{
+	float time;      // simulation time in seconds
+	float deltaTime; // fixed timestep
+	uint32_t frameIndex;
+	uint32_t padding;
+};
+
+CHECK_BLOCK_OFFSET(FrameConstants, time, 0)
+CHECK_BLOCK_OFFSET(FrameConstants, deltaTime, 4)
+CHECK_BLOCK_OFFSET(FrameConstants, frameIndex, 8)
+CHECK_BLOCK_SIZE(FrameConstants, 16)
+
+// layout(std140, binding = VIEW_CONSTANTS_BINDING) uniform ViewConstants
+struct ViewConstants
+{
+	glm::mat4 viewMatrix;
+	glm::mat4 projectionMatrix;
+	glm::mat4 viewProjectionMatrix;
+	glm::vec4 cameraPosition; // w unused
+};
+
+CHECK_BLOCK_OFFSET(ViewConstants, viewMatrix, 0)
+CHECK_BLOCK_OFFSET(ViewConstants, projectionMatrix, 64)
+CHECK_BLOCK_OFFSET(ViewConstants, viewProjectionMatrix, 128)
+CHECK_BLOCK_OFFSET(ViewConstants, cameraPosition, 192)
+CHECK_BLOCK_SIZE(ViewConstants, 208)
+
+// layout(std140, binding = MATERIAL_CONSTANTS_BINDING) uniform MaterialConstants
+struct MaterialConstants
+{
+	glm::vec4 color;
+	int32_t curveSteps; // segments per curve in smoothSurface.gs
+	int32_t padding[3];
+};
+
+CHECK_BLOCK_OFFSET(MaterialConstants, color, 0)
+CHECK_BLOCK_OFFSET(MaterialConstants, curveSteps, 16)
+CHECK_BLOCK_SIZE(MaterialConstants, 32)
+
+// layout(std430, binding = PULL_DRAW_PARAMS_BINDING) readonly buffer DrawParamsBuffer { DrawParams b_Draws[]; }
+// One entry per indirect command, the pulling shaders find theirs through gl_BaseInstance
+struct PullDrawParams
+{
+	uint32_t firstIndex;
+	int32_t baseVertex;
+	uint32_t firstInstance;
+	uint32_t elementCount;
+};
+
+CHECK_BLOCK_OFFSET(PullDrawParams, firstIndex, 0)
+CHECK_BLOCK_OFFSET(PullDrawParams, baseVertex, 4)
+CHECK_BLOCK_OFFSET(PullDrawParams, firstInstance, 8)
+CHECK_BLOCK_OFFSET(PullDrawParams, elementCount, 12)
+CHECK_BLOCK_SIZE(PullDrawParams, 16)
+
+// layout(std430, binding = INSTANCE_RANGES_BINDING) readonly buffer InstanceRangeBuffer { InstanceRange b_Ranges[]; }
+// A grid, array or scatter of instances the vertex shader expands from gl_InstanceID
+struct InstanceRangeData
+{
+	glm::mat4 transform;  // places the whole range
+	glm::vec4 stride;     // between neighbouring cells, w is the position jitter as a fraction of it
+	glm::uvec4 countSeed; // cells along x, y and z, w seeds the jitter
+	glm::vec4 jitter;     // x rotation about the local y axis in radians, y scale as a fraction, zw unused
+};
+
+CHECK_BLOCK_OFFSET(InstanceRangeData, transform, 0)
+CHECK_BLOCK_OFFSET(InstanceRangeData, stride, 64)
+CHECK_BLOCK_OFFSET(InstanceRangeData, countSeed, 80)
+CHECK_BLOCK_OFFSET(InstanceRangeData, jitter, 96)
+CHECK_BLOCK_SIZE(InstanceRangeData, 112)
+
+// Same integer hash as RangeHash in instanceRange.glsl, so both sides jitter an instance alike
+inline uint32_t InstanceRangeHash(uint32_t x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+// [0, 1), stream picks one of the independent values of an instance
+inline float InstanceRangeRandom(uint32_t seed, uint32_t instance, uint32_t stream)
+{
+	return (float)(InstanceRangeHash(seed ^ InstanceRangeHash(instance * 8u + stream)) >> 8) * (1.f / 16777216.f);
+}
+
+// C++ version of RangeModelMat in instanceRange.glsl, for whatever needs the instances on the CPU.
+// Cells run along x first, then y, then z.
+inline glm::mat4 InstanceRangeTransform(const InstanceRangeData& range, uint32_t instance)
+{
+	const uint32_t countX = range.countSeed.x;
+	const uint32_t countY = range.countSeed.y;
+	const uint32_t seed = range.countSeed.w;
+	const glm::vec3 stride = glm::vec3(range.stride);
+
+	const glm::vec3 cell((float)(instance % countX), (float)(instance / countX % countY), (float)(instance / (countX * countY)));
+	const glm::vec3 jitter(
+		InstanceRangeRandom(seed, instance, 0) - 0.5f,
+		InstanceRangeRandom(seed, instance, 1) - 0.5f,
+		InstanceRangeRandom(seed, instance, 2) - 0.5f);
+	const glm::vec3 position = cell * stride + jitter * stride * range.stride.w;
+
+	const float angle = (InstanceRangeRandom(seed, instance, 3) * 2.f - 1.f) * range.jitter.x;
+	const float scale = 1.f + (InstanceRangeRandom(seed, instance, 4) * 2.f - 1.f) * range.jitter.y;
+	const float c = std::cos(angle) * scale;
+	const float s = std::sin(angle) * scale;
+
+	const glm::mat4 local(
+		c, 0.f, -s, 0.f,
+		0.f, scale, 0.f, 0.f,
+		s, 0.f, c, 0.f,
+		position.x, position.y, position.z, 1.f);
+	return range.transform * local;
+}
+
+// layout(std140, binding = CULL_CONSTANTS_BINDING) uniform CullConstants, declared in gpuCull.cs
+struct CullConstants
+{
+	glm::vec4 frustumPlanes[6];
+	uint32_t instanceCount;
+	uint32_t geometryCount;
+	uint32_t blockCount; // workgroups of the per instance passes
+	uint32_t padding;
+};
+
+CHECK_BLOCK_OFFSET(CullConstants, frustumPlanes, 0)
+CHECK_BLOCK_OFFSET(CullConstants, instanceCount, 96)
+CHECK_BLOCK_OFFSET(CullConstants, geometryCount, 100)
+CHECK_BLOCK_OFFSET(CullConstants, blockCount, 104)
+CHECK_BLOCK_SIZE(CullConstants, 112)
+
+// layout(std430, binding = CULL_INSTANCES_BINDING) readonly buffer CullInstanceBuffer { CullInstance b_Instances[]; }
+struct CullInstanceData
+{
+	glm::mat4 modelTransform;
+	uint32_t geometry; // index into the CullGeometry array
+	uint32_t padding[3];
+};
+
+CHECK_BLOCK_OFFSET(CullInstanceData, modelTransform, 0)
+CHECK_BLOCK_OFFSET(CullInstanceData, geometry, 64)
+CHECK_BLOCK_SIZE(CullInstanceData, 80)
+
+// layout(std430, binding = CULL_GEOMETRY_BINDING) readonly buffer CullGeometryBuffer { CullGeometry b_Geometry[]; }
+// One per geometry with instances, its instances are contiguous in the instance array
+struct CullGeometryData
+{
+	glm::vec4 bounds; // model space sphere, w is the radius
+	uint32_t firstInstance;
+	uint32_t instanceCount;
+	uint32_t elementCount;
+	uint32_t firstIndex;
+	int32_t baseVertex;
+	uint32_t padding[3];
+};
+
+CHECK_BLOCK_OFFSET(CullGeometryData, bounds, 0)
+CHECK_BLOCK_OFFSET(CullGeometryData, firstInstance, 16)
+CHECK_BLOCK_OFFSET(CullGeometryData, instanceCount, 20)
+CHECK_BLOCK_OFFSET(CullGeometryData, elementCount, 24)
+CHECK_BLOCK_OFFSET(CullGeometryData, firstIndex, 28)
+CHECK_BLOCK_OFFSET(CullGeometryData, baseVertex, 32)
+CHECK_BLOCK_SIZE(CullGeometryData, 48)
+
+// layout(std140, binding = TERRAIN_CONSTANTS_BINDING) uniform TerrainConstants, declared in terrain.glsl
+struct TerrainConstants
+{
+	glm::vec4 morphRanges[TERRAIN_MAX_LEVELS]; // x where a level starts morphing into the next, y 1 / morph length, zw unused
+	glm::vec2 origin;    // world xz of the map's corner, every tile coordinate counts from there
+	float patchSize;     // edge of a level 0 patch, doubles per level
+	float sampleSpacing; // between level 0 height samples, doubles per level
+	uint32_t patchCells; // grid cells along a patch edge
+	uint32_t tileCells;  // height samples along a tile edge minus one
+	uint32_t ringTiles;  // tiles along the edge of a level's ring of tile slots
+	uint32_t padding;
+};
+
+CHECK_BLOCK_OFFSET(TerrainConstants, morphRanges, 0)
+CHECK_BLOCK_OFFSET(TerrainConstants, origin, 192)
+CHECK_BLOCK_OFFSET(TerrainConstants, patchSize, 200)
+CHECK_BLOCK_OFFSET(TerrainConstants, sampleSpacing, 204)
+CHECK_BLOCK_OFFSET(TerrainConstants, patchCells, 208)
+CHECK_BLOCK_OFFSET(TerrainConstants, tileCells, 212)
+CHECK_BLOCK_OFFSET(TerrainConstants, ringTiles, 216)
+CHECK_BLOCK_SIZE(TerrainConstants, 224)
+
+inline ViewConstants MakeViewConstants(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix)
+{
+	ViewConstants constants{};
+	constants.viewMatrix = viewMatrix;
+	constants.projectionMatrix = projectionMatrix;
+	constants.viewProjectionMatrix = projectionMatrix * viewMatrix;
+	constants.cameraPosition = glm::inverse(viewMatrix)[3];
+	return constants;
+}
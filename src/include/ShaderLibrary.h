@@ -0,0 +1,167 @@
+#pragma once
+
+#include "ShaderLoader.h"
+#include "ShaderPreprocessor.h"
+#include "StringID.h"
+
+#include <chrono>
+#include <map>
+
+// One specialization of a declared program, e.g. the vertex pulling version of a surface shader.
+// Defines are sorted and hashed once, build variants at setup and keep them around.
+class ShaderVariant
+{
+public:
+	ShaderVariant(StringID program, ShaderDefines defines = {});
+
+	StringID GetProgram() const { return m_Program; }
+	const ShaderDefines& GetDefines() const { return m_Defines; }
+	uint64_t GetKey() const { return m_Key; }
+
+private:
+	StringID m_Program;
+	ShaderDefines m_Defines;
+	uint64_t m_Key;
+};
+
+enum class ShaderState : uint8_t
+{
+	Missing,   // never requested, or not declared
+	Compiling,
+	Ready,
+	Failed
+};
+
+// Owns the programs by name. A program is declared as a list of stage files and compiled per
+// variant, lazily the first time it is asked for or ahead of time with WarmUp. Stages are run
+// through ShaderPreprocessor, identical stage texts share one shader object and variants made
+// of the same shader objects share one program.
+//
+// Compiles and links are only submitted when a variant is requested, nothing asks the driver for
+// a status until Poll sees the program is done. With GL_KHR_parallel_shader_compile the driver
+// works through all of them on its own threads meanwhile, so a WarmUp of dozens of variants
+// costs the calling thread little more than handing over the sources.
+//
+// Active uniforms and blocks are enumerated once when a program is linked, so looking one up
+// later is a hash map access instead of a glGet*Location call with a string. Lookups are meant
+// for setup, keep the results around for per frame work.
+class ShaderLibrary
+{
+public:
+	ShaderLibrary();
+	~ShaderLibrary();
+
+	void Declare(const std::string& name, const std::vector<std::string>& paths);
+
+	// Declares the program and compiles its variant without defines right away
+	GLuint Register(const std::string& name, const std::vector<std::string>& paths);
+
+	// Compiles on first use and waits until the program is linked, afterwards a hash map lookup.
+	// 0 if it failed.
+	GLuint GetVariant(const ShaderVariant& variant);
+
+	// Same without waiting, 0 while the variant is still compiling. Draws that get 0 are skipped
+	// for the frame.
+	GLuint TryGetVariant(const ShaderVariant& variant);
+
+	ShaderState GetState(const ShaderVariant& variant) const;
+
+	// Submits the compiles ahead of time, so the first frame that needs a variant doesn't stall on it
+	void WarmUp(const std::vector<ShaderVariant>& variants);
+
+	// Once per frame. Finishes every submitted program the driver is done with. Without parallel
+	// compiles asking would wait, so only one is finished per call.
+	void Poll();
+
+	bool IsParallelCompile() const { return m_ParallelCompile; }
+
+	// Variant without defines
+	GLuint GetProgram(StringID name) { return GetVariant(name); }
+
+	// -1 if the variant isn't compiled or has no such active uniform outside of a block
+	GLint GetUniformLocation(const ShaderVariant& variant, StringID uniform) const;
+
+	// Binding point of a uniform or shader storage block, -1 if the variant doesn't use it
+	GLint GetUniformBlockBinding(const ShaderVariant& variant, StringID block) const;
+	GLint GetStorageBlockBinding(const ShaderVariant& variant, StringID block) const;
+
+	// Variants asked for against shader objects and programs actually built
+	void LogStats() const;
+
+private:
+	struct Shader
+	{
+		GLuint id = 0;
+
+		// Source string numbers of the compile log
+		std::vector<std::string> files;
+
+		// Checked by the first program that uses the shader
+		bool validated = false;
+		bool compiled = false;
+	};
+
+	struct Program
+	{
+		GLuint id = 0;
+		ShaderState state = ShaderState::Compiling;
+		std::string name;
+		size_t defineCount = 0;
+		std::vector<Shader*> stages;
+		std::chrono::steady_clock::time_point submitTime;
+
+		std::unordered_map<StringID, GLint, StringIDHash> uniforms;
+		std::unordered_map<StringID, GLint, StringIDHash> uniformBlocks;
+		std::unordered_map<StringID, GLint, StringIDHash> storageBlocks;
+	};
+
+	struct Declaration
+	{
+		std::string name;
+		std::vector<std::string> paths;
+	};
+
+	// Submitted or already known program of the variant, nullptr if it can't be built
+	Program* Request(const ShaderVariant& variant);
+
+	Program* Compile(const ShaderVariant& variant);
+	Shader* GetShader(const std::string& path, const ShaderDefines& defines);
+
+	// Checks the results and enumerates the resources, waits if the driver isn't done yet
+	void Finish(Program& program);
+
+	const Program* FindVariant(const ShaderVariant& variant) const;
+
+	static void CollectResources(GLuint program, GLenum interface, GLenum property, std::unordered_map<StringID, GLint, StringIDHash>& resources);
+
+	// Blocks mirrored in ShaderConstants.h have to sit at the binding the C++ side pushes them to
+	static void ValidateBlockBindings(const std::string& name, const Program& program);
+
+private:
+	ShaderPreprocessor m_Preprocessor;
+
+	std::unordered_map<StringID, Declaration, StringIDHash> m_Declarations;
+
+	// Keyed by ShaderVariant::GetKey
+	std::unordered_map<uint64_t, Program*> m_Variants;
+
+	// Specialized stage text to its shader object. Programs point at the entries.
+	std::unordered_map<std::string, Shader> m_Shaders;
+
+	// Sorted shader objects to the program linked from them
+	std::map<std::vector<GLuint>, std::unique_ptr<Program>> m_Programs;
+
+	// Submitted and not finished yet, oldest first
+	std::vector<Program*> m_Pending;
+
+	bool m_ParallelCompile = false;
+	uint32_t m_StageRequests = 0;
+	uint32_t m_FailedPrograms = 0;
+
+	// On the calling thread, submitting and checking results, including waits for the driver
+	double m_SubmitSeconds = 0.0;
+	double m_FinishSeconds = 0.0;
+
+	// Submit to Ready, the longest one
+	double m_ReadySecondsMax = 0.0;
+};
@@ -0,0 +1,163 @@
+#pragma once
+
+// Compiles and links already preprocessed stages, see ShaderPreprocessor and ShaderLibrary.
+// Compiling and linking only submit the work, the Validate calls wait for it and check the result.
+class ShaderLoader
+{
+public:
+	// Stage from the file extension: vs, fs, gs, tc, te or cs
+	static GLenum GetShaderType(const std::string& path)
+	{
+		const std::string postfix = path.substr(path.find_last_of('.') + 1, path.size());
+
+		if (postfix == "vs") { return GL_VERTEX_SHADER; }
+		else if (postfix == "fs") { return GL_FRAGMENT_SHADER; }
+		else if (postfix == "gs") { return GL_GEOMETRY_SHADER; }
+		else if (postfix == "tc") { return GL_TESS_CONTROL_SHADER; }
+		else if (postfix == "te") { return GL_TESS_EVALUATION_SHADER; }
+		else if (postfix == "cs") { return GL_COMPUTE_SHADER; }
+
+		LOG_ERROR("Invalid shader postfix [%s] upon loading [%s]", postfix.c_str(), path.c_str())
+		assert(false);
+		return GL_NONE;
+	}
+
+	// GL_KHR_parallel_shader_compile or its ARB twin. Compiles and links then run on driver threads
+	// and IsDone can ask whether they finished without waiting for them.
+	static bool SupportsParallelCompile()
+	{
+		return GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile;
+	}
+
+	// Lets the driver use as many compiler threads as it sees fit, if it supports parallel compiles
+	static void EnableParallelCompile()
+	{
+		if (GLEW_KHR_parallel_shader_compile)
+		{
+			glMaxShaderCompilerThreadsKHR(0xffffffff);
+		}
+		else if (GLEW_ARB_parallel_shader_compile)
+		{
+			glMaxShaderCompilerThreadsARB(0xffffffff);
+		}
+	}
+
+	// Starts compiling without asking for the result, see ValidateShader
+	static GLuint CompileShader(GLenum type, const std::string& text)
+	{
+		const char* shaderCstr = text.c_str();
+
+		GLuint shaderHandle = glCreateShader(type);
+		glShaderSource(shaderHandle, 1, &shaderCstr, NULL);
+		glCompileShader(shaderHandle);
+
+		return shaderHandle;
+	}
+
+	// Starts linking without asking for the result, see ValidateProgram. The shaders don't have
+	// to be done compiling.
+	static GLuint LinkProgram(const std::vector<GLuint>& shaders)
+	{
+		GLuint program = glCreateProgram();
+
+		for (GLuint shader : shaders)
+		{
+			glAttachShader(program, shader);
+		}
+
+		glLinkProgram(program);
+
+		// Shaders are shared between programs and deleted by their owner
+		for (GLuint shader : shaders)
+		{
+			glDetachShader(program, shader);
+		}
+
+		return program;
+	}
+
+	// Whether asking for the link status would return right away. Always true without parallel
+	// compiles, the query waits for the driver then.
+	static bool IsProgramDone(GLuint program)
+	{
+		if (!SupportsParallelCompile())
+		{
+			return true;
+		}
+
+		GLint done = GL_FALSE;
+		glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &done);
+		return done == GL_TRUE;
+	}
+
+	// Waits for the compile. files names the source string numbers the compile log refers to.
+	static bool ValidateShader(GLuint shader, const std::vector<std::string>& files)
+	{
+		GLint isCompiled;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &isCompiled);
+
+		if(isCompiled == GL_FALSE)
+		{
+			LOG_ERROR("Compilation failed for shader [%s]", files.front().c_str())
+			for (size_t i = 1; i < files.size(); i++)
+			{
+				LOG_ERROR("  source %zu is [%s]", i, files[i].c_str())
+			}
+			PrintShaderLog(shader);
+			assert(false);
+			return false;
+		}
+
+		return true;
+	}
+
+	// Waits for the link
+	static bool ValidateProgram(GLuint program)
+	{
+		GLint isLinked;
+		glGetProgramiv(program, GL_LINK_STATUS, &isLinked);
+
+		if(isLinked == GL_FALSE)
+		{
+
+			LOG_ERROR("Program [%d] not linked", program)
+			PrintProgramLog(program);
+			assert(false);
+			return false;
+		}
+
+		return true;
+	}
+
+
+private:
+	static void PrintShaderLog(GLuint shader)
+	{
+		int len = 0;
+		int writtenChars = 0;
+
+		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &len);
+
+		if (len > 0)
+		{
+			std::string buffer(len, '\0');
+			glGetShaderInfoLog(shader, len, &writtenChars, &buffer[0]);
+			LOG_ERROR("%s", buffer.c_str())
+		}
+	}
+
+	static void PrintProgramLog(GLuint program)
+	{
+		int len = 0;
+		int writtenChars = 0;
+
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &len);
+
+		if (len > 0)
+		{
+			std::string buffer(len, '\0');
+			glGetProgramInfoLog(program, len, &writtenChars, &buffer[0]);
+			LOG_ERROR("%s", buffer.c_str())
+		}
+	}
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+struct ShaderDefine
+{
+	std::string name;
+	std::string value;
+};
+
+typedef std::vector<ShaderDefine> ShaderDefines;
+
+// One stage file with every #include expanded
+struct ShaderSource
+{
+	std::string text;
+
+	// Index is the source string number #line directives and compile errors refer to, 0 is the
+	// file itself
+	std::vector<std::string> files;
+};
+
+// Front end of the shader compiler. #include "file" is resolved relative to the including file
+// and pulls every file in at most once. Defines are placed right after #version, but only the
+// ones the source mentions, so variants that differ in defines a stage doesn't use produce the
+// same text for it.
+class ShaderPreprocessor
+{
+public:
+	// Expanded once per path, nullptr if a file couldn't be read
+	const ShaderSource* Load(const std::string& path);
+
+	static std::string Specialize(const ShaderSource& source, const ShaderDefines& defines);
+
+private:
+	bool Expand(const std::string& path, ShaderSource& source);
+
+	// Whole identifier, not part of a longer one
+	static bool Mentions(const std::string& text, const std::string& identifier);
+
+private:
+	std::unordered_map<std::string, ShaderSource> m_Sources;
+};
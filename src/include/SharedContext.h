@@ -0,0 +1,12 @@
+#pragma once
+
+class Camera;
+class GeometryManager;
+class Renderer;
+
+struct SharedContext
+{
+	Camera* worldCamera;
+	GeometryManager* geometryManager;
+	Renderer* renderer;
+};
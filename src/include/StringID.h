@@ -0,0 +1,116 @@
+#pragma once
+
+#include <mutex>
+
+// 64 bit FNV-1a hash of a name. Constructing one from a literal is constexpr, so lookups like
+// GetID("triangle") compare integers instead of hashing strings every frame. Names are handed
+// to Register once where they are defined (AddGeometry, ShaderLibrary) which catches two names
+// hashing to the same ID in debug builds.
+class StringID
+{
+public:
+	constexpr StringID()
+		: m_Hash(0)
+	{}
+
+	constexpr StringID(const char* string)
+		: m_Hash(Hash(string, Length(string)))
+	{}
+
+	StringID(const std::string& string)
+		: m_Hash(Hash(string.data(), string.size()))
+	{}
+
+	static constexpr uint64_t Hash(const char* string, size_t length)
+	{
+		uint64_t hash = 0xcbf29ce484222325ull;
+		for (size_t i = 0; i < length; i++)
+		{
+			hash ^= (uint8_t)string[i];
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	// Asserts if a different name already produced the same ID. Only checked in debug builds.
+	static StringID Register(const std::string& string)
+	{
+		const StringID id(string);
+
+#ifndef NDEBUG
+		std::lock_guard<std::mutex> lock(GetRegistryMutex());
+		auto it = GetRegistry().emplace(id.m_Hash, string).first;
+		if (it->second != string)
+		{
+			LOG_ERROR("String ID collision between [%s] and [%s]", it->second.c_str(), string.c_str())
+			assert(false);
+		}
+#endif
+
+		return id;
+	}
+
+	// Name behind a registered ID for log messages, debug builds only
+	static std::string GetString(StringID id)
+	{
+#ifndef NDEBUG
+		std::lock_guard<std::mutex> lock(GetRegistryMutex());
+		auto it = GetRegistry().find(id.m_Hash);
+		if (it != GetRegistry().end())
+		{
+			return it->second;
+		}
+#endif
+
+		char hex[19];
+		snprintf(hex, sizeof(hex), "0x%016llx", (unsigned long long)id.m_Hash);
+		return hex;
+	}
+
+	constexpr uint64_t GetHash() const { return m_Hash; }
+	constexpr bool IsValid() const { return m_Hash != 0; }
+
+	constexpr bool operator==(StringID other) const { return m_Hash == other.m_Hash; }
+	constexpr bool operator!=(StringID other) const { return m_Hash != other.m_Hash; }
+
+private:
+	static constexpr size_t Length(const char* string)
+	{
+		size_t length = 0;
+		while (string[length] != '\0')
+		{
+			length++;
+		}
+		return length;
+	}
+
+#ifndef NDEBUG
+	static std::unordered_map<uint64_t, std::string>& GetRegistry()
+	{
+		static std::unordered_map<uint64_t, std::string> registry;
+		return registry;
+	}
+
+	static std::mutex& GetRegistryMutex()
+	{
+		static std::mutex mutex;
+		return mutex;
+	}
+#endif
+
+private:
+	uint64_t m_Hash;
+};
+
+constexpr StringID operator""_sid(const char* string, size_t)
+{
+	return StringID(string);
+}
+
+struct StringIDHash
+{
+	size_t operator()(StringID id) const
+	{
+		return (size_t)id.GetHash();
+	}
+};
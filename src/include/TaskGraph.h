@@ -0,0 +1,75 @@
+#pragma once
+
+#include "JobSystem.h"
+
+typedef uint32_t TaskID;
+
+// Per frame dependency graph of stages. Built once and run every frame: tasks start on the job
+// system as soon as their dependencies are done, tasks that issue GL calls run on the thread
+// calling Run, which owns the context. Every run records how long each task took and which chain
+// of tasks bounded the frame.
+class TaskGraph
+{
+public:
+	// Dependencies have to be added first, so insertion order is a valid execution order
+	TaskID Add(const std::string& name, std::function<void()> function, std::initializer_list<TaskID> dependencies = {}, bool glThread = false);
+
+	// Replaces the dependencies of a task, e.g. to decouple stages when pipelining is toggled
+	void SetDependencies(TaskID taskID, std::initializer_list<TaskID> dependencies);
+
+	void Run(JobSystem& jobSystem);
+
+	// Per task mean duration and how often it was on the critical path, since the last reset
+	void LogStats() const;
+	void ResetStats();
+
+	double GetLastCriticalPath() const { return m_LastCriticalPath; }
+
+private:
+	struct Task
+	{
+		std::string name;
+		std::function<void()> function;
+		std::vector<TaskID> dependencies;
+		std::vector<TaskID> dependents;
+		bool glThread = false;
+
+		std::atomic<uint32_t> remaining{ 0 };
+		double start = 0.0;
+		double end = 0.0;
+
+		// Accumulated over runs
+		double totalDuration = 0.0;
+		uint32_t criticalRuns = 0;
+	};
+
+	void Launch(TaskID taskID);
+	void Execute(TaskID taskID);
+
+	void UpdateCriticalPath();
+
+	double Now() const;
+
+private:
+	std::vector<std::unique_ptr<Task>> m_Tasks;
+
+	std::mutex m_GLMutex;
+	std::vector<TaskID> m_GLReady;
+	std::atomic<uint32_t> m_Finished{ 0 };
+
+	// Only set during Run
+	JobSystem* m_JobSystem = nullptr;
+	JobCounter* m_Counter = nullptr;
+
+	std::chrono::steady_clock::time_point m_Epoch = std::chrono::steady_clock::now();
+
+	uint32_t m_Runs = 0;
+	double m_TotalWall = 0.0;
+	double m_TotalCriticalPath = 0.0;
+	double m_LastCriticalPath = 0.0;
+	std::vector<TaskID> m_LastCriticalChain;
+
+	// Reused by UpdateCriticalPath, so frames don't allocate
+	std::vector<double> m_PathEnd;
+	std::vector<TaskID> m_PathPrevious;
+};
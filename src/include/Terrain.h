@@ -0,0 +1,260 @@
+#pragma once
+
+#include "Renderer.h"
+
+#include <condition_variable>
+#include <mutex>
+
+class JobSystem;
+
+struct TerrainSettings
+{
+	// World position of the map's corner, generated heights are added to origin.y
+	glm::vec3 origin = glm::vec3(0.f);
+
+	// Quadtree roots along each edge of the map, a root is one patch of the top level
+	uint32_t rootCount = 16;
+	uint32_t levelCount = 5;
+
+	float sampleSpacing = 1.f;
+	uint32_t patchCells = 16;
+
+	// Has to be a multiple of patchCells, a tile holds (tileCells / patchCells)^2 patches of its level
+	uint32_t tileCells = 64;
+
+	// Level 0 is drawn up to lodDistance from the camera, every level after that twice as far. The
+	// last morphRatio of each level's range morphs it into the next.
+	float lodDistance = 80.f;
+	float morphRatio = 0.3f;
+
+	// Generated heights are in [-heightScale, heightScale] around origin.y
+	float heightScale = 30.f;
+	uint32_t seed = 1;
+
+	// Tiles are read from here and the ones that aren't there yet are generated and written, empty
+	// generates every tile
+	std::string tileDirectory;
+
+	// Tiles Update uploads per frame, and tiles loading at once
+	uint32_t uploadTilesPerFrame = 8;
+	uint32_t stagingTiles = 16;
+};
+
+struct TerrainStats
+{
+	uint64_t tilesRequested = 0;
+	uint64_t tilesLoaded = 0;
+	uint64_t tilesFailed = 0;
+	uint64_t tilesRead = 0;
+	uint64_t tilesWritten = 0;
+
+	// Slots that dropped one tile for another
+	uint64_t tilesReplaced = 0;
+
+	// Generating or reading, on the loader thread
+	double loadSeconds = 0.0;
+
+	uint64_t selectFrames = 0;
+	double selectSecondsSum = 0.0;
+	double selectSecondsMax = 0.0;
+	uint64_t patchesSum = 0;
+	uint32_t patchesMax = 0;
+};
+
+// Heightfield terrain drawn as a CDLOD quadtree of patches. Every patch is an instance of one grid
+// geometry, submitted into RenderQueue::Terrain and drawn with the TERRAIN variant of basicVert.vs,
+// which reads the heights and morphs each level into the next one near its range so neighbouring
+// levels meet without cracks, see terrain.glsl.
+//
+// Heights live in square tiles, one level of tiles per LOD level with twice the sample spacing of
+// the level below. Each level keeps its tiles in a ring of ringTiles x ringTiles slots indexed by
+// tile coordinate modulo the ring, which is enough for everything within its range of the camera.
+// Tiles are requested when the selection first needs them, generated or read on a loader thread
+// and uploaded by Update within a budget, so resident memory depends on the view distance and the
+// level count but not on the size of the map. Nodes whose tiles aren't there yet stay at the level
+// above.
+//
+// Select is safe from the stages and spreads the quadtree roots over the JobSystem. Update, Bind
+// and the constructor are GL thread only and Update must not run while a frame's stages do.
+class Terrain
+{
+public:
+	Terrain(GeometryManager& geometryManager, const TerrainSettings& settings = TerrainSettings());
+
+	// Drops whatever is still loading
+	~Terrain();
+
+	Terrain(const Terrain&) = delete;
+	Terrain& operator=(const Terrain&) = delete;
+
+	// The shared patch grid, pin it when a ResidencyManager is in use
+	GeoID GetPatchGeoID() const { return m_PatchGeoID; }
+
+	// Picks the patches for this camera from the tiles that are resident, and notes the missing ones
+	// for the next Update
+	void Select(const glm::vec3& cameraPosition, const glm::mat4& viewProjection, JobSystem* jobSystem = nullptr);
+
+	// The last Select's patches into RenderQueue::Terrain
+	void Submit(Renderer& renderer) const;
+
+	// Once per frame, see above. Requests the tiles the last Select missed and uploads loaded ones
+	// up to the budget. wait blocks until every request is uploaded, for runs that have to come
+	// out the same every time.
+	void Update(bool wait = false);
+
+	// Constants and heights for drawing RenderQueue::Terrain
+	void Bind() const;
+
+	// Height tiles on the GPU, the same for any map size
+	size_t GetResidentBytes() const;
+
+	// Level 0 of the whole map at once, what a single heightfield would take
+	size_t GetMapBytes() const;
+
+	uint32_t GetPendingCount() const { return m_InFlight; }
+	uint32_t GetPatchCount() const { return (uint32_t)m_Patches.size(); }
+
+	const TerrainStats& GetStats() const { return m_Stats; }
+	void LogStats();
+
+	// Tile files hold one tile of (samples x samples) heights, rows along x:
+	//   "GL2H" u32 version, u32 level, u32 tile x, u32 tile z, u32 samples, f32 heights[samples^2]
+	static bool ReadTileFile(const char* path, uint32_t level, uint32_t x, uint32_t z, uint32_t samples, float* heights);
+	static bool WriteTileFile(const char* path, uint32_t level, uint32_t x, uint32_t z, uint32_t samples, const float* heights);
+
+private:
+	struct TileKey
+	{
+		uint32_t level;
+		uint32_t x;
+		uint32_t z;
+
+		bool operator==(const TileKey& other) const { return level == other.level && x == other.x && z == other.z; }
+	};
+
+	enum class TileState : uint8_t
+	{
+		Empty,
+		Loading,
+		Ready,
+		Failed
+	};
+
+	struct TileSlot
+	{
+		TileKey key{};
+		TileState state = TileState::Empty;
+
+		// Frame of the last Select that drew from it, the slot isn't reused while a frame in
+		// flight may still read it
+		uint64_t lastUsedFrame = 0;
+
+		// Lowest and highest height per patch of the tile, rows along x
+		std::vector<glm::vec2> patchBounds;
+	};
+
+	// Loader thread memory for one tile, reused
+	struct StagingTile
+	{
+		TileKey key{};
+		uint32_t slot = 0;
+		bool succeeded = false;
+		bool read = false;
+		bool written = false;
+
+		std::vector<float> heights;
+		std::vector<glm::vec2> patchBounds;
+	};
+
+	struct Patch
+	{
+		uint32_t level;
+		uint32_t x;
+		uint32_t z;
+		glm::vec2 bounds;
+		uint32_t slot;
+	};
+
+	struct SelectContext
+	{
+		glm::vec3 cameraPosition;
+		glm::vec4 frustumPlanes[6];
+	};
+
+	// Written by the job that selects one root
+	struct RootSelection
+	{
+		std::vector<Patch> patches;
+		std::vector<TileKey> missing;
+	};
+
+	// Slot of the key's tile in its level's ring, the same as TerrainSlot in terrain.glsl
+	uint32_t GetSlot(const TileKey& key) const
+	{
+		return (key.level * m_RingTiles + key.z % m_RingTiles) * m_RingTiles + key.x % m_RingTiles;
+	}
+
+	// nullptr unless the tile is uploaded
+	const TileSlot* FindTile(const TileKey& key) const;
+
+	// The tile of a patch at level, and the patch's bounds inside it
+	TileKey GetPatchTile(uint32_t level, uint32_t x, uint32_t z) const;
+	glm::vec2 GetPatchBounds(const TileSlot& tile, uint32_t x, uint32_t z) const;
+
+	// False if the node is beyond its level's range, then the parent draws that quarter
+	bool SelectNode(const SelectContext& context, uint32_t level, uint32_t x, uint32_t z, const glm::vec2& bounds, RootSelection& selection) const;
+
+	float GetPatchSize(uint32_t level) const { return m_Settings.sampleSpacing * m_Settings.patchCells * (float)(1u << level); }
+
+	void LoaderLoop();
+	void Load(StagingTile& staging) const;
+	void Generate(const TileKey& key, float* heights) const;
+
+	// Procedural height at a position relative to the map's corner
+	float GenerateHeight(double x, double z) const;
+
+	void Upload(uint32_t stagingIndex);
+
+private:
+	TerrainSettings m_Settings;
+
+	GeoID m_PatchGeoID;
+	uint32_t m_TilePatches; // patches along a tile edge
+	uint32_t m_TileSamples; // samples along a tile edge
+	uint32_t m_RingTiles;
+
+	// Per level, where the level ends
+	std::vector<float> m_Ranges;
+
+	TerrainConstants m_Constants;
+	GLuint m_ConstantBuffer;
+	GLuint m_HeightBuffer;
+
+	// Read by Select, written by Update
+	std::vector<TileSlot> m_Slots;
+	uint64_t m_Frame;
+
+	// Select's output, one selection per root, merged in root order
+	std::vector<RootSelection> m_RootSelections;
+	std::vector<Patch> m_Patches;
+	std::vector<TileKey> m_Missing;
+
+	// Staging tiles nobody is loading into, GL thread only
+	std::vector<uint32_t> m_FreeStaging;
+	uint32_t m_InFlight;
+
+	TerrainStats m_Stats;
+
+	// Loader side, everything below is guarded by m_Mutex. The queues hold staging tile indices and
+	// never grow past the staging tile count.
+	std::vector<StagingTile> m_Staging;
+	std::mutex m_Mutex;
+	std::condition_variable m_RequestCondition;
+	std::condition_variable m_LoadedCondition;
+	std::vector<uint32_t> m_Requests;
+	std::vector<uint32_t> m_Loaded;
+	bool m_Stop;
+	double m_LoadSeconds;
+
+	std::thread m_Thread;
+};
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "MeshCodec.h"
+
+// Binary trace of everything the renderer is fed: geometry uploads, views and submits, grouped
+// into frames. Recorded by hooking a TraceRecorder into the GeometryManager and Renderer, and
+// played back by the replay target.
+//
+// Layout, native endianness:
+//   header   "GL2T" u32 version
+//   records  u8 type followed by its payload
+//     Geometry   u32 geoID, u16 name length, name, u32 vertex count, u32 vertex size, u32 index count,
+//                vec3 bounds center, f32 bounds radius, u32 bytes, MeshCodec vertices, u32 bytes, MeshCodec indices
+//     FrameBegin
+//     View       mat4 view, mat4 projection
+//     SubmitRun  u32 geoID, u32 count, count * 3x4 affine model matrices (columns, w row dropped)
+//     SubmitFull u32 geoID, mat4 model, for the rare transform with a projective row
+//     FrameEnd
+
+// Version 1 stored geometry uncompressed (u32 vertex bytes, vertices, u32 element count, elements),
+// it is still read and encoded while loading
+#define TRACE_VERSION 2
+
+enum class TraceRecord : uint8_t
+{
+	Geometry = 1,
+	FrameBegin,
+	View,
+	SubmitRun,
+	SubmitFull,
+	FrameEnd
+};
+
+class TraceRecorder
+{
+public:
+	TraceRecorder() = default;
+	~TraceRecorder();
+
+	TraceRecorder(const TraceRecorder&) = delete;
+	TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+	bool Open(const std::string& path);
+	void Close();
+	bool IsOpen() const { return m_File != nullptr; }
+
+	void RecordGeometry(uint32_t geoID, const std::string& name, const EncodedMesh& mesh);
+	void BeginFrame();
+	void RecordView(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
+	void RecordSubmit(uint32_t geoID, const glm::mat4& modelTransform);
+
+	// Writes the buffered frame out in one go
+	void EndFrame();
+
+	uint64_t GetFrameCount() const { return m_FrameCount; }
+	uint64_t GetBytesWritten() const { return m_BytesWritten; }
+
+private:
+	void FlushRun();
+
+	template<typename T>
+	void Write(const T& value)
+	{
+		const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+		m_Buffer.insert(m_Buffer.end(), bytes, bytes + sizeof(T));
+	}
+	void Write(const void* data, size_t bytes);
+
+private:
+	FILE* m_File = nullptr;
+	std::vector<uint8_t> m_Buffer;
+
+	// Consecutive submits of the same geometry share one record header
+	uint32_t m_RunGeoID = 0;
+	std::vector<float> m_RunTransforms;
+
+	uint64_t m_FrameCount = 0;
+	uint64_t m_BytesWritten = 0;
+};
+
+struct TraceGeometry
+{
+	uint32_t geoID;
+	std::string name;
+
+	// Stays encoded until GeometryManager decodes it into the geometry buffers
+	EncodedMesh mesh;
+};
+
+struct TraceView
+{
+	glm::mat4 viewMatrix;
+	glm::mat4 projectionMatrix;
+};
+
+struct TraceSubmit
+{
+	uint32_t geoID;
+	glm::mat4 modelTransform;
+};
+
+// Ranges into the flat arrays of the Trace. Geometry in a frame's range was added before it began.
+struct TraceFrame
+{
+	uint32_t firstGeometry, geometryCount;
+	uint32_t firstView, viewCount;
+	uint32_t firstSubmit, submitCount;
+};
+
+// Whole trace decoded up front, so replay timings don't include any file access
+struct Trace
+{
+	std::vector<TraceGeometry> geometry;
+	std::vector<TraceView> views;
+	std::vector<TraceSubmit> submits;
+	std::vector<TraceFrame> frames;
+
+	// Fails on traces whose geometry IDs don't run from 1 in record order, or that submit
+	// geometry not recorded before the submit
+	static bool Load(const std::string& path, Trace& trace);
+};
@@ -1,16 +1,29 @@
-#define GLEW_STATIC
-#define GLFW_INCLUDE_NONE
-
-
-
-
-#include <Gl/glew.h>
-#include <GLFW/glfw3.h>
-
-
-#include <glm/glm.hpp>
-#include <glm/gtc/matrix_transform.hpp>
-#include <glm/gtc/type_ptr.hpp>
+#include "Camera.h"
+#include "FrameScheduler.h"
+#include "GeometryManager.h"
+#include "MeshGenerator.h"
+#include "Renderer.h"
+#include "SharedContext.h"
+#include "CameraPath.h"
+#include "Framebuffer.h"
+#include "ShaderLibrary.h"
+#include "ShaderConstants.h"
+#include "ConstantBufferRing.h"
+#include "ResidencyManager.h"
+#include "AssetLoader.h"
+#include "GpuCulling.h"
+#include "Terrain.h"
+#include "FrameCapture.h"
+#include "TaskGraph.h"
+#include "FrameArena.h"
+#include "GLState.h"
+#include "AllocationCounter.h"
+
+#include <filesystem>
+
+#ifdef GL2_HEADLESS
+#include "HeadlessContext.h"
+#endif
 
 void DebugCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam)
 {
@@ -42,1090 +55,1432 @@ void DebugCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsiz
 }
 
 
-class Camera;
-class GeometryManager;
+void windowCloseFun(GLFWwindow* window)
+{
+	glfwDestroyWindow(window);
+	LOG_INFO("Destroyed window")
+}
 
-struct SharedContext
+void WindowSizeCallback(GLFWwindow* window, int width, int height)
 {
-	Camera* worldCamera;
-	GeometryManager* geometryManager;
-};
+	glViewport(0, 0, width, height);
+	auto sharedContext = static_cast<SharedContext*>(glfwGetWindowUserPointer(window));
+	sharedContext->worldCamera->SetAspectRatio((float)width / (float)height);
+}
+
 
-class Camera
+void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
-public:
-	Camera(float aspectRatio)
-		:m_AspectRatio(aspectRatio)
+	if (key == GLFW_KEY_P && action == GLFW_PRESS)
 	{
-		GLFWwindow* context = glfwGetCurrentContext();
-		glfwGetCursorPos(context, &m_CursorLastX, &m_CursorLastY);
+		auto sharedContext = static_cast<SharedContext*>(glfwGetWindowUserPointer(window));
+		const bool pulling = sharedContext->renderer->GetDrawPath() == DrawPath::VertexAttributes;
+		sharedContext->renderer->SetDrawPath(pulling ? DrawPath::VertexPulling : DrawPath::VertexAttributes);
+		LOG_INFO("Draw path: %s", pulling ? "vertex pulling" : "vertex attributes")
 	}
 
-	glm::mat4& GetViewMatrix()
+	if(key == GLFW_KEY_9 && action == GLFW_PRESS)
 	{
-		if (m_ViewIsDirty)
-		{
-			m_ViewIsDirty = false;
-
-			m_ViewMatrix = glm::lookAt(
-				m_Position,
-				m_Position + CalculateForwardVector(),
-				m_Up
-			);
-		}
-		return m_ViewMatrix;
+		GLState::Get().PolygonMode(GL_FILL);
 	}
-
-	glm::mat4& GetPerspectiveMatrix()
+	if (key == GLFW_KEY_0 && action == GLFW_PRESS)
 	{
-		if (m_PerspectiveIsDirty)
-		{
-			m_PerspectiveIsDirty = false;
-
-			m_PerspectiveProjection = glm::perspective(
-				glm::radians(m_Fov),
-				m_AspectRatio,
-				m_NearZ,
-				m_FarZ
-			);
-		}
-
-		return m_PerspectiveProjection;
+		GLState::Get().PolygonMode(GL_LINE);
 	}
+}
 
-	void Update(const float dt)
-	{
-		GLFWwindow* context = glfwGetCurrentContext();
-
-		// Preven't the camera from losing horizontal speed when looking up or down
-		const glm::vec3 forward = CalculateForwardVector();
-		const glm::vec3 horizontalDir = { forward.x, 0, forward.z };
-		const glm::vec3 direction = glm::normalize(horizontalDir);
-
-
-		float moveSpeed = m_BaseSpeed;
-		if(glfwGetKey(context, GLFW_KEY_E))
-		{
-			moveSpeed *= m_SpeedModifier;
-		}
+void PrintSupportedExtensions()
+{
+	GLint noExtensions = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &noExtensions);
 
-		if(glfwGetKey(context, GLFW_KEY_W))
-		{
-			Translate(glm::vec3(direction.x, 0, direction.z) * moveSpeed * dt);
-		}
 
-		if(glfwGetKey(context, GLFW_KEY_S))
-		{
-			Translate(glm::vec3(-direction.x, 0, -direction.z) * moveSpeed * dt);
-		}
+	for (int i = 0; i < noExtensions; i++)
+	{
+		std::cout << glGetStringi(GL_EXTENSIONS, i) << '\n';
+	}
+}
 
-		if (glfwGetKey(context, GLFW_KEY_A))
-		{
-			Translate(glm::vec3(direction.z, 0, -direction.x) * moveSpeed * dt);
-		}
+bool IsExtensionSupported(const std::string& name)
+{
+	GLint noExtensions = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &noExtensions);
 
-		if (glfwGetKey(context, GLFW_KEY_D))
+	std::set<std::string> oglExtensions;
+	for (int i = 0; i < noExtensions; i++)
+	{
+		if(strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name.c_str()) == 0)
 		{
-			Translate(glm::vec3(-direction.z, 0, direction.x) * moveSpeed * dt);
+			return true;
 		}
+	}
 
-		if (glfwGetKey(context, GLFW_KEY_LEFT_CONTROL))
-		{
-			Translate(glm::vec3(0.f, -1, 0.f) * moveSpeed * dt);
-		}
+	return false;
+}
 
-		if (glfwGetKey(context, GLFW_KEY_SPACE))
-		{
-			Translate(glm::vec3(0.f, 1, 0.f) * moveSpeed * dt);
-		}
 
-		double currentCursorX, currentCursorY;
-		glfwGetCursorPos(context, &currentCursorX, &currentCursorY);
+struct AppSettings
+{
+	bool headless = false;
+	int width = 2560;
+	int height = 1440;
 
-		const double mouseDeltaX = currentCursorX - m_CursorLastX;
-		const double mouseDeltaY = currentCursorY - m_CursorLastY;
+	// Headless only, the windowed mode runs until the window is closed
+	uint32_t frameCount = 600;
+	std::string cameraPath;
 
-		m_CursorLastX = currentCursorX;
-		m_CursorLastY = currentCursorY;
+	// Empty disables capturing
+	std::string capturePath;
+	CaptureFormat captureFormat = CaptureFormat::Y4M;
 
-		if(abs(mouseDeltaX) > m_MouseThreshhold || abs(mouseDeltaY) > m_MouseThreshhold)
-			Rotate(glm::vec3(-mouseDeltaY, mouseDeltaX, 0) * dt * m_RotationSpeed);
-	}
+	// Empty disables recording, play traces back with the replay target
+	std::string recordPath;
 
-	void SetAspectRatio(float aspectRatio)
-	{
-		m_PerspectiveIsDirty = true;
-		m_AspectRatio = aspectRatio;
-	}
+	// Toggled with P in windowed mode
+	DrawPath drawPath = DrawPath::VertexAttributes;
 
-	void SetFov(float fov)
-	{
-		m_PerspectiveIsDirty = true;
-		m_Fov = fov;
-	}
+	// Also draws every vertex as a quad, the geometry shader expansion vs instanced strips
+	bool pointQuads = false;
 
-	void SetNearFarPlane(float near, float far)
-	{
-		m_PerspectiveIsDirty = true;
-		m_NearZ = near;
-		m_FarZ = far;
-	}
+	// Geometry memory budget in megabytes, 0 keeps everything resident
+	uint32_t geometryBudget = 0;
 
-	void SetPosition(const glm::vec3& position)
-	{
-		m_Position = position;
-		m_ViewIsDirty = true;
-	}
+	// Builds frame N+1 on the job system while the GL thread draws frame N, one frame more latency
+	bool pipeline = false;
 
-	void Translate(glm::vec3&& step)
-	{
-		m_Position += step;
-		m_ViewIsDirty = true;
-	}
+	// Fails the run if a frame after the warm up allocated from the heap, needs a build with
+	// GL2_COUNT_ALLOCATIONS
+	bool checkAllocations = false;
 
-	void SetRotation(const glm::vec3& rotation)
-	{
-		m_Rotation = rotation;
-		m_Rotation.x = std::clamp(m_Rotation.x, -89.f, 89.f);
+	// Frame pacing, see FrameSchedulerSettings. 0 fps doesn't pace, 0 frames in flight skips the
+	// fences.
+	bool lowLatency = false;
+	double targetFrameRate = 0.0;
+	uint32_t maxFramesInFlight = 2;
 
-		m_ViewIsDirty = true;
-	}
+	// Headless only, checks every frame against the timing the pacing settings give on the manual
+	// clock and fails the run on a mismatch
+	bool checkFrameTiming = false;
 
-	void Rotate(const glm::vec3& angles)
-	{
-		m_Rotation += angles;
-		m_Rotation.x = std::clamp(m_Rotation.x, -89.f, 89.f);
+	// Orders instances by depth, opaque front to back and transparent back to front
+	bool depthSort = false;
 
-		LOG_INFO("%f, %f, %f", m_Rotation.x,m_Rotation.y, m_Rotation.z)
-		m_ViewIsDirty = true;
-	}
+	// Every second column of the grid goes into the transparent queue and is blended
+	bool transparent = false;
 
-private:
+	// Generated meshes requested from the AssetLoader a few frames in, drawn as the line strip
+	// until each is uploaded
+	uint32_t streamMeshes = 0;
 
-	[[nodiscard]] glm::vec3 CalculateForwardVector() const
-	{
-		return
-		{
-			cos(glm::radians(m_Rotation.x)) * cos(glm::radians(m_Rotation.y)),
-			sin(glm::radians(m_Rotation.x)),
-			sin(glm::radians(m_Rotation.y)) * cos(glm::radians(m_Rotation.x))
-		};
-	}
+	// Streams those meshes from mesh files in this directory instead of generating them on the
+	// loader threads. The missing files are generated and written before the run.
+	std::string meshFiles;
 
-private:
-	glm::mat4 m_ViewMatrix = glm::mat4(1.f);
-	glm::mat4 m_PerspectiveProjection = glm::mat4(1.f);
+	// Submits the grid as one instance range per column plus a seeded scatter of cubes below it,
+	// expanded in the vertex shader instead of submitted instance by instance
+	bool instanceRanges = false;
 
-	glm::vec3 m_Position = {0.f, 0.f, 5.f};
-	glm::vec3 m_Rotation = {0.f, -90.f, 0.f};
-	glm::vec3 m_Up = {0.f, 1.f, 0.f};
+	// Scatters this many cubes around the grid as renderables, to compare the culling paths on
+	uint32_t cubeField = 0;
 
-	float m_Fov = 45.f;
-	float m_AspectRatio;
-	float m_NearZ = 0.1f;
-	float m_FarZ = 1000.f;
+	// Culls the grid and the cube field with compute shaders that write the indirect commands,
+	// the check compares every frame against the same culling on the CPU and fails the run on a
+	// mismatch
+	bool gpuCulling = false;
+	bool checkGpuCulling = false;
 
-	bool m_ViewIsDirty = true;
-	bool m_PerspectiveIsDirty = true;
+	// Streamed heightfield below the scene, drawn as CDLOD patches. Tiles are generated unless a
+	// directory is given, then they are read from there and the missing ones written.
+	bool terrain = false;
+	std::string terrainTiles;
 
-	float m_BaseSpeed = 2.f;
-	float m_SpeedModifier = 10.f;
-	float m_RotationSpeed = 6.f;
+	// Draws this many cubes, spheres and squares one DrawIndexed call at a time, left to the
+	// renderer to batch. With --transparent every second one is blended.
+	uint32_t immediateDraws = 0;
 
-	double m_CursorLastX = 0;
-	double m_CursorLastY = 0;
-	double m_MouseThreshhold = 0.0001;
+	// A second view from above on the right half of the target, culled, packed and uploaded in the
+	// same pass as the main camera on the left half
+	bool splitScreen = false;
 };
 
-void windowCloseFun(GLFWwindow* window)
-{
-	glfwDestroyWindow(window);
-	LOG_INFO("Destroyed window")
-}
-
-void WindowSizeCallback(GLFWwindow* window, int width, int height)
+void PrintUsage()
 {
-	glViewport(0, 0, width, height);
-	auto sharedContext = static_cast<SharedContext*>(glfwGetWindowUserPointer(window));
-	sharedContext->worldCamera->SetAspectRatio((float)width / (float)height);
+	std::cout << "Usage: main [--headless] [--width <px>] [--height <px>] [--frames <n>] [--camera-path <file>]\n"
+		"            [--capture <file|%05d pattern|\"|command\">] [--capture-format raw|ppm|y4m]\n"
+		"            [--record <trace>] [--draw-path attributes|pulling] [--point-quads]\n"
+		"            [--geometry-budget <mb>] [--pipeline] [--check-allocations]\n"
+		"            [--depth-sort] [--transparent] [--stream-meshes <n>] [--mesh-files <dir>]\n"
+		"            [--instance-ranges] [--cube-field <n>] [--gpu-culling] [--check-gpu-culling]\n"
+		"            [--terrain] [--terrain-tiles <dir>] [--immediate-draws <n>]\n"
+		"            [--split-screen] [--low-latency] [--target-fps <hz>] [--frames-in-flight <n>]\n"
+		"            [--check-frame-timing]\n";
 }
 
-
-#define VERTEX_BUFFER_SIZE 1024 * 1024 * 16 //16mb
-#define ELEMENT_BUFFER_SIZE 1024 * 1024 * 16 //16mb
-
-struct Geometry
-{
-	GLsizei elementCount;
-	GLuint firstIndex;
-	GLint baseVertex;
-
-};
-
-#define SIZE_OF_VERTEX 12 // in bytes
-
-typedef uint32_t GeoID;
-class GeometryManager
+bool ParseArguments(int argc, char** argv, AppSettings& settings)
 {
-public:
-	GeometryManager()
-		: m_VertexBuffer(0)
-		, m_ElementBuffer(0)
-		, m_VertexBufferTop(0)
-		, m_ElementBufferTop(0)
-		, m_Indices(0)
-		, m_NextID(1)
+	for (int i = 1; i < argc; i++)
 	{
-		glCreateBuffers(1, &m_VertexBuffer);
-		glNamedBufferData(m_VertexBuffer, VERTEX_BUFFER_SIZE, nullptr, GL_STATIC_DRAW);
-
-		glCreateBuffers(1, &m_ElementBuffer);
-		glNamedBufferData(m_ElementBuffer, ELEMENT_BUFFER_SIZE, nullptr, GL_STATIC_DRAW);
-
+		const std::string argument = argv[i];
+		const bool hasValue = i + 1 < argc;
+
+		if (argument == "--headless") { settings.headless = true; }
+		else if (argument == "--width" && hasValue) { settings.width = std::atoi(argv[++i]); }
+		else if (argument == "--height" && hasValue) { settings.height = std::atoi(argv[++i]); }
+		else if (argument == "--frames" && hasValue) { settings.frameCount = (uint32_t)std::atoi(argv[++i]); }
+		else if (argument == "--camera-path" && hasValue) { settings.cameraPath = argv[++i]; }
+		else if (argument == "--record" && hasValue) { settings.recordPath = argv[++i]; }
+		else if (argument == "--point-quads") { settings.pointQuads = true; }
+		else if (argument == "--pipeline") { settings.pipeline = true; }
+		else if (argument == "--check-allocations") { settings.checkAllocations = true; }
+		else if (argument == "--low-latency") { settings.lowLatency = true; }
+		else if (argument == "--target-fps" && hasValue) { settings.targetFrameRate = std::atof(argv[++i]); }
+		else if (argument == "--frames-in-flight" && hasValue) { settings.maxFramesInFlight = (uint32_t)std::atoi(argv[++i]); }
+		else if (argument == "--check-frame-timing") { settings.checkFrameTiming = true; }
+		else if (argument == "--depth-sort") { settings.depthSort = true; }
+		else if (argument == "--transparent") { settings.transparent = true; }
+		else if (argument == "--geometry-budget" && hasValue) { settings.geometryBudget = (uint32_t)std::atoi(argv[++i]); }
+		else if (argument == "--stream-meshes" && hasValue) { settings.streamMeshes = (uint32_t)std::atoi(argv[++i]); }
+		else if (argument == "--mesh-files" && hasValue) { settings.meshFiles = argv[++i]; }
+		else if (argument == "--instance-ranges") { settings.instanceRanges = true; }
+		else if (argument == "--cube-field" && hasValue) { settings.cubeField = (uint32_t)std::atoi(argv[++i]); }
+		else if (argument == "--gpu-culling") { settings.gpuCulling = true; }
+		else if (argument == "--check-gpu-culling") { settings.gpuCulling = true; settings.checkGpuCulling = true; }
+		else if (argument == "--terrain") { settings.terrain = true; }
+		else if (argument == "--terrain-tiles" && hasValue) { settings.terrain = true; settings.terrainTiles = argv[++i]; }
+		else if (argument == "--split-screen") { settings.splitScreen = true; }
+		else if (argument == "--immediate-draws" && hasValue) { settings.immediateDraws = (uint32_t)std::atoi(argv[++i]); }
+		else if (argument == "--draw-path" && hasValue)
+		{
+			const std::string drawPath = argv[++i];
+			if (drawPath == "attributes") { settings.drawPath = DrawPath::VertexAttributes; }
+			else if (drawPath == "pulling") { settings.drawPath = DrawPath::VertexPulling; }
+			else
+			{
+				LOG_ERROR("Unknown draw path [%s]", drawPath.c_str())
+				return false;
+			}
+		}
+		else if (argument == "--capture" && hasValue) { settings.capturePath = argv[++i]; }
+		else if (argument == "--capture-format" && hasValue)
+		{
+			if (!FrameCapture::ParseFormat(argv[++i], settings.captureFormat))
+			{
+				LOG_ERROR("Unknown capture format [%s]", argv[i])
+				return false;
+			}
+		}
+		else
+		{
+			LOG_ERROR("Unknown argument [%s]", argument.c_str())
+			return false;
+		}
 	}
 
-	~GeometryManager()
+	// Windowed frames run on the steady clock, their timing depends on the machine
+	if (settings.checkFrameTiming && !settings.headless)
 	{
-		// delete buffers
+		LOG_ERROR("--check-frame-timing needs --headless")
+		return false;
 	}
 
-	// TODO Rausfinden was baseVertex und firstIndex sind
-
-	void AddGeometry(const std::string& name, void* vertexData, GLsizeiptr bytes, uint32_t* elementData, uint32_t elementCount)
+	// Traces carry neither the render queue nor the heights, a replay would draw the patches as
+	// flat opaque grids
+	if (settings.terrain && !settings.recordPath.empty())
 	{
-		assert(m_VertexBufferTop + bytes < VERTEX_BUFFER_SIZE);
-		assert(m_ElementBufferTop + elementCount * 4 < ELEMENT_BUFFER_SIZE);
-
-		Geometry& geometry = m_Geometry[m_NextID];
-		geometry.elementCount = elementCount;
-		geometry.firstIndex = m_Indices;
-		geometry.baseVertex = (GLint)m_VertexBufferTop / SIZE_OF_VERTEX;
-
-
-		m_Indices += elementCount;
-
-		glNamedBufferSubData(m_VertexBuffer, m_VertexBufferTop, bytes, vertexData);
-		m_VertexBufferTop += bytes;
-
-		glNamedBufferSubData(m_ElementBuffer, m_ElementBufferTop, elementCount * sizeof(uint32_t), (void*)elementData);
-		m_ElementBufferTop += elementCount * sizeof(uint32_t);
-
-		assert(m_NameToGeoID.find(name) == m_NameToGeoID.end());
-		m_NameToGeoID[name] = m_NextID++;
+		LOG_ERROR("--record can't be combined with --terrain")
+		return false;
 	}
 
-	GLuint GetVertexBufferID()
+	// Every cube and every immediate draw in each view takes an instance of a frame slot's region,
+	// which the renderer only asserts on. The grid, the terrain patches and the range descriptors
+	// fit in what is held back.
+	const uint64_t instanceCapacity = INSTANCE_REGION_CAPACITY - 4096;
+	const uint64_t immediateViews = settings.splitScreen ? 2 : 1;
+	if (settings.immediateDraws * immediateViews > instanceCapacity)
 	{
-		return m_VertexBuffer;
+		settings.immediateDraws = (uint32_t)(instanceCapacity / immediateViews);
+		LOG_WARN("--immediate-draws clamped to %u, the instance region holds no more", settings.immediateDraws)
 	}
-
-	GLuint GetElementBufferID()
+	const uint64_t fieldCapacity = instanceCapacity - settings.immediateDraws * immediateViews;
+	if (settings.cubeField > fieldCapacity)
 	{
-		return m_ElementBuffer;
+		settings.cubeField = (uint32_t)fieldCapacity;
+		LOG_WARN("--cube-field clamped to %u, the instance region holds no more", settings.cubeField)
 	}
 
-	size_t GetGeoCount()
+	return settings.width > 0 && settings.height > 0;
+}
+
+// Headless frames run on the manual clock and cost exactly one fixed step, which present advances
+// it by, so frame n has to end at n paced intervals plus that step. The input is sampled right
+// before the step with low latency and at the end of the previous frame without.
+bool CheckFrameTiming(const FrameScheduler& scheduler, double now)
+{
+	const FrameSchedulerSettings& settings = scheduler.GetSettings();
+	const double cost = settings.fixedTimestep;
+	const double interval = std::max(cost, settings.targetFrameRate > 0.0 ? 1.0 / settings.targetFrameRate : 0.0);
+	const uint64_t frame = scheduler.GetFrameIndex() - 1;
+	const double tolerance = 1e-6;
+
+	const double expectedEnd = frame * interval + cost;
+	const double inputTime = settings.lowLatency ? expectedEnd - cost : (frame > 0 ? expectedEnd - interval : 0.0);
+	const double expectedLatency = settings.lowLatency || frame == 0 ? cost : interval;
+
+	// Everything up to the input is either simulated or still in the accumulator, less than a step
+	const double simulated = (scheduler.GetStepCount() + scheduler.GetDroppedSteps()) * cost;
+	const double latency = scheduler.GetInputLatencies().GetMax();
+
+	if (std::abs(now - expectedEnd) > tolerance || std::abs(latency - expectedLatency) > tolerance
+		|| simulated > inputTime + tolerance || simulated + cost < inputTime - tolerance)
 	{
-		return m_NextID - 1;
+		LOG_ERROR("Frame %llu timing: ended at %.6f s, expected %.6f s, input latency %.6f s, expected %.6f s, simulated %.6f s of %.6f s",
+			(unsigned long long)frame, now, expectedEnd, latency, expectedLatency, simulated, inputTime)
+		return false;
 	}
+	return true;
+}
 
-	GeoID GetID(const std::string name)
-	{
-		auto it = m_NameToGeoID.find(name);
-		if(it == m_NameToGeoID.end())
-		{
-			return 0;
-		}
 
-		return it->second;
+int main(int argc, char** argv)
+{
+	AppSettings settings;
+	if (!ParseArguments(argc, argv, settings))
+	{
+		PrintUsage();
+		return 1;
 	}
 
-	Geometry& GetGeometry(GeoID geoID)
+	if (settings.checkAllocations && !AllocationCounter::IsEnabled())
 	{
-		assert(m_Geometry.find(geoID) != m_Geometry.end());
-		return m_Geometry[geoID];
+		std::cout << "Built without allocation counting, configure with GL2_COUNT_ALLOCATIONS=ON\n";
+		return 1;
 	}
 
-private:
-	GLuint m_VertexBuffer;
-	GLuint m_ElementBuffer;
-
-	GLintptr m_VertexBufferTop;
-	GLintptr m_ElementBufferTop;
-	GLuint m_Indices;
-
-	GeoID m_NextID;
-
-	std::unordered_map<std::string, GeoID> m_NameToGeoID;
-	std::unordered_map<GeoID, Geometry> m_Geometry;
+	GLFWwindow* window = nullptr;
 
-};
-
-struct Renderable
-{
-	GeoID geoID;
-	glm::mat4 modelTransform;
-};
-
-#define INSTANCE_BUFFER_DATA_SIZE 1024 * 1024 * 128 // 64mb
-
-class Renderer
-{
-private:
-	struct InstanceData
-	{
-		glm::mat4 modelTransform = glm::mat4(1.f);
-	};
+#ifdef GL2_HEADLESS
+	HeadlessContext headlessContext;
+#endif
 
-	struct DrawData
+	if (settings.headless)
 	{
-		GeoID geoID;
-		uint32_t instanceCount;
-		std::vector<InstanceData> instanceData{};
-	};
-
-	struct DrawCommand
+#ifdef GL2_HEADLESS
+		if (!headlessContext.Create(4, 6))
+		{
+			std::cout << "Couldn't create headless context\n";
+			abort();
+		}
+#else
+		std::cout << "Built without headless support, configure with GL2_HEADLESS=ON\n";
+		return 1;
+#endif
+	}
+	else
 	{
-		GLuint elementCount;
-		GLuint instanceCount;
-		GLuint firstIndex;
-		GLint baseVertex;
-		GLuint baseInstance;
-	};
+		if (glfwInit() != GLFW_TRUE)
+		{
+			std::cout << "Couldn't initialize GLFW\n";
+			abort();
+		}
 
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-public:
-	Renderer()
-		: m_VertexArray(0)
-		, m_InstanceDataBuffer{0,0}
-		, m_PersistentInstanceDataBuffer(0)
-		, m_DrawIndirectBuffer(0)
-		, m_GeoManagerGeoCount(0)
-		, m_InstanceDataBufferTop(0)
-	{
-		glCreateVertexArrays(1, &m_VertexArray);
+		window = glfwCreateWindow(settings.width, settings.height, "Init", NULL, NULL);
 
-		glCreateBuffers(2, m_InstanceDataBuffer);
+		if (!window)
+		{
 
-		glNamedBufferData(m_InstanceDataBuffer[0], INSTANCE_BUFFER_DATA_SIZE, nullptr, GL_STATIC_DRAW);
-		glNamedBufferData(m_InstanceDataBuffer[1], INSTANCE_BUFFER_DATA_SIZE, nullptr, GL_STATIC_DRAW);
+			std::cout << "Couln't initialize window\n";
+			glfwTerminate();
+			abort();
+		}
 
+		glfwMakeContextCurrent(window);
+	}
 
-		m_SyncObject = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	// A GLX build of GLEW loads every GL entry point and only then fails to find a GLX display,
+	// which is expected with an EGL context
+	const GLenum glewStatus = glewInit();
+	if (glewStatus != GLEW_OK && !(settings.headless && glewStatus == GLEW_ERROR_NO_GLX_DISPLAY))
+	{
+		std::cout << "Couldn't initialize GLEW\n";
+		glfwTerminate();
+		abort();
+	}
 
-		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
-		glCreateBuffers(1, &m_PersistentInstanceDataBuffer);
-		glNamedBufferStorage(m_PersistentInstanceDataBuffer, INSTANCE_BUFFER_DATA_SIZE, nullptr, flags);
+	SharedContext sharedContext{};
+	Camera camera((float)settings.width / settings.height);
+	sharedContext.worldCamera = &camera;
 
-		m_InstanceDataPtr = (char*)glMapNamedBufferRange(m_PersistentInstanceDataBuffer, 0, INSTANCE_BUFFER_DATA_SIZE, flags);
+	if (window)
+	{
+		//GLFW Settings
+		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+		glfwSwapInterval(1);
 
-		// Bind buffer to binding point 1
-		//glVertexArrayVertexBuffer(m_VertexArray, 1, m_InstanceDataBuffer[0], 0, 64);
-		glVertexArrayVertexBuffer(m_VertexArray, 1, m_PersistentInstanceDataBuffer, 0, 64);
+		//GLFW Callbacks
+		glfwSetWindowCloseCallback(window, windowCloseFun);
+		glfwSetWindowSizeCallback(window, WindowSizeCallback);
+		glfwSetKeyCallback(window, KeyCallback);
 
-		// Enable attribute indices
-		glEnableVertexArrayAttrib(m_VertexArray, 1);
-		glEnableVertexArrayAttrib(m_VertexArray, 2);
-		glEnableVertexArrayAttrib(m_VertexArray, 3);
-		glEnableVertexArrayAttrib(m_VertexArray, 4);
+		glfwSetWindowUserPointer(window, &sharedContext);
 
-		// Associate Binding Index with attribute indices
-		glVertexArrayAttribBinding(m_VertexArray, 1, 1);
-		glVertexArrayAttribBinding(m_VertexArray, 2, 1);
-		glVertexArrayAttribBinding(m_VertexArray, 3, 1);
-		glVertexArrayAttribBinding(m_VertexArray, 4, 1);
+		int w, h;
+		glfwGetWindowSize(window, &w, &h);
+		camera.SetAspectRatio((float)w / h);
+	}
 
-		// Specify layout of data for attribute indices
-		glVertexArrayAttribFormat(m_VertexArray, 1, 4, GL_FLOAT, GL_FALSE, 0);
-		glVertexArrayAttribFormat(m_VertexArray, 2, 4, GL_FLOAT, GL_FALSE, 16);
-		glVertexArrayAttribFormat(m_VertexArray, 3, 4, GL_FLOAT, GL_FALSE, 32);
-		glVertexArrayAttribFormat(m_VertexArray, 4, 4, GL_FLOAT, GL_FALSE, 48);
 
-		// Specify Divisor for Binding Index
-		glVertexArrayBindingDivisor(m_VertexArray, 1, 1);
+	//OpenGL Setup
+	glDebugMessageCallback(DebugCallback, 0);
+	GLState& glState = GLState::Get();
+	glState.Enable(GL_DEPTH_TEST);
+	//glEnable(GL_CULL_FACE);
 
-		LOG_INFO("Renderer initialized InstanceDataBuffer")
+	// Headless has no default framebuffer
+	std::unique_ptr<Framebuffer> offscreenTarget;
+	if (settings.headless)
+	{
+		offscreenTarget = std::make_unique<Framebuffer>(settings.width, settings.height);
 	}
 
-	~Renderer()
+	// Captures keep the size they started with, resizing the window doesn't restart them
+	std::unique_ptr<FrameCapture> frameCapture;
+	if (!settings.capturePath.empty())
 	{
+		int captureWidth = settings.width;
+		int captureHeight = settings.height;
+		if (window)
+		{
+			glfwGetFramebufferSize(window, &captureWidth, &captureHeight);
+		}
 
+		FrameCaptureSettings captureSettings{};
+		captureSettings.output = settings.capturePath;
+		captureSettings.format = settings.captureFormat;
+		frameCapture = std::make_unique<FrameCapture>(captureWidth, captureHeight, captureSettings);
+		if (!frameCapture->IsOpen())
+		{
+			return 1;
+		}
 	}
 
-	void SetVertexBuffer(GLuint vertexBufferID)
+	// Scripted camera for runs without input
+	CameraPath cameraPath;
+	if (!settings.cameraPath.empty())
 	{
-		LOG_INFO("Set vertex buffer for renderer")
-		glEnableVertexArrayAttrib(m_VertexArray, 0);
-		glVertexArrayVertexBuffer(m_VertexArray, 0, vertexBufferID, 0, sizeof(float) * 3);
-		glVertexArrayAttribFormat(m_VertexArray, 0, 3, GL_FLOAT, GL_FALSE, 0);
+		if (!CameraPath::LoadFromFile(settings.cameraPath, cameraPath))
+		{
+			return 1;
+		}
 	}
-
-	void SetElementBuffer(GLuint elementBufferID)
+	else if (settings.headless)
 	{
-		LOG_INFO("Set element buffer for renderer")
-		glVertexArrayElementBuffer(m_VertexArray, elementBufferID);
-		
+		cameraPath = CameraPath::Orbit({ 40.f, 5.f, 5.f }, 60.f, 20.f, 20.f);
 	}
 
-	void SetGeoCount(size_t count)
+	TraceRecorder traceRecorder;
+	if (!settings.recordPath.empty() && !traceRecorder.Open(settings.recordPath))
 	{
-		m_GeoManagerGeoCount = count;
-
-		glCreateBuffers(1, &m_DrawIndirectBuffer);
-		glNamedBufferData(m_DrawIndirectBuffer, m_GeoManagerGeoCount * sizeof(DrawCommand), nullptr, GL_STREAM_DRAW);
+		return 1;
 	}
 
-	void BeginScene()
+	GeometryManager geometryManager;
+	sharedContext.geometryManager = &geometryManager;
+	if (traceRecorder.IsOpen())
 	{
+		geometryManager.SetTraceRecorder(&traceRecorder);
 	}
 
-	void Submit(const Renderable& renderable)
+	// Has to exist before any geometry is added so it keeps the CPU copies
+	std::unique_ptr<ResidencyManager> residencyManager;
+	if (settings.geometryBudget > 0)
 	{
-		// Find DrawData entry for current geoID
-		uint32_t drawDataPos = 0;
-		while(drawDataPos < m_DrawData.size())
-		{
-			if(m_DrawData[drawDataPos].geoID == renderable.geoID)
-			{
-				break;
-			}
-
-			drawDataPos++;
-		}
-		 
-		// Create new entry if no DrawData entry exists for current geoID
-		if(drawDataPos >= m_DrawData.size())
-		{
-			DrawData drawData{};
-			drawData.geoID = renderable.geoID;
-			drawData.instanceData.reserve(30000);
-			m_DrawData.push_back(drawData);
-		}
-
-		// Update DrawData entry
-		DrawData& drawData = m_DrawData[drawDataPos];
-		drawData.instanceCount++;
-		InstanceData instanceData;
-		instanceData.modelTransform = renderable.modelTransform;
-		drawData.instanceData.push_back(instanceData);
+		ResidencySettings residencySettings{};
+		residencySettings.budgetBytes = (size_t)settings.geometryBudget * 1024 * 1024;
+		residencyManager = std::make_unique<ResidencyManager>(geometryManager, residencySettings);
 	}
 
-	void EndScene(GLFWwindow* window)
+	std::unique_ptr<AssetLoader> assetLoader;
+	if (settings.streamMeshes > 0)
 	{
-		std::vector<DrawCommand> drawCommands;
-		uint32_t baseInstance = 0;
-		m_InstanceDataBufferTop = 0;
-
-
-		auto context = static_cast<SharedContext*>(glfwGetWindowUserPointer(window));
-		GeometryManager* geometryManager = context->geometryManager;
-
+		assetLoader = std::make_unique<AssetLoader>(geometryManager);
+	}
 
+	// Small and distinct, the sizes repeat once every combination was requested
+	constexpr uint32_t streamedMeshVariants = 4 * 512;
+	auto getStreamedMeshDesc = [](uint32_t i)
+	{
+		const MeshShape shapes[] = { MeshShape::UVSphere, MeshShape::PlaneGrid, MeshShape::Cylinder, MeshShape::Torus };
+		const uint32_t variant = (i / 4) % 512;
+
+		MeshDesc desc;
+		desc.shape = shapes[i % 4];
+		desc.segmentsU = 3 + variant % 8;
+		desc.segmentsV = 3 + variant / 8;
+		return desc;
+	};
+	auto getMeshFilePath = [&](const MeshDesc& desc)
+	{
+		return settings.meshFiles + "/" + desc.GetName() + ".gl2m";
+	};
 
-		// Wait buffer
-		GLenum waitReturn = GL_UNSIGNALED;
-		while (waitReturn != GL_ALREADY_SIGNALED && waitReturn != GL_CONDITION_SATISFIED)
+	if (assetLoader && !settings.meshFiles.empty())
+	{
+		std::error_code error;
+		std::filesystem::create_directories(settings.meshFiles, error);
+		if (error)
 		{
-			waitReturn = glClientWaitSync(m_SyncObject, GL_SYNC_FLUSH_COMMANDS_BIT, 1);
+			LOG_ERROR("Couldn't create the mesh file directory [%s]: %s", settings.meshFiles.c_str(), error.message().c_str())
+			return 1;
 		}
-		glDeleteSync(m_SyncObject);
-
 
-		for(auto drawData: m_DrawData)
+		uint32_t written = 0;
+		for (uint32_t i = 0; i < std::min(settings.streamMeshes, streamedMeshVariants); i++)
 		{
-			Geometry& geometry = geometryManager->GetGeometry(drawData.geoID);
-			DrawCommand drawCommand{};
-
-			// unsure about this mapping
-			drawCommand.elementCount = geometry.elementCount;
-			drawCommand.instanceCount = drawData.instanceCount;
-			drawCommand.baseVertex = geometry.baseVertex;
-			drawCommand.firstIndex = geometry.firstIndex;
-			drawCommand.baseInstance = baseInstance;
-
-			drawCommands.push_back(drawCommand);
-
-			const size_t instanceDataSize = drawData.instanceData.size() * sizeof(InstanceData);
-			assert(m_InstanceDataBufferTop + instanceDataSize < INSTANCE_BUFFER_DATA_SIZE);
-
-
-			memcpy(m_InstanceDataPtr + m_InstanceDataBufferTop,
-				drawData.instanceData.data(), 
-				instanceDataSize
-			);
-			m_InstanceDataBufferTop += instanceDataSize;
-			LOG_INFO("Copied %d bytes into instance data buffer", instanceDataSize)
-
+			const MeshDesc desc = getStreamedMeshDesc(i);
+			const std::string path = getMeshFilePath(desc);
+			if (std::filesystem::exists(path))
+			{
+				continue;
+			}
 
-			baseInstance += drawData.instanceCount;
+			const MeshData data = MeshGenerator::Generate(desc);
+			const EncodedMesh mesh = GeometryManager::Encode(data.vertices.data(), (GLsizeiptr)(data.vertices.size() * sizeof(float)), data.indices.data(), data.GetIndexCount());
+			if (!AssetLoader::WriteMeshFile(path, mesh))
+			{
+				return 1;
+			}
+			written++;
 		}
-		// Lock buffer
-		m_SyncObject = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
-
-		glNamedBufferSubData(m_DrawIndirectBuffer, 0, drawCommands.size() * sizeof(DrawCommand), drawCommands.data());
-
-		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_DrawIndirectBuffer);
-		glBindVertexArray(m_VertexArray);
-
-		glMultiDrawElementsIndirect(
-			GL_LINES_ADJACENCY, 
-			GL_UNSIGNED_INT, 
-			nullptr, 
-			drawCommands.size(),
-			0
-		);
-
-		glBindVertexArray(0);
-		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
-
-		m_DrawData.clear();
+		LOG_INFO("Wrote %u missing mesh files to [%s]", written, settings.meshFiles.c_str())
 	}
 
-	void DrawIndexed(GLFWwindow* window, const Renderable& renderable)
-	{
-
-		auto context = static_cast<SharedContext*>(glfwGetWindowUserPointer(window));
-		GeometryManager* geometryManager = context->geometryManager;
-		Geometry& geometry = geometryManager->GetGeometry(renderable.geoID);
-
 
-		GLenum waitReturn = GL_UNSIGNALED;
-		while (waitReturn != GL_ALREADY_SIGNALED && waitReturn != GL_CONDITION_SATISFIED)
-		{
-			waitReturn = glClientWaitSync(m_SyncObject, GL_SYNC_FLUSH_COMMANDS_BIT, 1);
-		}
-		glDeleteSync(m_SyncObject);
-
-		memcpy(m_InstanceDataPtr + m_InstanceDataBufferTop, glm::value_ptr(renderable.modelTransform), sizeof(InstanceData));
-		m_SyncObject = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
-		glPointSize(10.f);
-		glBindVertexArray(m_VertexArray);
-		
-		glDrawElementsBaseVertex(
-			GL_LINES_ADJACENCY, // todo
-			geometry.elementCount,
-			GL_UNSIGNED_INT,
-			(const void*) (4 * geometry.firstIndex),
-			geometry.baseVertex
-		);
-
-		glBindVertexArray(0);
-	}
 
-private:
-	std::vector<DrawData> m_DrawData;
-	GLuint m_VertexArray;
-	GLuint m_InstanceDataBuffer[2];
-	GLuint m_PersistentInstanceDataBuffer;
-	GLuint m_DrawIndirectBuffer;
+	ShaderLibrary shaderLibrary;
 
-	GLsync m_SyncObject;
+	// Compiled per variant on first use, see the warm up below
+	shaderLibrary.Declare("smoothSurface", {
+		"assets/shaders/basicVert.vs",
+		"assets/shaders/basicFrag.fs",
+		"assets/shaders/smoothSurface.gs",
+		});
 
-	char* m_InstanceDataPtr;
+	shaderLibrary.Declare("geo", {
+		"assets/shaders/basicVert.vs",
+		"assets/shaders/basicFrag.fs",
+		"assets/shaders/pointsToSquare.gs",
+		});
 
-	size_t m_GeoManagerGeoCount;
+	// Vertex pulling replacement for geo, instanced strips instead of point expansion in a geometry shader
+	shaderLibrary.Declare("pointQuad", {
+		"assets/shaders/pointQuad.vs",
+		"assets/shaders/basicFrag.fs",
+		});
 
-	GLintptr m_InstanceDataBufferTop;
-};
 
 
-class ShaderLoader
-{
-public:
-	static GLuint CreateProgram(const std::vector<std::string>& paths)
-	{
-		GLuint program = glCreateProgram();
+	float Geo1[] = {
+		0.f, 0.f, 0.f,
+		1.f, 0.f, 0.f,
+		1.f, 1.f, 0.f
+	};
 
-		for (auto& path : paths)
-		{
-			const std::string postfix = path.substr(path.find_last_of('.') + 1, path.size());
-			GLenum type;
-
-			if (postfix == "vs") { type = GL_VERTEX_SHADER; }
-			else if (postfix == "fs") { type = GL_FRAGMENT_SHADER; }
-			else if (postfix == "gs") { type = GL_GEOMETRY_SHADER; }
-			else if (postfix == "tc") { type = GL_TESS_CONTROL_SHADER; }
-			else if (postfix == "te") { type = GL_TESS_EVALUATION_SHADER; }
-			else if (postfix == "cs") { type = GL_COMPUTE_SHADER; }
-			else
-			{
-				LOG_ERROR("Invalid shader postfix [%s] upon loading [%s]", postfix.c_str(), path.c_str())
-					assert(false);
-			}
+	uint32_t Geo1Indices[] = { 0,1,2 };
 
+	float quadPositions[] = {
+		-0.5f, -0.5f, 0.0f, // ul
+		 0.5f, -0.5f, 0.0f, // ur
+		-0.5f,  0.5f, 0.0f, // ol
+		 0.5f,  0.5f, 0.0f  // or
+	};
 
-			const std::string shaderText = LoadShaderText(path);
-			const char* shaderCstr = shaderText.c_str();
+	uint32_t quadIndices[] = {
+		0,1,2,
+		1,2,3
+	};
 
+	uint32_t quadLinestripIndices[] =
+	{
+		0,1,2,3
+	};
 
-			GLuint shaderHandle = glCreateShader(type);
-			glShaderSource(shaderHandle, 1, &shaderCstr, NULL);
-			glCompileShader(shaderHandle);
+	float fuenfeck[] = {
+		 0.0f,  0.5f, 0.0f,
+		-0.5f,  0.3f, 0.0f,
+		-0.3f, -0.4f, 0.0f,
+		 0.3f, -0.4f, 0.0f,
+		 0.5f,  0.3f, 0.0f,
+	};
 
-			ValidateShader(shaderHandle, path);
+	uint32_t fuenfeckIndices[] = {
+		0,1,2,
+		0,2,3,
+		0,3,4
+	};
 
-			glAttachShader(program, shaderHandle);
-		}
+	float simpleCube[] = { 
+		 0.5f,  0.5f,  0.5f, //or   0
+		-0.5f,  0.5f,  0.5f, //ol	1
+		-0.5f, -0.5f,  0.5f, //ul	2
+		 0.5f, -0.5f,  0.5f, //ur	3
+		 0.5f,  0.5f, -0.5f, //or	4
+		-0.5f,  0.5f, -0.5f, //ol	5
+		-0.5f, -0.5f, -0.5f, //ul	6
+		 0.5f, -0.5f, -0.5f, //ur	7
+	};
 
-		glLinkProgram(program);
+	uint32_t simpleCubeIndices[] = {
+		0,1,2,0,2,3, // vorne
+		4,0,3,4,3,7, // rechts
+		5,4,7,5,7,6, // hinten
+		1,5,6,1,6,2, // links
+		4,5,1,4,1,0, // oben
+		3,2,6,3,6,7
+	};
 
-		ValidateProgram(program);
+	MeshCache meshCache(geometryManager);
 
+	geometryManager.AddGeometry("square", quadPositions, sizeof(quadPositions), quadIndices, sizeof(quadIndices) / sizeof(GLuint));
+	geometryManager.AddGeometry("quadLinestrip", quadPositions, sizeof(quadPositions), quadLinestripIndices, sizeof(quadLinestripIndices) / sizeof(uint32_t));
+	geometryManager.AddGeometry("triangle", Geo1, sizeof(Geo1), Geo1Indices, sizeof(Geo1Indices) / sizeof(GLuint));
+	geometryManager.AddGeometry("fuenfeck", fuenfeck, sizeof(fuenfeck), fuenfeckIndices, sizeof(fuenfeckIndices) / sizeof(GLuint));
+	geometryManager.AddGeometry("simpleCube", simpleCube, sizeof(simpleCube), simpleCubeIndices, sizeof(simpleCubeIndices) / sizeof(GLuint));
 
-		return program;
-	}
+	// Frame, view and material blocks for every program, rewritten each frame
+	ConstantBufferRing constantBufferRing;
 
+	MaterialConstants lineMaterial{};
+	lineMaterial.color = { 1.f, 1.f, 0.f, 1.f };
+	lineMaterial.curveSteps = 9;
 
-private:
-	static std::string LoadShaderText(const std::string& path)
-	{
+	MaterialConstants transparentMaterial = lineMaterial;
+	transparentMaterial.color = { 0.f, 1.f, 1.f, 0.5f };
 
-		std::fstream file;
-		file.open(path);
-		if (!file.is_open())
-		{
-			LOG_ERROR("Couldn't open file at location [%s]", path.c_str())
-				assert(false);
-		}
+	MaterialConstants terrainMaterial = lineMaterial;
+	terrainMaterial.color = { 0.4f, 0.8f, 0.3f, 1.f };
 
-		std::string text;
-		std::string line;
+	// Indexed by DrawPath. The curve resolution never changes here, baking it in gives the
+	// geometry shader a constant loop.
+	const ShaderDefine curveSteps{ "CURVE_STEPS", std::to_string(lineMaterial.curveSteps) };
+	const ShaderVariant smoothSurfaceVariants[] = {
+		{ "smoothSurface"_sid, { curveSteps } },
+		{ "smoothSurface"_sid, { curveSteps, { "VERTEX_PULLING", "1" } } },
+	};
+	const ShaderVariant pointQuadVariants[] = {
+		{ "geo"_sid },
+		{ "pointQuad"_sid },
+	};
 
-		while (std::getline(file, line))
-		{
-			text += line;
-			text += '\n';
-		}
+	// Same programs expanding instance ranges, for --instance-ranges
+	const ShaderDefine instanceRangesDefine{ "INSTANCE_RANGES", "1" };
+	const ShaderVariant smoothSurfaceRangeVariants[] = {
+		{ "smoothSurface"_sid, { curveSteps, instanceRangesDefine } },
+		{ "smoothSurface"_sid, { curveSteps, { "VERTEX_PULLING", "1" }, instanceRangesDefine } },
+	};
+	const ShaderVariant pointQuadRangeVariants[] = {
+		{ "geo"_sid, { instanceRangesDefine } },
+		{ "pointQuad"_sid, { instanceRangesDefine } },
+	};
 
-		file.close();
-		return text;
-	}
+	// Terrain patches, --terrain
+	const ShaderDefine terrainDefine{ "TERRAIN", "1" };
+	const ShaderVariant smoothSurfaceTerrainVariants[] = {
+		{ "smoothSurface"_sid, { curveSteps, terrainDefine } },
+		{ "smoothSurface"_sid, { curveSteps, { "VERTEX_PULLING", "1" }, terrainDefine } },
+	};
 
-	static void ValidateShader(GLuint shader, const std::string& path)
+	// Every variant a frame can switch to, the driver compiles them while setup goes on. Until
+	// one is ready, the draws that need it are skipped.
+	shaderLibrary.WarmUp({ smoothSurfaceVariants[0], smoothSurfaceVariants[1] });
+	if (settings.pointQuads)
 	{
-		GLint isCompiled;
-		glGetShaderiv(shader, GL_COMPILE_STATUS, &isCompiled);
-
-		if(isCompiled == GL_FALSE)
+		shaderLibrary.WarmUp({ pointQuadVariants[0], pointQuadVariants[1] });
+	}
+	if (settings.instanceRanges)
+	{
+		shaderLibrary.WarmUp({ smoothSurfaceRangeVariants[0], smoothSurfaceRangeVariants[1] });
+		if (settings.pointQuads)
 		{
-			LOG_ERROR("Compilation failed for shader [%s]", path. c_str())
-			PrintShaderLog(shader);
-			assert(false);
+			shaderLibrary.WarmUp({ pointQuadRangeVariants[0], pointQuadRangeVariants[1] });
 		}
 	}
-
-	static void ValidateProgram(GLuint program)
+	if (settings.terrain)
 	{
-		GLint isLinked;
-		glGetProgramiv(program, GL_LINK_STATUS, &isLinked);
+		shaderLibrary.WarmUp({ smoothSurfaceTerrainVariants[0], smoothSurfaceTerrainVariants[1] });
+	}
 
-		if(isLinked == GL_FALSE)
+	// Headless frames have to come out the same on every run, so those wait for what they draw with
+	const uint32_t startPath = (uint32_t)settings.drawPath;
+	if (settings.headless)
+	{
+		shaderLibrary.GetVariant(smoothSurfaceVariants[startPath]);
+		if (settings.pointQuads)
 		{
-
-			LOG_ERROR("Program [%d] not linked", program)
-			PrintProgramLog(program);
-			assert(false);
+			shaderLibrary.GetVariant(pointQuadVariants[startPath]);
+		}
+		if (settings.instanceRanges)
+		{
+			shaderLibrary.GetVariant(smoothSurfaceRangeVariants[startPath]);
+			if (settings.pointQuads)
+			{
+				shaderLibrary.GetVariant(pointQuadRangeVariants[startPath]);
+			}
+		}
+		if (settings.terrain)
+		{
+			shaderLibrary.GetVariant(smoothSurfaceTerrainVariants[startPath]);
 		}
 	}
 
-	static void PrintShaderLog(GLuint shader)
-	{
-		int len = 0;
-		int writtenChars = 0;
-		char* buffer;
 
-		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &len);
 
-		if (len > 0)
+	glm::mat4 mat = { 0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f, 8.f, 9.f, 10.f, 11.f, 12.f, 13.f, 14.f, 15.f};
+
+
+	Renderable a;
+	a.geoID = sharedContext.geometryManager->GetID("triangle"_sid);
+	a.modelTransform = glm::mat4(1.f);
+	//a.modelTransform = mat;
+
+	Renderable plane;
+	plane.geoID = sharedContext.geometryManager->GetID("square"_sid);
+	plane.modelTransform = glm::translate(glm::mat4(1.f), { 0.f, 1.5f, 0.f });
+
+	Renderable sphere;
+	sphere.geoID = meshCache.Get({ MeshShape::UVSphere, 10, 10 });
+	sphere.modelTransform = glm::translate(glm::mat4(1.f), { 2.f, 0, 2.f });
+
+	Renderable cube;
+	cube.geoID = sharedContext.geometryManager->GetID("simpleCube"_sid);
+	cube.modelTransform = glm::mat4(1.f);
+
+	Renderable quadLinestrip;
+	quadLinestrip.geoID = sharedContext.geometryManager->GetID("quadLinestrip"_sid);
+	quadLinestrip.modelTransform = glm::scale(glm::mat4(1.f), {5.f, 1.f, 1.f});
+
+	// 4 km across, centered below the scene. Adds the patch geometry, so before the Renderer.
+	std::unique_ptr<Terrain> terrain;
+	if (settings.terrain)
+	{
+		TerrainSettings terrainSettings{};
+		terrainSettings.origin = { -2048.f, -45.f, -2048.f };
+		terrainSettings.tileDirectory = settings.terrainTiles;
+		terrain = std::make_unique<Terrain>(geometryManager, terrainSettings);
+
+		if (residencyManager)
 		{
-			buffer = (char*)malloc(len);
-			glGetShaderInfoLog(shader, len, &writtenChars, buffer);
-			LOG_ERROR("%s", buffer)
+			residencyManager->Pin(terrain->GetPatchGeoID());
 		}
 	}
 
-	static void PrintProgramLog(GLuint program)
+	Renderer renderer(&geometryManager);
+	renderer.SetVertexBuffer(sharedContext.geometryManager->GetVertexBufferID());
+	renderer.SetElementBuffer(sharedContext.geometryManager->GetElementBufferID());
+	renderer.SetGeoCount(sharedContext.geometryManager->GetGeoCount());
+	renderer.SetDrawPath(settings.drawPath);
+	renderer.SetDepthSort(settings.depthSort);
+	if (residencyManager)
+	{
+		// Small and always resident, drawn while the real geometry streams back in
+		residencyManager->SetPlaceholder(sharedContext.geometryManager->GetID("quadLinestrip"_sid));
+		renderer.SetResidencyManager(residencyManager.get());
+	}
+	sharedContext.renderer = &renderer;
+	if (traceRecorder.IsOpen())
 	{
-		int len = 0;
-		int writtenChars = 0;
-		char* buffer;
+		renderer.SetTraceRecorder(&traceRecorder);
+	}
+
+	constexpr uint32_t gridsize = 5;
+	constexpr uint32_t distance = 5;
+	
+
+	std::vector<Renderable> renderables;
+	renderables.reserve(gridsize* gridsize* gridsize);
 
-		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &len);
 
-		if (len > 0)
+	GeoID geoID = sharedContext.geometryManager->GetID("quadLinestrip"_sid);
+	std::vector<InstanceRange> instanceRanges;
+	for(int x = 0; x < gridsize && settings.instanceRanges; x++)
+	{
+		// The y-z plane of one column, the same transforms as the renderables below
+		InstanceRange column;
+		column.geoID = geoID;
+		column.transform = glm::translate(glm::scale(glm::mat4(1.f), { 4.f, 0.5f, 0.5f }), { (float)(x * distance), 0.f, 0.f });
+		column.stride = { 0.f, distance, distance };
+		column.count = { 1, gridsize, gridsize };
+		if (settings.transparent && x % 2 == 1)
 		{
-			buffer = (char*)malloc(len);
-			glGetProgramInfoLog(program, len, &writtenChars, buffer);
-			LOG_ERROR("%s", buffer)
+			column.queue = RenderQueue::Transparent;
 		}
+
+		instanceRanges.push_back(column);
 	}
-};
 
+	if (settings.instanceRanges)
+	{
+		InstanceRange scatter;
+		scatter.geoID = sharedContext.geometryManager->GetID("simpleCube"_sid);
+		scatter.transform = glm::translate(glm::mat4(1.f), { -40.f, -15.f, -60.f });
+		scatter.stride = { 4.f, 0.f, 4.f };
+		scatter.count = { 40, 1, 32 };
+		scatter.seed = 1234;
+		scatter.positionJitter = 1.f;
+		scatter.rotationJitter = glm::radians(180.f);
+		scatter.scaleJitter = 0.3f;
+		instanceRanges.push_back(scatter);
+	}
 
-struct Sphere
-{
-	Sphere(const int prec)
+	for(int x = 0; x < gridsize && !settings.instanceRanges; x++)
 	{
-		Init(prec);
+		for(int y = 0; y < gridsize; y++)
+		{
+			for(int z = 0; z < gridsize; z++)
+			{
+				Renderable renderable{};
+				renderable.geoID = geoID;
+				renderable.modelTransform = glm::translate(glm::scale(glm::mat4(1.f), { 4.f, 0.5f, 0.5f }), { x * distance, y * distance, z * distance });
+				if (settings.transparent && x % 2 == 1)
+				{
+					renderable.queue = RenderQueue::Transparent;
+				}
 
+				renderables.push_back(renderable);
+			}
+		}
 	}
 
-
-	void Init(const int prec)
+	// Jittered cells of a square scatter range, expanded here since every cube is a renderable
+	if (settings.cubeField > 0)
 	{
-		const int numVertices = (prec + 1) * (prec + 1);
-		const int numIndices = prec * prec * 6;
+		const uint32_t side = (uint32_t)std::ceil(std::sqrt((double)settings.cubeField));
+
+		InstanceRangeData field{};
+		field.transform = glm::translate(glm::mat4(1.f), { 40.f - side, -10.f, 10.f - side });
+		field.stride = { 2.f, 0.f, 2.f, 1.f };
+		field.countSeed = { side, 1, side, 4321 };
+		field.jitter = { glm::radians(180.f), 0.3f, 0.f, 0.f };
 
-		// Default initialize i indices (NOT PERFORMANT AT ALL)
-		for (int i = 0; i < numIndices; i++)
+		const GeoID cubeID = sharedContext.geometryManager->GetID("simpleCube"_sid);
+		for (uint32_t i = 0; i < settings.cubeField; i++)
 		{
-			m_Indices.push_back(0);
+			renderables.push_back({ cubeID, InstanceRangeTransform(field, i) });
 		}
+	}
 
-		for (int i = 0; i <= prec; i++)
+	// A ring above the grid, cycling through the geometries
+	std::vector<Renderable> immediateRenderables;
+	const GeoID immediateGeometries[] = { cube.geoID, sphere.geoID, plane.geoID };
+	for (uint32_t i = 0; i < settings.immediateDraws; i++)
+	{
+		const float angle = glm::radians(360.f * i / settings.immediateDraws);
+		const glm::vec3 position = { 10.f + 30.f * std::cos(angle), 25.f, 10.f + 30.f * std::sin(angle) };
+		immediateRenderables.push_back({ immediateGeometries[i % 3], glm::translate(glm::mat4(1.f), position) });
+
+		// DrawIndexed bypasses the residency manager
+		if (residencyManager)
 		{
-			for (int j = 0; j <= prec; j++)
-			{
-				float y = (float)cos(glm::radians(180.0f - i * 180.0f / prec));
-				// not sure what the minus infront of cos is used for
-				// The minus infront of the x or z value influences the winding!
-				float x = -(float)cos(glm::radians(j * 360.0f / prec)) * (float)abs(cos(asin(y)));
-				float z = (float)sin(glm::radians(j * 360.0f / prec)) * (float)abs(cos(asin(y)));
-
-
-				m_Vertices.push_back(x);
-				m_Vertices.push_back(y);
-				m_Vertices.push_back(z);
-				//Vertex& vertex = m_Vertices[i * (prec + 1) + j];
-				//vertex.position = glm::vec3(x, y, z);
-				//vertex.color = glm::vec4(0.2f, 0.3f, 0.8f, 1.f);
-				//// No color value specified
-				//vertex.texCoord = glm::vec2(((float)j / prec), ((float)i / prec));
-				//vertex.normal = glm::vec3(x, y, z);
-			}
+			residencyManager->Pin(immediateGeometries[i % 3]);
 		}
-		for (int i = 0; i < prec; i++)
+	}
+
+	// Nothing of this is submitted anymore, it stays on the GPU
+	std::unique_ptr<GpuCulling> gpuCulling;
+	if (settings.gpuCulling)
+	{
+		gpuCulling = std::make_unique<GpuCulling>(geometryManager, shaderLibrary);
+		gpuCulling->SetInstances(renderables);
+
+		if (residencyManager)
 		{
-			for (int j = 0; j < prec; j++)
+			for (const Renderable& renderable : renderables)
 			{
-				m_Indices[6 * (i * prec + j) + 0] = i * (prec + 1) + j;
-				m_Indices[6 * (i * prec + j) + 1] = i * (prec + 1) + j + 1;
-				m_Indices[6 * (i * prec + j) + 2] = (i + 1) * (prec + 1) + j;
-				m_Indices[6 * (i * prec + j) + 3] = i * (prec + 1) + j + 1;
-				m_Indices[6 * (i * prec + j) + 4] = (i + 1) * (prec + 1) + j + 1;
-				m_Indices[6 * (i * prec + j) + 5] = (i + 1) * (prec + 1) + j;
+				residencyManager->Pin(renderable.geoID);
 			}
 		}
+		renderables.clear();
 	}
 
+	// Filled when --stream-meshes requests its meshes, below the grid
+	struct StreamedRenderable
+	{
+		AssetID asset;
+		glm::mat4 modelTransform;
+	};
+	std::vector<StreamedRenderable> streamedRenderables;
+	constexpr uint64_t streamStartFrame = 10;
 
-	std::vector<float> m_Vertices;
-	std::vector<uint32_t> m_Indices;
-};
-
+	glClearColor(0.16f, 0.2f, 0.35f, 1.f);
 
-void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
-{
-	if(key == GLFW_KEY_9 && action == GLFW_PRESS)
-	{
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-	}
-	if (key == GLFW_KEY_0 && action == GLFW_PRESS)
+	// Samples of the scene draws that pass the depth test. Relative to the pixel count this is
+	// the overdraw depth sorting is meant to cut, every sample that is later drawn over was
+	// shaded for nothing. Read back a few frames late so it never stalls.
+	constexpr uint32_t overdrawQueryCount = 4;
+	GLuint overdrawQueries[overdrawQueryCount] = {};
+	uint64_t overdrawQueriesIssued = 0;
+	uint64_t samplesPassed = 0;
+	uint64_t overdrawFrames = 0;
+	glCreateQueries(GL_SAMPLES_PASSED, overdrawQueryCount, overdrawQueries);
+
+	// Headless runs advance the simulation by exactly one step per frame, so the camera path
+	// produces the same frames no matter how fast they render. --target-fps paces the manual clock
+	// too, then a frame covers the steps of its interval.
+	SteadyClock steadyClock;
+	ManualClock manualClock;
+	Clock& clock = settings.headless ? (Clock&)manualClock : (Clock&)steadyClock;
+
+	FrameSchedulerSettings schedulerSettings{};
+	schedulerSettings.maxFramesInFlight = settings.maxFramesInFlight;
+	schedulerSettings.targetFrameRate = settings.targetFrameRate;
+	schedulerSettings.lowLatency = settings.lowLatency;
+	schedulerSettings.reportInterval = settings.headless ? 0.0 : 5.0;
+	FrameScheduler scheduler(clock, schedulerSettings);
+
+	FrameScheduler::Callbacks frameCallbacks;
+	frameCallbacks.sampleInput = [&]()
 	{
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-	}
-}
+		if (window)
+		{
+			glfwPollEvents();
+			camera.SampleInput(window);
+		}
+	};
 
-void PrintSupportedExtensions()
-{
-	GLint noExtensions = 0;
-	glGetIntegerv(GL_NUM_EXTENSIONS, &noExtensions);
+	frameCallbacks.update = [&](double dt)
+	{
+		if (cameraPath.IsEmpty())
+		{
+			camera.Update((float)dt);
+			return;
+		}
 
+		glm::vec3 position, rotation;
+		cameraPath.Sample((float)(scheduler.GetSimulationTime() + dt), position, rotation);
+		camera.StepTo(position, rotation);
+	};
 
-	for (int i = 0; i < noExtensions; i++)
+	// What the GL thread needs to draw a frame after the stages that built it have moved on to
+	// the next one. Double buffered, the pipelined graph fills one while drawing the other.
+	struct FrameState
 	{
-		std::cout << glGetStringi(GL_EXTENSIONS, i) << '\n';
-	}
-}
+		FrameConstants frameConstants;
+		ViewConstants viewConstants;
+		ViewID mainView;
 
-bool IsExtensionSupported(const std::string& name)
-{
-	GLint noExtensions = 0;
-	glGetIntegerv(GL_NUM_EXTENSIONS, &noExtensions);
+		// --split-screen only
+		ViewConstants overviewConstants;
+		ViewID overviewView;
 
-	std::set<std::string> oglExtensions;
-	for (int i = 0; i < noExtensions; i++)
-	{
-		if(strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name.c_str()) == 0)
-		{
-			return true;
-		}
-	}
+		bool packed;
+	};
 
-	return false;
-}
+	FrameState frameStates[2] = {};
+	FrameState* buildState = &frameStates[0];
+	FrameState* drawState = &frameStates[0];
+	double renderAlpha = 0.0;
 
+	JobSystem& jobSystem = JobSystem::Get();
+	FrameArena& frameArena = FrameArena::Get();
+	TaskGraph frameGraph;
 
-int main()
-{
-	if (glfwInit() != GLFW_TRUE)
+	const TaskID cameraTask = frameGraph.Add("camera", [&]()
 	{
-		std::cout << "Couldn't initialize GLFW\n";
-		abort();
-	}
+		camera.Interpolate((float)renderAlpha);
 
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		buildState->frameConstants = {};
+		buildState->frameConstants.time = (float)scheduler.GetSimulationTime();
+		buildState->frameConstants.deltaTime = (float)schedulerSettings.fixedTimestep;
+		buildState->frameConstants.frameIndex = (uint32_t)scheduler.GetFrameIndex();
 
-	GLFWwindow* window = glfwCreateWindow(2560, 1440, "Init", NULL, NULL);
+		if (!settings.splitScreen)
+		{
+			buildState->viewConstants = MakeViewConstants(camera.GetViewMatrix(), camera.GetPerspectiveMatrix());
+			buildState->mainView = renderer.AddView(camera.GetViewMatrix(), camera.GetPerspectiveMatrix());
+			return;
+		}
 
-	if (!window)
+		// Each half is half as wide. The main camera is registered first, depth sorting follows it.
+		glm::mat4 projection = camera.GetPerspectiveMatrix();
+		projection[0][0] *= 2.f;
+		buildState->viewConstants = MakeViewConstants(camera.GetViewMatrix(), projection);
+		buildState->mainView = renderer.AddView(camera.GetViewMatrix(), projection);
+
+		// Fixed, above and behind the grid looking down on it
+		const glm::mat4 overviewMatrix = glm::lookAt(glm::vec3(40.f, 70.f, -60.f), glm::vec3(40.f, 0.f, 10.f), glm::vec3(0.f, 1.f, 0.f));
+		const glm::mat4 overviewProjection = glm::perspective(glm::radians(60.f), projection[1][1] / projection[0][0], 0.1f, 1000.f);
+		buildState->overviewConstants = MakeViewConstants(overviewMatrix, overviewProjection);
+		buildState->overviewView = renderer.AddView(overviewMatrix, overviewProjection);
+	});
+
+	// Parallel over the quadtree roots, reads the camera of this frame's view constants
+	const TaskID terrainTask = frameGraph.Add("terrain", [&]()
 	{
+		if (terrain)
+		{
+			terrain->Select(glm::vec3(buildState->viewConstants.cameraPosition), buildState->viewConstants.viewProjectionMatrix, &jobSystem);
+		}
+	}, { cameraTask });
 
-		std::cout << "Couln't initialize window\n";
-		glfwTerminate();
-		abort();
-	}
+	// MDI
+	const TaskID transformTask = frameGraph.Add("transforms", [&]()
+	{
+		if (terrain)
+		{
+			terrain->Submit(renderer);
+		}
+
+		for(auto& r  : renderables)
+		{
+			renderer.Submit(r);
+		}
+
+		for (const InstanceRange& range : instanceRanges)
+		{
+			renderer.SubmitRange(range);
+		}
 
-	glfwMakeContextCurrent(window);
+		// Substituted until they are uploaded
+		for (const StreamedRenderable& streamed : streamedRenderables)
+		{
+			const GeoID streamedGeoID = assetLoader->GetGeoID(streamed.asset);
+			renderer.Submit({ streamedGeoID != 0 ? streamedGeoID : geoID, streamed.modelTransform });
+		}
+	}, { cameraTask, terrainTask });
 
-	if (GLEW_OK != glewInit())
+	const TaskID cullTask = frameGraph.Add("cull", [&]()
 	{
-		std::cout << "Couldn't initialize GLEW\n";
-		glfwTerminate();
-		abort();
-	}
+		renderer.CullScene(&jobSystem);
+	}, { transformTask });
 
+	const TaskID packTask = frameGraph.Add("pack", [&]()
+	{
+		renderer.PackScene(&jobSystem);
+		buildState->packed = true;
+	}, { cullTask });
 
-	//GLFW Settings
-	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-	glfwSwapInterval(1);
+	auto submitFrame = [&]()
+	{
+		if (offscreenTarget)
+		{
+			offscreenTarget->Bind();
+		}
 
-	//GLFW Callbacks
-	glfwSetWindowCloseCallback(window, windowCloseFun);
-	glfwSetWindowSizeCallback(window, WindowSizeCallback);
-	glfwSetKeyCallback(window, KeyCallback);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+		shaderLibrary.Poll();
 
-	//OpenGL Setup
-	glDebugMessageCallback(DebugCallback, 0);
-	glEnable(GL_DEPTH_TEST);
-	//glEnable(GL_CULL_FACE);
+		// Nothing packed yet in the first pipelined frame
+		if (!drawState->packed)
+		{
+			return;
+		}
 
-	SharedContext sharedContext{};
-	glfwSetWindowUserPointer(window, &sharedContext);
+		constantBufferRing.BeginFrame();
+		constantBufferRing.Push(GL_UNIFORM_BUFFER, FRAME_CONSTANTS_BINDING, drawState->frameConstants);
+		constantBufferRing.Push(GL_UNIFORM_BUFFER, MATERIAL_CONSTANTS_BINDING, lineMaterial);
+		constantBufferRing.Push(GL_UNIFORM_BUFFER, VIEW_CONSTANTS_BINDING, drawState->viewConstants);
 
-	int w, h;
-	glfwGetWindowSize(window, &w, &h);
-	Camera camera((float)w / h);
-	sharedContext.worldCamera = &camera;
+		renderer.UploadScene(drawState != buildState);
 
-	GeometryManager geometryManager;
-	sharedContext.geometryManager = &geometryManager;
+		if (gpuCulling)
+		{
+			gpuCulling->Cull(drawState->viewConstants.viewProjectionMatrix);
+			if (settings.checkGpuCulling)
+			{
+				gpuCulling->CheckAgainstCpu();
+			}
+		}
 
+		const GLuint overdrawQuery = overdrawQueries[overdrawQueriesIssued % overdrawQueryCount];
+		if (overdrawQueriesIssued >= overdrawQueryCount)
+		{
+			GLuint64 samples = 0;
+			glGetQueryObjectui64v(overdrawQuery, GL_QUERY_RESULT, &samples);
+			samplesPassed += samples;
+			overdrawFrames++;
+		}
+		glBeginQuery(GL_SAMPLES_PASSED, overdrawQuery);
+		overdrawQueriesIssued++;
+
+		// 0 while a variant is still compiling, its draws sit the frame out
+		const uint32_t drawPath = (uint32_t)renderer.GetDrawnFramePath();
+		const GLuint surfaceProgram = shaderLibrary.TryGetVariant(smoothSurfaceVariants[drawPath]);
+		const GLuint pointQuadProgram = settings.pointQuads ? shaderLibrary.TryGetVariant(pointQuadVariants[drawPath]) : 0;
+		const GLuint surfaceRangeProgram = settings.instanceRanges ? shaderLibrary.TryGetVariant(smoothSurfaceRangeVariants[drawPath]) : 0;
+		const GLuint pointQuadRangeProgram = settings.instanceRanges && settings.pointQuads ? shaderLibrary.TryGetVariant(pointQuadRangeVariants[drawPath]) : 0;
+		const GLuint terrainProgram = terrain ? shaderLibrary.TryGetVariant(smoothSurfaceTerrainVariants[drawPath]) : 0;
+
+		// Every queue of one view. The GPU culled instances were only culled for the main camera.
+		auto drawScene = [&](ViewID view, bool mainView)
+		{
+			if (surfaceProgram)
+			{
+				glState.UseProgram(surfaceProgram);
+				renderer.DrawView(view);
 
+				if (gpuCulling && mainView)
+				{
+					gpuCulling->Draw((DrawPath)drawPath);
+				}
+			}
 
-	GLuint geoProgram = ShaderLoader::CreateProgram({
-		"assets/shaders/basicVert.vs",
-		"assets/shaders/basicFrag.fs",
-		"assets/shaders/pointsToSquare.gs",
-		});
+			if (surfaceRangeProgram)
+			{
+				glState.UseProgram(surfaceRangeProgram);
+				renderer.DrawView(view, GL_LINES_ADJACENCY, RenderQueue::Opaque, InstanceSource::Ranges);
+			}
 
-	GLuint smoothSurfaceProgram = ShaderLoader::CreateProgram({
-				"assets/shaders/basicVert.vs",
-		"assets/shaders/basicFrag.fs",
-		"assets/shaders/smoothSurface.gs",
+			if (pointQuadProgram)
+			{
+				glState.UseProgram(pointQuadProgram);
+				renderer.DrawViewPointQuads(view);
 
-		});
+				if (gpuCulling && mainView)
+				{
+					gpuCulling->DrawPointQuads((DrawPath)drawPath);
+				}
+			}
 
+			if (pointQuadRangeProgram)
+			{
+				glState.UseProgram(pointQuadRangeProgram);
+				renderer.DrawViewPointQuads(view, RenderQueue::Opaque, InstanceSource::Ranges);
+			}
 
+			if (terrainProgram)
+			{
+				constantBufferRing.Push(GL_UNIFORM_BUFFER, MATERIAL_CONSTANTS_BINDING, terrainMaterial);
+				glState.UseProgram(terrainProgram);
+				terrain->Bind();
+				renderer.DrawView(view, GL_LINES_ADJACENCY, RenderQueue::Terrain);
+			}
 
-	float Geo1[] = {
-		0.f, 0.f, 0.f,
-		1.f, 0.f, 0.f,
-		1.f, 1.f, 0.f
-	};
+			// Blended over the opaque queue without writing depth. Depth sorted frames draw the
+			// renderables back to front along the main camera, then the ranges in their own order.
+			if (settings.transparent)
+			{
+				constantBufferRing.Push(GL_UNIFORM_BUFFER, MATERIAL_CONSTANTS_BINDING, transparentMaterial);
+				glState.Enable(GL_BLEND);
+				glState.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+				glState.DepthMask(GL_FALSE);
+
+				if (surfaceProgram)
+				{
+					glState.UseProgram(surfaceProgram);
+					renderer.DrawView(view, GL_LINES_ADJACENCY, RenderQueue::Transparent);
+				}
+
+				if (surfaceRangeProgram)
+				{
+					glState.UseProgram(surfaceRangeProgram);
+					renderer.DrawView(view, GL_LINES_ADJACENCY, RenderQueue::Transparent, InstanceSource::Ranges);
+				}
+
+				if (pointQuadProgram)
+				{
+					glState.UseProgram(pointQuadProgram);
+					renderer.DrawViewPointQuads(view, RenderQueue::Transparent);
+				}
+
+				if (pointQuadRangeProgram)
+				{
+					glState.UseProgram(pointQuadRangeProgram);
+					renderer.DrawViewPointQuads(view, RenderQueue::Transparent, InstanceSource::Ranges);
+				}
+
+				glState.DepthMask(GL_TRUE);
+				glState.Disable(GL_BLEND);
+			}
 
-	uint32_t Geo1Indices[] = { 0,1,2 };
+			// DrawIndexed needs the attribute path's program whatever the frame was packed for
+			const GLuint immediateProgram = settings.immediateDraws > 0 ? shaderLibrary.TryGetVariant(smoothSurfaceVariants[(uint32_t)DrawPath::VertexAttributes]) : 0;
+			if (immediateProgram)
+			{
+				constantBufferRing.Push(GL_UNIFORM_BUFFER, MATERIAL_CONSTANTS_BINDING, lineMaterial);
+				glState.UseProgram(immediateProgram);
+				for (size_t i = 0; i < immediateRenderables.size(); i += settings.transparent ? 2 : 1)
+				{
+					renderer.DrawIndexed(immediateRenderables[i]);
+				}
+
+				if (settings.transparent)
+				{
+					constantBufferRing.Push(GL_UNIFORM_BUFFER, MATERIAL_CONSTANTS_BINDING, transparentMaterial);
+					glState.Enable(GL_BLEND);
+					glState.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+					glState.DepthMask(GL_FALSE);
+					for (size_t i = 1; i < immediateRenderables.size(); i += 2)
+					{
+						renderer.DrawIndexed(immediateRenderables[i]);
+					}
+					glState.DepthMask(GL_TRUE);
+					glState.Disable(GL_BLEND);
+				}
+				renderer.FlushDraws();
+			}
+		};
 
-	float quadPositions[] = {
-		-0.5f, -0.5f, 0.0f, // ul
-		 0.5f, -0.5f, 0.0f, // ur
-		-0.5f,  0.5f, 0.0f, // ol
-		 0.5f,  0.5f, 0.0f  // or
-	};
+		if (!settings.splitScreen)
+		{
+			drawScene(drawState->mainView, true);
+		}
+		else
+		{
+			// Both halves come from the same cull, pack and upload
+			int targetWidth = settings.width;
+			int targetHeight = settings.height;
+			if (window)
+			{
+				glfwGetFramebufferSize(window, &targetWidth, &targetHeight);
+			}
+			const int halfWidth = targetWidth / 2;
 
-	uint32_t quadIndices[] = {
-		0,1,2,
-		1,2,3
-	};
+			glViewport(0, 0, halfWidth, targetHeight);
+			drawScene(drawState->mainView, true);
+			renderer.FlushDraws();
 
-	uint32_t quadLinestripIndices[] =
-	{
-		0,1,2,3
-	};
+			constantBufferRing.Push(GL_UNIFORM_BUFFER, MATERIAL_CONSTANTS_BINDING, lineMaterial);
+			constantBufferRing.Push(GL_UNIFORM_BUFFER, VIEW_CONSTANTS_BINDING, drawState->overviewConstants);
+			glViewport(halfWidth, 0, targetWidth - halfWidth, targetHeight);
+			drawScene(drawState->overviewView, false);
+			renderer.FlushDraws();
 
-	float fuenfeck[] = {
-		 0.0f,  0.5f, 0.0f,
-		-0.5f,  0.3f, 0.0f,
-		-0.3f, -0.4f, 0.0f,
-		 0.3f, -0.4f, 0.0f,
-		 0.5f,  0.3f, 0.0f,
-	};
+			glViewport(0, 0, targetWidth, targetHeight);
+		}
 
-	uint32_t fuenfeckIndices[] = {
-		0,1,2,
-		0,2,3,
-		0,3,4
-	};
+		glEndQuery(GL_SAMPLES_PASSED);
 
-	float simpleCube[] = { 
-		 0.5f,  0.5f,  0.5f, //or   0
-		-0.5f,  0.5f,  0.5f, //ol	1
-		-0.5f, -0.5f,  0.5f, //ul	2
-		 0.5f, -0.5f,  0.5f, //ur	3
-		 0.5f,  0.5f, -0.5f, //or	4
-		-0.5f,  0.5f, -0.5f, //ol	5
-		-0.5f, -0.5f, -0.5f, //ul	6
-		 0.5f, -0.5f, -0.5f, //ur	7
-	};
+		constantBufferRing.EndFrame();
 
-	uint32_t simpleCubeIndices[] = {
-		0,1,2,0,2,3, // vorne
-		4,0,3,4,3,7, // rechts
-		5,4,7,5,7,6, // hinten
-		1,5,6,1,6,2, // links
-		4,5,1,4,1,0, // oben
-		3,2,6,3,6,7
+		if (frameCapture)
+		{
+			frameCapture->Capture(offscreenTarget ? offscreenTarget->GetID() : 0);
+		}
 	};
 
-	Sphere sphere30(10);
-
-	geometryManager.AddGeometry("square", quadPositions, sizeof(quadPositions), quadIndices, sizeof(quadIndices) / sizeof(GLuint));
-	geometryManager.AddGeometry("quadLinestrip", quadPositions, sizeof(quadPositions), quadLinestripIndices, sizeof(quadLinestripIndices) / sizeof(uint32_t));
-	geometryManager.AddGeometry("triangle", Geo1, sizeof(Geo1), Geo1Indices, sizeof(Geo1Indices) / sizeof(GLuint));
-	geometryManager.AddGeometry("fuenfeck", fuenfeck, sizeof(fuenfeck), fuenfeckIndices, sizeof(fuenfeckIndices) / sizeof(GLuint));
-	geometryManager.AddGeometry("simpleCube", simpleCube, sizeof(simpleCube), simpleCubeIndices, sizeof(simpleCubeIndices) / sizeof(GLuint));
-	geometryManager.AddGeometry("sphere30", sphere30.m_Vertices.data(), sphere30.m_Vertices.size() * sizeof(float), sphere30.m_Indices.data(), sphere30.m_Vertices.size() * sizeof(uint32_t));
+	const TaskID submitTask = frameGraph.Add("gl submit", submitFrame, { packTask }, true);
 
-	GLint viewMatLoc = glGetUniformLocation(smoothSurfaceProgram, "u_ViewMat");
-	GLint perspectiveMatLoc = glGetUniformLocation(smoothSurfaceProgram, "u_PerspectiveMat");
-	GLint stepsLoc = glGetUniformLocation(smoothSurfaceProgram, "uSteps");
-	GLint timeLoc = glGetUniformLocation(smoothSurfaceProgram, "uTime");
+	// Without the dependency the GL thread submits the previous frame while the workers build this one
+	if (settings.pipeline)
+	{
+		frameGraph.SetDependencies(submitTask, {});
+	}
 
-	
-	
-	glUseProgram(smoothSurfaceProgram);
-	//glUniformMatrix4fv(modelMatLoc, 1, GL_FALSE, glm::value_ptr(identity));
-	glUniformMatrix4fv(viewMatLoc, 1, GL_FALSE, glm::value_ptr(camera.GetViewMatrix()));
-	glUniformMatrix4fv(perspectiveMatLoc, 1, GL_FALSE, glm::value_ptr(camera.GetPerspectiveMatrix()));
-	glUniform1i(stepsLoc, 9);
-	glUseProgram(0);
+	// Containers and arenas settle on their final sizes within the first few frames
+	constexpr uint64_t allocationWarmupFrames = 8;
+	uint64_t steadyStateAllocations = 0;
+	uint64_t steadyStateFrames = 0;
 
+	// CPU time of the render callback with streamed meshes in flight and without, what loading
+	// mid-session costs a frame
+	struct RenderTimes
+	{
+		double sum = 0.0;
+		double max = 0.0;
+		uint64_t frames = 0;
 
+		void Add(double seconds)
+		{
+			sum += seconds;
+			max = std::max(max, seconds);
+			frames++;
+		}
+	};
+	RenderTimes streamingTimes;
+	RenderTimes otherTimes;
 
-	glm::mat4 mat = { 0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f, 8.f, 9.f, 10.f, 11.f, 12.f, 13.f, 14.f, 15.f};
+	frameCallbacks.render = [&](double alpha)
+	{
+		const uint64_t allocationsBefore = AllocationCounter::GetCount();
+		const double renderStart = steadyClock.Now();
+		renderAlpha = alpha;
 
+		const uint64_t frameIndex = scheduler.GetFrameIndex();
 
-	Renderable a;
-	a.geoID = sharedContext.geometryManager->GetID("triangle");
-	a.modelTransform = glm::mat4(1.f);
-	//a.modelTransform = mat;
+		// Requested all at once while the scene is already running, the loader spreads them out
+		if (assetLoader && frameIndex == streamStartFrame)
+		{
+			streamedRenderables.reserve(settings.streamMeshes);
+			for (uint32_t i = 0; i < settings.streamMeshes; i++)
+			{
+				const MeshDesc desc = getStreamedMeshDesc(i);
+				const AssetID asset = settings.meshFiles.empty()
+					? assetLoader->LoadGenerated(desc)
+					: assetLoader->LoadMeshFile(desc.GetName(), getMeshFilePath(desc));
 
-	Renderable plane;
-	plane.geoID = sharedContext.geometryManager->GetID("square");
-	plane.modelTransform = glm::translate(glm::mat4(1.f), { 0.f, 1.5f, 0.f });
+				const glm::vec3 position((float)(i % 40) * 2.f, -4.f, (float)(i / 40 % 40) * 2.f - 35.f);
+				streamedRenderables.push_back({ asset, glm::translate(glm::mat4(1.f), position) });
+			}
+		}
+		const bool streaming = assetLoader && assetLoader->GetPendingCount() > 0;
+		buildState = &frameStates[frameIndex % 2];
+		drawState = settings.pipeline ? &frameStates[(frameIndex + 1) % 2] : buildState;
+		buildState->packed = false;
 
-	Renderable sphere;
-	sphere.geoID = sharedContext.geometryManager->GetID("sphere30");
-	sphere.modelTransform = glm::translate(glm::mat4(1.f), { 2.f, 0, 2.f });
+		// Waits until the GPU is done with the renderer's frame slot, the graph can't do that off the GL thread
+		renderer.BeginScene();
 
-	Renderable cube;
-	cube.geoID = sharedContext.geometryManager->GetID("simpleCube");
-	cube.modelTransform = glm::mat4(1.f);
+		frameGraph.Run(jobSystem);
 
-	Renderable quadLinestrip;
-	quadLinestrip.geoID = sharedContext.geometryManager->GetID("quadLinestrip");
-	quadLinestrip.modelTransform = glm::scale(glm::mat4(1.f), {5.f, 1.f, 1.f});
+		// Adds, evicts and uploads geometry, only safe while no stage reads it. Streamed meshes go
+		// first, so the residency manager sees them in this frame's budget.
+		if (assetLoader)
+		{
+			assetLoader->Update();
+		}
+		if (terrain)
+		{
+			terrain->Update(settings.headless);
+		}
+		if (residencyManager)
+		{
+			residencyManager->Update();
+		}
 
-	Renderer renderer;
-	renderer.SetVertexBuffer(sharedContext.geometryManager->GetVertexBufferID());
-	renderer.SetElementBuffer(sharedContext.geometryManager->GetElementBufferID());
-	renderer.SetGeoCount(sharedContext.geometryManager->GetGeoCount());
+		// Nothing built during the frame is read after its stages are done, the draws use the
+		// instance and command buffers
+		frameArena.Reset();
+		glState.EndFrame();
 
-	constexpr uint32_t gridsize = 5;
-	constexpr uint32_t distance = 5;
-	
+		if (frameIndex >= allocationWarmupFrames)
+		{
+			steadyStateAllocations += AllocationCounter::GetCount() - allocationsBefore;
+			steadyStateFrames++;
+		}
 
-	std::vector<Renderable> renderables;
-	renderables.reserve(gridsize* gridsize* gridsize);
+		(streaming ? streamingTimes : otherTimes).Add(steadyClock.Now() - renderStart);
+	};
 
+	frameCallbacks.present = [&]()
+	{
+		if (window)
+		{
+			glfwSwapBuffers(window);
+		}
+		else
+		{
+			manualClock.Advance(schedulerSettings.fixedTimestep);
+		}
+	};
 
-	GeoID geoID = sharedContext.geometryManager->GetID("quadLinestrip");
-	for(int x = 0; x < gridsize; x++)
+	uint64_t frameTimingMismatches = 0;
+	if (settings.headless)
 	{
-		for(int y = 0; y < gridsize; y++)
+		const double start = steadyClock.Now();
+		for (uint32_t frame = 0; frame < settings.frameCount; frame++)
 		{
-			for(int z = 0; z < gridsize; z++)
-			{
-				Renderable renderable{};
-				renderable.geoID = geoID;
-				renderable.modelTransform = glm::translate(glm::scale(glm::mat4(1.f), { 4.f, 0.5f, 0.5f }), { x * distance, y * distance, z * distance });
+			scheduler.RunFrame(frameCallbacks);
 
-				renderables.push_back(renderable);
+			if (settings.checkFrameTiming && !CheckFrameTiming(scheduler, manualClock.Now()))
+			{
+				frameTimingMismatches++;
 			}
 		}
-	}
 
-	glClearColor(0.16f, 0.2f, 0.35f, 1.f);
-	while (!glfwWindowShouldClose(window))
-	{
-		static double lastTime = glfwGetTime();
-
-		const double timeNow = glfwGetTime();
-		const double dt = timeNow - lastTime;
-		lastTime = timeNow;
+		// The last pipelined frame was built but never drawn
+		if (settings.pipeline && settings.frameCount > 0)
+		{
+			drawState = buildState;
+			submitFrame();
+			glState.EndFrame();
+			frameCallbacks.present();
+		}
+		glFinish();
+		const double seconds = steadyClock.Now() - start;
 
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		
+		// Single line, stable format so CI can scrape it
+		LOG_INFO("Headless throughput: %u frames at %dx%d in %.3f s, %.2f fps, %.3f ms/frame",
+			settings.frameCount, settings.width, settings.height, seconds,
+			settings.frameCount / seconds, seconds * 1000.0 / settings.frameCount)
+	}
+	else
+	{
+		while (!glfwWindowShouldClose(window))
+		{
+			scheduler.RunFrame(frameCallbacks);
+		}
 
-		camera.Update(dt);
+		scheduler.LogStats();
+	}
 
-		glUseProgram(smoothSurfaceProgram);
-		glUniformMatrix4fv(viewMatLoc, 1, GL_FALSE, glm::value_ptr(camera.GetViewMatrix()));
-		glUniformMatrix4fv(perspectiveMatLoc, 1, GL_FALSE, glm::value_ptr(camera.GetPerspectiveMatrix()));
-		glUniform1d(timeLoc, timeNow);
-		
-		// Indexed Drawing
+	frameGraph.LogStats();
+	jobSystem.LogStats();
+	frameArena.LogStats();
+	shaderLibrary.LogStats();
+	renderer.LogStats();
+	geometryManager.LogStats();
+	glState.LogStats();
 
-		//for(auto& r  : renderables)
-		//{
-		//	renderer.DrawIndexed(window, r);
-		//}
+	if (overdrawFrames > 0)
+	{
+		const double samplesPerFrame = (double)samplesPassed / overdrawFrames;
+		LOG_INFO("Samples passing the depth test: %.0f per frame, %.3f per pixel", samplesPerFrame, samplesPerFrame / ((double)settings.width * settings.height))
+	}
+	glDeleteQueries(overdrawQueryCount, overdrawQueries);
 
-		// MDI
-		for(auto& r  : renderables)
+	int exitCode = 0;
+	if (settings.checkAllocations)
+	{
+		LOG_INFO("Heap allocations: %llu in %llu frames after the warm up", (unsigned long long)steadyStateAllocations, (unsigned long long)steadyStateFrames)
+		if (steadyStateAllocations > 0)
 		{
-			renderer.Submit(r);
+			LOG_ERROR("Steady state frames are expected to stay off the heap")
+			exitCode = 1;
 		}
-		
-		renderer.EndScene(window);
-
-		//renderer.DrawIndexed(window, quadLinestrip);
+	}
 
+	if (settings.checkFrameTiming)
+	{
+		scheduler.LogStats();
+		LOG_INFO("Frame timing check: %u frames, %llu mismatched", settings.frameCount, (unsigned long long)frameTimingMismatches)
+		if (frameTimingMismatches > 0)
+		{
+			exitCode = 1;
+		}
+	}
 
-		glUseProgram(0);
+	if (residencyManager)
+	{
+		residencyManager->LogStats();
+	}
 
+	if (gpuCulling)
+	{
+		gpuCulling->LogStats();
+		if (gpuCulling->GetStats().mismatchedFrames > 0)
+		{
+			exitCode = 1;
+		}
+	}
 
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+	if (terrain)
+	{
+		terrain->LogStats();
+	}
 
+	if (assetLoader)
+	{
+		assetLoader->LogStats();
+		LOG_INFO("Streaming: render %.3f ms mean, %.3f ms max in %llu frames with loads in flight, %.3f ms mean, %.3f ms max in %llu others",
+			streamingTimes.frames ? streamingTimes.sum / streamingTimes.frames * 1000.0 : 0.0, streamingTimes.max * 1000.0, (unsigned long long)streamingTimes.frames,
+			otherTimes.frames ? otherTimes.sum / otherTimes.frames * 1000.0 : 0.0, otherTimes.max * 1000.0, (unsigned long long)otherTimes.frames)
 	}
 
-	glfwTerminate();
+	if (frameCapture)
+	{
+		frameCapture->Flush();
+		frameCapture->LogStats();
+		frameCapture.reset();
+	}
 
-	
+	if (window)
+	{
+		glfwTerminate();
+	}
 
-	return 0;
+	return exitCode;
 }
\ No newline at end of file